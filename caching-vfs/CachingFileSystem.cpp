@@ -0,0 +1,170 @@
+//===--- CachingFileSystem.cpp - Cache files that don't change -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CachingFileSystem.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+
+namespace clang {
+namespace tooling {
+
+static llvm::cl::list<std::string> ImmutableDirsOption(
+    "immutable-dirs",
+    llvm::cl::desc("Comma-separated absolute directories whose files don't "
+                   "change while the tool runs, e.g. system headers. Files in "
+                   "them are only read once, for all translation units."),
+    llvm::cl::CommaSeparated);
+
+namespace {
+// Serves the cached contents of a file.
+class CachedFile : public vfs::File {
+public:
+  CachedFile(vfs::Status Status, const llvm::MemoryBuffer &Contents)
+      : Status(std::move(Status)), Contents(Contents) {}
+
+  llvm::ErrorOr<vfs::Status> status() override { return Status; }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  getBuffer(const llvm::Twine &Name, int64_t FileSize,
+            bool RequiresNullTerminator, bool IsVolatile) override {
+    // Cached buffers are always null-terminated.
+    return llvm::MemoryBuffer::getMemBuffer(Contents.getBuffer(), Name.str(),
+                                            RequiresNullTerminator);
+  }
+
+  std::error_code close() override { return std::error_code(); }
+
+private:
+  vfs::Status Status;
+  const llvm::MemoryBuffer &Contents;
+};
+} // namespace
+
+CachingFileSystem::CachingFileSystem(
+    llvm::IntrusiveRefCntPtr<vfs::FileSystem> Base,
+    llvm::ArrayRef<std::string> ImmutableDirs)
+    : Base(std::move(Base)) {
+  for (llvm::StringRef Dir : ImmutableDirs) {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+    llvm::sys::path::native(Path);
+    this->ImmutableDirs.push_back(Path.str());
+  }
+}
+
+bool CachingFileSystem::isCached(const llvm::Twine &Path,
+                                 llvm::SmallVectorImpl<char> &Key) {
+  Path.toVector(Key);
+  if (makeAbsolute(Key))
+    return false;
+  // ".." is kept: if "dir" is a symlink, "dir/.." needn't be its parent.
+  llvm::sys::path::remove_dots(Key, /*remove_dot_dot=*/false);
+  llvm::sys::path::native(Key);
+  auto InImmutableDir = [&](llvm::StringRef File) {
+    for (llvm::StringRef Dir : ImmutableDirs)
+      if (File.startswith(Dir) && File.size() > Dir.size() &&
+          llvm::sys::path::is_separator(File[Dir.size()]))
+        return true;
+    return false;
+  };
+  llvm::StringRef File(Key.data(), Key.size());
+  if (!InImmutableDir(File))
+    return false;
+  // Nor may ".." lead out of the directory, e.g. "/usr/../home/a.h".
+  llvm::SmallString<128> WithoutDotDot(File);
+  llvm::sys::path::remove_dots(WithoutDotDot, /*remove_dot_dot=*/true);
+  return InImmutableDir(WithoutDotDot);
+}
+
+llvm::ErrorOr<vfs::Status>
+CachingFileSystem::status(const llvm::Twine &Path) {
+  llvm::SmallString<128> Key;
+  if (!isCached(Path, Key))
+    return Base->status(Path);
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto It = Statuses.find(Key);
+    if (It != Statuses.end()) {
+      if (!It->second)
+        return It->second.getError();
+      return vfs::Status::copyWithNewName(*It->second, Path.str());
+    }
+  }
+  auto Result = Base->status(Path);
+  std::lock_guard<std::mutex> Lock(Mu);
+  Statuses.insert({Key, Result});
+  if (!Result)
+    return Result.getError();
+  return vfs::Status::copyWithNewName(*Result, Path.str());
+}
+
+llvm::ErrorOr<std::unique_ptr<vfs::File>>
+CachingFileSystem::openFileForRead(const llvm::Twine &Path) {
+  llvm::SmallString<128> Key;
+  if (!isCached(Path, Key))
+    return Base->openFileForRead(Path);
+  auto Status = status(Path);
+  if (!Status)
+    return Status.getError();
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto It = Contents.find(Key);
+    if (It != Contents.end())
+      return llvm::make_unique<CachedFile>(
+          vfs::Status::copyWithNewName(*Status, Path.str()), *It->second);
+  }
+
+  // Read the file without holding the lock. If another thread reads it at the
+  // same time, the first buffer wins.
+  auto File = Base->openFileForRead(Path);
+  if (!File)
+    return File.getError();
+  auto Buffer = (*File)->getBuffer(Path, Status->getSize(),
+                                   /*RequiresNullTerminator=*/true,
+                                   /*IsVolatile=*/false);
+  if (!Buffer)
+    return Buffer.getError();
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto &Cached = Contents[Key];
+  if (!Cached)
+    Cached = std::move(*Buffer);
+  return llvm::make_unique<CachedFile>(
+      vfs::Status::copyWithNewName(*Status, Path.str()), *Cached);
+}
+
+vfs::directory_iterator CachingFileSystem::dir_begin(const llvm::Twine &Dir,
+                                                     std::error_code &EC) {
+  return Base->dir_begin(Dir, EC);
+}
+
+llvm::ErrorOr<std::string>
+CachingFileSystem::getCurrentWorkingDirectory() const {
+  return Base->getCurrentWorkingDirectory();
+}
+
+std::error_code
+CachingFileSystem::setCurrentWorkingDirectory(const llvm::Twine &Path) {
+  return Base->setCurrentWorkingDirectory(Path);
+}
+
+llvm::IntrusiveRefCntPtr<vfs::FileSystem>
+addImmutableDirsCache(llvm::IntrusiveRefCntPtr<vfs::FileSystem> Base) {
+  if (ImmutableDirsOption.empty())
+    return Base;
+  return new CachingFileSystem(std::move(Base), ImmutableDirsOption);
+}
+
+llvm::IntrusiveRefCntPtr<vfs::FileSystem> getSharedCachingFileSystem() {
+  static llvm::IntrusiveRefCntPtr<vfs::FileSystem> FS =
+      addImmutableDirsCache(vfs::getRealFileSystem());
+  return FS;
+}
+
+} // end namespace tooling
+} // end namespace clang
@@ -0,0 +1,80 @@
+//===--- CachingFileSystem.h - Cache files that don't change ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Batch tools parse thousands of translation units that include the same
+// system and project headers. Each ClangTool run has its own FileManager, so
+// every unit stats and reads those headers again.
+//
+// CachingFileSystem is a file system layer that remembers the status and the
+// contents of files under directories that are known not to change while the
+// tool runs. Lookups of missing files are remembered too, as header search
+// probes many of them. It is thread-safe, so one instance can be shared by all
+// the ClangTool runs of a process.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CACHING_VFS_CACHINGFILESYSTEM_H
+#define LLVM_CLANG_TOOLS_EXTRA_CACHING_VFS_CACHINGFILESYSTEM_H
+
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+
+class CachingFileSystem : public vfs::FileSystem {
+public:
+  /// Files under \p ImmutableDirs, which must be absolute, are only looked up
+  /// once in \p Base. Other files are always looked up in \p Base.
+  CachingFileSystem(llvm::IntrusiveRefCntPtr<vfs::FileSystem> Base,
+                    llvm::ArrayRef<std::string> ImmutableDirs);
+
+  llvm::ErrorOr<vfs::Status> status(const llvm::Twine &Path) override;
+  llvm::ErrorOr<std::unique_ptr<vfs::File>>
+  openFileForRead(const llvm::Twine &Path) override;
+  vfs::directory_iterator dir_begin(const llvm::Twine &Dir,
+                                    std::error_code &EC) override;
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override;
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &Path) override;
+
+private:
+  /// Sets \p Key to the absolute path of \p Path, without "." but with "..",
+  /// and returns whether it is in an immutable directory. \p Base is still
+  /// queried with \p Path.
+  bool isCached(const llvm::Twine &Path, llvm::SmallVectorImpl<char> &Key);
+
+  llvm::IntrusiveRefCntPtr<vfs::FileSystem> Base;
+  std::vector<std::string> ImmutableDirs;
+
+  std::mutex Mu;
+  llvm::StringMap<llvm::ErrorOr<vfs::Status>> Statuses;
+  /// The contents of the files that were opened. They are never released, and
+  /// large files are memory-mapped.
+  llvm::StringMap<std::unique_ptr<llvm::MemoryBuffer>> Contents;
+};
+
+/// Returns \p Base with a CachingFileSystem on top of it for the directories
+/// given with -immutable-dirs, or \p Base itself if there are none.
+llvm::IntrusiveRefCntPtr<vfs::FileSystem>
+addImmutableDirsCache(llvm::IntrusiveRefCntPtr<vfs::FileSystem> Base);
+
+/// Returns the real file system, with the cache for -immutable-dirs. The cache
+/// is shared by all callers in the process.
+llvm::IntrusiveRefCntPtr<vfs::FileSystem> getSharedCachingFileSystem();
+
+} // end namespace tooling
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CACHING_VFS_CACHINGFILESYSTEM_H
@@ -78,6 +78,15 @@ static llvm::cl::opt<bool> DoxygenOnly(
     llvm::cl::desc("Use only doxygen-style comments to generate docs."),
     llvm::cl::init(false), llvm::cl::cat(ClangDocCategory));
 
+// This anchor is used to force the linker to link the multi-process executor.
+namespace clang {
+namespace tooling {
+extern volatile int MultiProcessToolExecutorAnchorSource;
+static int LLVM_ATTRIBUTE_UNUSED MultiProcessToolExecutorAnchorDestination =
+    MultiProcessToolExecutorAnchorSource;
+} // namespace tooling
+} // namespace clang
+
 bool CreateDirectory(const Twine &DirName, bool ClearDirectory = false) {
   std::error_code OK;
   llvm::SmallString<128> DocsRootPath;
@@ -16,6 +16,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "../ClangTidy.h"
+#include "CachingFileSystem.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/TargetSelect.h"
@@ -334,6 +335,7 @@ static int clangTidyMain(int argc, const char **argv) {
                          : getVfsOverlayFromFile(VfsOverlay));
   if (!BaseFS)
     return 1;
+  BaseFS = tooling::addImmutableDirsCache(BaseFS);
 
   auto OwningOptionsProvider = createOptionsProvider(BaseFS);
   auto *OptionsProvider = OwningOptionsProvider.get();
@@ -101,7 +101,7 @@ void ClangdLSPServer::onInitialize(InitializeParams &Params) {
             {"codeActionProvider", true},
             {"completionProvider",
              json::obj{
-                 {"resolveProvider", false},
+                 {"resolveProvider", CCOpts.LazyDetails},
                  {"triggerCharacters", {".", ">", ":"}},
              }},
             {"signatureHelpProvider",
@@ -168,6 +168,12 @@ void ClangdLSPServer::onDocumentDidChange(DidChangeTextDocumentParams &Params) {
 }
 
 void ClangdLSPServer::onFileEvent(DidChangeWatchedFilesParams &Params) {
+  // Only the open files whose compile commands actually changed are reparsed.
+  for (const FileEvent &Event : Params.changes)
+    if (auto Dir = NonCachedCDB.compilationDatabaseChanged(Event.uri.file()))
+      for (const Path &File : CDB.reloadDirectory(*Dir))
+        if (auto Contents = DraftMgr.getDraft(File))
+          Server.addDocument(File, *Contents, WantDiagnostics::Auto);
   Server.onFileEvent(Params);
 }
 
@@ -334,19 +340,61 @@ void ClangdLSPServer::onCodeAction(CodeActionParams &Params) {
 }
 
 void ClangdLSPServer::onCompletion(TextDocumentPositionParams &Params) {
-  Server.codeComplete(Params.textDocument.uri.file(), Params.position, CCOpts,
-                      [this](llvm::Expected<CodeCompleteResult> List) {
+  Path File = Params.textDocument.uri.file();
+  Server.codeComplete(File, Params.position, CCOpts,
+                      [this, File](llvm::Expected<CodeCompleteResult> List) {
                         if (!List)
                           return replyError(ErrorCode::InvalidParams,
                                             llvm::toString(List.takeError()));
                         CompletionList LSPList;
                         LSPList.isIncomplete = List->HasMore;
-                        for (const auto &R : List->Completions)
+                        if (!CCOpts.LazyDetails) {
+                          for (const auto &R : List->Completions)
+                            LSPList.items.push_back(R.render(CCOpts));
+                          return reply(std::move(LSPList));
+                        }
+                        // Send what is needed to display and filter the list,
+                        // the rest is sent by completionItem/resolve.
+                        std::lock_guard<std::mutex> Lock(CompletionMutex);
+                        CompletionItemData Data;
+                        Data.resultId = ++LastCompletionId;
+                        for (const auto &R : List->Completions) {
                           LSPList.items.push_back(R.render(CCOpts));
+                          CompletionItem &Item = LSPList.items.back();
+                          Item.detail.clear();
+                          Item.documentation.clear();
+                          Item.additionalTextEdits.clear();
+                          Item.data = Data;
+                          ++Data.index;
+                        }
+                        LastCompletionFile = File;
+                        LastCompletions = std::move(List->Completions);
                         reply(std::move(LSPList));
                       });
 }
 
+void ClangdLSPServer::onResolveCompletion(ResolveCompletionItemParams &Params) {
+  Path File;
+  CodeCompletion Item;
+  {
+    std::lock_guard<std::mutex> Lock(CompletionMutex);
+    if (!Params.data || Params.data->resultId != LastCompletionId ||
+        Params.data->index < 0 ||
+        size_t(Params.data->index) >= LastCompletions.size())
+      return replyError(ErrorCode::InvalidParams,
+                        "completion item is not from the last completion");
+    File = LastCompletionFile;
+    Item = LastCompletions[Params.data->index];
+  }
+  Server.resolveCompletion(
+      File, std::move(Item), [this](llvm::Expected<CodeCompletion> Resolved) {
+        if (!Resolved)
+          return replyError(ErrorCode::InternalError,
+                            llvm::toString(Resolved.takeError()));
+        reply(Resolved->render(CCOpts));
+      });
+}
+
 void ClangdLSPServer::onSignatureHelp(TextDocumentPositionParams &Params) {
   Server.signatureHelp(Params.textDocument.uri.file(), Params.position,
                        [](llvm::Expected<SignatureHelp> SignatureHelp) {
@@ -414,23 +462,62 @@ void ClangdLSPServer::onChangeConfiguration(
 }
 
 void ClangdLSPServer::onReference(ReferenceParams& Params) {
-  Server.references(
-      Params.textDocument.uri.file(), Params.position,
-      Params.context.includeDeclaration,
-      [](llvm::Expected<std::vector<Location>> Locations) {
-        if (!Locations)
-          return replyError(ErrorCode::InternalError,
-                            llvm::toString(Locations.takeError()));
-        reply(json::ary(*Locations));
-      });
+  ReferencesOptions Opts = RefOpts;
+  Opts.IncludeDeclaration = Params.context.includeDeclaration;
+  // Clients that don't send an offset can't ask for the rest of the results.
+  if (Params.offset)
+    Opts.Offset = *Params.offset;
+  else
+    Opts.Limit = 0;
+  // Without a partial result token, everything is sent in the reply.
+  auto Locations = std::make_shared<std::vector<Location>>();
+  std::function<void(std::vector<Location>)> OnBatch;
+  if (Params.partialResultToken) {
+    json::Expr Token = *Params.partialResultToken;
+    OnBatch = [Token](std::vector<Location> Batch) {
+      notify("$/progress", json::obj{
+                               {"token", Token},
+                               {"value", json::ary(Batch)},
+                           });
+    };
+  } else {
+    Opts.BatchSize = 0;
+    OnBatch = [Locations](std::vector<Location> Batch) {
+      *Locations = std::move(Batch);
+    };
+  }
+  size_t Offset = Opts.Offset + Opts.Limit;
+  Server.references(Params.textDocument.uri.file(), Params.position, Opts,
+                    std::move(OnBatch),
+                    [Locations, Offset](llvm::Expected<bool> HasMore) {
+                      if (!HasMore)
+                        return replyError(ErrorCode::InternalError,
+                                          llvm::toString(HasMore.takeError()));
+                      if (!*HasMore)
+                        return reply(json::ary(*Locations));
+                      reply(json::obj{
+                          {"locations", json::ary(*Locations)},
+                          {"offset", Offset},
+                      });
+                    });
+}
+
+void ClangdLSPServer::onMetrics(MetricsParams &Params) {
+  if (!Metrics)
+    return replyError(ErrorCode::InvalidRequest,
+                      "metrics are not enabled, run clangd with -metrics");
+  reply(Metrics->summary());
 }
 
 ClangdLSPServer::ClangdLSPServer(JSONOutput &Out,
                                  const clangd::CodeCompleteOptions &CCOpts,
                                  llvm::Optional<Path> CompileCommandsDir,
-                                 const ClangdServer::Options &Opts)
+                                 const ClangdServer::Options &Opts,
+                                 const trace::Metrics *Metrics,
+                                 const ReferencesOptions &RefOpts)
     : Out(Out), NonCachedCDB(std::move(CompileCommandsDir)), CDB(NonCachedCDB),
-      CCOpts(CCOpts), SupportedSymbolKinds(defaultSymbolKinds()),
+      Metrics(Metrics), CCOpts(CCOpts), RefOpts(RefOpts),
+      SupportedSymbolKinds(defaultSymbolKinds()),
       Server(CDB, FSProvider, /*DiagConsumer=*/*this, Opts) {}
 
 bool ClangdLSPServer::run(std::FILE *In, JSONStreamStyle InputStyle) {
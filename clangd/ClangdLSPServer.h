@@ -14,6 +14,7 @@
 #include "DraftStore.h"
 #include "FindSymbols.h"
 #include "GlobalCompilationDatabase.h"
+#include "Metrics.h"
 #include "Path.h"
 #include "Protocol.h"
 #include "ProtocolHandlers.h"
@@ -33,9 +34,13 @@ public:
   /// If \p CompileCommandsDir has a value, compile_commands.json will be
   /// loaded only from \p CompileCommandsDir. Otherwise, clangd will look
   /// for compile_commands.json in all parent directories of each file.
+  /// If \p Metrics is set, the "clangd/metrics" request returns its summary.
+  /// \p RefOpts sets the limit and batch size of textDocument/references.
   ClangdLSPServer(JSONOutput &Out, const clangd::CodeCompleteOptions &CCOpts,
                   llvm::Optional<Path> CompileCommandsDir,
-                  const ClangdServer::Options &Opts);
+                  const ClangdServer::Options &Opts,
+                  const trace::Metrics *Metrics = nullptr,
+                  const ReferencesOptions &RefOpts = ReferencesOptions());
 
   /// Run LSP server loop, receiving input for it from \p In. \p In must be
   /// opened in binary mode. Output will be written using Out variable passed to
@@ -65,6 +70,7 @@ private:
   void onDocumentSymbol(DocumentSymbolParams &Params) override;
   void onCodeAction(CodeActionParams &Params) override;
   void onCompletion(TextDocumentPositionParams &Params) override;
+  void onResolveCompletion(ResolveCompletionItemParams &Params) override;
   void onSignatureHelp(TextDocumentPositionParams &Params) override;
   void onGoToDefinition(TextDocumentPositionParams &Params) override;
   void onSwitchSourceHeader(TextDocumentIdentifier &Params) override;
@@ -76,6 +82,7 @@ private:
   void onHover(TextDocumentPositionParams &Params) override;
   void onChangeConfiguration(DidChangeConfigurationParams &Params) override;
   void onReference(ReferenceParams& Params) override;
+  void onMetrics(MetricsParams &Params) override;
 
   std::vector<Fix> getFixes(StringRef File, const clangd::Diagnostic &D);
 
@@ -106,8 +113,18 @@ private:
   CachingCompilationDb CDB;
 
   RealFileSystemProvider FSProvider;
+  /// Latency metrics reported to the client, may be null.
+  const trace::Metrics *Metrics;
   /// Options used for code completion
   clangd::CodeCompleteOptions CCOpts;
+  /// Options used for finding references
+  ReferencesOptions RefOpts;
+  /// The results of the last completion request, if their details are sent
+  /// lazily by completionItem/resolve. See CodeCompleteOptions::LazyDetails.
+  std::mutex CompletionMutex;
+  int LastCompletionId = 0;
+  Path LastCompletionFile;
+  std::vector<CodeCompletion> LastCompletions;
   /// The supported kinds of the client.
   SymbolKindBitset SupportedSymbolKinds;
 
@@ -90,26 +90,46 @@ ClangdServer::ClangdServer(GlobalCompilationDatabase &CDB,
       FileIdx(Opts.BuildDynamicSymbolIndex ? new FileIndex(Opts.URISchemes)
                                            : nullptr),
       PCHs(std::make_shared<PCHContainerOperations>()),
-      // Pass a callback into `WorkScheduler` to extract symbols from a newly
-      // parsed file and rebuild the file index synchronously each time an AST
-      // is parsed.
+      CacheSignatureHelp(Opts.CacheSignatureHelp),
+      // Pass callbacks into `WorkScheduler` to extract symbols from newly
+      // parsed preambles and ASTs, and rebuild the file index synchronously.
+      // Preambles are indexed as a whole, but only when they are rebuilt. ASTs
+      // are indexed on every update, but only for the main file's decls.
       // FIXME(ioeric): this can be slow and we may be able to index on less
       // critical paths.
       WorkScheduler(
           Opts.AsyncThreadsCount, Opts.StorePreamblesInMemory,
-          FileIdx
-              ? [this](PathRef Path, ASTContext &AST,
-                       std::shared_ptr<Preprocessor>
-                           PP) { FileIdx->update(Path, &AST, std::move(PP)); }
-              : PreambleParsedCallback(),
-          Opts.UpdateDebounce, Opts.RetentionPolicy) {
-  if (FileIdx && Opts.StaticIndex) {
-    MergedIndex = mergeIndex(FileIdx.get(), Opts.StaticIndex);
+          [this](PathRef Path, ASTContext &AST,
+                 std::shared_ptr<Preprocessor> PP) {
+            // The overloads declared in headers may have changed.
+            SignatureCache.remove(Path);
+            if (FileIdx)
+              FileIdx->updatePreamble(Path, &AST, std::move(PP));
+          },
+          Opts.UpdateDebounce, Opts.RetentionPolicy,
+          FileIdx ? [this](PathRef Path,
+                           ParsedAST &AST) { FileIdx->updateMain(Path, AST); }
+                  : ASTParsedCallback()) {
+  SymbolIndex *StaticIndex = Opts.StaticIndex;
+  if (Opts.BuildBackgroundIndex) {
+    BackgroundIdx = llvm::make_unique<BackgroundIndex>(
+        ResourceDir, FSProvider, Opts.BackgroundIndexShardDir,
+        Opts.URISchemes);
+    if (StaticIndex) {
+      // The background index is fresher than an externally-built one.
+      MergedStaticIndex = mergeIndex(BackgroundIdx.get(), StaticIndex);
+      StaticIndex = MergedStaticIndex.get();
+    } else
+      StaticIndex = BackgroundIdx.get();
+  }
+
+  if (FileIdx && StaticIndex) {
+    MergedIndex = mergeIndex(FileIdx.get(), StaticIndex);
     Index = MergedIndex.get();
   } else if (FileIdx)
     Index = FileIdx.get();
-  else if (Opts.StaticIndex)
-    Index = Opts.StaticIndex;
+  else if (StaticIndex)
+    Index = StaticIndex;
   else
     Index = nullptr;
 }
@@ -129,6 +149,10 @@ void ClangdServer::setRootPath(PathRef RootPath) {
 void ClangdServer::addDocument(PathRef File, StringRef Contents,
                                WantDiagnostics WantDiags) {
   DocVersion Version = ++InternalVersion[File];
+  if (BackgroundIdx)
+    if (auto ProjectRoot = CDB.getProjectRoot(File))
+      if (IndexedProjects.insert(*ProjectRoot).second)
+        BackgroundIdx->enqueue(CDB.getAllCompileCommands(*ProjectRoot));
   ParseInputs Inputs = {getCompileCommand(File), FSProvider.getFileSystem(),
                         Contents.str()};
 
@@ -141,7 +165,14 @@ void ClangdServer::addDocument(PathRef File, StringRef Contents,
 
 void ClangdServer::removeDocument(PathRef File) {
   ++InternalVersion[File];
+  CompletionCache.remove(File);
+  SignatureCache.remove(File);
+  ProximityCache.remove(File);
   WorkScheduler.remove(File);
+  // The symbols of a closed file's preamble stay, like those of its headers.
+  // After remove(), pending updates of the file no longer reach updateMain().
+  if (FileIdx)
+    FileIdx->removeMain(File);
 }
 
 void ClangdServer::codeComplete(PathRef File, Position Pos,
@@ -151,16 +182,23 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
   auto CodeCompleteOpts = Opts;
   if (!CodeCompleteOpts.Index) // Respect overridden index.
     CodeCompleteOpts.Index = Index;
+  CodeCompleteOpts.ProximityCache = &ProximityCache;
 
   // Copy PCHs to avoid accessing this->PCHs concurrently
   std::shared_ptr<PCHContainerOperations> PCHs = this->PCHs;
   auto FS = FSProvider.getFileSystem();
-  auto Task = [PCHs, Pos, FS,
+  CodeCompletionCache *Cache = &CompletionCache;
+  auto Task = [PCHs, Pos, FS, Cache,
                CodeCompleteOpts](Path File, Callback<CodeCompleteResult> CB,
                                  llvm::Expected<InputsAndPreamble> IP) {
     if (!IP)
       return CB(IP.takeError());
 
+    if (CodeCompleteOpts.CacheResults)
+      if (auto Cached =
+              Cache->lookup(File, IP->Contents, Pos, CodeCompleteOpts))
+        return CB(std::move(*Cached));
+
     auto PreambleData = IP->Preamble;
 
     // FIXME(ibiryukov): even if Preamble is non-null, we may want to check
@@ -169,6 +207,8 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
         File, IP->Command, PreambleData ? &PreambleData->Preamble : nullptr,
         PreambleData ? PreambleData->Includes : IncludeStructure(),
         IP->Contents, Pos, FS, PCHs, CodeCompleteOpts);
+    if (CodeCompleteOpts.CacheResults)
+      Cache->update(File, IP->Contents, Pos, CodeCompleteOpts, Result);
     CB(std::move(Result));
   };
 
@@ -176,20 +216,46 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
                                 Bind(Task, File.str(), std::move(CB)));
 }
 
+void ClangdServer::resolveCompletion(PathRef File, CodeCompletion Item,
+                                     Callback<CodeCompletion> CB) {
+  auto Action = [this](Path File, CodeCompletion Item,
+                       Callback<CodeCompletion> CB,
+                       llvm::Expected<InputsAndAST> InpAST) {
+    if (!InpAST)
+      return CB(InpAST.takeError());
+    resolveCompletionDetails(Item, File, InpAST->Inputs, InpAST->AST, Index);
+    CB(std::move(Item));
+  };
+
+  WorkScheduler.runWithAST(
+      "ResolveCompletion", File,
+      Bind(Action, File.str(), std::move(Item), std::move(CB)));
+}
+
 void ClangdServer::signatureHelp(PathRef File, Position Pos,
                                  Callback<SignatureHelp> CB) {
 
   auto PCHs = this->PCHs;
   auto FS = FSProvider.getFileSystem();
-  auto Action = [Pos, FS, PCHs](Path File, Callback<SignatureHelp> CB,
-                                llvm::Expected<InputsAndPreamble> IP) {
+  SignatureHelpCache *Cache = CacheSignatureHelp ? &SignatureCache : nullptr;
+  auto Action = [Pos, FS, PCHs, Cache](Path File, Callback<SignatureHelp> CB,
+                                       llvm::Expected<InputsAndPreamble> IP) {
     if (!IP)
       return CB(IP.takeError());
 
     auto PreambleData = IP->Preamble;
-    CB(clangd::signatureHelp(File, IP->Command,
-                             PreambleData ? &PreambleData->Preamble : nullptr,
-                             IP->Contents, Pos, FS, PCHs));
+    const PrecompiledPreamble *Preamble =
+        PreambleData ? &PreambleData->Preamble : nullptr;
+    if (!Cache)
+      return CB(clangd::signatureHelp(File, IP->Command, Preamble,
+                                      IP->Contents, Pos, FS, PCHs));
+
+    if (auto Cached = Cache->lookup(File, Preamble, IP->Contents, Pos))
+      return CB(std::move(*Cached));
+    SignatureHelp Result = clangd::signatureHelp(
+        File, IP->Command, Preamble, IP->Contents, Pos, FS, PCHs);
+    Cache->update(File, Preamble, IP->Contents, Pos, Result);
+    CB(std::move(Result));
   };
 
   WorkScheduler.runWithPreamble("SignatureHelp", File,
@@ -446,8 +512,10 @@ tooling::CompileCommand ClangdServer::getCompileCommand(PathRef File) {
 }
 
 void ClangdServer::onFileEvent(const DidChangeWatchedFilesParams &Params) {
-  // FIXME: Do nothing for now. This will be used for indexing and potentially
-  // invalidating other caches.
+  // FIXME: This will potentially be used for invalidating other caches.
+  if (BackgroundIdx)
+    for (const FileEvent &Event : Params.changes)
+      BackgroundIdx->fileChanged(Event.uri.file());
 }
 
 void ClangdServer::workspaceSymbols(
@@ -468,6 +536,19 @@ void ClangdServer::documentSymbols(
                            Bind(Action, std::move(CB)));
 }
 
+void ClangdServer::references(
+    PathRef File, Position Pos, const ReferencesOptions &Opts,
+    std::function<void(std::vector<Location>)> OnBatch, Callback<bool> CB) {
+  auto Action = [Pos, Opts, OnBatch,
+                 this](Callback<bool> CB, llvm::Expected<InputsAndAST> InpAST) {
+    if (!InpAST)
+      return CB(InpAST.takeError());
+    CB(clangd::references(InpAST->AST, Pos, Opts, Index, OnBatch));
+  };
+
+  WorkScheduler.runWithAST("References", File, Bind(Action, std::move(CB)));
+}
+
 void ClangdServer::references(PathRef File, Position Pos,
                               bool includeDeclaration,
                               Callback<std::vector<Location>> CB) {
@@ -489,5 +570,7 @@ ClangdServer::getUsedBytesPerFile() const {
 
 LLVM_NODISCARD bool
 ClangdServer::blockUntilIdleForTest(llvm::Optional<double> TimeoutSeconds) {
-  return WorkScheduler.blockUntilIdle(timeoutSeconds(TimeoutSeconds));
+  if (!WorkScheduler.blockUntilIdle(timeoutSeconds(TimeoutSeconds)))
+    return false;
+  return !BackgroundIdx || BackgroundIdx->blockUntilIdleForTest(TimeoutSeconds);
 }
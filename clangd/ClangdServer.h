@@ -12,16 +12,20 @@
 
 #include "ClangdUnit.h"
 #include "CodeComplete.h"
+#include "FileDistance.h"
 #include "Function.h"
 #include "GlobalCompilationDatabase.h"
 #include "Protocol.h"
 #include "TUScheduler.h"
+#include "XRefs.h"
+#include "index/Background.h"
 #include "index/FileIndex.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
 #include <functional>
 #include <future>
 #include <string>
@@ -86,6 +90,16 @@ public:
     /// If set, use this index to augment code completion results.
     SymbolIndex *StaticIndex = nullptr;
 
+    /// If true, ClangdServer indexes all files in the compilation database of
+    /// each opened file in the background, and uses this index like the static
+    /// index.
+    bool BuildBackgroundIndex = false;
+
+    /// The directory where the background index stores one shard per file, so
+    /// that unchanged files are not parsed again after a restart.
+    /// If empty, the background index is only kept in memory.
+    std::string BackgroundIndexShardDir;
+
     /// The resource directory is used to find internal headers, overriding
     /// defaults and -resource-dir compiler flag).
     /// If None, ClangdServer calls CompilerInvocation::GetResourcePath() to
@@ -95,6 +109,11 @@ public:
     /// Time to wait after a new file version before computing diagnostics.
     std::chrono::steady_clock::duration UpdateDebounce =
         std::chrono::milliseconds(500);
+
+    /// If true, signature help computed at the open paren of a call is reused
+    /// while the user types its arguments, see SignatureHelpCache.
+    /// The cached signatures aren't filtered by argument types.
+    bool CacheSignatureHelp = false;
   };
   // Sensible default options for use in tests.
   // Features like indexing must be enabled if desired.
@@ -143,6 +162,11 @@ public:
                     const clangd::CodeCompleteOptions &Opts,
                     Callback<CodeCompleteResult> CB);
 
+  /// Fills in the details of a code completion result in \p File that were
+  /// left out because of CodeCompleteOptions::LazyDetails.
+  void resolveCompletion(PathRef File, CodeCompletion Item,
+                         Callback<CodeCompletion> CB);
+
   /// Provide signature help for \p File at \p Pos.  This method should only be
   /// called for tracked files.
   void signatureHelp(PathRef File, Position Pos, Callback<SignatureHelp> CB);
@@ -171,6 +195,13 @@ public:
   void documentSymbols(StringRef File,
                        Callback<std::vector<SymbolInformation>> CB);
 
+  /// Retrieve locations for symbol references in batches. \p OnBatch is
+  /// called for each batch as soon as it is found, then \p CB is called with
+  /// whether references beyond Opts.Limit were left out.
+  void references(PathRef File, Position Pos, const ReferencesOptions &Opts,
+                  std::function<void(std::vector<Location>)> OnBatch,
+                  Callback<bool> CB);
+
   /// Retrieve locations for symbol references.
   void references(PathRef File, Position Pos, bool includeDeclaration,
                   Callback<std::vector<Location>> CB);
@@ -239,11 +270,21 @@ private:
   // The index used to look up symbols. This could be:
   //   - null (all index functionality is optional)
   //   - the dynamic index owned by ClangdServer (FileIdx)
-  //   - the static index passed to the constructor
+  //   - the static index passed to the constructor, and/or the background
+  //     index owned by ClangdServer (BackgroundIdx)
   //   - a merged view of a static and dynamic index (MergedIndex)
   SymbolIndex *Index;
   // If present, an up-to-date of symbols in open files. Read via Index.
   std::unique_ptr<FileIndex> FileIdx;
+  // If present, the symbols of all files in the projects of open files.
+  // Read via Index.
+  std::unique_ptr<BackgroundIndex> BackgroundIdx;
+  // Projects whose files were enqueued in BackgroundIdx, keyed by the
+  // directory of their compilation database.
+  llvm::StringSet<> IndexedProjects;
+  // If present, a merged view of BackgroundIdx and the static index passed to
+  // the constructor. Read via Index.
+  std::unique_ptr<SymbolIndex> MergedStaticIndex;
   // If present, a merged view of FileIdx and an external index. Read via Index.
   std::unique_ptr<SymbolIndex> MergedIndex;
   // If set, this represents the workspace path.
@@ -255,6 +296,15 @@ private:
   std::mutex DiagnosticsMutex;
   /// Maps from a filename to the latest version of reported diagnostics.
   llvm::StringMap<DocVersion> ReportedDiagnosticVersions;
+  /// The last code completion results for each file, see
+  /// CodeCompleteOptions::CacheResults.
+  CodeCompletionCache CompletionCache;
+  /// The last signature help for each file, reused while typing arguments.
+  /// Only used if CacheSignatureHelp is set, see Options::CacheSignatureHelp.
+  const bool CacheSignatureHelp;
+  SignatureHelpCache SignatureCache;
+  /// The file proximity structures for each file, reused by code completion.
+  URIDistanceCache ProximityCache;
   // WorkScheduler has to be the last member, because its destructor has to be
   // called before all other members to stop the worker thread that references
   // ClangdServer.
@@ -20,6 +20,7 @@
 
 #include "CodeComplete.h"
 #include "AST.h"
+#include "ClangdUnit.h"
 #include "CodeCompletionStrings.h"
 #include "Compiler.h"
 #include "FileDistance.h"
@@ -28,18 +29,23 @@
 #include "Logger.h"
 #include "Quality.h"
 #include "SourceCode.h"
+#include "Threading.h"
 #include "Trace.h"
 #include "URI.h"
+#include "URITable.h"
 #include "index/Index.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Basic/CharInfo.h"
 #include "clang/Basic/LangOptions.h"
 #include "clang/Format/Format.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Index/USRGeneration.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Sema/CodeCompleteConsumer.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/ScopedPrinter.h"
@@ -164,11 +170,13 @@ getOptionalParameters(const CodeCompletionString &CCS,
 
 /// Creates a `HeaderFile` from \p Header which can be either a URI or a literal
 /// include.
+/// \p URIs resolves the URI, using the path of the main file as hint.
 static llvm::Expected<HeaderFile> toHeaderFile(StringRef Header,
-                                               llvm::StringRef HintPath) {
+                                               URITable &URIs) {
   if (isLiteralInclude(Header))
     return HeaderFile{Header.str(), /*Verbatim=*/true};
-  auto U = URI::parse(Header);
+  unsigned File = URIs.intern(Header);
+  auto U = URIs.parse(File);
   if (!U)
     return U.takeError();
 
@@ -178,12 +186,27 @@ static llvm::Expected<HeaderFile> toHeaderFile(StringRef Header,
   if (!IncludePath->empty())
     return HeaderFile{std::move(*IncludePath), /*Verbatim=*/true};
 
-  auto Resolved = URI::resolve(*U, HintPath);
+  auto Resolved = URIs.resolve(File);
   if (!Resolved)
     return Resolved.takeError();
-  return HeaderFile{std::move(*Resolved), /*Verbatim=*/false};
+  return HeaderFile{*Resolved, /*Verbatim=*/false};
 }
 
+// Returns the style used to insert #includes into \p FileName.
+format::FormatStyle getFormatStyle(PathRef FileName, StringRef Contents,
+                                   vfs::FileSystem *VFS) {
+  auto Style = format::getStyle(format::DefaultFormatStyle, FileName,
+                                format::DefaultFallbackStyle, Contents, VFS);
+  if (!Style) {
+    log("Failed to get FormatStyle for file" + FileName + ": " +
+        llvm::toString(Style.takeError()) + ". Fallback is LLVM style.");
+    return format::getLLVMStyle();
+  }
+  return std::move(*Style);
+}
+
+llvm::Optional<SymbolID> getSymbolID(const CodeCompletionResult &R);
+
 /// A code completion result, in clang-native form.
 /// It may be promoted to a CompletionItem if it's among the top-ranked results.
 struct CompletionCandidate {
@@ -260,12 +283,21 @@ struct ScoredBundleGreater {
 // Many fields are the same for all candidates in a bundle (e.g. name), and are
 // computed from the first candidate, in the constructor.
 // Others vary per candidate, so add() must be called for remaining candidates.
+//
+// With CodeCompleteOptions::LazyDetails, only what resolveCompletionDetails()
+// needs to compute the details later is recorded.
 struct CodeCompletionBuilder {
   CodeCompletionBuilder(ASTContext &ASTCtx, const CompletionCandidate &C,
                         CodeCompletionString *SemaCCS,
+                        std::shared_ptr<GlobalCodeCompletionAllocator> CCAlloc,
                         const IncludeInserter &Includes, StringRef FileName,
-                        const CodeCompleteOptions &Opts)
-      : ASTCtx(ASTCtx), ExtractDocumentation(Opts.IncludeComments) {
+                        URITable &URIs, const CodeCompleteOptions &Opts)
+      : ASTCtx(ASTCtx), CCAllocator(std::move(CCAlloc)),
+        ExtractDocumentation(Opts.IncludeComments) {
+    if (Opts.LazyDetails) {
+      Completion.Deferred.emplace();
+      Completion.Deferred->Documentation = Opts.IncludeComments;
+    }
     add(C, SemaCCS);
     if (C.SemaResult) {
       Completion.Origin |= SymbolOrigin::AST;
@@ -289,30 +321,38 @@ struct CodeCompletionBuilder {
         Completion.Name = C.IndexResult->Name;
     }
     if (auto Inserted = C.headerToInsertIfNotPresent()) {
-      // Turn absolute path into a literal string that can be #included.
-      auto Include = [&]() -> Expected<std::pair<std::string, bool>> {
+      auto Headers = [&]() -> Expected<std::pair<HeaderFile, HeaderFile>> {
         auto ResolvedDeclaring =
-            toHeaderFile(C.IndexResult->CanonicalDeclaration.FileURI, FileName);
+            toHeaderFile(C.IndexResult->CanonicalDeclaration.FileURI, URIs);
         if (!ResolvedDeclaring)
           return ResolvedDeclaring.takeError();
-        auto ResolvedInserted = toHeaderFile(*Inserted, FileName);
+        auto ResolvedInserted = toHeaderFile(*Inserted, URIs);
         if (!ResolvedInserted)
           return ResolvedInserted.takeError();
-        return std::make_pair(Includes.calculateIncludePath(*ResolvedDeclaring,
-                                                            *ResolvedInserted),
-                              Includes.shouldInsertInclude(*ResolvedDeclaring,
-                                                           *ResolvedInserted));
+        return std::make_pair(std::move(*ResolvedDeclaring),
+                              std::move(*ResolvedInserted));
       }();
-      if (Include) {
-        Completion.Header = Include->first;
-        if (Include->second)
-          Completion.HeaderInsertion = Includes.insert(Include->first);
-      } else
+      if (!Headers)
         log(llvm::formatv(
             "Failed to generate include insertion edits for adding header "
-            "(FileURI='{0}', IncludeHeader='{1}') into {2}",
+            "(FileURI='{0}', IncludeHeader='{1}') into {2}: {3}",
             C.IndexResult->CanonicalDeclaration.FileURI,
-            C.IndexResult->Detail->IncludeHeader, FileName));
+            C.IndexResult->Detail->IncludeHeader, FileName,
+            llvm::toString(Headers.takeError())));
+      else if (Completion.Deferred) {
+        // Turning the header into a literal string and the insertion edit
+        // wait for resolveCompletionDetails().
+        Completion.Deferred->InsertInclude =
+            Includes.shouldInsertInclude(Headers->first, Headers->second);
+        Completion.Deferred->DeclaringHeader = std::move(Headers->first);
+        Completion.Deferred->InsertedHeader = std::move(Headers->second);
+      } else {
+        // Turn absolute path into a literal string that can be #included.
+        Completion.Header =
+            Includes.calculateIncludePath(Headers->first, Headers->second);
+        if (Includes.shouldInsertInclude(Headers->first, Headers->second))
+          Completion.HeaderInsertion = Includes.insert(Completion.Header);
+      }
     }
   }
 
@@ -320,16 +360,26 @@ struct CodeCompletionBuilder {
     assert(bool(C.SemaResult) == bool(SemaCCS));
     Bundled.emplace_back();
     BundledEntry &S = Bundled.back();
-    if (C.SemaResult) {
+    S.SemaCCS = SemaCCS;
+    S.IndexResult = C.IndexResult;
+    if (C.SemaResult)
       getSignature(*SemaCCS, &S.Signature, &S.SnippetSuffix,
                    &Completion.RequiredQualifier);
-      S.ReturnType = getReturnType(*SemaCCS);
-    } else if (C.IndexResult) {
+    else if (C.IndexResult) {
       S.Signature = C.IndexResult->Signature;
       S.SnippetSuffix = C.IndexResult->CompletionSnippetSuffix;
-      if (auto *D = C.IndexResult->Detail)
-        S.ReturnType = D->ReturnType;
     }
+    if (Completion.Deferred) {
+      // The first candidate's documentation is used, as below.
+      if (Completion.Deferred->ID)
+        return;
+      if (C.IndexResult)
+        Completion.Deferred->ID = C.IndexResult->ID;
+      else if (C.SemaResult)
+        Completion.Deferred->ID = getSymbolID(*C.SemaResult);
+      return;
+    }
+    S.ReturnType = returnType(S);
     if (ExtractDocumentation && Completion.Documentation.empty()) {
       if (C.IndexResult && C.IndexResult->Detail)
         Completion.Documentation = C.IndexResult->Detail->Documentation;
@@ -340,6 +390,17 @@ struct CodeCompletionBuilder {
   }
 
   CodeCompletion build() {
+    if (Completion.Deferred) {
+      // Overloads are only summarized if their return types agree, so a
+      // bundle's return types are needed now.
+      if (Bundled.size() > 1)
+        for (auto &S : Bundled)
+          S.ReturnType = returnType(S);
+      else if (Bundled.front().SemaCCS) {
+        Completion.Deferred->SemaCCS = Bundled.front().SemaCCS;
+        Completion.Deferred->Allocator = CCAllocator;
+      }
+    }
     Completion.ReturnType = summarizeReturnType();
     Completion.Signature = summarizeSignature();
     Completion.SnippetSuffix = summarizeSnippet();
@@ -352,8 +413,18 @@ private:
     std::string SnippetSuffix;
     std::string Signature;
     std::string ReturnType;
+    const CodeCompletionString *SemaCCS;
+    const Symbol *IndexResult;
   };
 
+  static std::string returnType(const BundledEntry &S) {
+    if (S.SemaCCS)
+      return getReturnType(*S.SemaCCS);
+    if (S.IndexResult && S.IndexResult->Detail)
+      return S.IndexResult->Detail->ReturnType;
+    return "";
+  }
+
   // If all BundledEntrys have the same value for a property, return it.
   template <std::string BundledEntry::*Member>
   const std::string *onlyValue() const {
@@ -385,6 +456,7 @@ private:
   }
 
   ASTContext &ASTCtx;
+  std::shared_ptr<GlobalCodeCompletionAllocator> CCAllocator;
   CodeCompletion Completion;
   SmallVector<BundledEntry, 1> Bundled;
   bool ExtractDocumentation;
@@ -628,6 +700,10 @@ struct CompletionRecorder : public CodeCompleteConsumer {
 
   CodeCompletionAllocator &getAllocator() override { return *CCAllocator; }
   CodeCompletionTUInfo &getCodeCompletionTUInfo() override { return CCTUInfo; }
+  // Owns the strings returned by codeCompletionString(), may outlive this.
+  std::shared_ptr<GlobalCodeCompletionAllocator> allocator() const {
+    return CCAllocator;
+  }
 
   // Returns the filtering/sorting name for Result, which must be from Results.
   // Returned string is owned by this recorder (or the AST).
@@ -772,6 +848,7 @@ struct SemaCompleteInput {
   Position Pos;
   IntrusiveRefCntPtr<vfs::FileSystem> VFS;
   std::shared_ptr<PCHContainerOperations> PCHs;
+  bool SkipFunctionBodies;
 };
 
 // Invokes Sema code completion on a file.
@@ -803,7 +880,9 @@ bool semaCodeComplete(std::unique_ptr<CodeCompleteConsumer> Consumer,
   }
   auto &FrontendOpts = CI->getFrontendOpts();
   FrontendOpts.DisableFree = false;
-  FrontendOpts.SkipFunctionBodies = true;
+  // With code completion enabled, the parser still parses the body that
+  // contains the completion point.
+  FrontendOpts.SkipFunctionBodies = Input.SkipFunctionBodies;
   CI->getLangOpts()->CommentOpts.ParseAllComments = true;
   // Disable typo correction in Sema.
   CI->getLangOpts()->SpellChecking = false;
@@ -880,6 +959,25 @@ bool allowIndex(CodeCompletionContext &CC) {
   llvm_unreachable("invalid NestedNameSpecifier kind");
 }
 
+// Returns the length of the identifier that S ends with.
+size_t identifierSuffixLength(llvm::StringRef S) {
+  size_t Length = 0;
+  while (Length < S.size() && isIdentifierBody(S[S.size() - Length - 1]))
+    ++Length;
+  return Length;
+}
+
+// Whether completion results computed with L can be reused for R.
+bool sameResults(const CodeCompleteOptions &L, const CodeCompleteOptions &R) {
+  return L.EnableSnippets == R.EnableSnippets &&
+         L.IncludeCodePatterns == R.IncludeCodePatterns &&
+         L.IncludeMacros == R.IncludeMacros &&
+         L.IncludeComments == R.IncludeComments &&
+         L.IncludeIneligibleResults == R.IncludeIneligibleResults &&
+         L.BundleOverloads == R.BundleOverloads && L.Limit == R.Limit &&
+         L.LazyDetails == R.LazyDetails && L.Index == R.Index;
+}
+
 } // namespace
 
 clang::CodeCompleteOptions CodeCompleteOptions::getClangCompleteOpts() const {
@@ -905,7 +1003,10 @@ clang::CodeCompleteOptions CodeCompleteOptions::getClangCompleteOpts() const {
 //
 // There are a few tricky considerations:
 //   - the AST provides information needed for the index query (e.g. which
-//     namespaces to search in). So Sema must start first.
+//     namespaces to search in). So Sema must start first. However, the query
+//     can often be guessed from the text alone: if SpeculativeIndexRequest is
+//     set, we query the index with the guess in parallel with Sema, and only
+//     query it again if Sema disagrees with the guess.
 //   - we only want to return the top results (Opts.Limit).
 //     Building CompletionItems for everything else is wasteful, so we want to
 //     preserve the "native" format until we're done with scoring.
@@ -942,14 +1043,18 @@ class CodeCompleteFlow {
   std::vector<std::string> QueryScopes;      // Initialized once Sema runs.
   // Include-insertion and proximity scoring rely on the include structure.
   // This is available after Sema has run.
-  llvm::Optional<IncludeInserter> Inserter;  // Available during runWithSema.
-  llvm::Optional<URIDistance> FileProximity; // Initialized once Sema runs.
+  llvm::Optional<IncludeInserter> Inserter;   // Available during runWithSema.
+  std::shared_ptr<URIDistance> FileProximity; // Initialized once Sema runs.
+  URITable URIs; // The URIs of index results, resolved for include insertion.
+  // A guessed index request and its results, computed while Sema runs.
+  llvm::Optional<FuzzyFindRequest> SpecReq;
+  std::future<std::pair<SymbolSlab, bool>> SpecResults;
 
 public:
   // A CodeCompleteFlow object is only useful for calling run() exactly once.
   CodeCompleteFlow(PathRef FileName, const IncludeStructure &Includes,
                    const CodeCompleteOptions &Opts)
-      : FileName(FileName), Includes(Includes), Opts(Opts) {}
+      : FileName(FileName), Includes(Includes), Opts(Opts), URIs(FileName) {}
 
   CodeCompleteResult run(const SemaCompleteInput &SemaCCInput) && {
     trace::Span Tracer("CodeCompleteFlow");
@@ -960,27 +1065,22 @@ public:
     CodeCompleteResult Output;
     auto RecorderOwner = llvm::make_unique<CompletionRecorder>(Opts, [&]() {
       assert(Recorder && "Recorder is not set");
-      auto Style =
-          format::getStyle(format::DefaultFormatStyle, SemaCCInput.FileName,
-                           format::DefaultFallbackStyle, SemaCCInput.Contents,
-                           SemaCCInput.VFS.get());
-      if (!Style) {
-        log("Failed to get FormatStyle for file" + SemaCCInput.FileName + ": " +
-            llvm::toString(Style.takeError()) + ". Fallback is LLVM style.");
-        Style = format::getLLVMStyle();
-      }
       // If preprocessor was run, inclusions from preprocessor callback should
       // already be added to Includes.
       Inserter.emplace(
-          SemaCCInput.FileName, SemaCCInput.Contents, *Style,
+          SemaCCInput.FileName, SemaCCInput.Contents,
+          getFormatStyle(SemaCCInput.FileName, SemaCCInput.Contents,
+                         SemaCCInput.VFS.get()),
           SemaCCInput.Command.Directory,
           Recorder->CCSema->getPreprocessor().getHeaderSearchInfo());
       for (const auto &Inc : Includes.MainFileIncludes)
         Inserter->addExisting(Inc);
 
       // Most of the cost of file proximity is in initializing the FileDistance
-      // structures based on the observed includes, once per query. Conceptually
-      // that happens here (though the per-URI-scheme initialization is lazy).
+      // structures based on the observed includes. Conceptually that happens
+      // here (though the per-URI-scheme initialization is lazy). With a
+      // ProximityCache it only happens when the includes change, and the
+      // distances of index files are remembered across queries.
       // The per-result proximity scoring is (amortized) very cheap.
       FileDistanceOptions ProxOpts{}; // Use defaults.
       const auto &SM = Recorder->CCSema->getSourceManager();
@@ -995,7 +1095,11 @@ public:
         if (Entry.getValue() > 0)
           Source.MaxUpTraversals = 1;
       }
-      FileProximity.emplace(ProxSources, ProxOpts);
+      if (Opts.ProximityCache)
+        FileProximity = Opts.ProximityCache->get(
+            FileName, std::move(ProxSources), ProxOpts);
+      else
+        FileProximity = std::make_shared<URIDistance>(ProxSources, ProxOpts);
 
       Output = runWithSema();
       Inserter.reset(); // Make sure this doesn't out-live Clang.
@@ -1007,6 +1111,9 @@ public:
           llvm::join(QueryScopes.begin(), QueryScopes.end(), ",")));
     });
 
+    if (Opts.Index && Opts.SpeculativeIndexRequest)
+      startSpeculativeIndexQuery(SemaCCInput);
+
     Recorder = RecorderOwner.get();
     semaCodeComplete(std::move(RecorderOwner), Opts.getClangCompleteOpts(),
                      SemaCCInput, &Includes);
@@ -1054,28 +1161,79 @@ private:
     return Output;
   }
 
-  SymbolSlab queryIndex() {
-    trace::Span Tracer("Query index");
-    SPAN_ATTACH(Tracer, "limit", Opts.Limit);
-
-    SymbolSlab::Builder ResultsBuilder;
-    // Build the query.
+  FuzzyFindRequest indexRequest(llvm::StringRef Query,
+                                std::vector<std::string> Scopes) const {
     FuzzyFindRequest Req;
     if (Opts.Limit)
       Req.MaxCandidateCount = Opts.Limit;
-    Req.Query = Filter->pattern();
+    Req.Query = Query;
     Req.RestrictForCodeCompletion = true;
-    Req.Scopes = QueryScopes;
+    Req.Scopes = std::move(Scopes);
     // FIXME: we should send multiple weighted paths here.
     Req.ProximityPaths.push_back(FileName);
+    return Req;
+  }
+
+  // Runs the query against the index. Returns the results, and whether more
+  // would be available with a higher limit.
+  static std::pair<SymbolSlab, bool> fuzzyFind(const SymbolIndex &Index,
+                                               const FuzzyFindRequest &Req) {
     log(llvm::formatv("Code complete: fuzzyFind(\"{0}\", scopes=[{1}])",
                       Req.Query,
                       llvm::join(Req.Scopes.begin(), Req.Scopes.end(), ",")));
-    // Run the query against the index.
-    if (Opts.Index->fuzzyFind(
-            Req, [&](const Symbol &Sym) { ResultsBuilder.insert(Sym); }))
+    SymbolSlab::Builder ResultsBuilder;
+    bool Incomplete = Index.fuzzyFind(
+        Req, [&](const Symbol &Sym) { ResultsBuilder.insert(Sym); });
+    return {std::move(ResultsBuilder).build(), Incomplete};
+  }
+
+  // Queries the index with a request guessed from the text, on another thread.
+  // queryIndex() uses the results if Sema agrees with the guess.
+  void startSpeculativeIndexQuery(const SemaCompleteInput &Input) {
+    auto Offset = positionToOffset(Input.Contents, Input.Pos);
+    if (!Offset) {
+      llvm::consumeError(Offset.takeError());
+      return;
+    }
+    auto Guess = speculateIndexQuery(Input.Contents, *Offset);
+    if (!Guess)
+      return;
+    SpecReq = indexRequest(Guess->Filter, std::move(Guess->Scopes));
+    const SymbolIndex *Index = Opts.Index;
+    FuzzyFindRequest Req = *SpecReq;
+    SpecResults = runAsync<std::pair<SymbolSlab, bool>>([Index, Req]() {
+      trace::Span Tracer("Speculative index query");
+      return fuzzyFind(*Index, Req);
+    });
+  }
+
+  // Whether the speculative request asks for the same results as Req.
+  bool speculationMatches(const FuzzyFindRequest &Req) const {
+    if (!SpecReq || SpecReq->Query != Req.Query)
+      return false;
+    std::vector<std::string> Guessed = SpecReq->Scopes, Actual = Req.Scopes;
+    std::sort(Guessed.begin(), Guessed.end());
+    std::sort(Actual.begin(), Actual.end());
+    return Guessed == Actual;
+  }
+
+  SymbolSlab queryIndex() {
+    trace::Span Tracer("Query index");
+    SPAN_ATTACH(Tracer, "limit", Opts.Limit);
+
+    FuzzyFindRequest Req = indexRequest(Filter->pattern(), QueryScopes);
+    bool Speculated = speculationMatches(Req);
+    SPAN_ATTACH(Tracer, "speculative", Speculated);
+    if (SpecReq && !Speculated)
+      log(llvm::formatv(
+          "Code complete: speculative fuzzyFind(\"{0}\", scopes=[{1}]) was "
+          "wrong, querying the index again",
+          SpecReq->Query,
+          llvm::join(SpecReq->Scopes.begin(), SpecReq->Scopes.end(), ",")));
+    auto Results = Speculated ? SpecResults.get() : fuzzyFind(*Opts.Index, Req);
+    if (Results.second)
       Incomplete = true;
-    return std::move(ResultsBuilder).build();
+    return std::move(Results.first);
   }
 
   // Merges Sema and Index results where possible, to form CompletionCandidates.
@@ -1147,7 +1305,7 @@ private:
     SymbolQualitySignals Quality;
     SymbolRelevanceSignals Relevance;
     Relevance.Query = SymbolRelevanceSignals::CodeComplete;
-    Relevance.FileProximityMatch = FileProximity.getPointer();
+    Relevance.FileProximityMatch = FileProximity.get();
     auto &First = Bundle.front();
     if (auto FuzzyScore = fuzzyScore(First))
       Relevance.NameMatch = *FuzzyScore;
@@ -1197,7 +1355,8 @@ private:
                           : nullptr;
       if (!Builder)
         Builder.emplace(Recorder->CCSema->getASTContext(), Item, SemaCCS,
-                        *Inserter, FileName, Opts);
+                        Recorder->allocator(), *Inserter, FileName, URIs,
+                        Opts);
       else
         Builder->add(Item, SemaCCS);
     }
@@ -1214,7 +1373,8 @@ CodeCompleteResult codeComplete(PathRef FileName,
                                 std::shared_ptr<PCHContainerOperations> PCHs,
                                 CodeCompleteOptions Opts) {
   return CodeCompleteFlow(FileName, PreambleInclusions, Opts)
-      .run({FileName, Command, Preamble, Contents, Pos, VFS, PCHs});
+      .run({FileName, Command, Preamble, Contents, Pos, VFS, PCHs,
+            Opts.SkipFunctionBodies});
 }
 
 SignatureHelp signatureHelp(PathRef FileName,
@@ -1233,10 +1393,428 @@ SignatureHelp signatureHelp(PathRef FileName,
   semaCodeComplete(llvm::make_unique<SignatureHelpCollector>(Options, Result),
                    Options,
                    {FileName, Command, Preamble, Contents, Pos, std::move(VFS),
-                    std::move(PCHs)});
+                    std::move(PCHs), /*SkipFunctionBodies=*/true});
   return Result;
 }
 
+llvm::Optional<SpeculativeIndexQuery>
+speculateIndexQuery(llvm::StringRef Content, size_t Offset) {
+  SpeculativeIndexQuery Query;
+  llvm::StringRef Before = Content.take_front(Offset);
+  size_t FilterLength = identifierSuffixLength(Before);
+  Query.Filter = Before.take_back(FilterLength).str();
+  Before = Before.drop_back(FilterLength).rtrim();
+
+  // Member accesses are completed by Sema alone.
+  if (Before.endswith(".") || Before.endswith("->"))
+    return llvm::None;
+
+  // Qualified completion: query the typed qualifier, e.g. "a::b::" for
+  // "::a::b::^". Sema may resolve it to a different namespace, or add the
+  // namespaces it nominates, in which case we will query again.
+  if (Before.endswith("::")) {
+    std::vector<llvm::StringRef> Names;
+    while (Before.consume_back("::")) {
+      Before = Before.rtrim();
+      size_t NameLength = identifierSuffixLength(Before);
+      if (NameLength == 0) {
+        // Template specializations are classes, which aren't in the index.
+        if (Before.endswith(">"))
+          return llvm::None;
+        break; // The global namespace.
+      }
+      Names.push_back(Before.take_back(NameLength));
+      Before = Before.drop_back(NameLength).rtrim();
+    }
+    std::string Scope;
+    for (llvm::StringRef Name : llvm::reverse(Names))
+      Scope += (Name + "::").str();
+    Query.Scopes.push_back(std::move(Scope));
+    return std::move(Query);
+  }
+
+  // Unqualified completion: find the enclosing namespaces and the
+  // using-directives in the blocks around the completion point.
+  struct Block {
+    // Namespace components, e.g. {"a", "b"} for "namespace a::b {".
+    std::vector<std::string> Namespaces;
+    std::vector<std::string> UsingDirectives;
+  };
+  std::vector<Block> Blocks(1); // The translation unit.
+  enum { Normal, NamespaceName, UsingDirective } State = Normal;
+  std::vector<std::string> Pending; // Components of a namespace name.
+  bool PrevWasUsing = false;
+
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = true;
+  LangOpts.CPlusPlus11 = true;
+  std::string Code = Before; // The lexer needs a null-terminated buffer.
+  Lexer Lex(SourceLocation(), LangOpts, Code.data(), Code.data(),
+            Code.data() + Code.size());
+  Token Tok;
+  // LexFromRawLexer() reports the end of the buffer along with the last token,
+  // so stop at the eof token instead.
+  for (Lex.LexFromRawLexer(Tok); Tok.isNot(tok::eof);
+       Lex.LexFromRawLexer(Tok)) {
+    bool IsIdentifier = Tok.is(tok::raw_identifier);
+    llvm::StringRef Identifier = IsIdentifier ? Tok.getRawIdentifier() : "";
+    switch (State) {
+    case NamespaceName:
+      if (IsIdentifier && Identifier != "inline") {
+        Pending.push_back(Identifier.str());
+        continue;
+      }
+      if (Tok.is(tok::coloncolon))
+        continue;
+      if (Tok.is(tok::l_brace)) {
+        if (Pending.empty())
+          Pending.push_back("(anonymous namespace)");
+        Blocks.emplace_back();
+        Blocks.back().Namespaces = std::move(Pending);
+        Pending.clear();
+        State = Normal;
+        continue;
+      }
+      State = Normal; // A namespace alias, or something we don't understand.
+      break;
+    case UsingDirective:
+      if (IsIdentifier) {
+        Pending.push_back(Identifier.str());
+        continue;
+      }
+      if (Tok.is(tok::coloncolon))
+        continue;
+      if (Tok.is(tok::semi) && !Pending.empty())
+        Blocks.back().UsingDirectives.push_back(
+            llvm::join(Pending.begin(), Pending.end(), "::") + "::");
+      Pending.clear();
+      State = Normal;
+      break;
+    case Normal:
+      break;
+    }
+
+    if (IsIdentifier && Identifier == "namespace") {
+      State = PrevWasUsing ? UsingDirective : NamespaceName;
+      Pending.clear();
+    } else if (Tok.is(tok::l_brace)) {
+      Blocks.emplace_back();
+    } else if (Tok.is(tok::r_brace) && Blocks.size() > 1) {
+      Blocks.pop_back();
+    }
+    PrevWasUsing = IsIdentifier && Identifier == "using";
+  }
+
+  llvm::StringSet<> Scopes;
+  std::string Enclosing;
+  Scopes.insert(Enclosing);
+  for (const Block &B : Blocks) {
+    for (const auto &Namespace : B.Namespaces) {
+      Enclosing += Namespace + "::";
+      Scopes.insert(Enclosing);
+    }
+    for (const auto &Nominated : B.UsingDirectives)
+      Scopes.insert(Nominated);
+  }
+  for (const auto &Scope : Scopes)
+    Query.Scopes.push_back(Scope.getKey().str());
+  return std::move(Query);
+}
+
+// The cache key is the file contents without the identifier being completed.
+// Returns the key and the part of the identifier before the completion point.
+static llvm::Optional<std::pair<std::string, llvm::StringRef>>
+completionCacheKey(llvm::StringRef Contents, Position Pos) {
+  auto Offset = positionToOffset(Contents, Pos);
+  if (!Offset) {
+    llvm::consumeError(Offset.takeError());
+    return llvm::None;
+  }
+  size_t Start = *Offset - identifierSuffixLength(Contents.take_front(*Offset));
+  std::string Key =
+      (Contents.take_front(Start) + Contents.drop_front(*Offset)).str();
+  return std::make_pair(std::move(Key), Contents.slice(Start, *Offset));
+}
+
+llvm::Optional<CodeCompleteResult>
+CodeCompletionCache::lookup(PathRef File, llvm::StringRef Contents,
+                            Position Pos, const CodeCompleteOptions &Opts) {
+  auto Key = completionCacheKey(Contents, Pos);
+  if (!Key)
+    return llvm::None;
+  llvm::StringRef Filter = Key->second;
+
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto It = Entries.find(File);
+  if (It == Entries.end())
+    return llvm::None;
+  const Entry &E = It->second;
+  // Results for a shorter prefix are a superset of ours only if none of them
+  // were dropped because of the limit.
+  if (E.Key != Key->first || !Filter.startswith(E.Filter) ||
+      E.Result.HasMore || !sameResults(E.Opts, Opts))
+    return llvm::None;
+
+  trace::Span Tracer("Cached code completion");
+  FuzzyMatcher Matcher(Filter);
+  CodeCompleteResult Result;
+  for (const CodeCompletion &C : E.Result.Completions) {
+    // Sema only offers macros that match the filter as a prefix.
+    if (C.Kind == CompletionItemKind::Text &&
+        bool(C.Origin & SymbolOrigin::AST) &&
+        !llvm::StringRef(C.Name).startswith_lower(Filter))
+      continue;
+    auto NameMatch = Matcher.match(C.Name);
+    if (!NameMatch)
+      continue;
+    Result.Completions.push_back(C);
+    // The name match is a multiplier on the total score, see CodeCompletion.
+    Result.Completions.back().Score.Total = C.Score.ExcludingName * *NameMatch;
+  }
+  // Same order as CodeCompleteFlow: by score, then by name.
+  std::sort(Result.Completions.begin(), Result.Completions.end(),
+            [](const CodeCompletion &L, const CodeCompletion &R) {
+              if (L.Score.Total != R.Score.Total)
+                return L.Score.Total > R.Score.Total;
+              return L.Name < R.Name;
+            });
+  SPAN_ATTACH(Tracer, "cached_results", int(E.Result.Completions.size()));
+  SPAN_ATTACH(Tracer, "returned_results", int(Result.Completions.size()));
+  log(llvm::formatv("Code complete: reused {0} results for \"{1}\", "
+                    "{2} returned for \"{3}\".",
+                    E.Result.Completions.size(), E.Filter,
+                    Result.Completions.size(), Filter));
+  return std::move(Result);
+}
+
+void CodeCompletionCache::update(PathRef File, llvm::StringRef Contents,
+                                 Position Pos, const CodeCompleteOptions &Opts,
+                                 CodeCompleteResult Result) {
+  auto Key = completionCacheKey(Contents, Pos);
+  if (!Key)
+    return;
+  std::lock_guard<std::mutex> Lock(Mu);
+  Entry &E = Entries[File];
+  E.Key = std::move(Key->first);
+  E.Filter = Key->second.str();
+  E.Opts = Opts;
+  E.Result = std::move(Result);
+}
+
+void CodeCompletionCache::remove(PathRef File) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Entries.erase(File);
+}
+
+namespace {
+// The arguments of the call that encloses the cursor.
+struct CallArguments {
+  // The offset of the open paren.
+  size_t OpenParen;
+  // The number of arguments before the one that contains the cursor.
+  unsigned Active;
+};
+} // namespace
+
+// Finds the call arguments before \p Offset by matching brackets backwards.
+// Gives up on anything that needs a lexer or a parser to be matched reliably:
+// literals, comments, template arguments and statement boundaries.
+static llvm::Optional<CallArguments> findCallArguments(llvm::StringRef Contents,
+                                                       size_t Offset) {
+  unsigned Depth = 0;
+  unsigned Commas = 0;
+  for (size_t I = Offset; I-- > 0;) {
+    switch (Contents[I]) {
+    case ')':
+    case ']':
+      ++Depth;
+      break;
+    case '(':
+      if (Depth == 0)
+        return CallArguments{I, Commas};
+      --Depth;
+      break;
+    case '[':
+      if (Depth == 0)
+        return llvm::None;
+      --Depth;
+      break;
+    case ',':
+      if (Depth == 0)
+        ++Commas;
+      break;
+    case '>':
+      // Member access through a pointer is fine.
+      if (I > 0 && Contents[I - 1] == '-') {
+        --I;
+        break;
+      }
+      return llvm::None;
+    case '<':
+    case '"':
+    case '\'':
+    case '/':
+    case '#':
+    case ';':
+    case '{':
+    case '}':
+      return llvm::None;
+    }
+  }
+  return llvm::None;
+}
+
+// The cache key is the file contents without the arguments before the cursor.
+static llvm::Optional<std::pair<std::string, CallArguments>>
+signatureHelpCacheKey(llvm::StringRef Contents, Position Pos) {
+  auto Offset = positionToOffset(Contents, Pos);
+  if (!Offset) {
+    llvm::consumeError(Offset.takeError());
+    return llvm::None;
+  }
+  auto Args = findCallArguments(Contents, *Offset);
+  if (!Args)
+    return llvm::None;
+  std::string Key = (Contents.take_front(Args->OpenParen + 1) +
+                     Contents.drop_front(*Offset))
+                        .str();
+  return std::make_pair(std::move(Key), *Args);
+}
+
+llvm::Optional<SignatureHelp>
+SignatureHelpCache::lookup(PathRef File, const PrecompiledPreamble *Preamble,
+                           llvm::StringRef Contents, Position Pos) {
+  auto Key = signatureHelpCacheKey(Contents, Pos);
+  if (!Key)
+    return llvm::None;
+  unsigned Active = Key->second.Active;
+
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto It = Entries.find(File);
+  if (It == Entries.end())
+    return llvm::None;
+  const Entry &E = It->second;
+  // Sema drops the candidates that can't take the arguments before the active
+  // one, so signatures computed at a later argument may be missing some.
+  if (E.Preamble != Preamble || E.Key != Key->first ||
+      E.OpenParen != Key->second.OpenParen || Active < E.Active)
+    return llvm::None;
+
+  trace::Span Tracer("Cached signature help");
+  SignatureHelp Result;
+  Result.activeSignature = 0;
+  Result.activeParameter = Active;
+  for (const SignatureInformation &Sig : E.Result.signatures) {
+    // Like Sema, drop the candidates that can't take the active argument.
+    if (Active > 0 && Sig.parameters.size() <= Active &&
+        !llvm::StringRef(Sig.label).contains("..."))
+      continue;
+    Result.signatures.push_back(Sig);
+  }
+  SPAN_ATTACH(Tracer, "cached_signatures", int(E.Result.signatures.size()));
+  SPAN_ATTACH(Tracer, "returned_signatures", int(Result.signatures.size()));
+  log(llvm::formatv("Signature help: reused {0} signatures, {1} returned for "
+                    "argument {2}.",
+                    E.Result.signatures.size(), Result.signatures.size(),
+                    Active));
+  return std::move(Result);
+}
+
+void SignatureHelpCache::update(PathRef File,
+                                const PrecompiledPreamble *Preamble,
+                                llvm::StringRef Contents, Position Pos,
+                                SignatureHelp Result) {
+  auto Key = signatureHelpCacheKey(Contents, Pos);
+  if (!Key)
+    return;
+  std::lock_guard<std::mutex> Lock(Mu);
+  Entry &E = Entries[File];
+  E.Preamble = Preamble;
+  E.Key = std::move(Key->first);
+  E.OpenParen = Key->second.OpenParen;
+  E.Active = Key->second.Active;
+  E.Result = std::move(Result);
+}
+
+void SignatureHelpCache::remove(PathRef File) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Entries.erase(File);
+}
+
+// Finds the declaration of a completion result that the index doesn't know,
+// by looking up its name in its scope. Returns null if that fails, e.g. for
+// anonymous namespaces.
+static const NamedDecl *findCompletedDecl(ASTContext &Ctx,
+                                          const CodeCompletion &C,
+                                          const SymbolID &ID) {
+  const DeclContext *DC = Ctx.getTranslationUnitDecl();
+  llvm::SmallVector<StringRef, 4> Scopes;
+  StringRef(C.Scope).split(Scopes, "::", /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef Scope : Scopes) {
+    const DeclContext *Inner = nullptr;
+    for (const NamedDecl *ND : DC->lookup(&Ctx.Idents.get(Scope)))
+      if ((Inner = llvm::dyn_cast<DeclContext>(ND)))
+        break;
+    if (!Inner)
+      return nullptr;
+    DC = Inner;
+  }
+  for (const NamedDecl *ND : DC->lookup(&Ctx.Idents.get(C.Name))) {
+    auto NDID = getSymbolID(CodeCompletionResult(ND, /*Priority=*/0));
+    if (NDID && *NDID == ID)
+      return ND;
+  }
+  return nullptr;
+}
+
+void resolveCompletionDetails(CodeCompletion &C, PathRef FileName,
+                              const ParseInputs &Inputs, ParsedAST &AST,
+                              const SymbolIndex *Index) {
+  if (!C.Deferred)
+    return;
+  trace::Span Tracer("Resolve completion details");
+  CodeCompletion::DeferredDetails Deferred = std::move(*C.Deferred);
+  C.Deferred.reset();
+
+  if (Deferred.SemaCCS)
+    C.ReturnType = getReturnType(*Deferred.SemaCCS);
+  if (Deferred.ID) {
+    bool Found = false;
+    if (Index) {
+      LookupRequest Req;
+      Req.IDs.insert(*Deferred.ID);
+      Index->lookup(Req, [&](const Symbol &Sym) {
+        if (!Sym.Detail)
+          return;
+        Found = true;
+        if (Deferred.Documentation)
+          C.Documentation = Sym.Detail->Documentation;
+        // Bundles' return types were summarized eagerly.
+        if (!Deferred.SemaCCS && C.BundleSize == 1)
+          C.ReturnType = Sym.Detail->ReturnType;
+      });
+    }
+    if (!Found && Deferred.Documentation)
+      if (const NamedDecl *ND =
+              findCompletedDecl(AST.getASTContext(), C, *Deferred.ID))
+        C.Documentation = getDocComment(AST.getASTContext(),
+                                        CodeCompletionResult(ND, 0),
+                                        /*CommentsFromHeader=*/false);
+  }
+
+  if (Deferred.DeclaringHeader && Deferred.InsertedHeader) {
+    IncludeInserter Includes(
+        FileName, Inputs.Contents,
+        getFormatStyle(FileName, Inputs.Contents, Inputs.FS.get()),
+        Inputs.CompileCommand.Directory,
+        AST.getPreprocessor().getHeaderSearchInfo());
+    C.Header = Includes.calculateIncludePath(*Deferred.DeclaringHeader,
+                                             *Deferred.InsertedHeader);
+    if (Deferred.InsertInclude)
+      C.HeaderInsertion = Includes.insert(C.Header);
+  }
+}
+
 bool isIndexedForCodeCompletion(const NamedDecl &ND, ASTContext &ASTCtx) {
   using namespace clang::ast_matchers;
   auto InTopLevelScope = hasDeclContext(
@@ -1250,8 +1828,10 @@ bool isIndexedForCodeCompletion(const NamedDecl &ND, ASTContext &ASTCtx) {
 
 CompletionItem CodeCompletion::render(const CodeCompleteOptions &Opts) const {
   CompletionItem LSP;
-  LSP.label = (HeaderInsertion ? Opts.IncludeIndicator.Insert
-                               : Opts.IncludeIndicator.NoInsert) +
+  bool InsertsInclude =
+      HeaderInsertion || (Deferred && Deferred->InsertInclude);
+  LSP.label = (InsertsInclude ? Opts.IncludeIndicator.Insert
+                              : Opts.IncludeIndicator.NoInsert) +
               (Opts.ShowOrigins ? "[" + llvm::to_string(Origin) + "]" : "") +
               RequiredQualifier + Name + Signature;
 
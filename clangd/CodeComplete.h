@@ -23,11 +23,18 @@
 #include "clang/Frontend/PrecompiledPreamble.h"
 #include "clang/Sema/CodeCompleteOptions.h"
 #include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include <mutex>
 
 namespace clang {
+class CodeCompletionString;
+class GlobalCodeCompletionAllocator;
 class NamedDecl;
 class PCHContainerOperations;
 namespace clangd {
+class ParsedAST;
+struct ParseInputs;
+class URIDistanceCache;
 
 struct CodeCompleteOptions {
   /// Returns options that can be passed to clang's completion engine.
@@ -70,12 +77,38 @@ struct CodeCompleteOptions {
   /// Expose origins of completion items in the label (for debugging).
   bool ShowOrigins = false;
 
+  /// Start the index query before Sema completion finishes, using a query
+  /// guessed from the code before the completion point. The two run in
+  /// parallel. If the guess turns out to be wrong, the index is queried again.
+  bool SpeculativeIndexRequest = false;
+
+  /// Reuse the results of the previous completion request in the same file if
+  /// the user has only typed more of the identifier being completed. The
+  /// results are then re-filtered and re-ranked rather than recomputed.
+  bool CacheResults = false;
+
+  /// Leave out the return type, documentation and include insertion of each
+  /// result, and only compute them for the item the client asks about, with
+  /// resolveCompletionDetails().
+  bool LazyDetails = false;
+
+  /// Don't parse the bodies of the functions in the main file, except the one
+  /// that contains the completion point. Functions whose bodies are needed
+  /// elsewhere, e.g. to deduce their return type, are still parsed, so member
+  /// and scope completions are the same either way.
+  bool SkipFunctionBodies = true;
+
   // Populated internally by clangd, do not set.
   /// If `Index` is set, it is used to augment the code completion
   /// results.
   /// FIXME(ioeric): we might want a better way to pass the index around inside
   /// clangd.
   const SymbolIndex *Index = nullptr;
+
+  // Populated internally by clangd, do not set.
+  /// If set, file proximity is computed with the URIDistance kept for the file
+  /// across requests, rather than from scratch.
+  URIDistanceCache *ProximityCache = nullptr;
 };
 
 // Semi-structured representation of a code-complete suggestion for our C++ API.
@@ -113,6 +146,24 @@ struct CodeCompletion {
   std::string Header;
   // Present if Header is set and should be inserted to use this item.
   llvm::Optional<TextEdit> HeaderInsertion;
+  // What resolveCompletionDetails() needs to fill in ReturnType,
+  // Documentation, Header and HeaderInsertion, which are left out because of
+  // CodeCompleteOptions::LazyDetails.
+  struct DeferredDetails {
+    // Looked up in the index, or in the AST if the index doesn't know it.
+    llvm::Optional<SymbolID> ID;
+    bool Documentation = false;
+    // The return type is read from the Sema completion string if there is one.
+    // It is owned by the allocator.
+    std::shared_ptr<GlobalCodeCompletionAllocator> Allocator;
+    const CodeCompletionString *SemaCCS = nullptr;
+    // Header is computed from these, if set.
+    llvm::Optional<HeaderFile> DeclaringHeader;
+    llvm::Optional<HeaderFile> InsertedHeader;
+    // Whether the header has to be inserted. Known eagerly, for the label.
+    bool InsertInclude = false;
+  };
+  llvm::Optional<DeferredDetails> Deferred;
 
   // Scores are used to rank completion items.
   struct Scores {
@@ -157,6 +208,64 @@ CodeCompleteResult codeComplete(PathRef FileName,
                                 std::shared_ptr<PCHContainerOperations> PCHs,
                                 CodeCompleteOptions Opts);
 
+/// Fills in the fields of \p C that were left out because of
+/// CodeCompleteOptions::LazyDetails. \p AST and \p Inputs are the current
+/// ones of \p FileName, where \p C was completed. \p Index may be null.
+void resolveCompletionDetails(CodeCompletion &C, PathRef FileName,
+                              const ParseInputs &Inputs, ParsedAST &AST,
+                              const SymbolIndex *Index);
+
+/// Remembers the last code completion results for each file.
+/// When the user keeps typing the same identifier ("foo^" -> "foob^"), the
+/// results for the new prefix are derived from the old ones with FuzzyMatcher
+/// instead of running Sema and querying the index again. Any other edit to the
+/// file invalidates the results.
+/// This class is thread-safe.
+class CodeCompletionCache {
+public:
+  /// Returns the completions at \p Pos in \p Contents, if they can be derived
+  /// from the ones last stored for \p File with the same options.
+  llvm::Optional<CodeCompleteResult> lookup(PathRef File, StringRef Contents,
+                                            Position Pos,
+                                            const CodeCompleteOptions &Opts);
+  /// Stores the completions computed at \p Pos in \p Contents.
+  void update(PathRef File, StringRef Contents, Position Pos,
+              const CodeCompleteOptions &Opts, CodeCompleteResult Result);
+  /// Forgets the completions stored for \p File.
+  void remove(PathRef File);
+
+private:
+  struct Entry {
+    // The file contents without the identifier being completed.
+    std::string Key;
+    // The part of the identifier before the completion point.
+    std::string Filter;
+    CodeCompleteOptions Opts;
+    CodeCompleteResult Result;
+  };
+
+  std::mutex Mu;
+  llvm::StringMap<Entry> Entries;
+};
+
+/// The index query that code completion is expected to make, guessed by lexing
+/// the code before the completion point rather than by running Sema.
+struct SpeculativeIndexQuery {
+  /// The partial identifier being completed.
+  std::string Filter;
+  /// The scopes to search in, in the format of FuzzyFindRequest::Scopes.
+  std::vector<std::string> Scopes;
+};
+
+/// Guesses the index query for code completion at \p Offset in \p Content.
+/// Qualified completions ("ns::^") query the typed qualifier. Unqualified ones
+/// query the enclosing namespaces, namespaces named by visible using-directives
+/// and the global namespace.
+/// Returns None if completion is unlikely to query the index at all, e.g. for
+/// member accesses.
+llvm::Optional<SpeculativeIndexQuery>
+speculateIndexQuery(llvm::StringRef Content, size_t Offset);
+
 /// Get signature help at a specified \p Pos in \p FileName.
 SignatureHelp signatureHelp(PathRef FileName,
                             const tooling::CompileCommand &Command,
@@ -165,6 +274,46 @@ SignatureHelp signatureHelp(PathRef FileName,
                             IntrusiveRefCntPtr<vfs::FileSystem> VFS,
                             std::shared_ptr<PCHContainerOperations> PCHs);
 
+/// Remembers the last signature help for each file.
+/// While the user types the arguments of a call, the overload set doesn't
+/// change, so the signatures computed at the call's open paren are reused and
+/// only the active parameter is recomputed, by counting the commas before the
+/// cursor. Any edit outside the arguments or a different preamble invalidates
+/// the signatures.
+/// This is an approximation of what Sema computes: only the arity of the
+/// candidates is rechecked, so candidates that the typed arguments rule out are
+/// still offered, and activeSignature is always the first one.
+/// This class is thread-safe.
+class SignatureHelpCache {
+public:
+  /// Returns the signature help at \p Pos in \p Contents, if it can be derived
+  /// from the one last stored for \p File with the same \p Preamble.
+  llvm::Optional<SignatureHelp> lookup(PathRef File,
+                                       const PrecompiledPreamble *Preamble,
+                                       StringRef Contents, Position Pos);
+  /// Stores the signature help computed at \p Pos in \p Contents.
+  void update(PathRef File, const PrecompiledPreamble *Preamble,
+              StringRef Contents, Position Pos, SignatureHelp Result);
+  /// Forgets the signature help stored for \p File.
+  void remove(PathRef File);
+
+private:
+  struct Entry {
+    // The preamble the signatures were computed with.
+    const PrecompiledPreamble *Preamble;
+    // The file contents without the arguments before the cursor.
+    std::string Key;
+    // The offset of the open paren of the call.
+    size_t OpenParen;
+    // The number of arguments before the cursor.
+    unsigned Active;
+    SignatureHelp Result;
+  };
+
+  std::mutex Mu;
+  llvm::StringMap<Entry> Entries;
+};
+
 // For index-based completion, we only consider:
 //   * symbols in namespaces or translation unit scopes (e.g. no class
 //     members, no locals)
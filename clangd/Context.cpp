@@ -8,13 +8,94 @@
 //===---------------------------------------------------------------------===//
 
 #include "Context.h"
+#include <algorithm>
 #include <cassert>
+#include <new>
 
 namespace clang {
 namespace clangd {
 
 Context Context::empty() { return Context(/*DataPtr=*/nullptr); }
 
+Context::Data::Data(std::shared_ptr<const Data> ParentPtr, const void *KeyPtr,
+                    const void *ValuePtr)
+    : Parent(std::move(ParentPtr)) {
+  const Data *P = Parent.get();
+  if (P && P->NumEntries < MaxEntries) {
+    std::copy(P->Entries, P->Entries + P->NumEntries, Entries);
+    NumEntries = P->NumEntries;
+    Skip = P->Skip;
+  } else {
+    NumEntries = 0;
+    Skip = P;
+  }
+  Entries[NumEntries].KeyPtr = KeyPtr;
+  Entries[NumEntries].ValuePtr = ValuePtr;
+  ++NumEntries;
+}
+
+// Nodes are allocated in a few size classes. Freed nodes are kept in free
+// lists of the thread that frees them, which need not be the one that
+// allocated them: contexts are routinely passed to other threads.
+static const size_t BlockGranularity = 64;
+static const unsigned NumSizeClasses = 4;
+static const unsigned MaxFreeBlocks = 64;
+
+namespace {
+struct FreeBlock {
+  FreeBlock *Next;
+};
+
+struct FreeLists {
+  FreeBlock *Heads[NumSizeClasses] = {};
+  unsigned Sizes[NumSizeClasses] = {};
+  ~FreeLists();
+};
+} // namespace
+
+// Set when the free lists of the thread are destroyed. Contexts that are
+// destroyed after them, e.g. the current() one, are freed directly.
+static thread_local bool FreeListsDestroyed = false;
+static thread_local FreeLists ThreadFreeLists;
+
+FreeLists::~FreeLists() {
+  for (unsigned Class = 0; Class < NumSizeClasses; ++Class)
+    while (FreeBlock *Block = Heads[Class]) {
+      Heads[Class] = Block->Next;
+      ::operator delete(Block);
+    }
+  FreeListsDestroyed = true;
+}
+
+void *Context::allocate(size_t Size) {
+  size_t Class = (Size - 1) / BlockGranularity;
+  if (Class >= NumSizeClasses)
+    return ::operator new(Size);
+  if (!FreeListsDestroyed) {
+    FreeLists &Lists = ThreadFreeLists;
+    if (FreeBlock *Block = Lists.Heads[Class]) {
+      Lists.Heads[Class] = Block->Next;
+      --Lists.Sizes[Class];
+      return Block;
+    }
+  }
+  // Blocks of a class all have the same size, as they may be reused.
+  return ::operator new((Class + 1) * BlockGranularity);
+}
+
+void Context::deallocate(void *Ptr, size_t Size) {
+  size_t Class = (Size - 1) / BlockGranularity;
+  if (Class < NumSizeClasses && !FreeListsDestroyed) {
+    FreeLists &Lists = ThreadFreeLists;
+    if (Lists.Sizes[Class] < MaxFreeBlocks) {
+      Lists.Heads[Class] = new (Ptr) FreeBlock{Lists.Heads[Class]};
+      ++Lists.Sizes[Class];
+      return;
+    }
+  }
+  ::operator delete(Ptr);
+}
+
 Context::Context(std::shared_ptr<const Data> DataPtr)
     : DataPtr(std::move(DataPtr)) {}
 
@@ -17,6 +17,7 @@
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Compiler.h"
+#include <cstddef>
 #include <memory>
 #include <type_traits>
 
@@ -100,9 +101,11 @@ public:
   /// specified for \p Key, return null.
   template <class Type> const Type *get(const Key<Type> &Key) const {
     for (const Data *DataPtr = this->DataPtr.get(); DataPtr != nullptr;
-         DataPtr = DataPtr->Parent.get()) {
-      if (DataPtr->KeyPtr == &Key)
-        return static_cast<const Type *>(DataPtr->Value->getValuePtr());
+         DataPtr = DataPtr->Skip) {
+      // Newer values shadow older ones.
+      for (unsigned I = DataPtr->NumEntries; I-- > 0;)
+        if (DataPtr->Entries[I].KeyPtr == &Key)
+          return static_cast<const Type *>(DataPtr->Entries[I].ValuePtr);
     }
     return nullptr;
   }
@@ -121,20 +124,16 @@ public:
   template <class Type>
   Context derive(const Key<Type> &Key,
                  typename std::decay<Type>::type Value) const & {
-    return Context(std::make_shared<Data>(Data{
-        /*Parent=*/DataPtr, &Key,
-        llvm::make_unique<TypedAnyStorage<typename std::decay<Type>::type>>(
-            std::move(Value))}));
+    return Context(makeData<typename std::decay<Type>::type>(
+        /*Parent=*/DataPtr, &Key, std::move(Value)));
   }
 
   template <class Type>
   Context
   derive(const Key<Type> &Key,
          typename std::decay<Type>::type Value) && /* takes ownership */ {
-    return Context(std::make_shared<Data>(Data{
-        /*Parent=*/std::move(DataPtr), &Key,
-        llvm::make_unique<TypedAnyStorage<typename std::decay<Type>::type>>(
-            std::move(Value))}));
+    return Context(makeData<typename std::decay<Type>::type>(
+        /*Parent=*/std::move(DataPtr), &Key, std::move(Value)));
   }
 
   /// Derives a child context, using an anonymous key.
@@ -153,34 +152,80 @@ public:
   Context clone() const;
 
 private:
-  class AnyStorage {
-  public:
-    virtual ~AnyStorage() = default;
-    virtual void *getValuePtr() = 0;
+  struct Entry {
+    const void *KeyPtr;
+    const void *ValuePtr;
   };
+  /// The number of values that can be found in a node without walking up the
+  /// chain.
+  static const unsigned MaxEntries = 4;
 
-  template <class T> class TypedAnyStorage : public Context::AnyStorage {
-    static_assert(std::is_same<typename std::decay<T>::type, T>::value,
-                  "Argument to TypedAnyStorage must be decayed");
+  struct Data {
+    Data(std::shared_ptr<const Data> Parent, const void *KeyPtr,
+         const void *ValuePtr);
+
+    // We need to make sure Parent outlives the value, so the value is stored
+    // in TypedData, whose members are destroyed before these. We do that to
+    // allow classes stored in Context's child layers to store references to
+    // the data in the parent layers.
+    std::shared_ptr<const Data> Parent;
+    /// The nearest ancestor whose value is not in Entries.
+    const Data *Skip;
+    /// The keys and values of this node and of its closest ancestors, oldest
+    /// first. Lookups of the few innermost keys don't chase pointers.
+    unsigned NumEntries;
+    Entry Entries[MaxEntries];
+  };
 
-  public:
-    TypedAnyStorage(T &&Value) : Value(std::move(Value)) {}
+  template <class T> struct TypedData : Data {
+    static_assert(std::is_same<typename std::decay<T>::type, T>::value,
+                  "Argument to TypedData must be decayed");
 
-    void *getValuePtr() override { return &Value; }
+    TypedData(std::shared_ptr<const Data> Parent, const void *KeyPtr,
+              T &&Value)
+        : Data(std::move(Parent), KeyPtr, &this->Value),
+          Value(std::move(Value)) {}
 
-  private:
     T Value;
   };
 
-  struct Data {
-    // We need to make sure Parent outlives the Value, so the order of members
-    // is important. We do that to allow classes stored in Context's child
-    // layers to store references to the data in the parent layers.
-    std::shared_ptr<const Data> Parent;
-    const void *KeyPtr;
-    std::unique_ptr<AnyStorage> Value;
+  /// Allocates the nodes, and the shared_ptr control blocks along with them,
+  /// from per-thread free lists, so that deriving a context on a hot path
+  /// usually doesn't call malloc().
+  static void *allocate(size_t Size);
+  static void deallocate(void *Ptr, size_t Size);
+
+  template <class T> struct Allocator {
+    using value_type = T;
+
+    Allocator() = default;
+    template <class U> Allocator(const Allocator<U> &) {}
+
+    T *allocate(size_t N) {
+      return static_cast<T *>(Context::allocate(N * sizeof(T)));
+    }
+    void deallocate(T *Ptr, size_t N) {
+      Context::deallocate(Ptr, N * sizeof(T));
+    }
+
+    template <class U> bool operator==(const Allocator<U> &) const {
+      return true;
+    }
+    template <class U> bool operator!=(const Allocator<U> &) const {
+      return false;
+    }
   };
 
+  template <class T>
+  static std::shared_ptr<const Data>
+  makeData(std::shared_ptr<const Data> Parent, const void *KeyPtr, T Value) {
+    static_assert(alignof(TypedData<T>) <= alignof(std::max_align_t),
+                  "Over-aligned values are not supported");
+    return std::allocate_shared<TypedData<T>>(Allocator<TypedData<T>>(),
+                                              std::move(Parent), KeyPtr,
+                                              std::move(Value));
+  }
+
   std::shared_ptr<const Data> DataPtr;
 };
 
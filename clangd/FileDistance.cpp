@@ -29,6 +29,9 @@
 // URIDistance creates FileDistance lazily for each URI scheme encountered. In
 // practice this is a small constant factor.
 //
+// URIDistanceCache keeps a URIDistance per file across requests, so the cost
+// of visiting an index file's ancestors is paid once until the sources change.
+//
 //===-------------------------------------------------------------------------//
 
 #include "FileDistance.h"
@@ -139,6 +142,7 @@ unsigned FileDistance::distance(StringRef Path) {
 }
 
 unsigned URIDistance::distance(llvm::StringRef URI) {
+  std::lock_guard<std::mutex> Lock(Mu);
   auto R = Cache.try_emplace(llvm::hash_value(URI), FileDistance::kUnreachable);
   if (!R.second)
     return R.first->getSecond();
@@ -171,5 +175,44 @@ FileDistance &URIDistance::forScheme(llvm::StringRef Scheme) {
   return *Delegate;
 }
 
+static bool sameSources(const StringMap<SourceParams> &L,
+                        const StringMap<SourceParams> &R) {
+  if (L.size() != R.size())
+    return false;
+  for (const auto &Source : L) {
+    auto It = R.find(Source.getKey());
+    if (It == R.end() || It->second.Cost != Source.second.Cost ||
+        It->second.MaxUpTraversals != Source.second.MaxUpTraversals)
+      return false;
+  }
+  return true;
+}
+
+static bool sameOptions(const FileDistanceOptions &L,
+                        const FileDistanceOptions &R) {
+  return L.UpCost == R.UpCost && L.DownCost == R.DownCost &&
+         L.IncludeCost == R.IncludeCost;
+}
+
+std::shared_ptr<URIDistance>
+URIDistanceCache::get(llvm::StringRef File, StringMap<SourceParams> Sources,
+                      const FileDistanceOptions &Opts) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Entry &E = Entries[File];
+  if (!E.Distance || !sameSources(E.Sources, Sources) ||
+      !sameOptions(E.Opts, Opts)) {
+    LLVM_DEBUG(dbgs() << "New URIDistance for " << File << "\n");
+    E.Distance = std::make_shared<URIDistance>(Sources, Opts);
+    E.Sources = std::move(Sources);
+    E.Opts = Opts;
+  }
+  return E.Distance;
+}
+
+void URIDistanceCache::remove(llvm::StringRef File) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Entries.erase(File);
+}
+
 } // namespace clangd
 } // namespace clang
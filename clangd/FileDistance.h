@@ -37,6 +37,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_FILEDISTANCE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_FILEDISTANCE_H
+
 #include "URI.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseMapInfo.h"
@@ -45,6 +48,8 @@
 #include "llvm/Support/Allocator.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/StringSaver.h"
+#include <memory>
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -84,6 +89,7 @@ private:
 // Supports lookups like FileDistance, but the lookup keys are URIs.
 // We convert each of the sources to the scheme of the URI and do a FileDistance
 // comparison on the bodies.
+// This class is thread-safe, so that it can be shared by concurrent requests.
 class URIDistance {
 public:
   URIDistance(llvm::StringMap<SourceParams> Sources,
@@ -98,6 +104,7 @@ private:
   // Returns the FileDistance for a URI scheme, creating it if needed.
   FileDistance &forScheme(llvm::StringRef Scheme);
 
+  std::mutex Mu;
   // We cache the results using the original strings so we can skip URI parsing.
   llvm::DenseMap<llvm::hash_code, unsigned> Cache;
   llvm::StringMap<SourceParams> Sources;
@@ -105,5 +112,32 @@ private:
   FileDistanceOptions Opts;
 };
 
+// Keeps the URIDistance of each open file, so that the distances computed for
+// one request are reused by the next ones. A file's URIDistance is replaced
+// when its sources (e.g. its includes) change.
+// This class is thread-safe.
+class URIDistanceCache {
+public:
+  // Returns the URIDistance for \p File from \p Sources, reusing the one
+  // returned last time if it was for the same sources and options.
+  std::shared_ptr<URIDistance> get(llvm::StringRef File,
+                                   llvm::StringMap<SourceParams> Sources,
+                                   const FileDistanceOptions &Opts = {});
+  // Forgets the URIDistance of \p File.
+  void remove(llvm::StringRef File);
+
+private:
+  struct Entry {
+    llvm::StringMap<SourceParams> Sources;
+    FileDistanceOptions Opts;
+    std::shared_ptr<URIDistance> Distance;
+  };
+
+  std::mutex Mu;
+  llvm::StringMap<Entry> Entries;
+};
+
 } // namespace clangd
 } // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_FILEDISTANCE_H
@@ -14,6 +14,7 @@
 #include "Logger.h"
 #include "Quality.h"
 #include "SourceCode.h"
+#include "URITable.h"
 #include "index/Index.h"
 #include "clang/Index/IndexDataConsumer.h"
 #include "clang/Index/IndexSymbol.h"
@@ -87,12 +88,21 @@ SymbolKind indexSymbolKindToSymbolKind(index::SymbolKind Kind) {
   llvm_unreachable("invalid symbol kind");
 }
 
-using ScoredSymbolInfo = std::pair<float, SymbolInformation>;
+// A candidate for a workspace symbol, which only becomes a SymbolInformation
+// if it ranks among the top results, as resolving its URI is expensive.
+struct ScoredSymbol {
+  float Score;
+  std::string Name;
+  std::string Scope;
+  index::SymbolKind Kind;
+  std::string FileURI;
+  SymbolLocation::Position Start, End;
+};
 struct ScoredSymbolGreater {
-  bool operator()(const ScoredSymbolInfo &L, const ScoredSymbolInfo &R) {
-    if (L.first != R.first)
-      return L.first > R.first;
-    return L.second.name < R.second.name; // Earlier name is better.
+  bool operator()(const ScoredSymbol &L, const ScoredSymbol &R) {
+    if (L.Score != R.Score)
+      return L.Score > R.Score;
+    return L.Name < R.Name; // Earlier name is better.
   }
 };
 
@@ -113,44 +123,16 @@ getWorkspaceSymbols(StringRef Query, int Limit, const SymbolIndex *const Index,
   // FuzzyFind doesn't want leading :: qualifier
   bool IsGlobalQuery = Names.first.consume_front("::");
   // Restrict results to the scope in the query string if present (global or
-  // not).
+  // not). A scope that is not fully qualified, like "b::" in "b::Foo", also
+  // matches the nested scope "a::b::".
   if (IsGlobalQuery || !Names.first.empty())
     Req.Scopes = {Names.first};
+  Req.MatchScopeSuffix = !IsGlobalQuery;
   if (Limit)
     Req.MaxCandidateCount = Limit;
-  TopN<ScoredSymbolInfo, ScoredSymbolGreater> Top(Req.MaxCandidateCount);
+  TopN<ScoredSymbol, ScoredSymbolGreater> Top(Req.MaxCandidateCount);
   FuzzyMatcher Filter(Req.Query);
-  Index->fuzzyFind(Req, [HintPath, &Top, &Filter](const Symbol &Sym) {
-    // Prefer the definition over e.g. a function declaration in a header
-    auto &CD = Sym.Definition ? Sym.Definition : Sym.CanonicalDeclaration;
-    auto Uri = URI::parse(CD.FileURI);
-    if (!Uri) {
-      log(llvm::formatv(
-          "Workspace symbol: Could not parse URI '{0}' for symbol '{1}'.",
-          CD.FileURI, Sym.Name));
-      return;
-    }
-    auto Path = URI::resolve(*Uri, HintPath);
-    if (!Path) {
-      log(llvm::formatv("Workspace symbol: Could not resolve path for URI "
-                        "'{0}' for symbol '{1}'.",
-                        (*Uri).toString(), Sym.Name.str()));
-      return;
-    }
-    Location L;
-    L.uri = URIForFile((*Path));
-    Position Start, End;
-    Start.line = CD.Start.Line;
-    Start.character = CD.Start.Column;
-    End.line = CD.End.Line;
-    End.character = CD.End.Column;
-    L.range = {Start, End};
-    SymbolKind SK = indexSymbolKindToSymbolKind(Sym.SymInfo.Kind);
-    std::string Scope = Sym.Scope;
-    StringRef ScopeRef = Scope;
-    ScopeRef.consume_back("::");
-    SymbolInformation Info = {Sym.Name, SK, L, ScopeRef};
-
+  Index->fuzzyFind(Req, [&Top, &Filter](const Symbol &Sym) {
     SymbolQualitySignals Quality;
     Quality.merge(Sym);
     SymbolRelevanceSignals Relevance;
@@ -169,10 +151,35 @@ getWorkspaceSymbols(StringRef Query, int Limit, const SymbolIndex *const Index,
                             << Score << "\n"
                             << Quality << Relevance << "\n");
 
-    Top.push({Score, std::move(Info)});
+    // Prefer the definition over e.g. a function declaration in a header
+    auto &CD = Sym.Definition ? Sym.Definition : Sym.CanonicalDeclaration;
+    Top.push({Score, Sym.Name, Sym.Scope, Sym.SymInfo.Kind, CD.FileURI,
+              CD.Start, CD.End});
   });
-  for (auto &R : std::move(Top).items())
-    Result.push_back(std::move(R.second));
+
+  URITable URIs(HintPath);
+  for (auto &Sym : std::move(Top).items()) {
+    auto File = URIs.uriForFile(URIs.intern(Sym.FileURI));
+    if (!File) {
+      log(llvm::formatv("Workspace symbol: Could not resolve path for URI "
+                        "'{0}' for symbol '{1}': {2}",
+                        Sym.FileURI, Sym.Name,
+                        llvm::toString(File.takeError())));
+      continue;
+    }
+    Location L;
+    L.uri = *File;
+    Position Start, End;
+    Start.line = Sym.Start.Line;
+    Start.character = Sym.Start.Column;
+    End.line = Sym.End.Line;
+    End.character = Sym.End.Column;
+    L.range = {Start, End};
+    SymbolKind SK = indexSymbolKindToSymbolKind(Sym.Kind);
+    StringRef ScopeRef = Sym.Scope;
+    ScopeRef.consume_back("::");
+    Result.push_back({std::move(Sym.Name), SK, L, ScopeRef});
+  }
   return Result;
 }
 
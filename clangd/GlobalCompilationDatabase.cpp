@@ -9,12 +9,31 @@
 
 #include "GlobalCompilationDatabase.h"
 #include "Logger.h"
+#include "MappedCompilationDatabase.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 
 namespace clang {
 namespace clangd {
+namespace {
+
+bool isInDirectory(PathRef File, PathRef Dir) {
+  if (Dir.empty())
+    return true;
+  return File.startswith(Dir) && File.size() > Dir.size() &&
+         llvm::sys::path::is_separator(File[Dir.size()]);
+}
+
+bool sameCommand(const llvm::Optional<tooling::CompileCommand> &LHS,
+                 const llvm::Optional<tooling::CompileCommand> &RHS) {
+  if (!LHS || !RHS)
+    return !LHS && !RHS;
+  return LHS->Directory == RHS->Directory &&
+         LHS->CommandLine == RHS->CommandLine;
+}
+
+} // namespace
 
 tooling::CompileCommand
 GlobalCompilationDatabase::getFallbackCommand(PathRef File) const {
@@ -30,6 +49,16 @@ GlobalCompilationDatabase::getFallbackCommand(PathRef File) const {
                                  /*Output=*/"");
 }
 
+llvm::Optional<Path>
+GlobalCompilationDatabase::getProjectRoot(PathRef File) const {
+  return llvm::None;
+}
+
+std::vector<tooling::CompileCommand>
+GlobalCompilationDatabase::getAllCompileCommands(PathRef ProjectRoot) const {
+  return {};
+}
+
 DirectoryBasedGlobalCompilationDatabase::
     DirectoryBasedGlobalCompilationDatabase(
         llvm::Optional<Path> CompileCommandsDir)
@@ -60,6 +89,33 @@ DirectoryBasedGlobalCompilationDatabase::getFallbackCommand(
   return C;
 }
 
+llvm::Optional<Path>
+DirectoryBasedGlobalCompilationDatabase::getProjectRoot(PathRef File) const {
+  Path CDBDir;
+  if (!getCDBForFile(File, &CDBDir))
+    return llvm::None;
+  return CDBDir;
+}
+
+std::vector<tooling::CompileCommand>
+DirectoryBasedGlobalCompilationDatabase::getAllCompileCommands(
+    PathRef ProjectRoot) const {
+  tooling::CompilationDatabase *CDB;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    CDB = getCDBInDirLocked(ProjectRoot);
+  }
+  if (!CDB)
+    return {};
+  auto Commands = CDB->getAllCompileCommands();
+  for (auto &Command : Commands) {
+    llvm::SmallString<128> File(Command.Filename);
+    llvm::sys::fs::make_absolute(Command.Directory, File);
+    addExtraFlags(File, Command);
+  }
+  return Commands;
+}
+
 void DirectoryBasedGlobalCompilationDatabase::setCompileCommandsDir(Path P) {
   std::lock_guard<std::mutex> Lock(Mutex);
   CompileCommandsDir = P;
@@ -72,6 +128,29 @@ void DirectoryBasedGlobalCompilationDatabase::setExtraFlagsForFile(
   ExtraFlagsForFile[File] = std::move(ExtraFlags);
 }
 
+llvm::Optional<Path>
+DirectoryBasedGlobalCompilationDatabase::compilationDatabaseChanged(
+    PathRef File) {
+  StringRef Name = llvm::sys::path::filename(File);
+  if (Name != "compile_commands.json" && Name != "compile_flags.txt")
+    return llvm::None;
+  StringRef Dir = llvm::sys::path::parent_path(File);
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (CompileCommandsDir) {
+    if (Dir != *CompileCommandsDir)
+      return llvm::None;
+    CompilationDatabases.erase(Dir);
+    return Path();
+  }
+  // Files are only looked up in directories that were already searched, so a
+  // directory that is not cached can't affect any file yet.
+  if (!CompilationDatabases.erase(Dir))
+    return llvm::None;
+  log("Compilation database in " + Dir + " changed");
+  return Dir.str();
+}
+
 void DirectoryBasedGlobalCompilationDatabase::addExtraFlags(
     PathRef File, tooling::CompileCommand &C) const {
   std::lock_guard<std::mutex> Lock(Mutex);
@@ -89,12 +168,14 @@ void DirectoryBasedGlobalCompilationDatabase::addExtraFlags(
 
 tooling::CompilationDatabase *
 DirectoryBasedGlobalCompilationDatabase::getCDBInDirLocked(PathRef Dir) const {
-  // FIXME(ibiryukov): Invalidate cached compilation databases on changes
   auto CachedIt = CompilationDatabases.find(Dir);
   if (CachedIt != CompilationDatabases.end())
     return CachedIt->second.get();
   std::string Error = "";
-  auto CDB = tooling::CompilationDatabase::loadFromDirectory(Dir, Error);
+  std::unique_ptr<tooling::CompilationDatabase> CDB =
+      MappedCompilationDatabase::loadFromDirectory(Dir, Error);
+  if (!CDB)
+    CDB = tooling::CompilationDatabase::loadFromDirectory(Dir, Error);
   if (CDB)
     CDB = tooling::inferMissingCompileCommands(std::move(CDB));
   auto Result = CDB.get();
@@ -103,19 +184,26 @@ DirectoryBasedGlobalCompilationDatabase::getCDBInDirLocked(PathRef Dir) const {
 }
 
 tooling::CompilationDatabase *
-DirectoryBasedGlobalCompilationDatabase::getCDBForFile(PathRef File) const {
+DirectoryBasedGlobalCompilationDatabase::getCDBForFile(PathRef File,
+                                                       Path *CDBDir) const {
   namespace path = llvm::sys::path;
   assert((path::is_absolute(File, path::Style::posix) ||
           path::is_absolute(File, path::Style::windows)) &&
          "path must be absolute");
 
   std::lock_guard<std::mutex> Lock(Mutex);
-  if (CompileCommandsDir)
+  if (CompileCommandsDir) {
+    if (CDBDir)
+      *CDBDir = *CompileCommandsDir;
     return getCDBInDirLocked(*CompileCommandsDir);
+  }
   for (auto Path = path::parent_path(File); !Path.empty();
        Path = path::parent_path(Path))
-    if (auto CDB = getCDBInDirLocked(Path))
+    if (auto CDB = getCDBInDirLocked(Path)) {
+      if (CDBDir)
+        *CDBDir = Path.str();
       return CDB;
+    }
   return nullptr;
 }
 
@@ -142,6 +230,16 @@ CachingCompilationDb::getFallbackCommand(PathRef File) const {
   return InnerCDB.getFallbackCommand(File);
 }
 
+llvm::Optional<Path>
+CachingCompilationDb::getProjectRoot(PathRef File) const {
+  return InnerCDB.getProjectRoot(File);
+}
+
+std::vector<tooling::CompileCommand>
+CachingCompilationDb::getAllCompileCommands(PathRef ProjectRoot) const {
+  return InnerCDB.getAllCompileCommands(ProjectRoot);
+}
+
 void CachingCompilationDb::invalidate(PathRef File) {
   std::unique_lock<std::mutex> Lock(Mut);
   Cached.erase(File);
@@ -152,5 +250,30 @@ void CachingCompilationDb::clear() {
   Cached.clear();
 }
 
+std::vector<Path> CachingCompilationDb::reloadDirectory(PathRef Dir) {
+  std::vector<std::pair<Path, llvm::Optional<tooling::CompileCommand>>>
+      OldCommands;
+  {
+    std::lock_guard<std::mutex> Lock(Mut);
+    for (const auto &Entry : Cached)
+      if (isInDirectory(Entry.first(), Dir))
+        OldCommands.emplace_back(Entry.first(), Entry.second);
+  }
+
+  std::vector<Path> Changed;
+  for (auto &Old : OldCommands) {
+    llvm::Optional<tooling::CompileCommand> Command =
+        InnerCDB.getCompileCommand(Old.first);
+    if (sameCommand(Old.second, Command))
+      continue;
+    {
+      std::lock_guard<std::mutex> Lock(Mut);
+      Cached[Old.first] = std::move(Command);
+    }
+    Changed.push_back(std::move(Old.first));
+  }
+  return Changed;
+}
+
 } // namespace clangd
 } // namespace clang
@@ -41,6 +41,16 @@ public:
   /// Clangd should treat the results as unreliable.
   virtual tooling::CompileCommand getFallbackCommand(PathRef File) const;
 
+  /// Returns the directory of the compilation database that \p File belongs
+  /// to, if there is one. The default implementation returns None.
+  virtual llvm::Optional<Path> getProjectRoot(PathRef File) const;
+
+  /// Returns the commands for all files in the compilation database found in
+  /// \p ProjectRoot, as returned by getProjectRoot().
+  /// The default implementation returns nothing.
+  virtual std::vector<tooling::CompileCommand>
+  getAllCompileCommands(PathRef ProjectRoot) const;
+
   /// FIXME(ibiryukov): add facilities to track changes to compilation flags of
   /// existing targets.
 };
@@ -62,20 +72,36 @@ public:
   /// Uses the default fallback command, adding any extra flags.
   tooling::CompileCommand getFallbackCommand(PathRef File) const override;
 
+  llvm::Optional<Path> getProjectRoot(PathRef File) const override;
+
+  /// Lists the commands from the database, adding any extra flags.
+  std::vector<tooling::CompileCommand>
+  getAllCompileCommands(PathRef ProjectRoot) const override;
+
   /// Set the compile commands directory to \p P.
   void setCompileCommandsDir(Path P);
 
   /// Sets the extra flags that should be added to a file.
   void setExtraFlagsForFile(PathRef File, std::vector<std::string> ExtraFlags);
 
+  /// Called when \p File changed on disk. If it is a compile_commands.json or
+  /// compile_flags.txt, the cached database of its directory is dropped, so
+  /// that it is loaded again on next use.
+  /// Returns the directory that contains the files whose commands may have
+  /// changed, or None if there are none. An empty path means all files.
+  llvm::Optional<Path> compilationDatabaseChanged(PathRef File);
+
 private:
-  tooling::CompilationDatabase *getCDBForFile(PathRef File) const;
+  /// If \p CDBDir is not null, it is set to the directory of the result.
+  tooling::CompilationDatabase *getCDBForFile(PathRef File,
+                                              Path *CDBDir = nullptr) const;
   tooling::CompilationDatabase *getCDBInDirLocked(PathRef File) const;
   void addExtraFlags(PathRef File, tooling::CompileCommand &C) const;
 
   mutable std::mutex Mutex;
   /// Caches compilation databases loaded from directories(keys are
-  /// directories).
+  /// directories). Directories without a database are cached as null, until
+  /// one is created in them.
   mutable llvm::StringMap<std::unique_ptr<clang::tooling::CompilationDatabase>>
       CompilationDatabases;
 
@@ -100,12 +126,23 @@ public:
   /// Forwards to the inner CDB. Results of this function are not cached.
   tooling::CompileCommand getFallbackCommand(PathRef File) const override;
 
+  /// Forwards to the inner CDB. Results of this function are not cached.
+  llvm::Optional<Path> getProjectRoot(PathRef File) const override;
+
+  /// Forwards to the inner CDB. Results of this function are not cached.
+  std::vector<tooling::CompileCommand>
+  getAllCompileCommands(PathRef ProjectRoot) const override;
+
   /// Removes an entry for \p File if it's present in the cache.
   void invalidate(PathRef File);
 
   /// Removes all cached compile commands.
   void clear();
 
+  /// Reloads the cached commands of the files in \p Dir, or of all files if
+  /// \p Dir is empty. Returns the files whose commands changed.
+  std::vector<Path> reloadDirectory(PathRef Dir);
+
 private:
   const GlobalCompilationDatabase &InnerCDB;
   mutable std::mutex Mut;
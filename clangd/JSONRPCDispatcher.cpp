@@ -86,6 +86,15 @@ void JSONOutput::mirrorInput(const Twine &Message) {
   InputMirror->flush();
 }
 
+void JSONOutput::mirrorInputTime() {
+  if (!InputMirror || !MirrorTimes)
+    return;
+
+  auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - MirrorStart);
+  *InputMirror << "X-Clangd-Time: " << Elapsed.count() << "\r\n";
+}
+
 void clangd::reply(json::Expr &&Result) {
   auto ID = Context::current().get(RequestID);
   if (!ID) {
@@ -137,6 +146,16 @@ void clangd::call(StringRef Method, json::Expr &&Params) {
       });
 }
 
+void clangd::notify(StringRef Method, json::Expr &&Params) {
+  Context::current()
+      .getExisting(RequestOut)
+      ->writeMessage(json::obj{
+          {"jsonrpc", "2.0"},
+          {"method", Method},
+          {"params", std::move(Params)},
+      });
+}
+
 void JSONRPCDispatcher::registerHandler(StringRef Method, Handler H) {
   assert(!Handlers.count(Method) && "Handler already registered!");
   Handlers[Method] = std::move(H);
@@ -213,10 +232,14 @@ static llvm::Optional<std::string> readStandardMessage(std::FILE *In,
   // delimited  by \r\n, and terminated by an empty line (\r\n).
   unsigned long long ContentLength = 0;
   std::string Line;
+  bool FirstLine = true;
   while (true) {
     if (feof(In) || ferror(In) || !readLine(In, Line))
       return llvm::None;
 
+    if (FirstLine)
+      Out.mirrorInputTime();
+    FirstLine = false;
     Out.mirrorInput(Line);
     llvm::StringRef LineRef(Line);
 
@@ -298,6 +321,7 @@ static llvm::Optional<std::string> readDelimitedMessage(std::FILE *In,
     log("Input error while reading message!");
     return llvm::None;
   } else { // Including EOF
+    Out.mirrorInputTime();
     Out.mirrorInput(
         llvm::formatv("Content-Length: {0}\r\n\r\n{1}", JSON.size(), JSON));
     return std::move(JSON);
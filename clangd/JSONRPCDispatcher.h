@@ -17,6 +17,7 @@
 #include "clang/Basic/LLVM.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringMap.h"
+#include <chrono>
 #include <iosfwd>
 #include <mutex>
 
@@ -30,8 +31,11 @@ class JSONOutput : public Logger {
   // JSONOutput now that we pass Context everywhere.
 public:
   JSONOutput(llvm::raw_ostream &Outs, llvm::raw_ostream &Logs,
-             llvm::raw_ostream *InputMirror = nullptr, bool Pretty = false)
-      : Pretty(Pretty), Outs(Outs), Logs(Logs), InputMirror(InputMirror) {}
+             llvm::raw_ostream *InputMirror = nullptr, bool Pretty = false,
+             bool MirrorTimes = false)
+      : Pretty(Pretty), Outs(Outs), Logs(Logs), InputMirror(InputMirror),
+        MirrorTimes(MirrorTimes),
+        MirrorStart(std::chrono::steady_clock::now()) {}
 
   /// Emit a JSONRPC message.
   void writeMessage(const json::Expr &Result);
@@ -43,6 +47,12 @@ public:
   /// null.
   /// Unlike other methods of JSONOutput, mirrorInput is not thread-safe.
   void mirrorInput(const Twine &Message);
+  /// Mirror the time at which a message started arriving, as an
+  /// "X-Clangd-Time" header with the milliseconds since the mirror was
+  /// opened. Recordings can then be replayed with their original timing.
+  /// Does nothing unless MirrorTimes was set, so that by default the mirror is
+  /// a byte for byte copy of the input.
+  void mirrorInputTime();
 
   // Whether output should be pretty-printed.
   const bool Pretty;
@@ -51,6 +61,8 @@ private:
   llvm::raw_ostream &Outs;
   llvm::raw_ostream &Logs;
   llvm::raw_ostream *InputMirror;
+  const bool MirrorTimes;
+  std::chrono::steady_clock::time_point MirrorStart;
 
   std::mutex StreamMutex;
 };
@@ -64,6 +76,9 @@ void replyError(ErrorCode code, const llvm::StringRef &Message);
 /// Sends a request to the client.
 /// Current context must derive from JSONRPCDispatcher::Handler.
 void call(llvm::StringRef Method, json::Expr &&Params);
+/// Sends a notification to the client.
+/// Current context must derive from JSONRPCDispatcher::Handler.
+void notify(llvm::StringRef Method, json::Expr &&Params);
 
 /// Main JSONRPC entry point. This parses the JSONRPC "header" and calls the
 /// registered Handler for the method received.
@@ -0,0 +1,359 @@
+//===--- MappedCompilationDatabase.cpp ---------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MappedCompilationDatabase.h"
+#include "JSONExpr.h"
+#include "Logger.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ConvertUTF.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+
+namespace {
+
+// Finds the structure of JSON data without validating or decoding it, except
+// for the strings that are asked for.
+class Scanner {
+public:
+  Scanner(StringRef Data) : Data(Data) {}
+
+  size_t position() {
+    skipSpace();
+    return Pos;
+  }
+  bool atEnd() { return position() == Data.size(); }
+
+  bool consume(char C) {
+    if (position() == Data.size() || Data[Pos] != C)
+      return false;
+    ++Pos;
+    return true;
+  }
+
+  bool readString(std::string &Out) {
+    if (!consume('"'))
+      return false;
+    Out.clear();
+    while (Pos < Data.size()) {
+      char C = Data[Pos++];
+      if (C == '"')
+        return true;
+      if (C != '\\') {
+        Out.push_back(C);
+        continue;
+      }
+      if (Pos == Data.size())
+        return false;
+      switch (char Escaped = Data[Pos++]) {
+      case '"':
+      case '\\':
+      case '/':
+        Out.push_back(Escaped);
+        break;
+      case 'b':
+        Out.push_back('\b');
+        break;
+      case 'f':
+        Out.push_back('\f');
+        break;
+      case 'n':
+        Out.push_back('\n');
+        break;
+      case 'r':
+        Out.push_back('\r');
+        break;
+      case 't':
+        Out.push_back('\t');
+        break;
+      case 'u': {
+        unsigned CodePoint;
+        if (!readHex4(CodePoint))
+          return false;
+        // Combine a UTF-16 surrogate pair.
+        unsigned Low;
+        if (CodePoint >= 0xD800 && CodePoint < 0xDC00 &&
+            Data.substr(Pos).startswith("\\u")) {
+          Pos += 2;
+          if (!readHex4(Low) || Low < 0xDC00 || Low >= 0xE000)
+            return false;
+          CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+        }
+        char Buf[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+        char *End = Buf;
+        if (!ConvertCodePointToUTF8(CodePoint, End))
+          return false;
+        Out.append(Buf, End);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+    return false;
+  }
+
+  bool skipValue() {
+    if (position() == Data.size())
+      return false;
+    if (Data[Pos] == '"')
+      return skipString();
+    if (Data[Pos] != '{' && Data[Pos] != '[') {
+      // A number or a literal.
+      size_t End =
+          std::min(Data.find_first_of(",]} \t\r\n", Pos), Data.size());
+      if (End == Pos)
+        return false;
+      Pos = End;
+      return true;
+    }
+    unsigned Depth = 0;
+    while (Pos < Data.size()) {
+      char C = Data[Pos];
+      if (C == '"') {
+        if (!skipString())
+          return false;
+        continue;
+      }
+      ++Pos;
+      if (C == '{' || C == '[')
+        ++Depth;
+      else if ((C == '}' || C == ']') && --Depth == 0)
+        return true;
+    }
+    return false;
+  }
+
+private:
+  void skipSpace() {
+    while (Pos < Data.size() && (Data[Pos] == ' ' || Data[Pos] == '\t' ||
+                                 Data[Pos] == '\n' || Data[Pos] == '\r'))
+      ++Pos;
+  }
+
+  bool skipString() {
+    ++Pos;
+    while (Pos < Data.size()) {
+      char C = Data[Pos++];
+      if (C == '"')
+        return true;
+      if (C == '\\')
+        ++Pos;
+    }
+    return false;
+  }
+
+  bool readHex4(unsigned &Out) {
+    if (Pos + 4 > Data.size() ||
+        Data.substr(Pos, 4).getAsInteger(/*Radix=*/16, Out))
+      return false;
+    Pos += 4;
+    return true;
+  }
+
+  StringRef Data;
+  size_t Pos = 0;
+};
+
+std::string normalizePath(StringRef Directory, StringRef File) {
+  SmallString<128> Path;
+  if (!sys::path::is_absolute(File))
+    Path = Directory;
+  sys::path::append(Path, File);
+  sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  sys::path::native(Path);
+  return Path.str().str();
+}
+
+} // namespace
+
+std::unique_ptr<MappedCompilationDatabase>
+MappedCompilationDatabase::loadFromDirectory(StringRef Directory,
+                                             std::string &Error) {
+  SmallString<128> Path = Directory;
+  sys::path::append(Path, "compile_commands.json");
+  return loadFromFile(Path, Error);
+}
+
+std::unique_ptr<MappedCompilationDatabase>
+MappedCompilationDatabase::loadFromFile(StringRef FilePath,
+                                        std::string &Error) {
+  // Large files are memory-mapped, so that only the parts that are read
+  // become resident.
+  auto Buffer = MemoryBuffer::getFile(FilePath, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    Error = "Can't read " + FilePath.str() + ": " +
+            Buffer.getError().message();
+    return nullptr;
+  }
+  std::unique_ptr<MappedCompilationDatabase> CDB(
+      new MappedCompilationDatabase(std::move(*Buffer)));
+  if (!CDB->scan(Error)) {
+    Error = FilePath.str() + ": " + Error;
+    return nullptr;
+  }
+  return CDB;
+}
+
+bool MappedCompilationDatabase::scan(std::string &Error) {
+  StringRef Data = Buffer->getBuffer();
+  if (Data.size() > UINT32_MAX) {
+    Error = "the compilation database is too large";
+    return false;
+  }
+  Scanner S(Data);
+  auto Fail = [&](StringRef Msg) {
+    Error = formatv("{0} at offset {1}", Msg, S.position()).str();
+    return false;
+  };
+
+  if (!S.consume('['))
+    return Fail("expected an array of entries");
+  std::string Key, File, Directory;
+  if (!S.consume(']')) {
+    do {
+      uint32_t Begin = S.position();
+      if (!S.consume('{'))
+        return Fail("expected an entry");
+      File.clear();
+      Directory.clear();
+      if (!S.consume('}')) {
+        do {
+          if (!S.readString(Key) || !S.consume(':'))
+            return Fail("expected a key");
+          if (Key == "file" || Key == "directory") {
+            if (!S.readString(Key == "file" ? File : Directory))
+              return Fail("expected a string");
+          } else if (!S.skipValue()) {
+            return Fail("expected a value");
+          }
+        } while (S.consume(','));
+        if (!S.consume('}'))
+          return Fail("expected the end of the entry");
+      }
+      Entries.push_back({Begin, static_cast<uint32_t>(S.position() - Begin)});
+      if (!File.empty())
+        EntriesForFile[normalizePath(Directory, File)].push_back(
+            Entries.size() - 1);
+    } while (S.consume(','));
+    if (!S.consume(']'))
+      return Fail("expected the end of the entries");
+  }
+  if (!S.atEnd())
+    return Fail("unexpected data after the entries");
+  return true;
+}
+
+StringRef MappedCompilationDatabase::internLocked(StringRef S) const {
+  auto R = Strings.insert(S);
+  if (R.second) // New entry added to the table, copy the string.
+    *R.first = S.copy(Arena);
+  return *R.first;
+}
+
+Optional<MappedCompilationDatabase::ParsedEntry>
+MappedCompilationDatabase::parseLocked(uint32_t Entry) const {
+  StringRef Text = Buffer->getBuffer().substr(Entries[Entry].Offset,
+                                              Entries[Entry].Length);
+  auto JSON = json::parse(Text);
+  if (!JSON) {
+    log("Malformed compilation database entry: " +
+        llvm::toString(JSON.takeError()));
+    return None;
+  }
+  const json::obj *O = JSON->asObject();
+  if (!O)
+    return None;
+  auto Directory = O->getString("directory");
+  auto File = O->getString("file");
+  if (!Directory || !File)
+    return None;
+
+  ParsedEntry Result;
+  Result.Directory = internLocked(*Directory);
+  Result.Filename = internLocked(*File);
+  if (auto Output = O->getString("output"))
+    Result.Output = internLocked(*Output);
+  if (const json::ary *Arguments = O->getArray("arguments")) {
+    for (const json::Expr &Argument : *Arguments) {
+      auto Arg = Argument.asString();
+      if (!Arg)
+        return None;
+      Result.CommandLine.push_back(internLocked(*Arg));
+    }
+  } else if (auto Command = O->getString("command")) {
+    BumpPtrAllocator Scratch;
+    StringSaver Saver(Scratch);
+    SmallVector<const char *, 64> Argv;
+#ifdef _WIN32
+    cl::TokenizeWindowsCommandLine(*Command, Saver, Argv);
+#else
+    cl::TokenizeGNUCommandLine(*Command, Saver, Argv);
+#endif
+    for (const char *Arg : Argv)
+      Result.CommandLine.push_back(internLocked(Arg));
+  } else {
+    return None;
+  }
+  return std::move(Result);
+}
+
+tooling::CompileCommand
+MappedCompilationDatabase::toCommand(const ParsedEntry &Entry) {
+  std::vector<std::string> CommandLine;
+  CommandLine.reserve(Entry.CommandLine.size());
+  for (StringRef Arg : Entry.CommandLine)
+    CommandLine.push_back(Arg.str());
+  return tooling::CompileCommand(Entry.Directory, Entry.Filename,
+                                 std::move(CommandLine), Entry.Output);
+}
+
+std::vector<tooling::CompileCommand>
+MappedCompilationDatabase::getCompileCommands(StringRef FilePath) const {
+  auto It = EntriesForFile.find(normalizePath("", FilePath));
+  if (It == EntriesForFile.end())
+    return {};
+  std::vector<tooling::CompileCommand> Commands;
+  std::lock_guard<std::mutex> Lock(Mu);
+  for (uint32_t Entry : It->second) {
+    auto Cached = Parsed.find(Entry);
+    if (Cached == Parsed.end())
+      Cached = Parsed.insert({Entry, parseLocked(Entry)}).first;
+    if (Cached->second)
+      Commands.push_back(toCommand(*Cached->second));
+  }
+  return Commands;
+}
+
+std::vector<std::string> MappedCompilationDatabase::getAllFiles() const {
+  std::vector<std::string> Files;
+  Files.reserve(EntriesForFile.size());
+  for (const auto &Entry : EntriesForFile)
+    Files.push_back(Entry.first().str());
+  return Files;
+}
+
+std::vector<tooling::CompileCommand>
+MappedCompilationDatabase::getAllCompileCommands() const {
+  std::vector<tooling::CompileCommand> Commands;
+  Commands.reserve(Entries.size());
+  std::lock_guard<std::mutex> Lock(Mu);
+  for (uint32_t Entry = 0; Entry < Entries.size(); ++Entry)
+    if (auto Result = parseLocked(Entry))
+      Commands.push_back(toCommand(*Result));
+  return Commands;
+}
+
+} // namespace clangd
+} // namespace clang
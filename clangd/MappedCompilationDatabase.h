@@ -0,0 +1,97 @@
+//===--- MappedCompilationDatabase.h -----------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A compilation database for large compile_commands.json files.
+//
+// tooling::JSONCompilationDatabase parses the whole file up front and keeps
+// every entry in memory. This one maps the file, only records where each
+// entry is and which file it is for, and parses an entry when its command is
+// first requested.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_MAPPEDCOMPILATIONDATABASE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_MAPPEDCOMPILATIONDATABASE_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <mutex>
+
+namespace clang {
+namespace clangd {
+
+class MappedCompilationDatabase : public tooling::CompilationDatabase {
+public:
+  /// Loads compile_commands.json from \p Directory. Returns null and sets
+  /// \p Error if it does not exist or is malformed.
+  static std::unique_ptr<MappedCompilationDatabase>
+  loadFromDirectory(llvm::StringRef Directory, std::string &Error);
+
+  static std::unique_ptr<MappedCompilationDatabase>
+  loadFromFile(llvm::StringRef FilePath, std::string &Error);
+
+  /// Returns the commands for \p FilePath. Its entries are parsed on first
+  /// use, and kept afterwards.
+  std::vector<tooling::CompileCommand>
+  getCompileCommands(llvm::StringRef FilePath) const override;
+
+  std::vector<std::string> getAllFiles() const override;
+
+  /// Parses every entry. The results are not kept.
+  std::vector<tooling::CompileCommand> getAllCompileCommands() const override;
+
+private:
+  /// An entry whose strings are owned by the arena.
+  struct ParsedEntry {
+    llvm::StringRef Directory;
+    llvm::StringRef Filename;
+    llvm::StringRef Output;
+    std::vector<llvm::StringRef> CommandLine;
+  };
+  /// The range of an entry in the buffer.
+  struct EntryRange {
+    uint32_t Offset;
+    uint32_t Length;
+  };
+
+  MappedCompilationDatabase(std::unique_ptr<llvm::MemoryBuffer> Buffer)
+      : Buffer(std::move(Buffer)) {}
+
+  /// Finds the entries in the buffer without parsing their commands.
+  bool scan(std::string &Error);
+  /// Returns None if the entry is malformed. Mu must be held.
+  llvm::Optional<ParsedEntry> parseLocked(uint32_t Entry) const;
+  llvm::StringRef internLocked(llvm::StringRef S) const;
+  static tooling::CompileCommand toCommand(const ParsedEntry &Entry);
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  std::vector<EntryRange> Entries;
+  /// The entries of each file, keyed by its absolute native path.
+  llvm::StringMap<llvm::SmallVector<uint32_t, 1>> EntriesForFile;
+
+  mutable std::mutex Mu;
+  /// Strings are interned, so the many arguments that entries have in common
+  /// are only stored once.
+  mutable llvm::BumpPtrAllocator Arena;
+  mutable llvm::DenseSet<llvm::StringRef> Strings;
+  /// The entries that were requested so far. Malformed entries are None.
+  mutable llvm::DenseMap<uint32_t, llvm::Optional<ParsedEntry>> Parsed;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_MAPPEDCOMPILATIONDATABASE_H
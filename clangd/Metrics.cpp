@@ -0,0 +1,227 @@
+//===--- Metrics.cpp - Aggregated performance metrics ---------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Metrics.h"
+#include "Logger.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cmath>
+
+namespace clang {
+namespace clangd {
+namespace trace {
+using namespace llvm;
+
+constexpr unsigned Histogram::SubBucketBits;
+constexpr unsigned Histogram::MaxExponent;
+constexpr unsigned Histogram::NumBuckets;
+
+Histogram::Histogram() : Buckets(new std::atomic<uint64_t>[NumBuckets]) {
+  for (unsigned I = 0; I < NumBuckets; ++I)
+    Buckets[I] = 0;
+}
+
+unsigned Histogram::bucketFor(uint64_t Micros) {
+  Micros = std::min(Micros, (uint64_t(2) << MaxExponent) - 1);
+  if (Micros < (1u << SubBucketBits))
+    return Micros;
+  unsigned Exponent = Log2_64(Micros);
+  uint64_t SubBucket = Micros >> (Exponent - SubBucketBits);
+  // SubBucket is in [2^SubBucketBits, 2^(SubBucketBits+1)).
+  return ((Exponent - SubBucketBits) << SubBucketBits) + SubBucket;
+}
+
+uint64_t Histogram::lowerBound(unsigned Bucket) {
+  if (Bucket < (2u << SubBucketBits))
+    return Bucket;
+  unsigned Exponent = (Bucket >> SubBucketBits) - 1 + SubBucketBits;
+  uint64_t SubBucket =
+      (1u << SubBucketBits) + (Bucket & ((1u << SubBucketBits) - 1));
+  return SubBucket << (Exponent - SubBucketBits);
+}
+
+void Histogram::record(double Value) {
+  uint64_t Micros = Value > 0 ? static_cast<uint64_t>(Value * 1000) : 0;
+  Buckets[bucketFor(Micros)].fetch_add(1, std::memory_order_relaxed);
+  SumMicros.fetch_add(Micros, std::memory_order_relaxed);
+  uint64_t Max = MaxMicros.load(std::memory_order_relaxed);
+  while (Micros > Max && !MaxMicros.compare_exchange_weak(Max, Micros))
+    ;
+  // Count is incremented last, so readers see consistent buckets for it.
+  Count.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t Histogram::count() const {
+  return Count.load(std::memory_order_acquire);
+}
+
+double Histogram::quantile(double Fraction) const {
+  uint64_t Total = count();
+  if (!Total)
+    return 0;
+  uint64_t Rank = std::max<uint64_t>(1, std::ceil(Fraction * Total));
+  uint64_t Seen = 0;
+  for (unsigned I = 0; I < NumBuckets; ++I) {
+    Seen += Buckets[I].load(std::memory_order_relaxed);
+    if (Seen >= Rank) {
+      // Report the middle of the bucket, but never more than the maximum.
+      uint64_t Low = lowerBound(I);
+      uint64_t High = I + 1 < NumBuckets ? lowerBound(I + 1) : Low + 1;
+      return std::min((Low + High - 1) / 2.0, max() * 1000) / 1000;
+    }
+  }
+  return max();
+}
+
+double Histogram::mean() const {
+  uint64_t Total = count();
+  return Total ? SumMicros.load(std::memory_order_relaxed) / 1000.0 / Total
+               : 0;
+}
+
+double Histogram::max() const {
+  return MaxMicros.load(std::memory_order_relaxed) / 1000.0;
+}
+
+void Metrics::record(StringRef Name, double Value) {
+  Histogram *H;
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto &Slot = Histograms[Name];
+    if (!Slot)
+      Slot = llvm::make_unique<Histogram>();
+    H = Slot.get();
+  }
+  H->record(Value);
+}
+
+const Histogram *Metrics::get(StringRef Name) const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto It = Histograms.find(Name);
+  return It == Histograms.end() ? nullptr : It->second.get();
+}
+
+json::Expr Metrics::summary() const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  json::obj Result;
+  for (const auto &Entry : Histograms) {
+    const Histogram &H = *Entry.second;
+    Result[Entry.first()] = json::obj{
+        {"count", H.count()},
+        {"mean", H.mean()},
+        {"p50", H.quantile(0.5)},
+        {"p90", H.quantile(0.9)},
+        {"p99", H.quantile(0.99)},
+        {"max", H.max()},
+    };
+  }
+  return std::move(Result);
+}
+
+namespace {
+class MetricsTracer : public EventTracer {
+public:
+  MetricsTracer(Metrics &M, EventTracer *Next) : M(M), Next(Next) {}
+
+  bool shouldTraceSpan() override {
+    // Every span must be measured, even if Next doesn't want it.
+    return true;
+  }
+
+  Context beginSpan(llvm::StringRef Name, json::obj *Args) override {
+    bool Forward = Next && Next->shouldTraceSpan();
+    Context Ctx = Forward ? Next->beginSpan(Name, Args)
+                          : Context::current().clone();
+    return std::move(Ctx).derive(
+        SpanKey, llvm::make_unique<SpanTimer>(M, Name, Forward));
+  }
+
+  void endSpan() override {
+    if (Next && Context::current().getExisting(SpanKey)->Forwarded)
+      Next->endSpan();
+  }
+
+  void instant(llvm::StringRef Name, json::obj &&Args) override {
+    if (Next)
+      Next->instant(Name, std::move(Args));
+  }
+
+  void metric(llvm::StringRef Name, double Value) override {
+    M.record(Name, Value);
+    if (Next)
+      Next->metric(Name, Value);
+  }
+
+private:
+  // Records the time until the span's context is destroyed.
+  struct SpanTimer {
+    SpanTimer(Metrics &M, llvm::StringRef Name, bool Forwarded)
+        : M(M), Name(Name), Forwarded(Forwarded),
+          Start(std::chrono::steady_clock::now()) {}
+    ~SpanTimer() {
+      M.record(Name, std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - Start)
+                         .count());
+    }
+
+    Metrics &M;
+    std::string Name;
+    bool Forwarded;
+    std::chrono::steady_clock::time_point Start;
+  };
+  static Key<std::unique_ptr<SpanTimer>> SpanKey;
+
+  Metrics &M;
+  EventTracer *Next;
+};
+
+Key<std::unique_ptr<MetricsTracer::SpanTimer>> MetricsTracer::SpanKey;
+} // namespace
+
+std::unique_ptr<EventTracer> createMetricsTracer(Metrics &M,
+                                                 EventTracer *Next) {
+  return llvm::make_unique<MetricsTracer>(M, Next);
+}
+
+MetricsDumper::MetricsDumper(const Metrics &M, PathRef File,
+                             std::chrono::steady_clock::duration Interval)
+    : M(M), File(File), Interval(Interval) {
+  Worker = std::thread([this] {
+    std::unique_lock<std::mutex> Lock(Mu);
+    while (!Done) {
+      CV.wait_for(Lock, this->Interval, [&] { return Done; });
+      dump();
+    }
+  });
+}
+
+MetricsDumper::~MetricsDumper() {
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Done = true;
+  }
+  CV.notify_all();
+  Worker.join();
+}
+
+void MetricsDumper::dump() {
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(File, EC, llvm::sys::fs::F_Text);
+  if (EC) {
+    log("Failed to write metrics to " + File + ": " + EC.message());
+    return;
+  }
+  OS << formatv("{0:2}", M.summary()) << "\n";
+}
+
+} // namespace trace
+} // namespace clangd
+} // namespace clang
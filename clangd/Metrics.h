@@ -0,0 +1,119 @@
+//===--- Metrics.h - Aggregated performance metrics -------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Aggregates the durations of trace events and the values reported through
+// trace::metric() into latency histograms, which can be queried while clangd
+// is running.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_METRICS_H_
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_METRICS_H_
+
+#include "JSONExpr.h"
+#include "Path.h"
+#include "Trace.h"
+#include "llvm/ADT/StringMap.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace clang {
+namespace clangd {
+namespace trace {
+
+/// A histogram of non-negative values with a bounded relative error, in the
+/// style of HdrHistogram. Values are kept with microsecond resolution, so
+/// latencies should be recorded in milliseconds.
+/// Recording is lock-free and may be done concurrently with queries.
+class Histogram {
+public:
+  Histogram();
+
+  void record(double Value);
+
+  uint64_t count() const;
+  /// Returns the smallest recorded value V such that a \p Fraction of all
+  /// recorded values are <= V, up to the precision of the histogram.
+  /// Returns 0 if the histogram is empty.
+  double quantile(double Fraction) const;
+  double mean() const;
+  double max() const;
+
+private:
+  // Each power of two is split into 2^SubBucketBits linear sub-buckets, which
+  // limits the relative error to 2^-SubBucketBits.
+  static constexpr unsigned SubBucketBits = 5;
+  static constexpr unsigned MaxExponent = 40; // ~12 days in microseconds.
+  static constexpr unsigned NumBuckets =
+      (MaxExponent - SubBucketBits + 2) << SubBucketBits;
+
+  static unsigned bucketFor(uint64_t Micros);
+  static uint64_t lowerBound(unsigned Bucket);
+
+  std::unique_ptr<std::atomic<uint64_t>[]> Buckets;
+  std::atomic<uint64_t> Count = {0};
+  std::atomic<uint64_t> SumMicros = {0};
+  std::atomic<uint64_t> MaxMicros = {0};
+};
+
+/// A thread-safe set of named histograms.
+class Metrics {
+public:
+  /// Adds \p Value to the histogram called \p Name, creating it if needed.
+  void record(llvm::StringRef Name, double Value);
+
+  /// Returns the histogram called \p Name, or nullptr if nothing was recorded.
+  const Histogram *get(llvm::StringRef Name) const;
+
+  /// Summarizes all histograms, as an object mapping names to objects with
+  /// count, mean, p50, p90, p99 and max properties.
+  json::Expr summary() const;
+
+private:
+  mutable std::mutex Mu;
+  // Histograms are never removed, so they may be used without holding Mu.
+  llvm::StringMap<std::unique_ptr<Histogram>> Histograms /*GUARDED_BY(Mu)*/;
+};
+
+/// Create an EventTracer that records the duration of every span into \p M,
+/// under the name of the span, as well as all values reported by
+/// trace::metric(). Durations are measured in milliseconds until the span's
+/// context is destroyed, so they include asynchronous work done on its behalf.
+/// All events are also forwarded to \p Next, if it is set.
+std::unique_ptr<EventTracer> createMetricsTracer(Metrics &M,
+                                                 EventTracer *Next = nullptr);
+
+/// Periodically overwrites a file with the summary() of a Metrics object.
+/// The file is written from a background thread, and one last time when the
+/// MetricsDumper is destroyed.
+class MetricsDumper {
+public:
+  MetricsDumper(const Metrics &M, PathRef File,
+                std::chrono::steady_clock::duration Interval);
+  ~MetricsDumper();
+
+private:
+  void dump();
+
+  const Metrics &M;
+  const std::string File;
+  const std::chrono::steady_clock::duration Interval;
+  std::mutex Mu;
+  std::condition_variable CV;
+  bool Done = false /*GUARDED_BY(Mu)*/;
+  std::thread Worker;
+};
+
+} // namespace trace
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_METRICS_H_
@@ -483,6 +483,15 @@ json::Expr toJSON(const Hover &H) {
   return std::move(Result);
 }
 
+json::Expr toJSON(const CompletionItemData &D) {
+  return json::obj{{"resultId", D.resultId}, {"index", D.index}};
+}
+
+bool fromJSON(const json::Expr &Params, CompletionItemData &D) {
+  json::ObjectMapper O(Params);
+  return O && O.map("resultId", D.resultId) && O.map("index", D.index);
+}
+
 json::Expr toJSON(const CompletionItem &CI) {
   assert(!CI.label.empty() && "completion item label is required");
   json::obj Result{{"label", CI.label}};
@@ -504,6 +513,8 @@ json::Expr toJSON(const CompletionItem &CI) {
     Result["textEdit"] = *CI.textEdit;
   if (!CI.additionalTextEdits.empty())
     Result["additionalTextEdits"] = json::ary(CI.additionalTextEdits);
+  if (CI.data)
+    Result["data"] = *CI.data;
   return std::move(Result);
 }
 
@@ -517,6 +528,11 @@ bool operator<(const CompletionItem &L, const CompletionItem &R) {
          (R.sortText.empty() ? R.label : R.sortText);
 }
 
+bool fromJSON(const json::Expr &Params, ResolveCompletionItemParams &R) {
+  json::ObjectMapper O(Params);
+  return O && O.map("data", R.data);
+}
+
 json::Expr toJSON(const CompletionList &L) {
   return json::obj{
       {"isIncomplete", L.isIncomplete},
@@ -601,8 +617,12 @@ bool fromJSON(const json::Expr &Params, ReferenceContext &RC) {
 
 bool fromJSON(const json::Expr &Params, ReferenceParams &R) {
   json::ObjectMapper O(Params);
-  return O && O.map("context", R.context) &&
-         O.map("textDocument", R.textDocument) && O.map("position", R.position);
+  if (!O || !O.map("context", R.context) ||
+      !O.map("textDocument", R.textDocument) || !O.map("position", R.position))
+    return false;
+  if (const json::Expr *Token = Params.asObject()->get("partialResultToken"))
+    R.partialResultToken = *Token;
+  return O.map("offset", R.offset) && (!R.offset || *R.offset >= 0);
 }
 
 } // namespace clangd
@@ -202,6 +202,7 @@ struct NoParams {};
 inline bool fromJSON(const json::Expr &, NoParams &) { return true; }
 using ShutdownParams = NoParams;
 using ExitParams = NoParams;
+using MetricsParams = NoParams;
 
 /// Defines how the host (editor) should sync document changes to the language
 /// server.
@@ -674,6 +675,17 @@ enum class InsertTextFormat {
   Snippet = 2,
 };
 
+/// Identifies a completion item in a completionItem/resolve request.
+/// clangd sends this as the `data` of items whose details are resolved lazily.
+struct CompletionItemData {
+  /// Distinguishes the results of different completion requests.
+  int resultId = 0;
+  /// The position of the item in the results.
+  int index = 0;
+};
+json::Expr toJSON(const CompletionItemData &);
+bool fromJSON(const json::Expr &, CompletionItemData &);
+
 struct CompletionItem {
   /// The label of this completion item. By default also the text that is
   /// inserted when selecting this completion.
@@ -718,17 +730,22 @@ struct CompletionItem {
   /// themselves.
   std::vector<TextEdit> additionalTextEdits;
 
-  // TODO(krasimir): The following optional fields defined by the language
-  // server protocol are unsupported:
-  //
-  // data?: any - A data entry field that is preserved on a completion item
-  //              between a completion and a completion resolve request.
+  /// A data entry field that is preserved on a completion item between a
+  /// completion and a completion resolve request.
+  llvm::Optional<CompletionItemData> data;
 };
 json::Expr toJSON(const CompletionItem &);
 llvm::raw_ostream &operator<<(llvm::raw_ostream &, const CompletionItem &);
 
 bool operator<(const CompletionItem &, const CompletionItem &);
 
+/// The parameters of a completionItem/resolve request: an item returned by a
+/// previous completion request. clangd only needs its `data`.
+struct ResolveCompletionItemParams {
+  llvm::Optional<CompletionItemData> data;
+};
+bool fromJSON(const json::Expr &, ResolveCompletionItemParams &);
+
 /// Represents a collection of completion items to be presented in the editor.
 struct CompletionList {
   /// The list is not complete. Further typing should result in recomputing the
@@ -828,6 +845,17 @@ bool fromJSON(const json::Expr &, ReferenceContext &);
 
 struct  ReferenceParams : public TextDocumentPositionParams {
   ReferenceContext context;
+
+  /// If set, the results are sent in batches by $/progress notifications with
+  /// this token, before the (empty) reply. A number or a string.
+  llvm::Optional<json::Expr> partialResultToken;
+
+  /// clangd extension: skip this many references. Clients that send it, even
+  /// as 0, can page through the results: the server's limit only applies to
+  /// them. When the limit cuts the results, the reply is
+  /// {"locations": [...], "offset": N}, and the next ones are returned by the
+  /// same request with offset N. Otherwise the reply is a list of locations.
+  llvm::Optional<int> offset;
 };
 bool fromJSON(const json::Expr &, ReferenceParams &);
 
@@ -60,6 +60,7 @@ void clangd::registerCallbackHandlers(JSONRPCDispatcher &Dispatcher,
   Register("textDocument/formatting", &ProtocolCallbacks::onDocumentFormatting);
   Register("textDocument/codeAction", &ProtocolCallbacks::onCodeAction);
   Register("textDocument/completion", &ProtocolCallbacks::onCompletion);
+  Register("completionItem/resolve", &ProtocolCallbacks::onResolveCompletion);
   Register("textDocument/signatureHelp", &ProtocolCallbacks::onSignatureHelp);
   Register("textDocument/definition", &ProtocolCallbacks::onGoToDefinition);
   Register("textDocument/switchSourceHeader",
@@ -75,4 +76,5 @@ void clangd::registerCallbackHandlers(JSONRPCDispatcher &Dispatcher,
            &ProtocolCallbacks::onChangeConfiguration);
   Register("workspace/symbol", &ProtocolCallbacks::onWorkspaceSymbol);
   Register("textDocument/references", &ProtocolCallbacks::onReference);
+  Register("clangd/metrics", &ProtocolCallbacks::onMetrics);
 }
@@ -45,6 +45,7 @@ public:
   onDocumentRangeFormatting(DocumentRangeFormattingParams &Params) = 0;
   virtual void onCodeAction(CodeActionParams &Params) = 0;
   virtual void onCompletion(TextDocumentPositionParams &Params) = 0;
+  virtual void onResolveCompletion(ResolveCompletionItemParams &Params) = 0;
   virtual void onSignatureHelp(TextDocumentPositionParams &Params) = 0;
   virtual void onGoToDefinition(TextDocumentPositionParams &Params) = 0;
   virtual void onSwitchSourceHeader(TextDocumentIdentifier &Params) = 0;
@@ -56,6 +57,7 @@ public:
   virtual void onHover(TextDocumentPositionParams &Params) = 0;
   virtual void onChangeConfiguration(DidChangeConfigurationParams &Params) = 0;
   virtual void onReference(ReferenceParams& Params) = 0;
+  virtual void onMetrics(MetricsParams &Params) = 0;
 };
 
 void registerCallbackHandlers(JSONRPCDispatcher &Dispatcher,
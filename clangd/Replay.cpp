@@ -0,0 +1,144 @@
+//===--- Replay.cpp - Replaying recorded LSP sessions ------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Replay.h"
+#include "llvm/Support/FormatVariadic.h"
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+
+Expected<std::vector<RecordedMessage>> readRecording(StringRef Data) {
+  std::vector<RecordedMessage> Messages;
+  size_t Pos = 0;
+  while (Pos < Data.size()) {
+    uint64_t ContentLength = 0;
+    Optional<uint64_t> Time;
+    // Read the headers, up to an empty line.
+    bool EndOfHeaders = false;
+    while (!EndOfHeaders) {
+      size_t EOL = Data.find('\n', Pos);
+      if (EOL == StringRef::npos)
+        return std::move(Messages); // Truncated.
+      StringRef Line = Data.slice(Pos, EOL).rtrim("\r");
+      Pos = EOL + 1;
+      uint64_t Value;
+      if (Line.startswith("#"))
+        continue;
+      if (Line.consume_front("Content-Length: ")) {
+        if (Line.trim().getAsInteger(10, ContentLength))
+          return make_error<StringError>(
+              formatv("Bad Content-Length at offset {0}", EOL),
+              inconvertibleErrorCode());
+      } else if (Line.consume_front("X-Clangd-Time: ")) {
+        if (!Line.trim().getAsInteger(10, Value))
+          Time = Value;
+      } else if (Line.trim().empty()) {
+        EndOfHeaders = true;
+      }
+    }
+    if (ContentLength == 0)
+      return make_error<StringError>(
+          formatv("Missing Content-Length before offset {0}", Pos),
+          inconvertibleErrorCode());
+    if (Pos + ContentLength > Data.size())
+      break; // Truncated.
+    auto Message = json::parse(Data.substr(Pos, ContentLength));
+    if (!Message)
+      return make_error<StringError>(
+          formatv("Bad message at offset {0}: {1}", Pos,
+                  llvm::toString(Message.takeError())),
+          inconvertibleErrorCode());
+    Pos += ContentLength;
+    RecordedMessage Recorded;
+    Recorded.TimeMs = Time;
+    Recorded.Message = std::move(*Message);
+    Messages.push_back(std::move(Recorded));
+  }
+  return std::move(Messages);
+}
+
+void writeLSPMessage(const json::Expr &Message, raw_ostream &OS) {
+  std::string S = formatv("{0}", Message).str();
+  OS << "Content-Length: " << S.size() << "\r\n\r\n" << S;
+}
+
+namespace {
+
+double number(const json::obj *O, StringRef Key) {
+  if (!O)
+    return 0;
+  if (auto N = O->getNumber(Key))
+    return *N;
+  return 0;
+}
+
+// Formats the relative change from Base to Value, e.g. "+5.2%".
+std::string change(double Value, double Base) {
+  if (Base == 0)
+    return Value == 0 ? "0%" : "new";
+  double Percent = (Value - Base) / Base * 100;
+  return formatv("{0}{1:f1}%", Percent < 0 ? "" : "+", Percent).str();
+}
+
+} // namespace
+
+void printReplayReport(const json::Expr &Report, const json::Expr *Baseline,
+                       raw_ostream &OS) {
+  const json::obj *R = Report.asObject();
+  const json::obj *Base = Baseline ? Baseline->asObject() : nullptr;
+  if (!R)
+    return;
+  auto Throughput = [](const json::obj *O) {
+    double Seconds = number(O, "seconds");
+    return Seconds > 0 ? number(O, "requests") / Seconds : 0;
+  };
+  OS << formatv("Replayed {0} requests in {1:f2}s: {2:f1} requests/s",
+                static_cast<uint64_t>(number(R, "requests")),
+                number(R, "seconds"), Throughput(R));
+  if (Base)
+    OS << formatv(" ({0} from {1:f1})", change(Throughput(R), Throughput(Base)),
+                  Throughput(Base));
+  OS << "\n";
+
+  static const char *const Columns[] = {"count", "mean", "p50",
+                                        "p90",   "p99",  "max"};
+  OS << formatv("{0,-40}", "latency (ms)");
+  for (const char *Column : Columns)
+    OS << formatv("{0,10}", Column);
+  OS << "\n";
+  const json::obj *Latency = R->getObject("latency");
+  const json::obj *BaseLatency = Base ? Base->getObject("latency") : nullptr;
+  if (!Latency)
+    return;
+  // json::obj is ordered, so methods are printed alphabetically.
+  for (const auto &Entry : *Latency) {
+    const json::obj *Stats = Entry.second.asObject();
+    OS << formatv("{0,-40}", StringRef(Entry.first));
+    for (const char *Column : Columns) {
+      if (StringRef(Column) == "count")
+        OS << formatv("{0,10}", static_cast<uint64_t>(number(Stats, Column)));
+      else
+        OS << formatv("{0,10:f2}", number(Stats, Column));
+    }
+    OS << "\n";
+    if (!BaseLatency)
+      continue;
+    const json::obj *BaseStats = BaseLatency->getObject(Entry.first);
+    OS << formatv("{0,-40}", "  change");
+    for (const char *Column : Columns)
+      OS << formatv("{0,10}", BaseStats ? change(number(Stats, Column),
+                                                 number(BaseStats, Column))
+                                        : "new");
+    OS << "\n";
+  }
+}
+
+} // namespace clangd
+} // namespace clang
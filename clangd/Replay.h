@@ -0,0 +1,56 @@
+//===--- Replay.h - Replaying recorded LSP sessions --------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Support for clangd-replay, which plays sessions recorded with
+// -input-mirror-file back against clangd to measure its latency and
+// throughput.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_REPLAY_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_REPLAY_H
+
+#include "JSONExpr.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// A message sent by the client in a recorded session.
+struct RecordedMessage {
+  /// When the message was received, in milliseconds since the recording
+  /// started. Only set by clangd versions that mirror X-Clangd-Time headers.
+  llvm::Optional<uint64_t> TimeMs;
+  json::Expr Message = nullptr;
+};
+
+/// Reads the messages of a session recorded with -input-mirror-file. Messages
+/// have their times if it was recorded with -input-mirror-timestamps. A
+/// truncated last message, e.g. when clangd was killed, is ignored.
+llvm::Expected<std::vector<RecordedMessage>>
+readRecording(llvm::StringRef Data);
+
+/// Writes a JSON-RPC message with its Content-Length header.
+void writeLSPMessage(const json::Expr &Message, llvm::raw_ostream &OS);
+
+/// Prints a replay report as a table. A report is an object with "seconds",
+/// "requests" and "latency" properties, where "latency" is a
+/// trace::Metrics::summary() of the latencies of each method. If
+/// \p Baseline is set, the relative change from it is printed as well.
+void printReplayReport(const json::Expr &Report, const json::Expr *Baseline,
+                       llvm::raw_ostream &OS);
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_REPLAY_H
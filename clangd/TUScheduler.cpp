@@ -151,7 +151,8 @@ class ASTWorker {
             steady_clock::duration UpdateDebounce,
             std::shared_ptr<PCHContainerOperations> PCHs,
             bool StorePreamblesInMemory,
-            PreambleParsedCallback PreambleCallback);
+            PreambleParsedCallback PreambleCallback,
+            ASTParsedCallback ASTCallback);
 
 public:
   /// Create a new ASTWorker and return a handle to it.
@@ -165,7 +166,8 @@ public:
                                 steady_clock::duration UpdateDebounce,
                                 std::shared_ptr<PCHContainerOperations> PCHs,
                                 bool StorePreamblesInMemory,
-                                PreambleParsedCallback PreambleCallback);
+                                PreambleParsedCallback PreambleCallback,
+                                ASTParsedCallback ASTCallback);
   ~ASTWorker();
 
   void update(ParseInputs Inputs, WantDiagnostics,
@@ -222,6 +224,10 @@ private:
   const bool StorePreambleInMemory;
   /// Callback, passed to the preamble builder.
   const PreambleParsedCallback PreambleCallback;
+  /// Callback, run on each AST built for an update.
+  const ASTParsedCallback ASTCallback;
+  /// Held while ASTCallback runs, and by stop(). Acquired before Mutex.
+  std::mutex ASTCallbackMutex;
   /// Helper class required to build the ASTs.
   const std::shared_ptr<PCHContainerOperations> PCHs;
 
@@ -288,10 +294,12 @@ ASTWorkerHandle ASTWorker::Create(PathRef FileName,
                                   steady_clock::duration UpdateDebounce,
                                   std::shared_ptr<PCHContainerOperations> PCHs,
                                   bool StorePreamblesInMemory,
-                                  PreambleParsedCallback PreambleCallback) {
+                                  PreambleParsedCallback PreambleCallback,
+                                  ASTParsedCallback ASTCallback) {
   std::shared_ptr<ASTWorker> Worker(new ASTWorker(
       FileName, IdleASTs, Barrier, /*RunSync=*/!Tasks, UpdateDebounce,
-      std::move(PCHs), StorePreamblesInMemory, std::move(PreambleCallback)));
+      std::move(PCHs), StorePreamblesInMemory, std::move(PreambleCallback),
+      std::move(ASTCallback)));
   if (Tasks)
     Tasks->runAsync("worker:" + llvm::sys::path::filename(FileName),
                     [Worker]() { Worker->run(); });
@@ -304,10 +312,12 @@ ASTWorker::ASTWorker(PathRef FileName, TUScheduler::ASTCache &LRUCache,
                      steady_clock::duration UpdateDebounce,
                      std::shared_ptr<PCHContainerOperations> PCHs,
                      bool StorePreamblesInMemory,
-                     PreambleParsedCallback PreambleCallback)
+                     PreambleParsedCallback PreambleCallback,
+                     ASTParsedCallback ASTCallback)
     : IdleASTs(LRUCache), RunSync(RunSync), UpdateDebounce(UpdateDebounce),
       FileName(FileName), StorePreambleInMemory(StorePreamblesInMemory),
-      PreambleCallback(std::move(PreambleCallback)), PCHs(std::move(PCHs)),
+      PreambleCallback(std::move(PreambleCallback)),
+      ASTCallback(std::move(ASTCallback)), PCHs(std::move(PCHs)),
       Barrier(Barrier), Done(false) {}
 
 ASTWorker::~ASTWorker() {
@@ -361,6 +371,20 @@ void ASTWorker::update(
     // spam us with updates.
     if (WantDiags != WantDiagnostics::No && AST)
       OnUpdated(AST->getDiagnostics());
+    if (AST && ASTCallback) {
+      // Once the file is removed, its AST must not be reported any more, e.g.
+      // so that its symbols don't come back in the index.
+      std::lock_guard<std::mutex> CallbackLock(ASTCallbackMutex);
+      bool Removed;
+      {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Removed = Done;
+      }
+      if (!Removed) {
+        trace::Span Tracer("Running ASTCallback");
+        ASTCallback(FileName, *AST);
+      }
+    }
     // Stash the AST in the cache for further use.
     IdleASTs.put(this,
                  AST ? llvm::make_unique<ParsedAST>(std::move(*AST)) : nullptr);
@@ -423,6 +447,8 @@ bool ASTWorker::isASTCached() const { return IdleASTs.getUsedBytes(this) != 0; }
 
 void ASTWorker::stop() {
   {
+    // Wait for a running ASTCallback. Later ones see Done and are skipped.
+    std::lock_guard<std::mutex> CallbackLock(ASTCallbackMutex);
     std::lock_guard<std::mutex> Lock(Mutex);
     assert(!Done && "stop() called twice");
     Done = true;
@@ -486,6 +512,11 @@ void ASTWorker::run() {
     {
       std::lock_guard<Semaphore> BarrierLock(Barrier);
       WithContext Guard(std::move(Req.Ctx));
+      // Includes the debounce delay and the wait for a free worker slot.
+      trace::metric("QueueWait:" + Req.Name,
+                    std::chrono::duration<double, std::milli>(
+                        steady_clock::now() - Req.AddTime)
+                        .count());
       trace::Span Tracer(Req.Name);
       Req.Action();
     }
@@ -573,10 +604,12 @@ TUScheduler::TUScheduler(unsigned AsyncThreadsCount,
                          bool StorePreamblesInMemory,
                          PreambleParsedCallback PreambleCallback,
                          std::chrono::steady_clock::duration UpdateDebounce,
-                         ASTRetentionPolicy RetentionPolicy)
+                         ASTRetentionPolicy RetentionPolicy,
+                         ASTParsedCallback ASTCallback)
     : StorePreamblesInMemory(StorePreamblesInMemory),
       PCHOps(std::make_shared<PCHContainerOperations>()),
-      PreambleCallback(std::move(PreambleCallback)), Barrier(AsyncThreadsCount),
+      PreambleCallback(std::move(PreambleCallback)),
+      ASTCallback(std::move(ASTCallback)), Barrier(AsyncThreadsCount),
       IdleASTs(llvm::make_unique<ASTCache>(RetentionPolicy.MaxRetainedASTs)),
       UpdateDebounce(UpdateDebounce) {
   if (0 < AsyncThreadsCount) {
@@ -615,7 +648,7 @@ void TUScheduler::update(
     ASTWorkerHandle Worker = ASTWorker::Create(
         File, *IdleASTs, WorkerThreads ? WorkerThreads.getPointer() : nullptr,
         Barrier, UpdateDebounce, PCHOps, StorePreamblesInMemory,
-        PreambleCallback);
+        PreambleCallback, ASTCallback);
     FD = std::unique_ptr<FileData>(new FileData{
         Inputs.Contents, Inputs.CompileCommand, std::move(Worker)});
   } else {
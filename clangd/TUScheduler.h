@@ -34,6 +34,11 @@ struct InputsAndPreamble {
   const PreambleData *Preamble;
 };
 
+/// Called with the AST of the main file each time it is rebuilt after an
+/// update. It is not called for a file after remove(), even for updates that
+/// were still pending.
+using ASTParsedCallback = std::function<void(PathRef Path, ParsedAST &AST)>;
+
 /// Determines whether diagnostics should be generated for a file snapshot.
 enum class WantDiagnostics {
   Yes,  /// Diagnostics must be generated for this snapshot.
@@ -63,7 +68,8 @@ public:
   TUScheduler(unsigned AsyncThreadsCount, bool StorePreamblesInMemory,
               PreambleParsedCallback PreambleCallback,
               std::chrono::steady_clock::duration UpdateDebounce,
-              ASTRetentionPolicy RetentionPolicy);
+              ASTRetentionPolicy RetentionPolicy,
+              ASTParsedCallback ASTCallback = nullptr);
   ~TUScheduler();
 
   /// Returns estimated memory usage for each of the currently open files.
@@ -82,7 +88,7 @@ public:
               llvm::unique_function<void(std::vector<Diag>)> OnUpdated);
 
   /// Remove \p File from the list of tracked files and schedule removal of its
-  /// resources.
+  /// resources. Waits for an ASTParsedCallback running for \p File to finish.
   void remove(PathRef File);
 
   /// Schedule an async read of the AST. \p Action will be called when AST is
@@ -126,6 +132,7 @@ private:
   const bool StorePreamblesInMemory;
   const std::shared_ptr<PCHContainerOperations> PCHOps;
   const PreambleParsedCallback PreambleCallback;
+  const ASTParsedCallback ASTCallback;
   Semaphore Barrier;
   llvm::StringMap<std::unique_ptr<FileData>> Files;
   std::unique_ptr<ASTCache> IdleASTs;
@@ -4,6 +4,9 @@
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Threading.h"
 #include <thread>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 namespace clang {
 namespace clangd {
@@ -79,6 +82,17 @@ void AsyncTaskRunner::runAsync(llvm::Twine Name,
       .detach();
 }
 
+void setCurrentThreadPriority(ThreadPriority Priority) {
+#ifdef __linux__
+  sched_param Param;
+  Param.sched_priority = 0;
+  // With a pid of 0, this only affects the calling thread.
+  sched_setscheduler(0,
+                     Priority == ThreadPriority::Low ? SCHED_IDLE : SCHED_OTHER,
+                     &Param);
+#endif
+}
+
 Deadline timeoutSeconds(llvm::Optional<double> Seconds) {
   using namespace std::chrono;
   if (!Seconds)
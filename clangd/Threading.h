@@ -15,6 +15,7 @@
 #include "llvm/ADT/Twine.h"
 #include <cassert>
 #include <condition_variable>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -115,6 +116,27 @@ private:
   mutable std::condition_variable TasksReachedZero;
   std::size_t InFlightTasks = 0;
 };
+
+enum class ThreadPriority {
+  Low = 0,
+  Normal = 1,
+};
+/// Changes the scheduling priority of the calling thread. Low priority threads
+/// only run when the CPU is otherwise idle. This is a no-op on platforms other
+/// than Linux.
+void setCurrentThreadPriority(ThreadPriority Priority);
+
+/// Runs \p Action asynchronously on a new thread, propagating the current
+/// context. The returned future blocks on destruction until \p Action is done.
+template <typename T>
+std::future<T> runAsync(llvm::unique_function<T()> Action) {
+  return std::async(std::launch::async,
+                    [](llvm::unique_function<T()> &&Action, Context Ctx) {
+                      WithContext WithCtx(std::move(Ctx));
+                      return Action();
+                    },
+                    std::move(Action), Context::current().clone());
+}
 } // namespace clangd
 } // namespace clang
 #endif
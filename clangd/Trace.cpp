@@ -12,12 +12,17 @@
 #include "Function.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Chrono.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FormatProviders.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Threading.h"
 #include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <mutex>
+#include <thread>
 
 namespace clang {
 namespace clangd {
@@ -186,6 +191,278 @@ private:
 
 Key<std::unique_ptr<JSONTracer::JSONSpan>> JSONTracer::SpanKey;
 
+// The binary trace format is a header followed by a sequence of records:
+//   Header: "CLDTRACE" u32:version
+//   Record: u8:phase u64:tid u64:start u64:duration
+//           u32:namelen name u32:argslen args
+// Integers are little-endian, times are in nanoseconds since the tracer was
+// created, and args are the compact JSON serialization of the event's args.
+// Phases are a subset of the Trace Event format ones: X (a complete span),
+// i (an instant event) and M (thread name metadata).
+constexpr char BinaryTraceMagic[] = "CLDTRACE";
+constexpr uint32_t BinaryTraceVersion = 1;
+constexpr size_t BinaryRecordHeaderSize = 1 + 8 + 8 + 8;
+
+void appendU32(SmallVectorImpl<char> &Out, uint32_t V) {
+  char Buf[4];
+  support::endian::write32le(Buf, V);
+  Out.append(Buf, Buf + sizeof(Buf));
+}
+
+void appendU64(SmallVectorImpl<char> &Out, uint64_t V) {
+  char Buf[8];
+  support::endian::write64le(Buf, V);
+  Out.append(Buf, Buf + sizeof(Buf));
+}
+
+void encodeRecord(SmallVectorImpl<char> &Out, char Phase, uint64_t TID,
+                  uint64_t Start, uint64_t Duration, StringRef Name,
+                  StringRef Args) {
+  Out.push_back(Phase);
+  appendU64(Out, TID);
+  appendU64(Out, Start);
+  appendU64(Out, Duration);
+  appendU32(Out, Name.size());
+  Out.append(Name.begin(), Name.end());
+  appendU32(Out, Args.size());
+  Out.append(Args.begin(), Args.end());
+}
+
+// A fixed-size single-producer, single-consumer byte queue.
+// The owning thread appends whole records, the flushing thread drains them.
+// Neither side takes a lock.
+class RecordBuffer {
+public:
+  RecordBuffer() : Data(new char[Capacity]) {}
+
+  // Appends Record as a unit. If it doesn't fit, nothing is written.
+  bool push(StringRef Record) {
+    size_t H = Head.load(std::memory_order_relaxed);
+    size_t T = Tail.load(std::memory_order_acquire);
+    if (Record.size() > Capacity - (H - T)) {
+      Dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    size_t Begin = H & (Capacity - 1);
+    size_t First = std::min(Record.size(), Capacity - Begin);
+    std::memcpy(&Data[Begin], Record.data(), First);
+    std::memcpy(&Data[0], Record.data() + First, Record.size() - First);
+    Head.store(H + Record.size(), std::memory_order_release);
+    return true;
+  }
+
+  // Writes all records pushed so far to Out.
+  void drain(raw_ostream &Out) {
+    size_t T = Tail.load(std::memory_order_relaxed);
+    size_t H = Head.load(std::memory_order_acquire);
+    size_t Begin = T & (Capacity - 1);
+    size_t First = std::min(H - T, Capacity - Begin);
+    Out.write(&Data[Begin], First);
+    Out.write(&Data[0], H - T - First);
+    Tail.store(H, std::memory_order_release);
+  }
+
+  uint64_t dropped() const { return Dropped.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t Capacity = 1 << 16; // Must be a power of two.
+  std::unique_ptr<char[]> Data;
+  std::atomic<size_t> Head = {0}; // Only written by the producer.
+  std::atomic<size_t> Tail = {0}; // Only written by the consumer.
+  std::atomic<uint64_t> Dropped = {0};
+};
+
+// Writes events into per-thread buffers without locking, a background thread
+// periodically moves them to Out. Events are encoded, but not formatted, on
+// the traced threads. Unlike JSONTracer, no flow events are recorded.
+class BinaryTracer : public EventTracer {
+public:
+  BinaryTracer(raw_ostream &Out, double SampleRate,
+               std::chrono::milliseconds FlushInterval)
+      : Out(Out), SampleRate(SampleRate), FlushInterval(FlushInterval),
+        ID(nextTracerID()), Start(std::chrono::steady_clock::now()) {
+    Out.write(BinaryTraceMagic, sizeof(BinaryTraceMagic) - 1);
+    SmallString<4> Version;
+    appendU32(Version, BinaryTraceVersion);
+    Out << Version;
+    Flusher = std::thread([this] { flushLoop(); });
+  }
+
+  ~BinaryTracer() {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      ShuttingDown = true;
+    }
+    CV.notify_all();
+    Flusher.join();
+
+    // The flusher drained everything on exit, report the losses.
+    uint64_t Dropped = 0;
+    for (const auto &Buffer : Buffers)
+      Dropped += Buffer->dropped();
+    if (Dropped) {
+      SmallString<64> Record;
+      encodeRecord(Record, 'i', get_threadid(), timestamp(), 0,
+                   "Dropped events",
+                   formatv("{0}", json::Expr(json::obj{{"Count", Dropped}}))
+                       .str());
+      Out << Record;
+    }
+    Out.flush();
+  }
+
+  bool shouldTraceSpan() override {
+    // Nested spans follow the sampling decision made for the outermost one.
+    if (auto *Parent = Context::current().get(SpanKey))
+      return *Parent != nullptr;
+    return true;
+  }
+
+  // Outermost spans that are not sampled store a null BinarySpan, so that
+  // their children are skipped by shouldTraceSpan().
+  Context beginSpan(llvm::StringRef Name, json::obj *Args) override {
+    if (!Context::current().get(SpanKey) && !sampleRootSpan())
+      return Context::current().derive(SpanKey, nullptr);
+    return Context::current().derive(
+        SpanKey, llvm::make_unique<BinarySpan>(this, Name, Args));
+  }
+
+  void endSpan() override {
+    if (const auto &Span = Context::current().getExisting(SpanKey))
+      Span->markEnded();
+  }
+
+  void instant(llvm::StringRef Name, json::obj &&Args) override {
+    if (auto *Span = Context::current().get(SpanKey))
+      if (!*Span)
+        return;
+    record('i', get_threadid(), timestamp(), 0, Name,
+           formatv("{0}", json::Expr(std::move(Args))).str());
+  }
+
+private:
+  class BinarySpan {
+  public:
+    BinarySpan(BinaryTracer *Tracer, llvm::StringRef Name, json::obj *Args)
+        : StartTime(Tracer->timestamp()), EndTime(0), Name(Name),
+          TID(get_threadid()), Tracer(Tracer), Args(Args) {
+      // ~BinarySpan() may run in a different thread, so we need to describe
+      // this one now.
+      Tracer->threadBuffer();
+    }
+
+    ~BinarySpan() {
+      uint64_t End = EndTime;
+      if (!End)
+        End = Tracer->timestamp();
+      std::string ArgsJSON;
+      if (!Args->empty())
+        ArgsJSON = formatv("{0}", json::Expr(std::move(*Args)));
+      Tracer->record('X', TID, StartTime, End - StartTime, Name, ArgsJSON);
+    }
+
+    // May be called by any thread.
+    void markEnded() { EndTime = Tracer->timestamp(); }
+
+  private:
+    uint64_t StartTime;
+    std::atomic<uint64_t> EndTime; // Filled in by markEnded().
+    std::string Name;
+    uint64_t TID;
+    BinaryTracer *Tracer;
+    json::obj *Args;
+  };
+  static Key<std::unique_ptr<BinarySpan>> SpanKey;
+
+  static uint64_t nextTracerID() {
+    static std::atomic<uint64_t> Next = {1};
+    return Next++;
+  }
+
+  // Deterministically picks SampleRate of the calls.
+  bool sampleRootSpan() {
+    if (SampleRate >= 1)
+      return true;
+    if (SampleRate <= 0)
+      return false;
+    uint64_t N = RootSpans++;
+    return static_cast<uint64_t>((N + 1) * SampleRate) !=
+           static_cast<uint64_t>(N * SampleRate);
+  }
+
+  void record(char Phase, uint64_t TID, uint64_t StartTime, uint64_t Duration,
+              StringRef Name, StringRef Args) {
+    SmallString<128> Record;
+    encodeRecord(Record, Phase, TID, StartTime, Duration, Name, Args);
+    threadBuffer().push(Record);
+  }
+
+  // Returns the buffer owned by the current thread, creating it if needed.
+  RecordBuffer &threadBuffer() {
+    // Tracers are identified by ID rather than address, which may be reused.
+    struct LocalBuffer {
+      uint64_t TracerID = 0;
+      RecordBuffer *Buffer = nullptr;
+    };
+    static thread_local LocalBuffer Local;
+    if (Local.TracerID == ID)
+      return *Local.Buffer;
+
+    auto Buffer = llvm::make_unique<RecordBuffer>();
+    Local.TracerID = ID;
+    Local.Buffer = Buffer.get();
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      Buffers.push_back(std::move(Buffer));
+    }
+    SmallString<32> Name;
+    get_thread_name(Name);
+    if (!Name.empty())
+      record('M', get_threadid(), 0, 0, "thread_name",
+             formatv("{0}", json::Expr(json::obj{{"name", Name}})).str());
+    return *Local.Buffer;
+  }
+
+  void flushLoop() {
+    std::vector<RecordBuffer *> ToDrain;
+    bool Done = false;
+    while (!Done) {
+      {
+        std::unique_lock<std::mutex> Lock(Mu);
+        CV.wait_for(Lock, FlushInterval, [&] { return ShuttingDown; });
+        Done = ShuttingDown;
+        // Buffers are never removed, so pointers stay valid without the lock.
+        ToDrain.clear();
+        for (const auto &Buffer : Buffers)
+          ToDrain.push_back(Buffer.get());
+      }
+      for (RecordBuffer *Buffer : ToDrain)
+        Buffer->drain(Out);
+      Out.flush();
+    }
+  }
+
+  uint64_t timestamp() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now() - Start).count();
+  }
+
+  raw_ostream &Out; // Only used by the flusher thread after construction.
+  const double SampleRate;
+  const std::chrono::milliseconds FlushInterval;
+  const uint64_t ID;
+  const std::chrono::steady_clock::time_point Start;
+  std::atomic<uint64_t> RootSpans = {0};
+
+  std::mutex Mu;
+  std::condition_variable CV;
+  bool ShuttingDown = false /*GUARDED_BY(Mu)*/;
+  std::vector<std::unique_ptr<RecordBuffer>> Buffers /*GUARDED_BY(Mu)*/;
+  std::thread Flusher;
+};
+
+Key<std::unique_ptr<BinaryTracer::BinarySpan>> BinaryTracer::SpanKey;
+
 EventTracer *T = nullptr;
 } // namespace
 
@@ -201,15 +478,101 @@ std::unique_ptr<EventTracer> createJSONTracer(llvm::raw_ostream &OS,
   return llvm::make_unique<JSONTracer>(OS, Pretty);
 }
 
+std::unique_ptr<EventTracer>
+createBinaryTracer(llvm::raw_ostream &OS, double SampleRate,
+                   std::chrono::milliseconds FlushInterval) {
+  return llvm::make_unique<BinaryTracer>(OS, SampleRate, FlushInterval);
+}
+
+llvm::Error convertBinaryTrace(llvm::StringRef Data, llvm::raw_ostream &OS,
+                               bool Pretty) {
+  auto Malformed = [](const Twine &Message) {
+    return make_error<StringError>("Malformed binary trace: " + Message,
+                                   inconvertibleErrorCode());
+  };
+  auto ConsumeString = [&](StringRef &Out) {
+    if (Data.size() < 4)
+      return false;
+    uint32_t Size = support::endian::read32le(Data.data());
+    Data = Data.drop_front(4);
+    if (Data.size() < Size)
+      return false;
+    Out = Data.take_front(Size);
+    Data = Data.drop_front(Size);
+    return true;
+  };
+
+  if (!Data.consume_front(
+          StringRef(BinaryTraceMagic, sizeof(BinaryTraceMagic) - 1)))
+    return Malformed("bad magic");
+  if (Data.size() < 4 ||
+      support::endian::read32le(Data.data()) != BinaryTraceVersion)
+    return Malformed("unsupported version");
+  Data = Data.drop_front(4);
+
+  const char *JSONFormat = Pretty ? "{0:2}" : "{0}";
+  OS << R"({"displayTimeUnit":"ns","traceEvents":[)"
+     << "\n";
+  OS << formatv(JSONFormat, json::Expr(json::obj{
+                                {"pid", 0},
+                                {"ph", "M"},
+                                {"name", "process_name"},
+                                {"args", json::obj{{"name", "clangd"}}},
+                            }));
+  while (!Data.empty()) {
+    if (Data.size() < BinaryRecordHeaderSize)
+      return Malformed("truncated record");
+    char Phase = Data[0];
+    uint64_t TID = support::endian::read64le(Data.data() + 1);
+    uint64_t StartTime = support::endian::read64le(Data.data() + 9);
+    uint64_t Duration = support::endian::read64le(Data.data() + 17);
+    Data = Data.drop_front(BinaryRecordHeaderSize);
+    StringRef Name, ArgsJSON;
+    if (!ConsumeString(Name) || !ConsumeString(ArgsJSON))
+      return Malformed("truncated record");
+
+    json::Expr Args = json::obj{};
+    if (!ArgsJSON.empty()) {
+      auto Parsed = json::parse(ArgsJSON);
+      if (!Parsed)
+        return Parsed.takeError();
+      Args = std::move(*Parsed);
+    }
+    json::obj Event{
+        {"pid", 0},
+        {"ph", StringRef(&Phase, 1)},
+        {"tid", TID},
+        {"name", Name},
+        {"args", std::move(Args)},
+    };
+    // The Trace Event format measures time in microseconds.
+    if (Phase != 'M')
+      Event["ts"] = StartTime / 1000.0;
+    if (Phase == 'X')
+      Event["dur"] = Duration / 1000.0;
+    OS << ",\n" << formatv(JSONFormat, json::Expr(std::move(Event)));
+  }
+  OS << "\n]}";
+  OS.flush();
+  return Error::success();
+}
+
 void log(const Twine &Message) {
   if (!T)
     return;
   T->instant("Log", json::obj{{"Message", Message.str()}});
 }
 
+void metric(const Twine &Name, double Value) {
+  if (!T)
+    return;
+  SmallString<64> Buffer;
+  T->metric(Name.toStringRef(Buffer), Value);
+}
+
 // Returned context owns Args.
 static Context makeSpanContext(llvm::Twine Name, json::obj *Args) {
-  if (!T)
+  if (!T || !Args)
     return Context::current().clone();
   WithContextValue WithArgs{std::unique_ptr<json::obj>(Args)};
   return T->beginSpan(Name.isSingleStringRef() ? Name.getSingleStringRef()
@@ -221,11 +584,11 @@ static Context makeSpanContext(llvm::Twine Name, json::obj *Args) {
 // The args are owned by the context though. They stick around until the
 // beginSpan() context is destroyed, when the tracing engine will consume them.
 Span::Span(llvm::Twine Name)
-    : Args(T ? new json::obj() : nullptr),
+    : Args(T && T->shouldTraceSpan() ? new json::obj() : nullptr),
       RestoreCtx(makeSpanContext(Name, Args)) {}
 
 Span::~Span() {
-  if (T)
+  if (T && Args)
     T->endSpan();
 }
 
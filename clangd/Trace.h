@@ -22,7 +22,9 @@
 #include "Function.h"
 #include "JSONExpr.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Support/Error.h"
 #include "llvm/Support/raw_ostream.h"
+#include <chrono>
 
 namespace clang {
 namespace clangd {
@@ -47,8 +49,17 @@ public:
   // per-thread nesting. Instead they should observe context destruction.
   virtual void endSpan(){};
 
+  /// Called before a Span is created. Tracers that sample events may return
+  /// false to drop the span entirely: no Args are allocated, no Context is
+  /// derived, and neither beginSpan() nor endSpan() is called.
+  virtual bool shouldTraceSpan() { return true; }
+
   /// Called for instant events.
   virtual void instant(llvm::StringRef Name, json::obj &&Args) = 0;
+
+  /// Called when a value of a named quantity is measured, e.g. the time a
+  /// request waited in a queue. Tracers that don't aggregate values ignore it.
+  virtual void metric(llvm::StringRef Name, double Value) {}
 };
 
 /// Sets up a global EventTracer that consumes events produced by Span and
@@ -68,9 +79,30 @@ public:
 std::unique_ptr<EventTracer> createJSONTracer(llvm::raw_ostream &OS,
                                               bool Pretty = false);
 
+/// Create an instance of EventTracer that records events into per-thread
+/// lock-free buffers, and writes them to \p OS in a compact binary format from
+/// a background thread every \p FlushInterval.
+/// Only a \p SampleRate fraction of the top-level spans are recorded, together
+/// with all the spans nested inside them. Events that don't fit into a thread's
+/// buffer before the next flush are dropped (and counted).
+///
+/// The output can be converted to the Trace Event format by
+/// convertBinaryTrace().
+std::unique_ptr<EventTracer> createBinaryTracer(
+    llvm::raw_ostream &OS, double SampleRate = 1.0,
+    std::chrono::milliseconds FlushInterval = std::chrono::milliseconds(100));
+
+/// Converts the output of a tracer created by createBinaryTracer() into the
+/// format produced by createJSONTracer().
+llvm::Error convertBinaryTrace(llvm::StringRef Data, llvm::raw_ostream &OS,
+                               bool Pretty = false);
+
 /// Records a single instant event, associated with the current thread.
 void log(const llvm::Twine &Name);
 
+/// Records a measured value of a named quantity. Times are in milliseconds.
+void metric(const llvm::Twine &Name, double Value);
+
 /// Records an event whose duration is the lifetime of the Span object.
 /// This lifetime is extended when the span's context is reused.
 ///
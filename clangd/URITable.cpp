@@ -0,0 +1,74 @@
+//===--- URITable.cpp - Interned file URIs -----------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "URITable.h"
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+
+unsigned URITable::intern(StringRef FileURI) {
+  auto R = Ordinals.try_emplace(FileURI, Entries.size());
+  if (R.second) {
+    Entries.emplace_back();
+    Entries.back().FileURI = R.first->getKey();
+  }
+  return R.first->second;
+}
+
+StringRef URITable::uri(unsigned File) const {
+  assert(File < Entries.size() && "not an ordinal of this table");
+  return Entries[File].FileURI;
+}
+
+URITable::Entry &URITable::parsed(unsigned File) {
+  assert(File < Entries.size() && "not an ordinal of this table");
+  Entry &E = Entries[File];
+  if (!E.Parsed) {
+    E.Parsed = true;
+    auto U = URI::parse(E.FileURI);
+    if (U)
+      E.ParsedURI = std::move(*U);
+    else
+      E.Error = toString(U.takeError());
+  }
+  return E;
+}
+
+Expected<const URI &> URITable::parse(unsigned File) {
+  const Entry &E = parsed(File);
+  if (!E.ParsedURI)
+    return make_error<StringError>(E.Error, inconvertibleErrorCode());
+  return *E.ParsedURI;
+}
+
+Expected<const URIForFile &> URITable::uriForFile(unsigned File) {
+  Entry &E = parsed(File);
+  if (E.ParsedURI && !E.Resolved) {
+    E.Resolved = true;
+    auto Path = URI::resolve(*E.ParsedURI, HintPath);
+    if (Path)
+      E.File = URIForFile(std::move(*Path));
+    else
+      E.Error = toString(Path.takeError());
+  }
+  if (!E.File)
+    return make_error<StringError>(E.Error, inconvertibleErrorCode());
+  return *E.File;
+}
+
+Expected<StringRef> URITable::resolve(unsigned File) {
+  auto U = uriForFile(File);
+  if (!U)
+    return U.takeError();
+  return U->file();
+}
+
+} // namespace clangd
+} // namespace clang
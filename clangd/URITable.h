@@ -0,0 +1,83 @@
+//===--- URITable.h - Interned file URIs -------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Index results locate symbols by file URI, and a request typically resolves
+// the URIs of a few files over and over. A URITable interns the URIs seen by
+// one request and memoizes their parsed form, absolute path and LSP URI.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_URITABLE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_URITABLE_H
+
+#include "Protocol.h"
+#include "URI.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include <deque>
+
+namespace clang {
+namespace clangd {
+
+/// Interns file URIs to ordinals, and memoizes their resolution per ordinal.
+///
+/// A table lives as long as the request that resolves the results of an index
+/// query. It owns copies of the URIs, so they may outlive the index snapshot.
+/// The results are computed on first use and returned by reference, so lookups
+/// don't allocate.
+///
+/// This is not thread-safe.
+class URITable {
+public:
+  /// \p HintPath is passed to URI::resolve() for all the URIs.
+  explicit URITable(llvm::StringRef HintPath = "") : HintPath(HintPath) {}
+
+  URITable(const URITable &) = delete;
+  URITable &operator=(const URITable &) = delete;
+
+  /// Returns the ordinal of \p FileURI, adding it if needed.
+  unsigned intern(llvm::StringRef FileURI);
+
+  /// The URI with ordinal \p File.
+  llvm::StringRef uri(unsigned File) const;
+
+  /// Parses the URI like URI::parse().
+  llvm::Expected<const URI &> parse(unsigned File);
+
+  /// Resolves the URI to an absolute path like URI::resolve().
+  llvm::Expected<llvm::StringRef> resolve(unsigned File);
+
+  /// The URI of the resolved path, as sent to LSP clients.
+  llvm::Expected<const URIForFile &> uriForFile(unsigned File);
+
+private:
+  struct Entry {
+    llvm::StringRef FileURI; // Owned by Ordinals.
+    // The results of parsing and resolving, set on first use. A failure sets
+    // Error instead.
+    bool Parsed = false;
+    llvm::Optional<URI> ParsedURI;
+    bool Resolved = false;
+    llvm::Optional<URIForFile> File;
+    std::string Error;
+  };
+
+  /// Returns the entry of \p File, parsing its URI on first use.
+  Entry &parsed(unsigned File);
+
+  std::string HintPath;
+  llvm::StringMap<unsigned> Ordinals;
+  /// Indexed by ordinal. A deque keeps returned references valid.
+  std::deque<Entry> Entries;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_URITABLE_H
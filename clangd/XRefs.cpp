@@ -11,6 +11,7 @@
 #include "Logger.h"
 #include "SourceCode.h"
 #include "URI.h"
+#include "URITable.h"
 #include "llvm/ADT/STLExtras.h"
 #include "clang/AST/DeclTemplate.h"
 #include "clang/AST/RecursiveASTVisitor.h"
@@ -20,6 +21,7 @@
 #include "llvm/Support/Path.h"
 #include "index/SymbolCollector.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringSet.h"
 
 namespace clang {
 namespace clangd {
@@ -41,25 +43,21 @@ const Decl *GetDefinition(const Decl *D) {
 }
 
 // Convert a SymbolLocation to LSP's Location.
-// HintPath is used to resolve the path of URI.
+// URIs resolves the URI of the location, and memoizes the result.
 // FIXME: figure out a good home for it, and share the implementation with
 // FindSymbols.
 llvm::Optional<Location> ToLSPLocation(const SymbolLocation &Loc,
-                                       llvm::StringRef HintPath) {
+                                       URITable &URIs) {
   if (!Loc)
     return llvm::None;
-  auto Uri = URI::parse(Loc.FileURI);
-  if (!Uri) {
-    log("Could not parse URI: " + Loc.FileURI);
-    return llvm::None;
-  }
-  auto Path = URI::resolve(*Uri, HintPath);
-  if (!Path) {
-    log("Could not resolve URI: " + Loc.FileURI);
+  auto File = URIs.uriForFile(URIs.intern(Loc.FileURI));
+  if (!File) {
+    log("Could not resolve URI " + Loc.FileURI + ": " +
+        llvm::toString(File.takeError()));
     return llvm::None;
   }
   Location LSPLoc;
-  LSPLoc.uri = URIForFile(*Path);
+  LSPLoc.uri = *File;
   LSPLoc.range.start.line = Loc.Start.Line;
   LSPLoc.range.start.character = Loc.Start.Column;
   LSPLoc.range.end.line = Loc.End.Line;
@@ -301,17 +299,18 @@ std::vector<Location> findDefinitions(ParsedAST &AST, Position Pos,
         SourceMgr.getFileEntryForID(SourceMgr.getMainFileID());
     if (auto Path = getAbsoluteFilePath(FE, SourceMgr))
       HintPath = *Path;
+    URITable URIs(HintPath);
     // Query the index and populate the empty slot.
     Index->lookup(
-        QueryRequest, [&HintPath, &ResultCandidates](const Symbol &Sym) {
+        QueryRequest, [&URIs, &ResultCandidates](const Symbol &Sym) {
           auto It = ResultCandidates.find(Sym.ID);
           assert(It != ResultCandidates.end());
           auto &Value = It->second;
 
           if (!Value.Def)
-            Value.Def = ToLSPLocation(Sym.Definition, HintPath);
+            Value.Def = ToLSPLocation(Sym.Definition, URIs);
           if (!Value.Decl)
-            Value.Decl = ToLSPLocation(Sym.CanonicalDeclaration, HintPath);
+            Value.Decl = ToLSPLocation(Sym.CanonicalDeclaration, URIs);
         });
   }
 
@@ -731,9 +730,9 @@ class ReferencesFinder : public index::IndexDataConsumer {
 
 } // namespace
 
-std::vector<Location> references(ParsedAST &AST, Position Pos,
-                                 bool IncludeDeclaration,
-                                 const SymbolIndex *Index) {
+bool references(ParsedAST &AST, Position Pos, const ReferencesOptions &Opts,
+                const SymbolIndex *Index,
+                llvm::function_ref<void(std::vector<Location>)> Consumer) {
   const SourceManager &SourceMgr = AST.getASTContext().getSourceManager();
   SourceLocation SourceLocationBeg =
       getBeginningOfIdentifier(AST, Pos, SourceMgr.getMainFileID());
@@ -742,13 +741,11 @@ std::vector<Location> references(ParsedAST &AST, Position Pos,
   // FIXME: support macros.
   llvm::DenseSet<SymbolID> IDs;
   for (const auto* D : Symbols.Decls) {
-    if (auto ID = getSymbolID(D)) {
-      llvm::errs() << "ID: " << *ID << "\n";
+    if (auto ID = getSymbolID(D))
       IDs.insert(*ID);
-    }
   }
   XrefKindSet Filter = (XrefKindSet)XrefKind::Reference;
-  if (IncludeDeclaration) {
+  if (Opts.IncludeDeclaration) {
     Filter |=
         (XrefKindSet)XrefKind::Declarataion | (XrefKindSet)XrefKind::Definition;
   }
@@ -766,28 +763,62 @@ std::vector<Location> references(ParsedAST &AST, Position Pos,
   std::string HintPath;
   if (auto Path = getAbsoluteFilePath(FE, SourceMgr))
     HintPath = *Path;
-  std::vector<Location> Result;
-  llvm::DenseSet<llvm::StringRef> SeenFiles;
-  for (auto It : Collector.takeSymbols()) {
-    SeenFiles.insert(It.Loc.FileURI);
-    if (auto LSPLoc = ToLSPLocation(It.Loc, HintPath)) {
-      Result.push_back(*LSPLoc);
+  URITable URIs(HintPath);
+
+  // Locations are skipped until Opts.Offset, then batched until Opts.Limit.
+  size_t Skipped = 0, Returned = 0;
+  bool HasMore = false;
+  std::vector<Location> Batch;
+  auto Add = [&](Location Loc) {
+    if (Skipped < Opts.Offset) {
+      ++Skipped;
+      return;
     }
+    if (Opts.Limit && Returned == Opts.Limit) {
+      HasMore = true;
+      return;
+    }
+    ++Returned;
+    Batch.push_back(std::move(Loc));
+    if (Opts.BatchSize && Batch.size() == Opts.BatchSize) {
+      Consumer(std::move(Batch));
+      Batch.clear();
+    }
+  };
+
+  // The index may be stale for files that we have in the AST.
+  llvm::StringSet<> SeenFiles;
+  SymbolRefSlab MainFileRefs = Collector.takeSymbols();
+  for (const auto &It : MainFileRefs) {
+    SeenFiles.insert(It.Loc.FileURI);
+    if (auto LSPLoc = ToLSPLocation(It.Loc, URIs))
+      Add(std::move(*LSPLoc));
   }
-  if (Index) {
-    llvm::errs() << "Query index\n";
+  if (Index && !HasMore) {
     XrefRequest Req;
     Req.IDs = std::move(IDs);
     Req.Options = Filter;
-    Index->xrefs(Req, [&](const SymbolRefLocation& Loc) {
-      if (!llvm::is_contained(SeenFiles, Loc.Loc.FileURI)) {
-        if (auto LSPLoc = ToLSPLocation(Loc.Loc, HintPath)) {
-          Result.push_back(*LSPLoc);
-          llvm::errs() << "index output: " << LSPLoc->uri.uri();
-        }
-      }
+    Index->xrefs(Req, [&](const SymbolRefLocation &Loc) {
+      if (HasMore || SeenFiles.count(Loc.Loc.FileURI))
+        return;
+      if (auto LSPLoc = ToLSPLocation(Loc.Loc, URIs))
+        Add(std::move(*LSPLoc));
     });
   }
+  if (!Batch.empty())
+    Consumer(std::move(Batch));
+  return HasMore;
+}
+
+std::vector<Location> references(ParsedAST &AST, Position Pos,
+                                 bool IncludeDeclaration,
+                                 const SymbolIndex *Index) {
+  ReferencesOptions Opts;
+  Opts.IncludeDeclaration = IncludeDeclaration;
+  std::vector<Location> Result;
+  references(AST, Pos, Opts, Index, [&](std::vector<Location> Batch) {
+    Result = std::move(Batch);
+  });
   return Result;
 }
 
@@ -33,6 +33,28 @@ std::vector<DocumentHighlight> findDocumentHighlights(ParsedAST &AST,
 /// Get the hover information when hovering at \p Pos.
 llvm::Optional<Hover> getHover(ParsedAST &AST, Position Pos);
 
+struct ReferencesOptions {
+  /// Also return the declarations and definitions of the symbol.
+  bool IncludeDeclaration = false;
+  /// Locations are passed to the consumer in batches of this size.
+  /// 0 means a single batch.
+  size_t BatchSize = 0;
+  /// Skip this many locations, returned by a previous call that hit Limit.
+  size_t Offset = 0;
+  /// Stop after this many locations. 0 means no limit.
+  size_t Limit = 0;
+};
+
+/// Finds references to the symbol at \p Pos: the ones in the main file, then
+/// the ones in other files known to \p Index. Locations are passed to
+/// \p Consumer in batches as soon as they are found.
+/// Returns true if there were more than Opts.Limit locations. The next ones can
+/// be found by another call, with Opts.Offset increased by Opts.Limit.
+bool references(ParsedAST &AST, Position Pos, const ReferencesOptions &Opts,
+                const SymbolIndex *Index,
+                llvm::function_ref<void(std::vector<Location>)> Consumer);
+
+/// Returns all references to the symbol at \p Pos.
 std::vector<Location> references(ParsedAST &AST, Position Pos,
                                  bool includeDeclaration,
                                  const SymbolIndex *Index = nullptr);
@@ -0,0 +1,334 @@
+//===--- ClangdBenchmark.cpp - Benchmarks of clangd hot paths ----*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Micro-benchmarks of the code that runs on every keystroke or request, over
+// synthetic inputs. Run with --benchmark_filter=<regex> to select some.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangdServer.h"
+#include "Context.h"
+#include "DraftStore.h"
+#include "FuzzyMatch.h"
+#include "GlobalCompilationDatabase.h"
+#include "JSONExpr.h"
+#include "SourceCode.h"
+#include "index/MemIndex.h"
+#include "index/SymbolYAML.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "benchmark/benchmark.h"
+#include <future>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Generates N symbols with distinct names made of common words, in 16 scopes.
+SymbolSlab generateSymbols(unsigned N) {
+  static const char *const Words[] = {"get",  "set",    "Value", "Node",
+                                      "Decl", "Type",   "make",  "Buffer",
+                                      "Index", "Symbol", "find",  "Context"};
+  const unsigned NumWords = llvm::array_lengthof(Words);
+  SymbolSlab::Builder Builder;
+  for (unsigned I = 0; I < N; ++I) {
+    std::string Name = std::string(Words[I % NumWords]) +
+                       Words[(I / NumWords) % NumWords] + std::to_string(I);
+    std::string Scope = "ns" + std::to_string(I % 16) + "::";
+    std::string URI = "file:///src/file" + std::to_string(I % 512) + ".h";
+    Symbol Sym;
+    Sym.ID = SymbolID(Scope + Name);
+    Sym.Name = Name;
+    Sym.Scope = Scope;
+    Sym.SymInfo.Kind = index::SymbolKind::Function;
+    Sym.SymInfo.Lang = index::SymbolLanguage::CXX;
+    Sym.CanonicalDeclaration.FileURI = URI;
+    Sym.References = I % 100;
+    Sym.IsIndexedForCodeCompletion = true;
+    Builder.insert(Sym);
+  }
+  return std::move(Builder).build();
+}
+
+// Generates a source file with the given number of lines.
+std::string generateCode(unsigned Lines) {
+  std::string Code;
+  llvm::raw_string_ostream OS(Code);
+  for (unsigned I = 0; I < Lines; ++I)
+    OS << "  int variable_" << I << " = function_" << I << "(argument);\n";
+  return OS.str();
+}
+
+void fuzzyMatch(benchmark::State &State) {
+  SymbolSlab Symbols = generateSymbols(1000);
+  for (auto _ : State) {
+    FuzzyMatcher Matcher("gvn");
+    for (const Symbol &Sym : Symbols)
+      benchmark::DoNotOptimize(Matcher.match(Sym.Name));
+  }
+  State.SetItemsProcessed(State.iterations() * Symbols.size());
+}
+BENCHMARK(fuzzyMatch);
+
+void memIndexFuzzyFind(benchmark::State &State) {
+  auto Index = MemIndex::build(generateSymbols(State.range(0)));
+  FuzzyFindRequest Req;
+  Req.Query = "gvn";
+  Req.MaxCandidateCount = 100;
+  for (auto _ : State)
+    Index->fuzzyFind(Req,
+                     [](const Symbol &Sym) { benchmark::DoNotOptimize(Sym); });
+  State.SetItemsProcessed(State.iterations() * State.range(0));
+}
+BENCHMARK(memIndexFuzzyFind)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+void memIndexLookup(benchmark::State &State) {
+  SymbolSlab Symbols = generateSymbols(State.range(0));
+  LookupRequest Req;
+  for (const Symbol &Sym : Symbols)
+    if (Req.IDs.size() < 100)
+      Req.IDs.insert(Sym.ID);
+  auto Index = MemIndex::build(std::move(Symbols));
+  for (auto _ : State)
+    Index->lookup(Req,
+                  [](const Symbol &Sym) { benchmark::DoNotOptimize(Sym); });
+  State.SetItemsProcessed(State.iterations() * Req.IDs.size());
+}
+BENCHMARK(memIndexLookup)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+void symbolsFromYAML(benchmark::State &State) {
+  std::string YAML;
+  llvm::raw_string_ostream OS(YAML);
+  SymbolsToYAML(generateSymbols(State.range(0)), OS);
+  OS.flush();
+  for (auto _ : State)
+    benchmark::DoNotOptimize(SymbolsFromYAML(YAML));
+  State.SetBytesProcessed(State.iterations() * YAML.size());
+}
+BENCHMARK(symbolsFromYAML)->Range(1 << 8, 1 << 14);
+
+// Derives contexts the way a request does, and reads the innermost and the
+// outermost values.
+void contextDerive(benchmark::State &State) {
+  static Key<int> RequestID;
+  static Key<std::string> Method;
+  static Key<int> Span[4];
+  for (auto _ : State) {
+    Context Ctx = Context::empty().derive(RequestID, 1).derive(Method, "m");
+    for (const auto &K : Span)
+      Ctx = std::move(Ctx).derive(K, 42);
+    benchmark::DoNotOptimize(Ctx.get(Span[3]));
+    benchmark::DoNotOptimize(Ctx.get(RequestID));
+  }
+}
+BENCHMARK(contextDerive);
+
+void positionToOffset(benchmark::State &State) {
+  unsigned Lines = State.range(0);
+  std::string Code = generateCode(Lines);
+  std::vector<Position> Positions;
+  for (unsigned I = 0; I < 100; ++I) {
+    Position P;
+    P.line = Lines * I / 100;
+    P.character = 10;
+    Positions.push_back(P);
+  }
+  for (auto _ : State)
+    for (const Position &P : Positions)
+      benchmark::DoNotOptimize(cantFail(positionToOffset(Code, P)));
+  State.SetItemsProcessed(State.iterations() * Positions.size());
+}
+BENCHMARK(positionToOffset)->Range(1 << 8, 1 << 16);
+
+void updateDraft(benchmark::State &State) {
+  unsigned Lines = State.range(0);
+  DraftStore Drafts;
+  Drafts.addDraft("/bench/file.cc", generateCode(Lines));
+  // Typing a character in the middle of the file, then deleting it.
+  Position Start, End;
+  Start.line = End.line = Lines / 2;
+  End.character = 1;
+  TextDocumentContentChangeEvent Insert, Delete;
+  Insert.range = Range{Start, Start};
+  Insert.text = "x";
+  Delete.range = Range{Start, End};
+  for (auto _ : State) {
+    benchmark::DoNotOptimize(cantFail(Drafts.updateDraft("/bench/file.cc",
+                                                         {Insert})));
+    benchmark::DoNotOptimize(cantFail(Drafts.updateDraft("/bench/file.cc",
+                                                         {Delete})));
+  }
+  State.SetItemsProcessed(State.iterations() * 2);
+}
+BENCHMARK(updateDraft)->Range(1 << 8, 1 << 16);
+
+// A completion response, which is the largest payload sent while typing.
+json::Expr completionList(unsigned Items) {
+  json::ary List;
+  for (unsigned I = 0; I < Items; ++I) {
+    std::string Name = "function_" + std::to_string(I);
+    List.push_back(json::obj{
+        {"label", " " + Name + "(int argument)"},
+        {"kind", 3},
+        {"detail", "int"},
+        {"documentation", "Computes the value of " + Name + "."},
+        {"sortText", llvm::formatv("{0:x8}{1}", I, Name).str()},
+        {"filterText", Name},
+        {"insertText", Name + "(${1:int argument})"},
+        {"insertTextFormat", 2},
+    });
+  }
+  return json::obj{
+      {"jsonrpc", "2.0"},
+      {"id", 42},
+      {"result", json::obj{{"isIncomplete", true}, {"items", std::move(List)}}},
+  };
+}
+
+void serializeJSON(benchmark::State &State) {
+  json::Expr Message = completionList(State.range(0));
+  size_t Bytes = 0;
+  for (auto _ : State) {
+    std::string Out = llvm::formatv("{0}", Message).str();
+    Bytes += Out.size();
+    benchmark::DoNotOptimize(Out);
+  }
+  State.SetBytesProcessed(Bytes);
+}
+BENCHMARK(serializeJSON)->Range(1 << 4, 1 << 10);
+
+void parseJSON(benchmark::State &State) {
+  std::string Message =
+      llvm::formatv("{0}", completionList(State.range(0))).str();
+  for (auto _ : State)
+    benchmark::DoNotOptimize(cantFail(json::parse(Message)));
+  State.SetBytesProcessed(State.iterations() * Message.size());
+}
+BENCHMARK(parseJSON)->Range(1 << 4, 1 << 10);
+
+class InMemoryFSProvider : public FileSystemProvider {
+public:
+  IntrusiveRefCntPtr<vfs::FileSystem> getFileSystem() override {
+    IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS(
+        new vfs::InMemoryFileSystem);
+    for (const auto &File : Files)
+      FS->addFile(File.first(), /*ModificationTime=*/0,
+                  llvm::MemoryBuffer::getMemBufferCopy(File.second,
+                                                       File.first()));
+    return FS;
+  }
+
+  llvm::StringMap<std::string> Files;
+};
+
+class IgnoreDiagnostics : public DiagnosticsConsumer {
+  void onDiagnosticsReady(PathRef File, std::vector<Diag> Diags) override {}
+};
+
+// Completes an identifier in a file that includes a header with N functions
+// and N classes. The preamble is built once, so this measures the parse of
+// the main file, the Sema completion and the ranking of the results.
+void codeComplete(benchmark::State &State) {
+  const char *MainPath = "/bench/main.cc";
+  InMemoryFSProvider FS;
+  std::string Header;
+  llvm::raw_string_ostream OS(Header);
+  for (int I = 0; I < State.range(0); ++I)
+    OS << "int function_" << I << "(int argument);\n"
+       << "struct Class_" << I << " { int member_" << I << "; };\n";
+  FS.Files["/bench/header.h"] = OS.str();
+  std::string Main = "#include \"header.h\"\nint main() {\n  return fun";
+  FS.Files[MainPath] = Main;
+
+  IgnoreDiagnostics Diags;
+  DirectoryBasedGlobalCompilationDatabase CDB(llvm::None);
+  ClangdServer Server(CDB, FS, Diags, ClangdServer::optsForTest());
+  Server.addDocument(MainPath, Main, WantDiagnostics::No);
+  if (!Server.blockUntilIdleForTest()) {
+    State.SkipWithError("timed out building the preamble");
+    return;
+  }
+
+  Position Pos = offsetToPosition(Main, Main.size());
+  CodeCompleteOptions Opts;
+  for (auto _ : State) {
+    std::promise<size_t> NumResults;
+    Server.codeComplete(
+        MainPath, Pos, Opts,
+        [&NumResults](llvm::Expected<CodeCompleteResult> Result) {
+          if (!Result) {
+            llvm::consumeError(Result.takeError());
+            NumResults.set_value(0);
+            return;
+          }
+          NumResults.set_value(Result->Completions.size());
+        });
+    benchmark::DoNotOptimize(NumResults.get_future().get());
+  }
+}
+BENCHMARK(codeComplete)->Range(1 << 6, 1 << 12)->Unit(benchmark::kMillisecond);
+
+// Completes a member at the end of a main file that defines N functions with
+// long bodies, with and without skipping the bodies that don't contain the
+// completion point.
+void codeCompleteAfterBodies(benchmark::State &State) {
+  const char *MainPath = "/bench/main.cc";
+  InMemoryFSProvider FS;
+  std::string Main;
+  llvm::raw_string_ostream OS(Main);
+  OS << "struct Struct { int member; int method(); };\n";
+  for (int I = 0; I < State.range(0); ++I) {
+    OS << "int function_" << I << "(int argument) {\n"
+       << "  Struct S;\n";
+    for (int J = 0; J < 50; ++J)
+      OS << "  int variable_" << J << " = argument * " << J
+         << " + S.member;\n";
+    OS << "  return argument;\n}\n";
+  }
+  OS << "int main() {\n  Struct S;\n  return S.";
+  FS.Files[MainPath] = OS.str();
+
+  IgnoreDiagnostics Diags;
+  DirectoryBasedGlobalCompilationDatabase CDB(llvm::None);
+  ClangdServer Server(CDB, FS, Diags, ClangdServer::optsForTest());
+  Server.addDocument(MainPath, Main, WantDiagnostics::No);
+  if (!Server.blockUntilIdleForTest()) {
+    State.SkipWithError("timed out building the preamble");
+    return;
+  }
+
+  Position Pos = offsetToPosition(Main, Main.size());
+  CodeCompleteOptions Opts;
+  Opts.SkipFunctionBodies = State.range(1);
+  for (auto _ : State) {
+    std::promise<size_t> NumResults;
+    Server.codeComplete(
+        MainPath, Pos, Opts,
+        [&NumResults](llvm::Expected<CodeCompleteResult> Result) {
+          if (!Result) {
+            llvm::consumeError(Result.takeError());
+            NumResults.set_value(0);
+            return;
+          }
+          NumResults.set_value(Result->Completions.size());
+        });
+    benchmark::DoNotOptimize(NumResults.get_future().get());
+  }
+}
+BENCHMARK(codeCompleteAfterBodies)
+    ->ArgNames({"functions", "skip"})
+    ->Ranges({{1 << 4, 1 << 10}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
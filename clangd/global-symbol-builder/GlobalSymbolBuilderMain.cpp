@@ -11,11 +11,26 @@
 // whole project. This tools is for **experimental** only. Don't use it in
 // production code.
 //
+// The symbols of each translation unit are merged as soon as it is indexed,
+// into shards partitioned by symbol ID that are merged concurrently.
+//
+// With --manifest-dir, the symbols of each translation unit are also stored in
+// that directory, with digests of its command line and of every file it
+// includes. When the tool runs again, units whose inputs are unchanged are not
+// parsed: their stored symbols are merged instead, so that the output is the
+// same as if every unit had been indexed again. Stored units that the run did
+// not use are removed afterwards.
+//
+// With --executor=multi-process, units are indexed in worker processes, which
+// report the symbols of each unit as a result. They are merged once all the
+// units are indexed.
+//
 //===---------------------------------------------------------------------===//
 
 #include "index/CanonicalIncludes.h"
 #include "index/Index.h"
 #include "index/Merge.h"
+#include "index/Serialization.h"
 #include "index/SymbolCollector.h"
 #include "index/SymbolYAML.h"
 #include "clang/Frontend/CompilerInstance.h"
@@ -25,12 +40,19 @@
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Execution.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <atomic>
+#include <mutex>
 
 using namespace llvm;
 using namespace clang::tooling;
@@ -49,22 +71,317 @@ static llvm::cl::opt<std::string> AssumedHeaderDir(
                    "not given, such headers will have relative paths."),
     llvm::cl::init(""));
 
+enum class IndexFormat { YAML, Binary };
+static llvm::cl::opt<IndexFormat> Format(
+    "format", llvm::cl::desc("Format of the index to be written"),
+    llvm::cl::values(clEnumValN(IndexFormat::YAML, "yaml", "YAML symbols"),
+                     clEnumValN(IndexFormat::Binary, "binary",
+                                "binary index file, see Serialization.h")),
+    llvm::cl::init(IndexFormat::YAML));
+
+static llvm::cl::opt<std::string> ManifestDir(
+    "manifest-dir",
+    llvm::cl::desc("Directory where the symbols and inputs of each translation "
+                   "unit are stored. Units whose command line and included "
+                   "files did not change since the last run are not indexed "
+                   "again."),
+    llvm::cl::init(""));
+
+// The command line of the unit that is being indexed on this thread. Executors
+// run the arguments adjusters of a unit and its action on the same thread.
+static thread_local std::vector<std::string> CurrentCommandLine;
+
+// Combines occurrences of the same symbol across translation units.
+// Symbols are partitioned into shards by their ID. Each shard has its own lock,
+// so TUs that finish at the same time are mostly merged concurrently.
+class SymbolMerger {
+public:
+  SymbolMerger(unsigned NumShards) : Shards(NumShards) {}
+
+  // Merges the symbols of a translation unit. This is thread-safe.
+  void add(const SymbolSlab &Symbols) {
+    std::vector<std::vector<const Symbol *>> ByShard(Shards.size());
+    for (const Symbol &Sym : Symbols)
+      ByShard[shardOf(Sym.ID)].push_back(&Sym);
+    for (unsigned I = 0; I < Shards.size(); ++I) {
+      if (ByShard[I].empty())
+        continue;
+      Shard &S = Shards[I];
+      std::lock_guard<std::mutex> Lock(S.Mu);
+      for (const Symbol *Sym : ByShard[I]) {
+        if (const auto *Existing = S.Symbols.find(Sym->ID))
+          S.Symbols.insert(mergeSymbol(*Existing, *Sym, &S.Scratch));
+        else
+          S.Symbols.insert(*Sym);
+      }
+    }
+  }
+
+  // Builds the shards in parallel. No symbol is in more than one of them.
+  std::vector<SymbolSlab> build() && {
+    std::vector<SymbolSlab> Result(Shards.size());
+    llvm::ThreadPool Pool;
+    for (unsigned I = 0; I < Shards.size(); ++I)
+      Pool.async([this, &Result, I] {
+        Result[I] = std::move(Shards[I].Symbols).build();
+      });
+    Pool.wait();
+    return Result;
+  }
+
+private:
+  struct Shard {
+    std::mutex Mu;
+    SymbolSlab::Builder Symbols;
+    Symbol::Details Scratch;
+  };
+
+  unsigned shardOf(const SymbolID &ID) const {
+    return static_cast<size_t>(hash_value(ID)) % Shards.size();
+  }
+
+  std::vector<Shard> Shards;
+};
+
+// Identifies the inputs of a unit, except the files it includes.
+FileDigest commandDigest(llvm::ArrayRef<std::string> CommandLine,
+                         llvm::StringRef Directory, llvm::StringRef Content) {
+  llvm::SHA1 Hasher;
+  Hasher.update(Directory);
+  for (const auto &Arg : CommandLine) {
+    Hasher.update(llvm::StringRef("\0", 1));
+    Hasher.update(Arg);
+  }
+  Hasher.update(llvm::StringRef("\0", 1));
+  Hasher.update(Content);
+  llvm::StringRef Hash = Hasher.final();
+  FileDigest Result;
+  std::copy(Hash.bytes_begin(), Hash.bytes_end(), Result.begin());
+  return Result;
+}
+
+// The symbols of each translation unit from previous runs, and the inputs they
+// were built from. A unit's file lists the main file first, with the digest of
+// its command, followed by the files it included. A file compiled with several
+// commands has a unit for each of them.
+class IndexManifest {
+public:
+  IndexManifest(llvm::StringRef Dir)
+      : Dir(Dir),
+        // File systems may store modification times in whole seconds.
+        Started(std::chrono::time_point_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now())) {}
+
+  // Returns the stored symbols of MainFile, unless its inputs have changed.
+  llvm::Optional<SymbolSlab> load(llvm::StringRef MainFile,
+                                  const FileDigest &Key) {
+    std::string Path = unitPath(MainFile, Key);
+    auto Buf = llvm::MemoryBuffer::getFile(Path);
+    if (!Buf)
+      return llvm::None;
+    auto Unit = readIndexFile((*Buf)->getBuffer());
+    if (!Unit) {
+      llvm::errs() << "Ignoring stored symbols of " << MainFile << ": "
+                   << llvm::toString(Unit.takeError()) << "\n";
+      return llvm::None;
+    }
+    if (Unit->Sources.empty() || Unit->Sources.front().Digest != Key)
+      return llvm::None;
+    for (const auto &Source : llvm::makeArrayRef(Unit->Sources).drop_front()) {
+      auto Digest = fileDigest(Source.Path);
+      if (!Digest || *Digest != Source.Digest)
+        return llvm::None;
+    }
+    // Marks the unit as used by this run, so that prune() keeps it. Units may
+    // be loaded in worker processes, which don't share this object.
+    int FD;
+    if (!llvm::sys::fs::openFileForRead(Path, FD)) {
+      llvm::sys::fs::setLastModificationAndAccessTime(
+          FD, std::chrono::system_clock::now());
+      llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+    }
+    ++NumLoaded;
+    return std::move(Unit->Symbols);
+  }
+
+  void store(llvm::StringRef MainFile, const FileDigest &Key,
+             const SymbolSlab &Symbols,
+             llvm::ArrayRef<IndexFileSource> Sources) {
+    IndexFileOut Unit;
+    Unit.Symbols = &Symbols;
+    Unit.Sources = Sources;
+    // Write to a temporary file first, so that an interrupted run never leaves
+    // a partial file behind.
+    std::string Path = unitPath(MainFile, Key);
+    llvm::SmallString<128> TempPath;
+    int FD;
+    std::error_code EC = llvm::sys::fs::create_directories(Dir);
+    if (!EC)
+      EC = llvm::sys::fs::createUniqueFile(Path + "-%%%%%%.tmp", FD, TempPath);
+    if (!EC) {
+      {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        writeIndexFile(Unit, OS);
+      }
+      EC = llvm::sys::fs::rename(TempPath, Path);
+    }
+    if (EC)
+      llvm::errs() << "Couldn't write " << Path << ": " << EC.message()
+                   << "\n";
+    else
+      ++NumStored;
+  }
+
+  // Removes the units that were neither loaded nor stored since the manifest
+  // was created, e.g. because their file is no longer in the compilation
+  // database or their command or main file changed. Returns their number.
+  unsigned prune() {
+    unsigned NumPruned = 0;
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator It(Dir, EC), End; It != End && !EC;
+         It.increment(EC)) {
+      if (llvm::sys::path::extension(It->path()) != ".idx")
+        continue;
+      llvm::sys::fs::file_status Status;
+      if (llvm::sys::fs::status(It->path(), Status) ||
+          Status.getLastModificationTime() >= Started)
+        continue;
+      if (!llvm::sys::fs::remove(It->path()))
+        ++NumPruned;
+    }
+    if (EC)
+      llvm::errs() << "Couldn't list " << Dir << ": " << EC.message() << "\n";
+    return NumPruned;
+  }
+
+  // The number of units whose symbols were reused, and that were indexed and
+  // stored.
+  std::atomic<unsigned> NumLoaded = {0};
+  std::atomic<unsigned> NumStored = {0};
+
+private:
+  std::string unitPath(llvm::StringRef MainFile, const FileDigest &Key) const {
+    // Files with the same name in different directories, and the same file
+    // compiled with different commands, get different paths.
+    FileDigest PathDigest =
+        digest((MainFile + llvm::toStringRef(Key)).str());
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(
+        Path, llvm::sys::path::filename(MainFile) + "." +
+                  llvm::toHex(llvm::toStringRef(PathDigest)).substr(0, 16) +
+                  ".idx");
+    return Path.str();
+  }
+
+  // Headers are shared by many units, so their digests are only computed once
+  // per run.
+  llvm::Optional<FileDigest> fileDigest(llvm::StringRef Path) {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      auto It = Digests.find(Path);
+      if (It != Digests.end())
+        return It->second;
+    }
+    llvm::Optional<FileDigest> Digest;
+    if (auto Buf = llvm::MemoryBuffer::getFile(Path))
+      Digest = digest((*Buf)->getBuffer());
+    std::lock_guard<std::mutex> Lock(Mu);
+    Digests[Path] = Digest;
+    return Digest;
+  }
+
+  std::string Dir;
+  // Units that were modified before this are unused by the run.
+  llvm::sys::TimePoint<std::chrono::seconds> Started;
+  std::mutex Mu;
+  llvm::StringMap<llvm::Optional<FileDigest>> Digests;
+};
+
 class SymbolIndexActionFactory : public tooling::FrontendActionFactory {
 public:
-  SymbolIndexActionFactory(tooling::ExecutionContext *Ctx) : Ctx(Ctx) {}
+  // If Ctx is set, the symbols of each unit are reported to it instead of
+  // being merged, e.g. because units are indexed in other processes.
+  SymbolIndexActionFactory(SymbolMerger &Merger, IndexManifest *Manifest,
+                           ExecutionContext *Ctx)
+      : Merger(Merger), Manifest(Manifest), Ctx(Ctx) {}
+
+  clang::FrontendAction *create() override { return createAction(nullptr); }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    if (!Manifest || Invocation->getFrontendOpts().Inputs.size() != 1)
+      return FrontendActionFactory::runInvocation(
+          std::move(Invocation), Files, std::move(PCHContainerOps),
+          DiagConsumer);
+
+    llvm::SmallString<128> MainFile(
+        Invocation->getFrontendOpts().Inputs.front().getFile());
+    Files->makeAbsolutePath(MainFile);
+    llvm::sys::path::remove_dots(MainFile, /*remove_dot_dot=*/true);
+    auto Buf = Files->getBufferForFile(MainFile);
+    if (!Buf) {
+      llvm::errs() << "Couldn't read " << MainFile << ": "
+                   << Buf.getError().message() << "\n";
+      return false;
+    }
+    auto Directory =
+        Files->getVirtualFileSystem()->getCurrentWorkingDirectory();
+    FileDigest Key = commandDigest(CurrentCommandLine,
+                                   Directory ? *Directory : "",
+                                   (*Buf)->getBuffer());
+    if (auto Symbols = Manifest->load(MainFile, Key)) {
+      addSymbols(MainFile, *Symbols);
+      return true;
+    }
+
+    // Same as FrontendActionFactory::runInvocation(), but the action also
+    // records the inputs of the unit.
+    IndexFileSource Unit{MainFile.str().str(), Key};
+    CompilerInstance Compiler(std::move(PCHContainerOps));
+    Compiler.setInvocation(std::move(Invocation));
+    Compiler.setFileManager(Files);
+    std::unique_ptr<FrontendAction> Action(createAction(&Unit));
+    Compiler.createDiagnostics(DiagConsumer, /*ShouldOwnClient=*/false);
+    if (!Compiler.hasDiagnostics())
+      return false;
+    Compiler.createSourceManager(*Files);
+    const bool Success = Compiler.ExecuteAction(*Action);
+    Files->clearStatCaches();
+    return Success;
+  }
 
-  clang::FrontendAction *create() override {
-    // Wraps the index action and reports collected symbols to the execution
-    // context at the end of each translation unit.
+private:
+  void addSymbols(llvm::StringRef MainFile, const SymbolSlab &Symbols) {
+    if (!Ctx) {
+      Merger.add(Symbols);
+      return;
+    }
+    IndexFileOut Out;
+    Out.Symbols = &Symbols;
+    std::string Data;
+    llvm::raw_string_ostream OS(Data);
+    writeIndexFile(Out, OS);
+    Ctx->reportResult(MainFile, OS.str());
+  }
+
+  // If Unit is set, the symbols and inputs of the unit are stored in the
+  // manifest.
+  clang::FrontendAction *createAction(const IndexFileSource *Unit) {
+    // Wraps the index action and merges collected symbols at the end of each
+    // translation unit.
     class WrappedIndexAction : public WrapperFrontendAction {
     public:
       WrappedIndexAction(std::shared_ptr<SymbolCollector> C,
                          std::unique_ptr<CanonicalIncludes> Includes,
                          const index::IndexingOptions &Opts,
-                         tooling::ExecutionContext *Ctx)
+                         SymbolIndexActionFactory &Factory,
+                         IndexManifest *Manifest, const IndexFileSource *Unit)
           : WrapperFrontendAction(
                 index::createIndexingAction(C, Opts, nullptr)),
-            Ctx(Ctx), Collector(C), Includes(std::move(Includes)),
+            Factory(Factory), Manifest(Manifest), Unit(Unit), Collector(C),
+            Includes(std::move(Includes)),
             PragmaHandler(collectIWYUHeaderMaps(this->Includes.get())) {}
 
       std::unique_ptr<ASTConsumer>
@@ -91,14 +408,39 @@ public:
           return;
         }
 
-        auto Symbols = Collector->takeSymbols();
-        for (const auto &Sym : Symbols) {
-          Ctx->reportResult(Sym.ID.str(), SymbolToYAML(Sym));
-        }
+        SymbolSlab Symbols = Collector->takeSymbols();
+        if (Unit)
+          Manifest->store(Unit->Path, Unit->Digest, Symbols,
+                          sources(CI.getSourceManager()));
+        Factory.addSymbols(getCurrentFile(), Symbols);
       }
 
     private:
-      tooling::ExecutionContext *Ctx;
+      // The main file with the digest of its command, then every file that
+      // was parsed.
+      std::vector<IndexFileSource> sources(const SourceManager &SM) const {
+        std::vector<IndexFileSource> Sources = {*Unit};
+        const FileEntry *MainFile = SM.getFileEntryForID(SM.getMainFileID());
+        for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It) {
+          const FileEntry *File = It->first;
+          if (File == MainFile)
+            continue;
+          bool Invalid = false;
+          const llvm::MemoryBuffer *Buffer =
+              SM.getMemoryBufferForFile(File, &Invalid);
+          if (Invalid || !Buffer)
+            continue;
+          std::string Path = File->tryGetRealPathName().str();
+          if (Path.empty())
+            Path = File->getName().str();
+          Sources.push_back({std::move(Path), digest(Buffer->getBuffer())});
+        }
+        return Sources;
+      }
+
+      SymbolIndexActionFactory &Factory;
+      IndexManifest *Manifest;
+      const IndexFileSource *Unit;
       std::shared_ptr<SymbolCollector> Collector;
       std::unique_ptr<CanonicalIncludes> Includes;
       std::unique_ptr<CommentHandler> PragmaHandler;
@@ -118,35 +460,23 @@ public:
     CollectorOpts.Includes = Includes.get();
     return new WrappedIndexAction(
         std::make_shared<SymbolCollector>(std::move(CollectorOpts)),
-        std::move(Includes), IndexOpts, Ctx);
+        std::move(Includes), IndexOpts, *this, Manifest, Unit);
   }
 
-  tooling::ExecutionContext *Ctx;
+  SymbolMerger &Merger;
+  IndexManifest *Manifest;
+  ExecutionContext *Ctx;
 };
 
-// Combine occurrences of the same symbol across translation units.
-SymbolSlab mergeSymbols(tooling::ToolResults *Results) {
-  SymbolSlab::Builder UniqueSymbols;
-
-  
-  llvm::BumpPtrAllocator Arena;
-  Symbol::Details Scratch;
-  Results->forEachResult([&](llvm::StringRef Key, llvm::StringRef Value) {
-    Arena.Reset();
-    llvm::yaml::Input Yin(Value, &Arena);
-    auto Sym = clang::clangd::SymbolFromYAML(Yin, Arena);
-    clang::clangd::SymbolID ID;
-    Key >> ID;
-    if (const auto *Existing = UniqueSymbols.find(ID))
-      UniqueSymbols.insert(mergeSymbol(*Existing, Sym, &Scratch));
-    else
-      UniqueSymbols.insert(Sym);
-  });
-  return std::move(UniqueSymbols).build();
-}
-
 } // namespace
 } // namespace clangd
+
+namespace tooling {
+// This anchor is used to force the linker to link the multi-process executor.
+extern volatile int MultiProcessToolExecutorAnchorSource;
+static int LLVM_ATTRIBUTE_UNUSED MultiProcessToolExecutorAnchorDestination =
+    MultiProcessToolExecutorAnchorSource;
+} // namespace tooling
 } // namespace clang
 
 int main(int argc, const char **argv) {
@@ -170,19 +500,70 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
-  // Map phase: emit symbols found in each translation unit.
+  // Map and reduce phases: symbols found in each translation unit are merged
+  // using the ID as a key while other translation units are still indexed.
+  // More shards than threads keep lock contention low.
+  // Units that are unchanged since the last run contribute their stored
+  // symbols instead. Units that are no longer in the compilation database are
+  // not visited, so their symbols are dropped.
+  clang::clangd::SymbolMerger Merger(4 * llvm::hardware_concurrency());
+  std::unique_ptr<clang::clangd::IndexManifest> Manifest;
+  if (!clang::clangd::ManifestDir.empty())
+    Manifest = llvm::make_unique<clang::clangd::IndexManifest>(
+        clang::clangd::ManifestDir);
+  bool InProcess = Executor->get()->isSingleProcess();
   auto Err = Executor->get()->execute(
       llvm::make_unique<clang::clangd::SymbolIndexActionFactory>(
-          Executor->get()->getExecutionContext()));
+          Merger, Manifest.get(),
+          InProcess ? nullptr : Executor->get()->getExecutionContext()),
+      [](const CommandLineArguments &Args, StringRef Filename) {
+        clang::clangd::CurrentCommandLine = Args;
+        return Args;
+      });
   if (Err) {
     llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+  } else if (Manifest) {
+    // A failed run may not have visited every unit, so nothing is pruned.
+    if (unsigned NumPruned = Manifest->prune())
+      llvm::errs() << "Removed the stored symbols of " << NumPruned
+                   << " unused translation units\n";
   }
+  if (!InProcess) {
+    // Results are read back one file at a time, so only the merged symbols
+    // are kept in memory.
+    Executor->get()->getToolResults()->forEachResult(
+        [&](llvm::StringRef Key, llvm::StringRef Value) {
+          auto Unit = clang::clangd::readIndexFile(Value);
+          if (!Unit) {
+            llvm::errs() << "Ignoring the symbols of " << Key << ": "
+                         << llvm::toString(Unit.takeError()) << "\n";
+            return;
+          }
+          Merger.add(Unit->Symbols);
+        });
+  }
+  // Workers have their own counts.
+  if (Manifest && InProcess)
+    llvm::errs() << "Reused the symbols of " << Manifest->NumLoaded
+                 << " translation units, indexed " << Manifest->NumStored
+                 << "\n";
+  auto Shards = std::move(Merger).build();
 
-  // Reduce phase: combine symbols using the ID as a key.
-  auto UniqueSymbols =
-      clang::clangd::mergeSymbols(Executor->get()->getToolResults());
-
-  // Output phase: emit YAML for result symbols.
-  SymbolsToYAML(UniqueSymbols, llvm::outs());
+  // Output phase: emit result symbols, one shard after the other.
+  switch (clang::clangd::Format) {
+  case clang::clangd::IndexFormat::YAML:
+    for (const auto &Shard : Shards)
+      SymbolsToYAML(Shard, llvm::outs());
+    break;
+  case clang::clangd::IndexFormat::Binary: {
+    std::vector<const SymbolSlab *> ShardPointers;
+    for (const auto &Shard : Shards)
+      ShardPointers.push_back(&Shard);
+    clang::clangd::IndexFileOut Out;
+    Out.SymbolShards = ShardPointers;
+    clang::clangd::writeIndexFile(Out, llvm::outs());
+    break;
+  }
+  }
   return 0;
 }
@@ -0,0 +1,53 @@
+//===--- IndexServerMain.cpp -------------------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Loads an index file and serves it to clangd instances started with
+// -remote-index=<address>, so that they share a single copy of a large index.
+//
+//===---------------------------------------------------------------------===//
+
+#include "index/Remote.h"
+#include "index/Serialization.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace clang::clangd;
+
+static cl::opt<std::string> IndexFile(cl::Positional, cl::Required,
+                                      cl::desc("<index file>"));
+
+static cl::opt<std::string>
+    Address("address",
+            cl::desc("Address to listen on: unix:<socket path> or "
+                     "[<host>]:<port>"),
+            cl::init("localhost:50051"));
+
+int main(int argc, const char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Serves a clangd index (binary or YAML) to remote index clients.\n");
+
+  std::unique_ptr<SymbolIndex> Index = loadIndex(IndexFile);
+  if (!Index) {
+    errs() << "Can't load index from " << IndexFile << "\n";
+    return 1;
+  }
+  auto Server = IndexServer::listen(*Index, Address);
+  if (!Server) {
+    errs() << "Can't listen on " << Address << ": "
+           << toString(Server.takeError()) << "\n";
+    return 1;
+  }
+  errs() << "Serving " << IndexFile << " on " << Address << "\n";
+  (*Server)->wait();
+  return 0;
+}
@@ -0,0 +1,431 @@
+//===--- Background.cpp - Build an index in a background thread --*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Background.h"
+#include "../ClangdServer.h"
+#include "../Compiler.h"
+#include "../Logger.h"
+#include "../Threading.h"
+#include "../Trace.h"
+#include "CanonicalIncludes.h"
+#include "SymbolCollector.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Index/IndexingAction.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Rebuilding the index is linear in the number of symbols, so while there are
+// many units in the queue, only rebuild it after this many units changed.
+constexpr unsigned RebuildPeriod = 32;
+
+// Identifies the inputs of a unit, except the files it includes.
+FileDigest commandDigest(const tooling::CompileCommand &Cmd,
+                         llvm::StringRef Content) {
+  llvm::SHA1 Hasher;
+  Hasher.update(Cmd.Directory);
+  for (const auto &Arg : Cmd.CommandLine) {
+    Hasher.update(llvm::StringRef("\0", 1));
+    Hasher.update(Arg);
+  }
+  Hasher.update(llvm::StringRef("\0", 1));
+  Hasher.update(Content);
+  llvm::StringRef Hash = Hasher.final();
+  FileDigest Result;
+  std::copy(Hash.bytes_begin(), Hash.bytes_end(), Result.begin());
+  return Result;
+}
+
+// Runs the symbol collector, and also collects references and the files that
+// were parsed.
+class IndexAction : public WrapperFrontendAction {
+public:
+  IndexAction(std::shared_ptr<SymbolCollector> Collector,
+              std::unique_ptr<CanonicalIncludes> Includes,
+              const index::IndexingOptions &Opts,
+              llvm::ArrayRef<std::string> URISchemes)
+      : WrapperFrontendAction(
+            index::createIndexingAction(Collector, Opts, nullptr)),
+        Collector(Collector), Includes(std::move(Includes)),
+        PragmaHandler(collectIWYUHeaderMaps(this->Includes.get())),
+        URISchemes(URISchemes) {}
+
+  std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
+                                                 StringRef InFile) override {
+    CI.getPreprocessor().addCommentHandler(PragmaHandler.get());
+    return WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+  }
+
+  void EndSourceFileAction() override {
+    WrapperFrontendAction::EndSourceFileAction();
+
+    auto &CI = getCompilerInstance();
+    Refs = indexASTRef(CI.getASTContext(), CI.getPreprocessorPtr(),
+                       URISchemes);
+    SourceManager &SM = CI.getSourceManager();
+    const FileEntry *MainFile = SM.getFileEntryForID(SM.getMainFileID());
+    for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It) {
+      const FileEntry *File = It->first;
+      if (File == MainFile)
+        continue;
+      bool Invalid = false;
+      const llvm::MemoryBuffer *Buffer =
+          SM.getMemoryBufferForFile(File, &Invalid);
+      if (Invalid || !Buffer)
+        continue;
+      std::string Path = File->tryGetRealPathName().str();
+      if (Path.empty())
+        Path = File->getName().str();
+      Sources.push_back({std::move(Path), digest(Buffer->getBuffer())});
+    }
+  }
+
+  SymbolSlab takeSymbols() { return Collector->takeSymbols(); }
+  SymbolRefSlab takeRefs() { return std::move(Refs); }
+  std::vector<IndexFileSource> takeSources() { return std::move(Sources); }
+
+private:
+  std::shared_ptr<SymbolCollector> Collector;
+  std::unique_ptr<CanonicalIncludes> Includes;
+  std::unique_ptr<CommentHandler> PragmaHandler;
+  llvm::ArrayRef<std::string> URISchemes;
+  SymbolRefSlab Refs;
+  std::vector<IndexFileSource> Sources;
+};
+
+} // namespace
+
+BackgroundIndex::BackgroundIndex(llvm::StringRef ResourceDir,
+                                 FileSystemProvider &FSProvider,
+                                 llvm::StringRef ShardDir,
+                                 std::vector<std::string> URISchemes,
+                                 unsigned ThreadPoolSize)
+    : BackgroundContext(Context::current().clone()), ResourceDir(ResourceDir),
+      FSProvider(FSProvider), ShardDir(ShardDir),
+      URISchemes(std::move(URISchemes)) {
+  assert(ThreadPoolSize > 0 && "Thread pool size can't be zero.");
+  while (ThreadPoolSize--)
+    ThreadPool.emplace_back([this] { run(); });
+}
+
+BackgroundIndex::~BackgroundIndex() {
+  {
+    std::lock_guard<std::mutex> Lock(QueueMu);
+    ShouldStop = true;
+  }
+  QueueCV.notify_all();
+  for (auto &Thread : ThreadPool)
+    Thread.join();
+}
+
+void BackgroundIndex::enqueue(std::vector<tooling::CompileCommand> Commands) {
+  {
+    std::lock_guard<std::mutex> Lock(QueueMu);
+    for (auto &Cmd : Commands) {
+      // Filename is only used by clangd, make it absolute once and for all.
+      if (!llvm::sys::path::is_absolute(Cmd.Filename)) {
+        llvm::SmallString<128> Path(Cmd.Directory);
+        llvm::sys::path::append(Path, Cmd.Filename);
+        Cmd.Filename = Path.str();
+      }
+      if (Queued.insert(Cmd.Filename).second)
+        Queue.push_back(std::move(Cmd));
+    }
+  }
+  QueueCV.notify_all();
+}
+
+void BackgroundIndex::fileChanged(PathRef File) {
+  std::vector<tooling::CompileCommand> ToIndex;
+  {
+    std::lock_guard<std::mutex> Lock(StateMu);
+    Digests.erase(File);
+    auto It = Dependents.find(File);
+    if (It == Dependents.end())
+      return;
+    for (const auto &MainFile : It->second) {
+      auto Cmd = Commands.find(MainFile.getKey());
+      if (Cmd != Commands.end())
+        ToIndex.push_back(Cmd->second);
+    }
+  }
+  enqueue(std::move(ToIndex));
+}
+
+bool BackgroundIndex::blockUntilIdleForTest(
+    llvm::Optional<double> TimeoutSeconds) {
+  std::unique_lock<std::mutex> Lock(QueueMu);
+  return wait(Lock, QueueCV, timeoutSeconds(TimeoutSeconds),
+              [&] { return Queue.empty() && NumActiveTasks == 0; });
+}
+
+void BackgroundIndex::run() {
+  WithContext Background(BackgroundContext.clone());
+  setCurrentThreadPriority(ThreadPriority::Low);
+  while (true) {
+    tooling::CompileCommand Cmd;
+    {
+      std::unique_lock<std::mutex> Lock(QueueMu);
+      QueueCV.wait(Lock, [&] { return ShouldStop || !Queue.empty(); });
+      if (ShouldStop)
+        return;
+      ++NumActiveTasks;
+      Cmd = std::move(Queue.front());
+      Queue.pop_front();
+      Queued.erase(Cmd.Filename);
+    }
+
+    bool Changed = index(std::move(Cmd));
+
+    bool Rebuild;
+    {
+      std::lock_guard<std::mutex> Lock(QueueMu);
+      if (Changed)
+        ++PendingUpdates;
+      Rebuild = PendingUpdates > 0 &&
+                (PendingUpdates >= RebuildPeriod || Queue.empty());
+      if (Rebuild)
+        PendingUpdates = 0;
+    }
+    if (Rebuild)
+      // Units share the symbols of their headers: merge them, so that the
+      // copy from a unit that saw the definition isn't hidden by another.
+      Index.build(Symbols.mergedSymbols(), Symbols.allSymbolRefs());
+
+    {
+      std::lock_guard<std::mutex> Lock(QueueMu);
+      --NumActiveTasks;
+    }
+    QueueCV.notify_all();
+  }
+}
+
+bool BackgroundIndex::index(tooling::CompileCommand Cmd) {
+  trace::Span Tracer("BackgroundIndex");
+  SPAN_ATTACH(Tracer, "file", Cmd.Filename);
+  Path MainFile = Cmd.Filename;
+  {
+    std::lock_guard<std::mutex> Lock(StateMu);
+    Commands[MainFile] = Cmd;
+  }
+
+  auto FS = FSProvider.getFileSystem();
+  auto Buf = FS->getBufferForFile(MainFile);
+  if (!Buf) {
+    log("BackgroundIndex: couldn't read " + MainFile + ": " +
+        Buf.getError().message());
+    return false;
+  }
+  FileDigest Key = commandDigest(Cmd, (*Buf)->getBuffer());
+  if (isIndexed(MainFile, Key, *FS))
+    return false;
+  if (loadShard(MainFile, Key, *FS))
+    return true;
+
+  ParseInputs Inputs;
+  Inputs.CompileCommand = std::move(Cmd);
+  Inputs.CompileCommand.CommandLine.push_back("-resource-dir=" + ResourceDir);
+  Inputs.FS = FS;
+  Inputs.Contents = (*Buf)->getBuffer().str();
+  auto CI = buildCompilerInvocation(Inputs);
+  if (!CI) {
+    log("BackgroundIndex: couldn't build compiler invocation for " + MainFile);
+    return false;
+  }
+  IgnoreDiagnostics IgnoreDiags;
+  auto Clang = prepareCompilerInstance(
+      std::move(CI), /*Preamble=*/nullptr, std::move(*Buf),
+      std::make_shared<PCHContainerOperations>(), FS, IgnoreDiags);
+  if (!Clang) {
+    log("BackgroundIndex: couldn't build compiler instance for " + MainFile);
+    return false;
+  }
+
+  SymbolCollector::Options CollectorOpts;
+  if (!URISchemes.empty())
+    CollectorOpts.URISchemes = URISchemes;
+  CollectorOpts.CollectIncludePath = true;
+  CollectorOpts.CountReferences = true;
+  CollectorOpts.Origin = SymbolOrigin::Static;
+  auto Includes = llvm::make_unique<CanonicalIncludes>();
+  addSystemHeadersMapping(Includes.get());
+  CollectorOpts.Includes = Includes.get();
+  index::IndexingOptions IndexOpts;
+  IndexOpts.SystemSymbolFilter =
+      index::IndexingOptions::SystemSymbolFilterKind::All;
+  IndexOpts.IndexFunctionLocals = false;
+  IndexAction Action(
+      std::make_shared<SymbolCollector>(std::move(CollectorOpts)),
+      std::move(Includes), IndexOpts, URISchemes);
+
+  const FrontendInputFile &Input = Clang->getFrontendOpts().Inputs.front();
+  if (!Action.BeginSourceFile(*Clang, Input)) {
+    log("BackgroundIndex: BeginSourceFile() failed for " + MainFile);
+    return false;
+  }
+  if (!Action.Execute())
+    log("BackgroundIndex: Execute() failed for " + MainFile);
+  Action.EndSourceFile();
+  if (Clang->getDiagnostics().hasUncompilableErrorOccurred())
+    log("BackgroundIndex: " + MainFile +
+        " has errors, its symbols may be incomplete");
+
+  std::vector<IndexFileSource> Sources = {{MainFile, Key}};
+  for (auto &Source : Action.takeSources())
+    Sources.push_back(std::move(Source));
+  SymbolSlab Syms = Action.takeSymbols();
+  SymbolRefSlab Refs = Action.takeRefs();
+  log(llvm::formatv("BackgroundIndex: indexed {0} ({1} symbols, {2} refs)",
+                    MainFile, Syms.size(), Refs.size()));
+
+  if (!ShardDir.empty()) {
+    IndexFileOut Shard;
+    Shard.Symbols = &Syms;
+    Shard.Refs = &Refs;
+    Shard.Sources = Sources;
+    // Write to a temporary file first, so that readers never see a partial
+    // shard.
+    std::string ShardPath = shardPath(MainFile);
+    llvm::SmallString<128> TempPath;
+    int FD;
+    std::error_code EC = llvm::sys::fs::create_directories(ShardDir);
+    if (!EC)
+      EC = llvm::sys::fs::createUniqueFile(ShardPath + "-%%%%%%.tmp", FD,
+                                           TempPath);
+    if (!EC) {
+      {
+        llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        writeIndexFile(Shard, OS);
+      }
+      EC = llvm::sys::fs::rename(TempPath, ShardPath);
+    }
+    if (EC)
+      log("BackgroundIndex: couldn't write shard " + ShardPath + ": " +
+          EC.message());
+  }
+
+  update(MainFile, std::move(Syms), std::move(Refs), std::move(Sources));
+  return true;
+}
+
+bool BackgroundIndex::isIndexed(PathRef MainFile, const FileDigest &Key,
+                                vfs::FileSystem &FS) {
+  std::vector<IndexFileSource> Indexed;
+  {
+    std::lock_guard<std::mutex> Lock(StateMu);
+    auto It = IndexedSources.find(MainFile);
+    if (It == IndexedSources.end())
+      return false;
+    Indexed = It->second;
+  }
+  return isUpToDate(Indexed, Key, FS);
+}
+
+bool BackgroundIndex::loadShard(PathRef MainFile, const FileDigest &Key,
+                                vfs::FileSystem &FS) {
+  if (ShardDir.empty())
+    return false;
+  std::string ShardPath = shardPath(MainFile);
+  auto Buf = llvm::MemoryBuffer::getFile(ShardPath);
+  if (!Buf)
+    return false;
+  auto Shard = readIndexFile((*Buf)->getBuffer());
+  if (!Shard) {
+    log("BackgroundIndex: couldn't read shard " + ShardPath + ": " +
+        llvm::toString(Shard.takeError()));
+    return false;
+  }
+  if (!isUpToDate(Shard->Sources, Key, FS))
+    return false;
+  update(MainFile, std::move(Shard->Symbols), std::move(Shard->Refs),
+         std::move(Shard->Sources));
+  return true;
+}
+
+bool BackgroundIndex::isUpToDate(llvm::ArrayRef<IndexFileSource> Sources,
+                                 const FileDigest &Key, vfs::FileSystem &FS) {
+  if (Sources.empty() || Sources.front().Digest != Key)
+    return false;
+  for (const auto &Source : Sources.drop_front()) {
+    auto Digest = fileDigest(Source.Path, FS);
+    if (!Digest || *Digest != Source.Digest)
+      return false;
+  }
+  return true;
+}
+
+llvm::Optional<FileDigest> BackgroundIndex::fileDigest(PathRef File,
+                                                       vfs::FileSystem &FS) {
+  {
+    std::lock_guard<std::mutex> Lock(StateMu);
+    auto It = Digests.find(File);
+    if (It != Digests.end())
+      return It->second;
+  }
+  auto Buf = FS.getBufferForFile(File);
+  if (!Buf)
+    return llvm::None;
+  FileDigest Digest = digest((*Buf)->getBuffer());
+  std::lock_guard<std::mutex> Lock(StateMu);
+  Digests[File] = Digest;
+  return Digest;
+}
+
+void BackgroundIndex::update(PathRef MainFile, SymbolSlab Syms,
+                             SymbolRefSlab Refs,
+                             std::vector<IndexFileSource> Sources) {
+  {
+    std::lock_guard<std::mutex> Lock(StateMu);
+    for (const auto &Source : Sources)
+      Dependents[Source.Path].insert(MainFile);
+    IndexedSources[MainFile] = std::move(Sources);
+  }
+  Symbols.update(MainFile, llvm::make_unique<SymbolSlab>(std::move(Syms)),
+                 llvm::make_unique<SymbolRefSlab>(std::move(Refs)));
+}
+
+std::string BackgroundIndex::shardPath(PathRef MainFile) const {
+  // Files with the same name in different directories get different shards.
+  FileDigest PathDigest = digest(MainFile);
+  llvm::SmallString<128> ShardPath(ShardDir);
+  llvm::sys::path::append(
+      ShardPath, llvm::sys::path::filename(MainFile) + "." +
+                     llvm::toHex(llvm::toStringRef(PathDigest)).substr(0, 16) +
+                     ".idx");
+  return ShardPath.str();
+}
+
+bool BackgroundIndex::fuzzyFind(
+    const FuzzyFindRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  return Index.fuzzyFind(Req, Callback);
+}
+
+void BackgroundIndex::lookup(
+    const LookupRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  Index.lookup(Req, Callback);
+}
+
+void BackgroundIndex::xrefs(
+    const XrefRequest &Req,
+    llvm::function_ref<void(const SymbolRefLocation &)> Callback) const {
+  Index.xrefs(Req, Callback);
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,126 @@
+//===--- Background.h - Build an index in a background thread ----*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_BACKGROUND_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_BACKGROUND_H
+
+#include "../Context.h"
+#include "../Path.h"
+#include "FileIndex.h"
+#include "Index.h"
+#include "Serialization.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+class FileSystemProvider;
+
+/// Builds an index of a whole project by parsing every translation unit in its
+/// compilation database, on low-priority worker threads.
+///
+/// The symbols of each translation unit are saved to a shard file, together
+/// with digests of the compile command and of every file that was parsed.
+/// When a unit is enqueued again, e.g. after a restart, its shard is loaded
+/// instead of parsing the unit, unless one of its files has changed since.
+class BackgroundIndex : public SymbolIndex {
+public:
+  /// Shards are stored in \p ShardDir. If it is empty, they are only kept in
+  /// memory. If \p URISchemes is empty, the default schemes in SymbolCollector
+  /// will be used.
+  BackgroundIndex(llvm::StringRef ResourceDir, FileSystemProvider &FSProvider,
+                  llvm::StringRef ShardDir,
+                  std::vector<std::string> URISchemes = {},
+                  unsigned ThreadPoolSize = 1);
+  /// Stops the worker threads, after they finish the units they are indexing.
+  ~BackgroundIndex();
+
+  /// Enqueues translation units to be indexed. Units that are already queued
+  /// are skipped.
+  void enqueue(std::vector<tooling::CompileCommand> Commands);
+
+  /// Re-indexes the translation units that depend on \p File, which changed
+  /// on disk.
+  void fileChanged(PathRef File);
+
+  /// Blocks until the queue is empty and the index is up to date. Only for use
+  /// in tests. Returns false if the timeout expires.
+  LLVM_NODISCARD bool
+  blockUntilIdleForTest(llvm::Optional<double> TimeoutSeconds = 10);
+
+  bool
+  fuzzyFind(const FuzzyFindRequest &Req,
+            llvm::function_ref<void(const Symbol &)> Callback) const override;
+
+  void lookup(const LookupRequest &Req,
+              llvm::function_ref<void(const Symbol &)> Callback) const override;
+
+  void xrefs(const XrefRequest &Req,
+             llvm::function_ref<void(const SymbolRefLocation &)> Callback)
+      const override;
+
+private:
+  /// The main loop of the worker threads.
+  void run();
+  /// Indexes the unit, unless it is up to date. Returns whether the symbols of
+  /// the unit changed, i.e. whether the index has to be rebuilt.
+  bool index(tooling::CompileCommand Cmd);
+  /// Returns whether the unit was indexed in this session and is up to date.
+  bool isIndexed(PathRef MainFile, const FileDigest &Key, vfs::FileSystem &FS);
+  /// Loads the symbols of the unit from its shard, if the shard is up to date.
+  bool loadShard(PathRef MainFile, const FileDigest &Key, vfs::FileSystem &FS);
+  bool isUpToDate(llvm::ArrayRef<IndexFileSource> Sources,
+                  const FileDigest &Key, vfs::FileSystem &FS);
+  llvm::Optional<FileDigest> fileDigest(PathRef File, vfs::FileSystem &FS);
+  void update(PathRef MainFile, SymbolSlab Symbols, SymbolRefSlab Refs,
+              std::vector<IndexFileSource> Sources);
+  std::string shardPath(PathRef MainFile) const;
+
+  const Context BackgroundContext;
+  const std::string ResourceDir;
+  FileSystemProvider &FSProvider;
+  const std::string ShardDir;
+  const std::vector<std::string> URISchemes;
+
+  FileSymbols Symbols;
+  MemIndex Index;
+
+  std::mutex StateMu;
+  /// The sources of each indexed unit, keyed by the unit's main file. The
+  /// first source is the main file, with a digest of its command and contents.
+  llvm::StringMap<std::vector<IndexFileSource>> IndexedSources;
+  /// Maps each file to the main files of the units that include it.
+  llvm::StringMap<llvm::StringSet<>> Dependents;
+  /// The last command used for each unit, keyed by its main file.
+  llvm::StringMap<tooling::CompileCommand> Commands;
+  /// Digests of files that have not changed since they were last read.
+  llvm::StringMap<FileDigest> Digests;
+
+  std::mutex QueueMu;
+  std::condition_variable QueueCV;
+  std::deque<tooling::CompileCommand> Queue;
+  llvm::StringSet<> Queued;
+  unsigned NumActiveTasks = 0;
+  /// Number of units whose symbols changed since the index was last built.
+  unsigned PendingUpdates = 0;
+  bool ShouldStop = false;
+  std::vector<std::thread> ThreadPool;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_BACKGROUND_H
@@ -10,23 +10,61 @@
 #include "CanonicalIncludes.h"
 #include "../Headers.h"
 #include "clang/Driver/Types.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Regex.h"
 
 namespace clang {
 namespace clangd {
 namespace {
 const char IWYUPragma[] = "// IWYU pragma: private, include ";
+
+// Returns the suffix that \p RE matches, if it is of the form "<suffix>$" and
+// the suffix has no special characters other than '.' and escaped ones. '.' is
+// then taken literally.
+// Keep in sync with literalSuffix() in
+// include-fixer/find-all-symbols/HeaderMapCollector.cpp, which maps the same
+// system header patterns.
+llvm::Optional<std::string> literalSuffix(llvm::StringRef RE) {
+  if (!RE.consume_back("$"))
+    return llvm::None;
+  std::string Suffix;
+  for (size_t I = 0; I < RE.size(); ++I) {
+    char C = RE[I];
+    if (C == '\\') {
+      if (++I == RE.size())
+        return llvm::None;
+      C = RE[I];
+      if (llvm::isAlnum(C)) // e.g. "\1", not an escaped character.
+        return llvm::None;
+    } else if (llvm::StringRef("^$|()[]{}*+?").contains(C)) {
+      return llvm::None;
+    }
+    Suffix.push_back(C);
+  }
+  return std::move(Suffix);
+}
 } // namespace
 
 void CanonicalIncludes::addMapping(llvm::StringRef Path,
                                    llvm::StringRef CanonicalPath) {
-  addRegexMapping((llvm::Twine("^") + llvm::Regex::escape(Path) + "$").str(),
-                  CanonicalPath);
+  MappedHeaders.clear();
+  PathMappings.try_emplace(Path, Mapping{NextIndex++, CanonicalPath.str()});
 }
 
 void CanonicalIncludes::addRegexMapping(llvm::StringRef RE,
                                         llvm::StringRef CanonicalPath) {
-  this->RegexHeaderMappingTable.emplace_back(llvm::Regex(RE), CanonicalPath);
+  MappedHeaders.clear();
+  Mapping M{NextIndex++, CanonicalPath.str()};
+  if (auto Suffix = literalSuffix(RE)) {
+    if (SuffixMappings.try_emplace(*Suffix, std::move(M)).second) {
+      auto It = std::lower_bound(SuffixLengths.begin(), SuffixLengths.end(),
+                                 Suffix->size());
+      if (It == SuffixLengths.end() || *It != Suffix->size())
+        SuffixLengths.insert(It, Suffix->size());
+    }
+    return;
+  }
+  RegexMappings.emplace_back(llvm::Regex(RE), std::move(M));
 }
 
 void CanonicalIncludes::addSymbolMapping(llvm::StringRef QualifiedName,
@@ -34,6 +72,38 @@ void CanonicalIncludes::addSymbolMapping(llvm::StringRef QualifiedName,
   this->SymbolMapping[QualifiedName] = CanonicalPath;
 }
 
+const CanonicalIncludes::Mapping *
+CanonicalIncludes::mapHeaderLocked(llvm::StringRef Header) const {
+  const Mapping *Best = nullptr;
+  auto Consider = [&](const Mapping &M) {
+    if (!Best || M.Index < Best->Index)
+      Best = &M;
+  };
+  auto It = PathMappings.find(Header);
+  if (It != PathMappings.end())
+    Consider(It->second);
+  for (unsigned Length : SuffixLengths) {
+    if (Length > Header.size())
+      break;
+    It = SuffixMappings.find(Header.take_back(Length));
+    if (It != SuffixMappings.end())
+      Consider(It->second);
+  }
+  for (auto &Entry : RegexMappings) {
+    if (Best && Best->Index < Entry.second.Index)
+      break;
+#ifndef NDEBUG
+    std::string Dummy;
+    assert(Entry.first.isValid(Dummy) && "Regex should never be invalid!");
+#endif
+    if (Entry.first.match(Header)) {
+      Consider(Entry.second);
+      break;
+    }
+  }
+  return Best;
+}
+
 llvm::StringRef
 CanonicalIncludes::mapHeader(llvm::ArrayRef<std::string> Headers,
                              llvm::StringRef QualifiedName) const {
@@ -41,7 +111,6 @@ CanonicalIncludes::mapHeader(llvm::ArrayRef<std::string> Headers,
   auto SE = SymbolMapping.find(QualifiedName);
   if (SE != SymbolMapping.end())
     return SE->second;
-  std::lock_guard<std::mutex> Lock(RegexMutex);
   // Find the first header such that the extension is not '.inc', and isn't a
   // recognized non-header file
   auto I =
@@ -62,15 +131,12 @@ CanonicalIncludes::mapHeader(llvm::ArrayRef<std::string> Headers,
   if ((ExtType != driver::types::TY_INVALID) &&
       !driver::types::onlyPrecompileType(ExtType))
     return Headers[0];
-  for (auto &Entry : RegexHeaderMappingTable) {
-#ifndef NDEBUG
-    std::string Dummy;
-    assert(Entry.first.isValid(Dummy) && "Regex should never be invalid!");
-#endif
-    if (Entry.first.match(Header))
-      return Entry.second;
-  }
-  return Header;
+  std::lock_guard<std::mutex> Lock(RegexMutex);
+  auto R = MappedHeaders.try_emplace(Header, nullptr);
+  if (R.second)
+    R.first->second = mapHeaderLocked(Header);
+  return R.first->second ? llvm::StringRef(R.first->second->CanonicalPath)
+                         : Header;
 }
 
 std::unique_ptr<CommentHandler>
@@ -40,7 +40,10 @@ public:
   /// Adds a string-to-string mapping from \p Path to \p CanonicalPath.
   void addMapping(llvm::StringRef Path, llvm::StringRef CanonicalPath);
 
-  /// Maps all files matching \p RE to \p CanonicalPath
+  /// Maps all files matching \p RE to \p CanonicalPath. If several patterns
+  /// match a file, the first one added wins.
+  /// Patterns of the form "<suffix>$" (e.g. "bits/types.h$") are matched as
+  /// literal suffixes without running a regex. '.' is taken literally there.
   void addRegexMapping(llvm::StringRef RE, llvm::StringRef CanonicalPath);
 
   /// Sets the canonical include for any symbol with \p QualifiedName.
@@ -55,17 +58,32 @@ public:
                             llvm::StringRef QualifiedName) const;
 
 private:
-  // A map from header patterns to header names. This needs to be mutable so
-  // that we can match again a Regex in a const function member.
-  // FIXME(ioeric): All the regexes we have so far are suffix matches. The
-  // performance could be improved by allowing only suffix matches instead of
-  // arbitrary regexes.
-  mutable std::vector<std::pair<llvm::Regex, std::string>>
-      RegexHeaderMappingTable;
+  struct Mapping {
+    // The order in which the mapping was added. Lower ones take precedence.
+    unsigned Index;
+    std::string CanonicalPath;
+  };
+  /// Returns the first mapping that applies to \p Header, or nullptr.
+  const Mapping *mapHeaderLocked(llvm::StringRef Header) const;
+
+  unsigned NextIndex = 0;
+  // Mappings of whole paths, added by addMapping().
+  llvm::StringMap<Mapping> PathMappings;
+  // Mappings of literal suffixes, and the distinct lengths of these suffixes in
+  // increasing order. A header is matched by looking up its suffix of each
+  // length, rather than by trying each pattern.
+  llvm::StringMap<Mapping> SuffixMappings;
+  std::vector<unsigned> SuffixLengths;
+  // The other patterns, in the order they were added. This needs to be mutable
+  // so that we can match again a Regex in a const function member.
+  mutable std::vector<std::pair<llvm::Regex, Mapping>> RegexMappings;
   // A map from fully qualified symbol names to header names.
   llvm::StringMap<std::string> SymbolMapping;
-  // Guards Regex matching as it's not thread-safe.
+  // Guards Regex matching as it's not thread-safe, and the memo.
   mutable std::mutex RegexMutex;
+  // The result of mapHeaderLocked() for each header seen so far, as the same
+  // headers are mapped for many symbols. Cleared when mappings are added.
+  mutable llvm::StringMap<const Mapping *> MappedHeaders;
 };
 
 /// Returns a CommentHandler that parses pragma comment on include files to
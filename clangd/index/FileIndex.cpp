@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "FileIndex.h"
+#include "Merge.h"
 #include "SymbolCollector.h"
 #include "clang/Index/IndexingAction.h"
 #include "clang/Lex/Preprocessor.h"
@@ -15,9 +16,21 @@
 namespace clang {
 namespace clangd {
 
-SymbolRefSlab indexASTRef(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
-                          llvm::ArrayRef<std::string> URISchemes) {
-  llvm::errs() << "Index ast ref\n";
+// Returns the decls to index: TopLevelDecls if set, otherwise all top-level
+// decls of the AST.
+static std::vector<const Decl *>
+declsToIndex(ASTContext &AST,
+             llvm::Optional<llvm::ArrayRef<Decl *>> TopLevelDecls) {
+  if (TopLevelDecls)
+    return {TopLevelDecls->begin(), TopLevelDecls->end()};
+  return {AST.getTranslationUnitDecl()->decls().begin(),
+          AST.getTranslationUnitDecl()->decls().end()};
+}
+
+SymbolRefSlab
+indexASTRef(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
+            llvm::ArrayRef<std::string> URISchemes,
+            llvm::Optional<llvm::ArrayRef<Decl *>> TopLevelDecls) {
   XrefKindSet Filter = (XrefKindSet)XrefKind::Declarataion |
                        (XrefKindSet)XrefKind::Definition |
                        (XrefKindSet)XrefKind::Reference;
@@ -27,22 +40,15 @@ SymbolRefSlab indexASTRef(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
   IndexOpts.SystemSymbolFilter =
       index::IndexingOptions::SystemSymbolFilterKind::All;
   IndexOpts.IndexFunctionLocals = true;
-  std::vector<Decl *> decls = {AST.getTranslationUnitDecl()->decls().begin(),
-                               AST.getTranslationUnitDecl()->decls().end()};
-  //for (const auto* D : decls) {
-    //llvm::errs() << "local top level Decls\n";
-    //D->dump();
-  //}
-  indexTopLevelDecls(AST, decls, Collector, IndexOpts);
-  auto R = Collector.takeSymbols();
-  //for (const auto S : R) {
-    //llvm::errs() << S.Loc << "\n";
-  //}
-  return R;
+  index::indexTopLevelDecls(AST, declsToIndex(AST, TopLevelDecls), Collector,
+                            IndexOpts);
+  return Collector.takeSymbols();
 }
 
 SymbolSlab indexAST(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
-                    llvm::ArrayRef<std::string> URISchemes) {
+                    llvm::ArrayRef<std::string> URISchemes,
+                    llvm::Optional<llvm::ArrayRef<Decl *>> TopLevelDecls,
+                    bool CollectMainFileSymbols) {
   SymbolCollector::Options CollectorOpts;
   // FIXME(ioeric): we might also want to collect include headers. We would need
   // to make sure all includes are canonicalized (with CanonicalIncludes), which
@@ -54,6 +60,7 @@ SymbolSlab indexAST(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
   if (!URISchemes.empty())
     CollectorOpts.URISchemes = URISchemes;
   CollectorOpts.Origin = SymbolOrigin::Dynamic;
+  CollectorOpts.CollectMainFileSymbols = CollectMainFileSymbols;
 
   SymbolCollector Collector(std::move(CollectorOpts));
   Collector.setPreprocessor(PP);
@@ -63,16 +70,14 @@ SymbolSlab indexAST(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
       index::IndexingOptions::SystemSymbolFilterKind::DeclarationsOnly;
   IndexOpts.IndexFunctionLocals = false;
 
-  std::vector<const Decl *> TopLevelDecls(
-      AST.getTranslationUnitDecl()->decls().begin(),
-      AST.getTranslationUnitDecl()->decls().end());
-  index::indexTopLevelDecls(AST, TopLevelDecls, Collector, IndexOpts);
-
+  index::indexTopLevelDecls(AST, declsToIndex(AST, TopLevelDecls), Collector,
+                            IndexOpts);
   return Collector.takeSymbols();
 }
 
 FileIndex::FileIndex(std::vector<std::string> URISchemes)
-    : URISchemes(std::move(URISchemes)) {}
+    : URISchemes(std::move(URISchemes)),
+      MergedIndex(mergeIndex(&MainFileIndex, &PreambleIndex)) {}
 
 void FileSymbols::update(PathRef Path, std::unique_ptr<SymbolSlab> Slab,
                          std::unique_ptr<SymbolRefSlab> RefSlab) {
@@ -109,6 +114,36 @@ std::shared_ptr<std::vector<const Symbol *>> FileSymbols::allSymbols() {
   return {std::move(Snap), Pointers};
 }
 
+std::shared_ptr<std::vector<const Symbol *>> FileSymbols::mergedSymbols() {
+  std::vector<std::shared_ptr<SymbolSlab>> Slabs;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    for (const auto &FileAndSlab : FileToSlabs)
+      Slabs.push_back(FileAndSlab.second);
+  }
+
+  SymbolSlab::Builder Merged;
+  Symbol::Details Scratch;
+  for (const auto &Slab : Slabs)
+    for (const Symbol &Sym : *Slab) {
+      if (const Symbol *Existing = Merged.find(Sym.ID))
+        Merged.insert(mergeSymbol(*Existing, Sym, &Scratch));
+      else
+        Merged.insert(Sym);
+    }
+
+  struct Snapshot {
+    SymbolSlab Slab;
+    std::vector<const Symbol *> Pointers;
+  };
+  auto Snap = std::make_shared<Snapshot>();
+  Snap->Slab = std::move(Merged).build();
+  for (const Symbol &Sym : Snap->Slab)
+    Snap->Pointers.push_back(&Sym);
+  auto *Pointers = &Snap->Pointers;
+  return {std::move(Snap), Pointers};
+}
+
 std::shared_ptr<std::vector<const SymbolRefLocation *>>
 FileSymbols::allSymbolRefs() {
   struct Snapshot {
@@ -132,37 +167,58 @@ FileSymbols::allSymbolRefs() {
   return {std::move(Snap), Pointers};
 }
 
-void FileIndex::update(PathRef Path, ASTContext *AST,
-                       std::shared_ptr<Preprocessor> PP) {
+void FileIndex::updatePreamble(PathRef Path, ASTContext *AST,
+                               std::shared_ptr<Preprocessor> PP) {
   if (!AST) {
-    FSymbols.update(Path, nullptr, nullptr);
+    PreambleSymbols.update(Path, nullptr, nullptr);
   } else {
     assert(PP);
     auto Slab = llvm::make_unique<SymbolSlab>();
     *Slab = indexAST(*AST, PP, URISchemes);
     auto RefSlab = llvm::make_unique<SymbolRefSlab>();
     *RefSlab = indexASTRef(*AST, PP, URISchemes);
-    FSymbols.update(Path, std::move(Slab), std::move(RefSlab));
+    PreambleSymbols.update(Path, std::move(Slab), std::move(RefSlab));
   }
-  auto Symbols = FSymbols.allSymbols();
-  Index.build(std::move(Symbols), FSymbols.allSymbolRefs());
+  PreambleIndex.build(PreambleSymbols.allSymbols(),
+                      PreambleSymbols.allSymbolRefs());
+}
+
+void FileIndex::updateMain(PathRef Path, ParsedAST &AST) {
+  // Only the decls of the main file: the ones in the preamble are covered by
+  // updatePreamble(), and deserializing them would be slow.
+  auto Slab = llvm::make_unique<SymbolSlab>();
+  *Slab = indexAST(AST.getASTContext(), AST.getPreprocessorPtr(), URISchemes,
+                   AST.getLocalTopLevelDecls(),
+                   /*CollectMainFileSymbols=*/true);
+  auto RefSlab = llvm::make_unique<SymbolRefSlab>();
+  *RefSlab = indexASTRef(AST.getASTContext(), AST.getPreprocessorPtr(),
+                         URISchemes, AST.getLocalTopLevelDecls());
+  MainFileSymbols.update(Path, std::move(Slab), std::move(RefSlab));
+  MainFileIndex.build(MainFileSymbols.allSymbols(),
+                      MainFileSymbols.allSymbolRefs());
+}
+
+void FileIndex::removeMain(PathRef Path) {
+  MainFileSymbols.update(Path, nullptr, nullptr);
+  MainFileIndex.build(MainFileSymbols.allSymbols(),
+                      MainFileSymbols.allSymbolRefs());
 }
 
 bool FileIndex::fuzzyFind(
     const FuzzyFindRequest &Req,
     llvm::function_ref<void(const Symbol &)> Callback) const {
-  return Index.fuzzyFind(Req, Callback);
+  return MergedIndex->fuzzyFind(Req, Callback);
 }
 
 void FileIndex::lookup(
     const LookupRequest &Req,
     llvm::function_ref<void(const Symbol &)> Callback) const {
-  Index.lookup(Req, Callback);
+  MergedIndex->lookup(Req, Callback);
 }
 
 void FileIndex::xrefs(const XrefRequest &Req,
       llvm::function_ref<void(const SymbolRefLocation&)> Callback) const {
-  Index.xrefs(Req, Callback);
+  MergedIndex->xrefs(Req, Callback);
 }
 
 } // namespace clangd
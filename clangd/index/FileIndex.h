@@ -47,6 +47,12 @@ public:
   // The shared_ptr keeps the symbols alive
   std::shared_ptr<std::vector<const Symbol *>> allSymbols();
 
+  /// Like allSymbols(), but a symbol that is in the slabs of several files,
+  /// e.g. one declared in a header that several units include, is merged into
+  /// one with mergeSymbol(). This keeps the definition and documentation that
+  /// any of them has, and sums their references.
+  std::shared_ptr<std::vector<const Symbol *>> mergedSymbols();
+
   //
   std::shared_ptr<std::vector<const SymbolRefLocation *>> allSymbolRefs();
 private:
@@ -58,17 +64,32 @@ private:
 };
 
 /// \brief This manages symbls from files and an in-memory index on all symbols.
+///
+/// Symbols are kept in two layers, which are merged when queried:
+///  - the symbols of each file's preamble. These are indexed from the preamble
+///    AST once when the preamble is built, and are reused by all the ASTs
+///    built on top of it.
+///  - the symbols and references of each file's main AST. These are updated
+///    on every rebuild, but only cover the top-level decls of the main file.
 class FileIndex : public SymbolIndex {
 public:
   /// If URISchemes is empty, the default schemes in SymbolCollector will be
   /// used.
   FileIndex(std::vector<std::string> URISchemes = {});
 
-  /// \brief Update symbols in \p Path with symbols in \p AST. If \p AST is
-  /// nullptr, this removes all symbols in the file.
+  /// \brief Update the preamble symbols of \p Path with the symbols in the
+  /// preamble \p AST. If \p AST is nullptr, this removes them.
   /// If \p AST is not null, \p PP cannot be null and it should be the
   /// preprocessor that was used to build \p AST.
-  void update(PathRef Path, ASTContext *AST, std::shared_ptr<Preprocessor> PP);
+  void updatePreamble(PathRef Path, ASTContext *AST,
+                      std::shared_ptr<Preprocessor> PP);
+
+  /// \brief Update the main file symbols of \p Path with the ones declared in
+  /// the main file of \p AST.
+  void updateMain(PathRef Path, ParsedAST &AST);
+
+  /// \brief Remove the main file symbols of \p Path, e.g. when it is closed.
+  void removeMain(PathRef Path);
 
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
@@ -81,16 +102,41 @@ public:
         llvm::function_ref<void(const SymbolRefLocation&)>) const override;
 
 private:
-  FileSymbols FSymbols;
-  MemIndex Index;
   std::vector<std::string> URISchemes;
+
+  // Symbols from each file's preamble. These are large, but only change when
+  // the preamble is rebuilt.
+  FileSymbols PreambleSymbols;
+  MemIndex PreambleIndex;
+
+  // Symbols and references from each file's main AST. These change on every
+  // edit, but are small.
+  FileSymbols MainFileSymbols;
+  MemIndex MainFileIndex;
+
+  // Prefers MainFileIndex, whose data is fresher.
+  std::unique_ptr<SymbolIndex> MergedIndex;
 };
 
 /// Retrieves namespace and class level symbols in \p AST.
 /// Exposed to assist in unit tests.
 /// If URISchemes is empty, the default schemes in SymbolCollector will be used.
-SymbolSlab indexAST(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
-                    llvm::ArrayRef<std::string> URISchemes = {});
+/// If \p TopLevelDecls is set, only these decls are indexed. Otherwise all
+/// top-level decls of the AST are, including the ones of the preamble.
+/// Symbols declared in the main file are only collected if
+/// \p CollectMainFileSymbols is set.
+SymbolSlab
+indexAST(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
+         llvm::ArrayRef<std::string> URISchemes = {},
+         llvm::Optional<llvm::ArrayRef<Decl *>> TopLevelDecls = llvm::None,
+         bool CollectMainFileSymbols = false);
+
+/// Retrieves all declarations, definitions and references in \p AST.
+/// \p TopLevelDecls is used as in indexAST().
+SymbolRefSlab
+indexASTRef(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
+            llvm::ArrayRef<std::string> URISchemes = {},
+            llvm::Optional<llvm::ArrayRef<Decl *>> TopLevelDecls = llvm::None);
 
 } // namespace clangd
 } // namespace clang
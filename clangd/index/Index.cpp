@@ -44,6 +44,13 @@ void operator>>(StringRef Str, SymbolID &ID) {
   std::copy(HexString.begin(), HexString.end(), ID.HashValue.begin());
 }
 
+SymbolID SymbolID::fromRaw(StringRef Raw) {
+  SymbolID ID;
+  assert(Raw.size() == ID.HashValue.size());
+  std::copy(Raw.begin(), Raw.end(), ID.HashValue.begin());
+  return ID;
+}
+
 raw_ostream &operator<<(raw_ostream &OS, SymbolOrigin O) {
   if (O == SymbolOrigin::Unknown)
     return OS << "unknown";
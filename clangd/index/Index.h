@@ -72,8 +72,16 @@ public:
   // Returns a 40-bytes hex encoded string.
   std::string str() const;
 
-private:
   static constexpr unsigned HashByteLength = 20;
+  // Returns the raw hash bytes, e.g. for binary serialization.
+  llvm::StringRef raw() const {
+    return llvm::StringRef(reinterpret_cast<const char *>(HashValue.data()),
+                           HashValue.size());
+  }
+  // Constructs a SymbolID from the bytes returned by raw().
+  static SymbolID fromRaw(llvm::StringRef Raw);
+
+private:
 
   friend llvm::hash_code hash_value(const SymbolID &ID) {
     // We already have a good hash, just return the first bytes.
@@ -315,6 +323,10 @@ struct FuzzyFindRequest {
   ///
   /// The global scope is "", a top level scope is "foo::", etc.
   std::vector<std::string> Scopes;
+  /// If set, a scope in Scopes also matches the innermost scopes of a
+  /// symbol's scope, e.g. "xyz::" matches symbols in namespace abc::xyz. This
+  /// is used for partially qualified names like "xyz::Foo".
+  bool MatchScopeSuffix = false;
   /// \brief The number of top candidates to return. The index may choose to
   /// return more than this, e.g. if it doesn't know which candidates are best.
   size_t MaxCandidateCount = UINT_MAX;
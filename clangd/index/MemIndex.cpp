@@ -10,19 +10,39 @@
 #include "MemIndex.h"
 #include "../FuzzyMatch.h"
 #include "../Logger.h"
+#include "llvm/Support/Threading.h"
+#include <future>
 #include <queue>
 #include <set>
 
 namespace clang {
 namespace clangd {
+namespace {
+
+// Shards must be large enough for scoring them to outweigh handing them to
+// another thread.
+constexpr size_t MinSymbolsPerShard = 1 << 14;
+
+// Whether a symbol in scope \p SymScope matches the requested \p Scope.
+bool scopeMatches(StringRef SymScope, StringRef Scope, bool MatchSuffix) {
+  if (SymScope == Scope)
+    return true;
+  // The suffix must start at a scope boundary: "b::" matches "a::b::", but
+  // not "ab::".
+  return MatchSuffix && !Scope.empty() && SymScope.endswith(Scope) &&
+         SymScope.drop_back(Scope.size()).endswith("::");
+}
+
+} // namespace
 
 void MemIndex::build(
     std::shared_ptr<std::vector<const Symbol *>> Syms,
     std::shared_ptr<std::vector<const SymbolRefLocation *>> SymbolRefs) {
-  llvm::DenseMap<SymbolID, const Symbol *> TempIndex;
+  auto New = std::make_shared<Data>();
   for (const Symbol *Sym : *Syms)
-    TempIndex[Sym->ID] = Sym;
-  llvm::DenseMap<SymbolIDRef, std::vector<const SymbolRefLocation *>> TempXrefIndex;
+    New->Index[Sym->ID] = Sym;
+  for (const auto &Pair : New->Index)
+    New->SymbolsByScope[Pair.second->Scope].push_back(Pair.second);
   //llvm::DenseMap<SymbolIDRef, std::string> abc;
   auto cmp = [](const SymbolRefLocation* L, const SymbolRefLocation* R) {
     return L->Loc < R->Loc;
@@ -33,28 +53,64 @@ void MemIndex::build(
   for (const auto *Ref : *SymbolRefs) {
     //llvm::errs() << Ref->Loc << "\n";
     auto inserted_value = Dep.insert(Ref);
-    if (Ref->SymID.ID()->str() == "D6F95DC7B26A83A738DE640FF8F58F72245A08CD") {
-      llvm::errs() << Ref->Loc;
-      llvm::errs() << "find \n!";
-    }
-    if (inserted_value.second) {
-    if (Ref->SymID.ID()->str() == "D6F95DC7B26A83A738DE640FF8F58F72245A08CD") {
-      llvm::errs() << Ref->Loc;
-      llvm::errs() << "insert\n!";
-    }
-      TempXrefIndex[Ref->SymID].push_back(Ref);
-    }
+    if (inserted_value.second)
+      New->XrefIndex[Ref->SymID].push_back(Ref);
   }
+  New->Symbols = std::move(Syms);
+  New->Xrefs = std::move(SymbolRefs);
 
-  llvm::errs() << Dep.size() << "!!\n";
-  // Swap out the old symbols and index.
+  // Swap out the old symbols and index. They are released by the last query
+  // that uses them.
   {
     std::lock_guard<std::mutex> Lock(Mutex);
-    Index = std::move(TempIndex);
-    Symbols = std::move(Syms); // Relase old symbols.
+    Current = std::move(New);
+  }
+}
+
+std::shared_ptr<const MemIndex::Data> MemIndex::snapshot() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  return Current;
+}
+
+llvm::ThreadPool &MemIndex::scoringPool() const {
+  // The calling thread scores a shard too.
+  std::call_once(PoolFlag, [this] {
+    Pool = llvm::make_unique<llvm::ThreadPool>(
+        std::max(1u, llvm::hardware_concurrency() - 1));
+  });
+  return *Pool;
+}
+
+void MemIndex::ScoredSymbols::push(std::pair<float, const Symbol *> Scored,
+                                   size_t Limit) {
+  Top.push(Scored);
+  if (Top.size() > Limit) {
+    More = true;
+    Top.pop();
+  }
+}
 
-    XrefIndex = std::move(TempXrefIndex);
-    Xrefs = std::move(SymbolRefs);
+void MemIndex::scoreSymbols(
+    const FuzzyFindRequest &Req,
+    llvm::ArrayRef<llvm::ArrayRef<const Symbol *>> Candidates, size_t Begin,
+    size_t End, ScoredSymbols &Out) {
+  FuzzyMatcher Filter(Req.Query);
+  size_t Offset = 0; // Of the first symbol in the current list.
+  for (llvm::ArrayRef<const Symbol *> Symbols : Candidates) {
+    size_t ListBegin = Offset, ListEnd = Offset + Symbols.size();
+    Offset = ListEnd;
+    if (ListEnd <= Begin)
+      continue;
+    if (ListBegin >= End)
+      break;
+    size_t From = std::max(Begin, ListBegin) - ListBegin;
+    size_t To = std::min(End, ListEnd) - ListBegin;
+    for (const Symbol *Sym : Symbols.slice(From, To - From)) {
+      if (Req.RestrictForCodeCompletion && !Sym->IsIndexedForCodeCompletion)
+        continue;
+      if (auto Score = Filter.match(Sym->Name))
+        Out.push({-*Score * quality(*Sym), Sym}, Req.MaxCandidateCount);
+    }
   }
 }
 
@@ -64,39 +120,66 @@ bool MemIndex::fuzzyFind(
   assert(!StringRef(Req.Query).contains("::") &&
          "There must be no :: in query.");
 
-  std::priority_queue<std::pair<float, const Symbol *>> Top;
-  FuzzyMatcher Filter(Req.Query);
-  bool More = false;
-  {
-    std::lock_guard<std::mutex> Lock(Mutex);
-    for (const auto Pair : Index) {
-      const Symbol *Sym = Pair.second;
+  auto Snapshot = snapshot();
+  const auto &SymbolsByScope = Snapshot->SymbolsByScope;
+  // Find the scopes to search.
+  std::vector<llvm::ArrayRef<const Symbol *>> Candidates;
+  if (!Req.Scopes.empty() && !Req.MatchScopeSuffix) {
+    for (size_t I = 0; I < Req.Scopes.size(); ++I) {
+      if (llvm::is_contained(llvm::makeArrayRef(Req.Scopes).take_front(I),
+                             Req.Scopes[I]))
+        continue; // Don't return the symbols twice.
+      auto It = SymbolsByScope.find(Req.Scopes[I]);
+      if (It != SymbolsByScope.end())
+        Candidates.push_back(It->second);
+    }
+  } else {
+    for (const auto &Entry : SymbolsByScope)
+      if (Req.Scopes.empty() ||
+          llvm::any_of(Req.Scopes, [&](StringRef Scope) {
+            return scopeMatches(Entry.first(), Scope, Req.MatchScopeSuffix);
+          }))
+        Candidates.push_back(Entry.second);
+  }
+  size_t NumCandidates = 0;
+  for (llvm::ArrayRef<const Symbol *> Symbols : Candidates)
+    NumCandidates += Symbols.size();
 
-      // Exact match against all possible scopes.
-      if (!Req.Scopes.empty() && !llvm::is_contained(Req.Scopes, Sym->Scope))
-        continue;
-      if (Req.RestrictForCodeCompletion && !Sym->IsIndexedForCodeCompletion)
-        continue;
+  // Large indexes are split into shards that are scored in parallel.
+  unsigned NumShards = std::max<size_t>(
+      1, std::min<size_t>(llvm::hardware_concurrency(),
+                          NumCandidates / MinSymbolsPerShard));
+  std::vector<ScoredSymbols> Shards(NumShards);
+  auto ScoreShard = [&](unsigned Shard) {
+    size_t Begin = NumCandidates * Shard / NumShards;
+    size_t End = NumCandidates * (Shard + 1) / NumShards;
+    scoreSymbols(Req, Candidates, Begin, End, Shards[Shard]);
+  };
+  std::vector<std::shared_future<void>> Workers;
+  for (unsigned Shard = 1; Shard < NumShards; ++Shard)
+    Workers.push_back(scoringPool().async(ScoreShard, Shard));
+  ScoreShard(0);
+  for (std::shared_future<void> &Worker : Workers)
+    Worker.wait();
 
-      if (auto Score = Filter.match(Sym->Name)) {
-        Top.emplace(-*Score * quality(*Sym), Sym);
-        if (Top.size() > Req.MaxCandidateCount) {
-          More = true;
-          Top.pop();
-        }
-      }
-    }
-    for (; !Top.empty(); Top.pop())
-      Callback(*Top.top().second);
+  // Merge the best results of each shard.
+  ScoredSymbols Result = std::move(Shards.front());
+  for (unsigned Shard = 1; Shard < NumShards; ++Shard) {
+    Result.More |= Shards[Shard].More;
+    for (; !Shards[Shard].Top.empty(); Shards[Shard].Top.pop())
+      Result.push(Shards[Shard].Top.top(), Req.MaxCandidateCount);
   }
-  return More;
+  for (; !Result.Top.empty(); Result.Top.pop())
+    Callback(*Result.Top.top().second);
+  return Result.More;
 }
 
 void MemIndex::lookup(const LookupRequest &Req,
                       llvm::function_ref<void(const Symbol &)> Callback) const {
+  auto Snapshot = snapshot();
   for (const auto &ID : Req.IDs) {
-    auto I = Index.find(ID);
-    if (I != Index.end())
+    auto I = Snapshot->Index.find(ID);
+    if (I != Snapshot->Index.end())
       Callback(*I->second);
   }
 }
@@ -104,9 +187,10 @@ void MemIndex::lookup(const LookupRequest &Req,
 void MemIndex::xrefs(
     const XrefRequest &Req,
     llvm::function_ref<void(const SymbolRefLocation &)> Callback) const {
+  auto Snapshot = snapshot();
   for (const auto &ID : Req.IDs) {
-    auto I = XrefIndex.find(&ID);
-    if (I != XrefIndex.end()) {
+    auto I = Snapshot->XrefIndex.find(&ID);
+    if (I != Snapshot->XrefIndex.end()) {
       for (auto *Ref : I->second) {
         Callback(*Ref);
       }
@@ -114,19 +198,26 @@ void MemIndex::xrefs(
   }
 }
 
-std::unique_ptr<SymbolIndex> MemIndex::build(SymbolSlab Slab) {
+std::unique_ptr<SymbolIndex> MemIndex::build(SymbolSlab Slab,
+                                             SymbolRefSlab Refs) {
   struct Snapshot {
     SymbolSlab Slab;
+    SymbolRefSlab Refs;
     std::vector<const Symbol *> Pointers;
+    std::vector<const SymbolRefLocation *> RefPointers;
   };
   auto Snap = std::make_shared<Snapshot>();
   Snap->Slab = std::move(Slab);
+  Snap->Refs = std::move(Refs);
   for (auto &Sym : Snap->Slab)
     Snap->Pointers.push_back(&Sym);
-  auto S = std::shared_ptr<std::vector<const Symbol *>>(std::move(Snap),
-                                                        &Snap->Pointers);
+  for (auto &Ref : Snap->Refs)
+    Snap->RefPointers.push_back(&Ref);
+  auto S = std::shared_ptr<std::vector<const Symbol *>>(Snap, &Snap->Pointers);
+  auto R = std::shared_ptr<std::vector<const SymbolRefLocation *>>(
+      std::move(Snap), &Snap->RefPointers);
   auto MemIdx = llvm::make_unique<MemIndex>();
-  //MemIdx->build(std::move(S));
+  MemIdx->build(std::move(S), std::move(R));
   return std::move(MemIdx);
 }
 
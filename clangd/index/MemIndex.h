@@ -11,7 +11,10 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_MEMINDEX_H
 
 #include "Index.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/ThreadPool.h"
 #include <mutex>
+#include <queue>
 
 namespace clang {
 namespace clangd {
@@ -25,8 +28,10 @@ public:
   void build(std::shared_ptr<std::vector<const Symbol *>> Symbols,
              std::shared_ptr<std::vector<const SymbolRefLocation *>> SymbolRefs);
 
-  /// \brief Build index from a symbol slab.
-  static std::unique_ptr<SymbolIndex> build(SymbolSlab Slab);
+  /// \brief Build index from a symbol slab and, optionally, a slab of
+  /// references to the symbols.
+  static std::unique_ptr<SymbolIndex> build(SymbolSlab Slab,
+                                            SymbolRefSlab Refs = {});
 
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
@@ -41,14 +46,42 @@ public:
         llvm::function_ref<void(const SymbolRefLocation&)>) const override;
 
 private:
-  std::shared_ptr<std::vector<const Symbol *>> Symbols;
-  // Index is a set of symbols that are deduplicated by symbol IDs.
-  // FIXME: build smarter index structure.
-  llvm::DenseMap<SymbolID, const Symbol *> Index;
+  /// The best scoring symbols, worst first.
+  struct ScoredSymbols {
+    std::priority_queue<std::pair<float, const Symbol *>> Top;
+    bool More = false;
+    void push(std::pair<float, const Symbol *> Scored, size_t Limit);
+  };
+  /// Scores the symbols from \p Begin to \p End in the concatenation of
+  /// \p Candidates.
+  static void
+  scoreSymbols(const FuzzyFindRequest &Req,
+               llvm::ArrayRef<llvm::ArrayRef<const Symbol *>> Candidates,
+               size_t Begin, size_t End, ScoredSymbols &Out);
 
-  std::shared_ptr<std::vector<const SymbolRefLocation*>> Xrefs;
-  llvm::DenseMap<SymbolIDRef, std::vector<const SymbolRefLocation*>> XrefIndex;
+  /// The symbols and references of one build(). Never modified, so queries
+  /// only hold Mutex while they take a reference to it.
+  struct Data {
+    std::shared_ptr<std::vector<const Symbol *>> Symbols;
+    // Index is a set of symbols that are deduplicated by symbol IDs.
+    llvm::DenseMap<SymbolID, const Symbol *> Index;
+    // The symbols in Index, grouped by scope, so that scoped queries only look
+    // at the symbols in matching scopes.
+    llvm::StringMap<std::vector<const Symbol *>> SymbolsByScope;
+
+    std::shared_ptr<std::vector<const SymbolRefLocation *>> Xrefs;
+    llvm::DenseMap<SymbolIDRef, std::vector<const SymbolRefLocation *>>
+        XrefIndex;
+  };
+  std::shared_ptr<const Data> snapshot() const;
+  /// Returns the threads that score the shards of large queries, which are
+  /// started by the first such query.
+  llvm::ThreadPool &scoringPool() const;
+
+  std::shared_ptr<const Data> Current = std::make_shared<Data>();
   mutable std::mutex Mutex;
+  mutable std::once_flag PoolFlag;
+  mutable std::unique_ptr<llvm::ThreadPool> Pool;
 };
 
 } // namespace clangd
@@ -0,0 +1,561 @@
+//===--- Remote.cpp - Index served by another process ------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Remote.h"
+#include "../Logger.h"
+#include "../Trace.h"
+#include "Serialization.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include <algorithm>
+#include <cerrno>
+#include <list>
+#include <map>
+#ifndef _WIN32
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+
+namespace {
+
+enum ResponseStatus : uint8_t {
+  Ok = 0,
+  Failed = 1,
+};
+
+// Larger frames are rejected, so that a corrupt length can't make us allocate
+// unbounded memory.
+constexpr uint32_t MaxFrameSize = 1u << 30;
+// Each client cache keeps this many of the most recently used entries.
+constexpr size_t MaxCacheEntries = 256;
+// The client keeps this many idle connections open for later requests.
+constexpr size_t MaxIdleConnections = 4;
+
+Error makeStringError(const Twine &Msg) {
+  return make_error<StringError>(Msg, inconvertibleErrorCode());
+}
+
+// The platform-specific parts: opening sockets and sending frames.
+#ifndef _WIN32
+
+#ifdef MSG_NOSIGNAL
+constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+constexpr int SendFlags = 0;
+#endif
+
+Error makeSocketError(const Twine &Msg, int Errno) {
+  return makeStringError(Msg + ": " +
+                         std::error_code(Errno, std::generic_category())
+                             .message());
+}
+
+// Creates a socket that is connected to Address, or listening on it.
+Expected<int> openSocket(StringRef Address, bool Listen) {
+  if (Address.consume_front("unix:")) {
+    sockaddr_un Addr = {};
+    Addr.sun_family = AF_UNIX;
+    if (Address.size() >= sizeof(Addr.sun_path))
+      return makeStringError("socket path is too long: " + Address);
+    std::copy(Address.begin(), Address.end(), Addr.sun_path);
+    // Remove the socket of a server that did not shut down cleanly.
+    sys::fs::file_status Status;
+    if (Listen && !sys::fs::status(Address, Status) &&
+        Status.type() == sys::fs::file_type::socket_file)
+      ::unlink(Addr.sun_path);
+
+    int FD = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (FD < 0)
+      return makeSocketError("can't create socket", errno);
+    auto *SockAddr = reinterpret_cast<const sockaddr *>(&Addr);
+    if (Listen ? ::bind(FD, SockAddr, sizeof(Addr)) == 0 &&
+                     ::listen(FD, SOMAXCONN) == 0
+               : ::connect(FD, SockAddr, sizeof(Addr)) == 0)
+      return FD;
+    int Errno = errno;
+    ::close(FD);
+    return makeSocketError("unix:" + Address, Errno);
+  }
+
+  StringRef HostRef, PortRef;
+  std::tie(HostRef, PortRef) = Address.rsplit(':');
+  if (PortRef.empty())
+    return makeStringError("expected unix:<path> or <host>:<port>, got " +
+                           Address);
+  std::string Host = HostRef.str(), Port = PortRef.str();
+  addrinfo Hints = {};
+  Hints.ai_family = AF_UNSPEC;
+  Hints.ai_socktype = SOCK_STREAM;
+  if (Listen)
+    Hints.ai_flags = AI_PASSIVE;
+  addrinfo *Addrs = nullptr;
+  if (int Res = ::getaddrinfo(Host.empty() ? nullptr : Host.c_str(),
+                              Port.c_str(), &Hints, &Addrs))
+    return makeStringError(Address + ": " + ::gai_strerror(Res));
+  auto FreeAddrs = make_scope_exit([&] { ::freeaddrinfo(Addrs); });
+
+  int Errno = 0;
+  for (addrinfo *Addr = Addrs; Addr; Addr = Addr->ai_next) {
+    int FD = ::socket(Addr->ai_family, Addr->ai_socktype, Addr->ai_protocol);
+    if (FD < 0) {
+      Errno = errno;
+      continue;
+    }
+    if (Listen) {
+      int One = 1;
+      ::setsockopt(FD, SOL_SOCKET, SO_REUSEADDR, &One, sizeof(One));
+    }
+    if (Listen ? ::bind(FD, Addr->ai_addr, Addr->ai_addrlen) == 0 &&
+                     ::listen(FD, SOMAXCONN) == 0
+               : ::connect(FD, Addr->ai_addr, Addr->ai_addrlen) == 0)
+      return FD;
+    Errno = errno;
+    ::close(FD);
+  }
+  return makeSocketError(Address, Errno);
+}
+
+int acceptConnection(int ListenFD) {
+  while (true) {
+    int FD = ::accept(ListenFD, nullptr, nullptr);
+    if (FD >= 0 || (errno != EINTR && errno != ECONNABORTED))
+      return FD;
+  }
+}
+
+// Wakes up threads blocked on the socket, e.g. in accept() or recv().
+void shutdownSocket(int FD) { ::shutdown(FD, SHUT_RDWR); }
+
+void closeSocket(int FD) { ::close(FD); }
+
+// sys::fs::remove() refuses to remove sockets.
+void removeSocketFile(const std::string &Path) { ::unlink(Path.c_str()); }
+
+bool sendAll(int FD, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t N = ::send(FD, Data.data(), Data.size(), SendFlags);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Data = Data.drop_front(N);
+  }
+  return true;
+}
+
+bool receiveAll(int FD, char *Data, size_t Size) {
+  while (Size > 0) {
+    ssize_t N = ::recv(FD, Data, Size, 0);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Data += N;
+    Size -= N;
+  }
+  return true;
+}
+
+#else
+
+Expected<int> openSocket(StringRef Address, bool Listen) {
+  return makeStringError("remote index is not supported on this platform");
+}
+int acceptConnection(int ListenFD) { return -1; }
+void shutdownSocket(int FD) {}
+void closeSocket(int FD) {}
+void removeSocketFile(const std::string &Path) {}
+bool sendAll(int FD, StringRef Data) { return false; }
+bool receiveAll(int FD, char *Data, size_t Size) { return false; }
+
+#endif
+
+// The header and payload are sent together, so that small requests fit in a
+// single packet.
+bool writeFrame(int FD, StringRef Payload) {
+  std::string Frame(4, '\0');
+  support::endian::write32le(&Frame[0], Payload.size());
+  Frame += Payload;
+  return sendAll(FD, Frame);
+}
+
+bool readFrame(int FD, std::string &Payload) {
+  char Header[4];
+  if (!receiveAll(FD, Header, sizeof(Header)))
+    return false;
+  uint32_t Size = support::endian::read32le(Header);
+  if (Size > MaxFrameSize)
+    return false;
+  Payload.resize(Size);
+  return receiveAll(FD, &Payload[0], Size);
+}
+
+template <typename Request> std::string encode(const Request &Req) {
+  std::string Result;
+  raw_string_ostream OS(Result);
+  writeRequest(Req, OS);
+  return OS.str();
+}
+
+std::string errorResponse(const Twine &Msg) {
+  return (Twine(static_cast<char>(Failed)) + Msg).str();
+}
+
+std::string handleRequest(const SymbolIndex &Index, StringRef Request) {
+  auto Kind = requestKind(Request);
+  if (!Kind)
+    return errorResponse("unknown request");
+  SymbolSlab::Builder Symbols;
+  SymbolRefSlab::Builder Refs;
+  bool More = false;
+  switch (*Kind) {
+  case IndexRequestKind::FuzzyFind: {
+    auto Req = readFuzzyFindRequest(Request);
+    if (!Req)
+      return errorResponse(toString(Req.takeError()));
+    if (StringRef(Req->Query).contains("::"))
+      return errorResponse("the query must be unqualified");
+    More = Index.fuzzyFind(*Req, [&](const Symbol &S) { Symbols.insert(S); });
+    break;
+  }
+  case IndexRequestKind::Lookup: {
+    auto Req = readLookupRequest(Request);
+    if (!Req)
+      return errorResponse(toString(Req.takeError()));
+    Index.lookup(*Req, [&](const Symbol &S) { Symbols.insert(S); });
+    break;
+  }
+  case IndexRequestKind::Xrefs: {
+    auto Req = readXrefRequest(Request);
+    if (!Req)
+      return errorResponse(toString(Req.takeError()));
+    Index.xrefs(*Req, [&](const SymbolRefLocation &R) { Refs.insert(R); });
+    break;
+  }
+  }
+
+  SymbolSlab SymbolResults = std::move(Symbols).build();
+  SymbolRefSlab RefResults = std::move(Refs).build();
+  IndexFileOut Out;
+  Out.Symbols = &SymbolResults;
+  Out.Refs = &RefResults;
+  std::string Response;
+  raw_string_ostream OS(Response);
+  OS << static_cast<char>(Ok) << static_cast<char>(More);
+  writeIndexFile(Out, OS);
+  return OS.str();
+}
+
+// Keeps the values of the MaxCacheEntries most recently used keys.
+template <typename KeyT, typename ValueT> class LRUCache {
+public:
+  // Returns the value of Key and marks it as recently used, or null.
+  const ValueT *get(const KeyT &Key) {
+    auto It = Index.find(Key);
+    if (It == Index.end())
+      return nullptr;
+    Entries.splice(Entries.begin(), Entries, It->second);
+    return &It->second->second;
+  }
+
+  void put(const KeyT &Key, ValueT Value) {
+    auto It = Index.find(Key);
+    if (It != Index.end()) {
+      It->second->second = std::move(Value);
+      Entries.splice(Entries.begin(), Entries, It->second);
+      return;
+    }
+    Entries.emplace_front(Key, std::move(Value));
+    Index[Key] = Entries.begin();
+    if (Entries.size() > MaxCacheEntries) {
+      Index.erase(Entries.back().first);
+      Entries.pop_back();
+    }
+  }
+
+private:
+  using EntryList = std::list<std::pair<KeyT, ValueT>>;
+  // The most recently used entries come first.
+  EntryList Entries;
+  std::map<KeyT, typename EntryList::iterator> Index;
+};
+
+class RemoteIndex : public SymbolIndex {
+public:
+  RemoteIndex(StringRef Address, int FD) : Address(Address), Idle{FD} {}
+  ~RemoteIndex() override {
+    for (int FD : Idle)
+      closeSocket(FD);
+  }
+
+  bool
+  fuzzyFind(const FuzzyFindRequest &Req,
+            function_ref<void(const Symbol &)> Callback) const override {
+    trace::Span Tracer("RemoteIndex fuzzyFind");
+    std::string Request = encode(Req);
+    std::shared_ptr<const FuzzyFindResult> Result;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      if (auto *Cached = FuzzyFindCache.get(Request))
+        Result = *Cached;
+    }
+    SPAN_ATTACH(Tracer, "cached", Result != nullptr);
+    if (!Result) {
+      auto NewResult = std::make_shared<FuzzyFindResult>();
+      auto In = call(Request, NewResult->More);
+      if (!In) {
+        log("RemoteIndex fuzzyFind failed: " + toString(In.takeError()));
+        return false;
+      }
+      NewResult->Symbols = std::move(In->Symbols);
+      Result = std::move(NewResult);
+      std::lock_guard<std::mutex> Lock(Mu);
+      FuzzyFindCache.put(Request, Result);
+    }
+    for (const Symbol &Sym : Result->Symbols)
+      Callback(Sym);
+    return Result->More;
+  }
+
+  void lookup(const LookupRequest &Req,
+              function_ref<void(const Symbol &)> Callback) const override {
+    trace::Span Tracer("RemoteIndex lookup");
+    std::vector<CachedSymbol> Results;
+    LookupRequest Missing;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      for (const SymbolID &ID : Req.IDs) {
+        auto *Cached = LookupCache.get(ID);
+        if (!Cached)
+          Missing.IDs.insert(ID);
+        else if (Cached->second)
+          Results.push_back(*Cached);
+      }
+    }
+    SPAN_ATTACH(Tracer, "cached",
+                static_cast<int>(Req.IDs.size() - Missing.IDs.size()));
+    if (!Missing.IDs.empty()) {
+      bool More;
+      auto In = call(encode(Missing), More);
+      if (!In) {
+        log("RemoteIndex lookup failed: " + toString(In.takeError()));
+      } else {
+        auto Slab = std::make_shared<SymbolSlab>(std::move(In->Symbols));
+        std::lock_guard<std::mutex> Lock(Mu);
+        // Symbols that were not found are cached as null.
+        for (const SymbolID &ID : Missing.IDs) {
+          auto Sym = Slab->find(ID);
+          CachedSymbol Entry(Slab, Sym == Slab->end() ? nullptr : &*Sym);
+          LookupCache.put(ID, Entry);
+          if (Entry.second)
+            Results.push_back(std::move(Entry));
+        }
+      }
+    }
+    for (const auto &Result : Results)
+      Callback(*Result.second);
+  }
+
+  void xrefs(const XrefRequest &Req,
+             function_ref<void(const SymbolRefLocation &)> Callback)
+      const override {
+    trace::Span Tracer("RemoteIndex xrefs");
+    std::string Request = encode(Req);
+    std::shared_ptr<const SymbolRefSlab> Result;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      if (auto *Cached = XrefsCache.get(Request))
+        Result = *Cached;
+    }
+    SPAN_ATTACH(Tracer, "cached", Result != nullptr);
+    if (!Result) {
+      bool More;
+      auto In = call(Request, More);
+      if (!In) {
+        log("RemoteIndex xrefs failed: " + toString(In.takeError()));
+        return;
+      }
+      Result = std::make_shared<SymbolRefSlab>(std::move(In->Refs));
+      std::lock_guard<std::mutex> Lock(Mu);
+      XrefsCache.put(Request, Result);
+    }
+    for (const SymbolRefLocation &Ref : *Result)
+      Callback(Ref);
+  }
+
+private:
+  struct FuzzyFindResult {
+    SymbolSlab Symbols;
+    bool More = false;
+  };
+  /// A cached symbol, and the slab that owns it. Null if it doesn't exist.
+  using CachedSymbol = std::pair<std::shared_ptr<SymbolSlab>, const Symbol *>;
+
+  /// Sends a request on a connection of its own and parses the response, so
+  /// that concurrent requests don't wait for each other. Mu must not be held.
+  /// If an idle connection turns out to be broken, a new one is opened once.
+  Expected<IndexFileIn> call(StringRef Request, bool &More) const {
+    std::string Response;
+    bool Done = false;
+    for (int Attempt = 0; Attempt < 2 && !Done; ++Attempt) {
+      int FD = Attempt == 0 ? takeIdleConnection() : -1;
+      if (FD < 0) {
+        auto NewFD = openSocket(Address, /*Listen=*/false);
+        if (!NewFD)
+          return NewFD.takeError();
+        FD = *NewFD;
+      }
+      Done = writeFrame(FD, Request) && readFrame(FD, Response);
+      if (Done)
+        returnIdleConnection(FD);
+      else
+        closeSocket(FD);
+    }
+    if (!Done)
+      return makeStringError("lost the connection to " + Address);
+    if (Response.size() < 2)
+      return makeStringError("malformed response");
+    if (Response[0] != Ok)
+      return makeStringError("index server error: " + Response.substr(1));
+    More = Response[1];
+    return readIndexFile(StringRef(Response).drop_front(2));
+  }
+
+  /// Returns an open connection that no request is using, or -1.
+  int takeIdleConnection() const {
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (Idle.empty())
+      return -1;
+    int FD = Idle.back();
+    Idle.pop_back();
+    return FD;
+  }
+
+  void returnIdleConnection(int FD) const {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      if (Idle.size() < MaxIdleConnections) {
+        Idle.push_back(FD);
+        return;
+      }
+    }
+    closeSocket(FD);
+  }
+
+  const std::string Address;
+  /// Guards the connections and the caches, never held during a request.
+  mutable std::mutex Mu;
+  mutable std::vector<int> Idle;
+  /// Results of fuzzyFind and xrefs, keyed by the encoded request.
+  mutable LRUCache<std::string, std::shared_ptr<const FuzzyFindResult>>
+      FuzzyFindCache;
+  mutable LRUCache<std::string, std::shared_ptr<const SymbolRefSlab>>
+      XrefsCache;
+  mutable LRUCache<SymbolID, CachedSymbol> LookupCache;
+};
+
+} // namespace
+
+Expected<std::unique_ptr<SymbolIndex>>
+connectRemoteIndex(StringRef Address) {
+  auto FD = openSocket(Address, /*Listen=*/false);
+  if (!FD)
+    return FD.takeError();
+  return llvm::make_unique<RemoteIndex>(Address, *FD);
+}
+
+Expected<std::unique_ptr<IndexServer>>
+IndexServer::listen(const SymbolIndex &Index, StringRef Address) {
+  auto FD = openSocket(Address, /*Listen=*/true);
+  if (!FD)
+    return FD.takeError();
+  std::string SocketPath;
+  if (Address.startswith("unix:"))
+    SocketPath = Address.drop_front(5).str();
+  return std::unique_ptr<IndexServer>(
+      new IndexServer(Index, *FD, std::move(SocketPath)));
+}
+
+IndexServer::IndexServer(const SymbolIndex &Index, int ListenFD,
+                         std::string SocketPath)
+    : Index(Index), ListenFD(ListenFD), SocketPath(std::move(SocketPath)),
+      Acceptor([this] { acceptLoop(); }) {}
+
+IndexServer::~IndexServer() {
+  shutdownSocket(ListenFD);
+  Acceptor.join();
+  std::thread Last;
+  {
+    std::unique_lock<std::mutex> Lock(Mu);
+    for (int FD : Connections)
+      shutdownSocket(FD);
+    WorkerDoneCV.wait(Lock, [this] { return Workers.empty(); });
+    Last = std::move(LastFinished);
+  }
+  // Each finished worker joins the one before it, so this joins them all.
+  if (Last.joinable())
+    Last.join();
+  closeSocket(ListenFD);
+  if (!SocketPath.empty())
+    removeSocketFile(SocketPath);
+}
+
+void IndexServer::wait() {
+  std::unique_lock<std::mutex> Lock(Mu);
+  StoppedCV.wait(Lock, [this] { return Stopped; });
+}
+
+void IndexServer::acceptLoop() {
+  int FD;
+  while ((FD = acceptConnection(ListenFD)) >= 0) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Connections.push_back(FD);
+    Workers.emplace_back();
+    auto Self = std::prev(Workers.end());
+    *Self = std::thread([this, FD, Self] { serve(FD, Self); });
+  }
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Stopped = true;
+  }
+  StoppedCV.notify_all();
+}
+
+void IndexServer::serve(int FD, std::list<std::thread>::iterator Self) {
+  std::string Request;
+  while (readFrame(FD, Request)) {
+    trace::Span Tracer("IndexServer request");
+    if (!writeFrame(FD, handleRequest(Index, Request)))
+      break;
+  }
+  // A thread can't join itself: it joins the previous finished worker, and
+  // leaves itself to be joined by the next one, or by the destructor.
+  std::thread Previous;
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Connections.erase(std::find(Connections.begin(), Connections.end(), FD));
+    closeSocket(FD);
+    Previous = std::move(LastFinished);
+    LastFinished = std::move(*Self);
+    Workers.erase(Self);
+  }
+  WorkerDoneCV.notify_all();
+  if (Previous.joinable())
+    Previous.join();
+}
+
+} // namespace clangd
+} // namespace clang
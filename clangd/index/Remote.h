@@ -0,0 +1,88 @@
+//===--- Remote.h - Index served by another process --------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A SymbolIndex that forwards requests to an index server, so that a large
+// index can be loaded once and shared by many clangd instances.
+//
+// The client and the server talk over a Unix domain socket or TCP. Each
+// message is a frame: a 32-bit little-endian length followed by the payload.
+// Requests are encoded with writeRequest(). A response starts with a status
+// byte; errors are followed by a message, successful responses by a byte that
+// is set if fuzzyFind() may have more results, and then the results in the
+// binary index file format.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REMOTE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REMOTE_H
+
+#include "Index.h"
+#include "llvm/Support/Error.h"
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// Connects to the index server at \p Address, which is either
+/// "unix:<socket path>" or "<host>:<port>".
+///
+/// The most recently used results are cached by the client, so the server is
+/// only asked once for identical requests. Lookups only ask for the symbols
+/// that are not cached, in a single request. Concurrent requests are sent on
+/// separate connections.
+llvm::Expected<std::unique_ptr<SymbolIndex>>
+connectRemoteIndex(llvm::StringRef Address);
+
+/// Serves requests for a SymbolIndex to remote index clients. Each connection
+/// is handled by its own thread, which is joined after the connection closes.
+class IndexServer {
+public:
+  /// Starts serving \p Index at \p Address, which has the same format as for
+  /// connectRemoteIndex(). \p Index must outlive the server.
+  static llvm::Expected<std::unique_ptr<IndexServer>>
+  listen(const SymbolIndex &Index, llvm::StringRef Address);
+
+  /// Stops accepting connections and closes the open ones.
+  ~IndexServer();
+
+  /// Blocks until the server stops accepting connections.
+  void wait();
+
+private:
+  IndexServer(const SymbolIndex &Index, int ListenFD, std::string SocketPath);
+
+  void acceptLoop();
+  void serve(int FD, std::list<std::thread>::iterator Self);
+
+  const SymbolIndex &Index;
+  const int ListenFD;
+  /// The Unix domain socket to remove when the server stops, if any.
+  const std::string SocketPath;
+
+  std::mutex Mu;
+  std::condition_variable StoppedCV;
+  bool Stopped = false;
+  std::vector<int> Connections;
+  /// The threads serving the open connections.
+  std::list<std::thread> Workers;
+  std::condition_variable WorkerDoneCV;
+  /// The last worker to finish, which hasn't been joined yet.
+  std::thread LastFinished;
+  std::thread Acceptor;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REMOTE_H
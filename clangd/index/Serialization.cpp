@@ -0,0 +1,473 @@
+//===--- Serialization.cpp - Binary format for index data ------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Serialization.h"
+#include "../Logger.h"
+#include "MemIndex.h"
+#include "SymbolYAML.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SHA1.h"
+#include <algorithm>
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+
+namespace {
+
+// The file layout is (integers are varints unless noted otherwise):
+//   - magic "CdIx", and the format version.
+//   - string table: count, then each string as length and bytes.
+//     Strings are sorted, and referenced below by their index in the table.
+//   - sources: count, then each source as path and 20-byte digest.
+//   - symbols: count, then each symbol as written by writeSymbol().
+//   - refs: count, then each ref as 20-byte ID, kind and location.
+constexpr char Magic[] = "CdIx";
+constexpr uint32_t Version = 1;
+
+void writeVar(uint32_t V, raw_ostream &OS) {
+  do {
+    uint8_t Byte = V & 0x7f;
+    V >>= 7;
+    if (V)
+      Byte |= 0x80;
+    OS.write(Byte);
+  } while (V);
+}
+
+// Assigns each string an index in the string table.
+class StringTableOut {
+public:
+  void intern(StringRef S) { Unique.insert(S); }
+
+  // Must be called after all strings were interned, and before index().
+  void finalize() {
+    Sorted.assign(Unique.begin(), Unique.end());
+    std::sort(Sorted.begin(), Sorted.end());
+    for (unsigned I = 0; I < Sorted.size(); ++I)
+      Index[Sorted[I]] = I;
+  }
+
+  unsigned index(StringRef S) const {
+    auto It = Index.find(S);
+    assert(It != Index.end() && "string was not interned");
+    return It->second;
+  }
+
+  void write(raw_ostream &OS) const {
+    writeVar(Sorted.size(), OS);
+    for (StringRef S : Sorted) {
+      writeVar(S.size(), OS);
+      OS << S;
+    }
+  }
+
+private:
+  DenseSet<StringRef> Unique;
+  std::vector<StringRef> Sorted;
+  DenseMap<StringRef, unsigned> Index;
+};
+
+void internSymbol(const Symbol &S, StringTableOut &Strings) {
+  Strings.intern(S.Name);
+  Strings.intern(S.Scope);
+  Strings.intern(S.Definition.FileURI);
+  Strings.intern(S.CanonicalDeclaration.FileURI);
+  Strings.intern(S.Signature);
+  Strings.intern(S.CompletionSnippetSuffix);
+  if (S.Detail) {
+    Strings.intern(S.Detail->Documentation);
+    Strings.intern(S.Detail->ReturnType);
+    Strings.intern(S.Detail->IncludeHeader);
+  }
+}
+
+void writeLocation(const SymbolLocation &Loc, const StringTableOut &Strings,
+                   raw_ostream &OS) {
+  writeVar(Strings.index(Loc.FileURI), OS);
+  writeVar(Loc.Start.Line, OS);
+  writeVar(Loc.Start.Column, OS);
+  writeVar(Loc.End.Line, OS);
+  writeVar(Loc.End.Column, OS);
+}
+
+enum SymbolFlag : uint8_t {
+  IndexedForCodeCompletion = 1 << 0,
+  HasDetail = 1 << 1,
+};
+
+void writeSymbol(const Symbol &S, const StringTableOut &Strings,
+                 raw_ostream &OS) {
+  OS << S.ID.raw();
+  OS.write(static_cast<uint8_t>(S.SymInfo.Kind));
+  OS.write(static_cast<uint8_t>(S.SymInfo.SubKind));
+  OS.write(static_cast<uint8_t>(S.SymInfo.Lang));
+  writeVar(static_cast<uint32_t>(S.SymInfo.Properties), OS);
+  writeVar(Strings.index(S.Name), OS);
+  writeVar(Strings.index(S.Scope), OS);
+  writeLocation(S.Definition, Strings, OS);
+  writeLocation(S.CanonicalDeclaration, Strings, OS);
+  writeVar(S.References, OS);
+  uint8_t Flags = 0;
+  if (S.IsIndexedForCodeCompletion)
+    Flags |= IndexedForCodeCompletion;
+  if (S.Detail)
+    Flags |= HasDetail;
+  OS.write(Flags);
+  OS.write(static_cast<uint8_t>(S.Origin));
+  writeVar(Strings.index(S.Signature), OS);
+  writeVar(Strings.index(S.CompletionSnippetSuffix), OS);
+  if (S.Detail) {
+    writeVar(Strings.index(S.Detail->Documentation), OS);
+    writeVar(Strings.index(S.Detail->ReturnType), OS);
+    writeVar(Strings.index(S.Detail->IncludeHeader), OS);
+  }
+}
+
+// Consumes data from a buffer. After an out-of-bounds read, all reads return
+// zero values and err() is true.
+class Reader {
+public:
+  Reader(StringRef Data) : Begin(Data.begin()), End(Data.end()) {}
+
+  bool err() const { return Err; }
+  bool eof() const { return Begin == End; }
+
+  uint8_t consume8() {
+    if (Begin == End) {
+      Err = true;
+      return 0;
+    }
+    return *Begin++;
+  }
+
+  uint32_t consumeVar() {
+    uint32_t V = 0;
+    for (unsigned Shift = 0; Shift < 35; Shift += 7) {
+      uint8_t Byte = consume8();
+      V |= uint32_t(Byte & 0x7f) << Shift;
+      if (!(Byte & 0x80))
+        return V;
+    }
+    Err = true;
+    return 0;
+  }
+
+  StringRef consume(size_t N) {
+    if (size_t(End - Begin) < N) {
+      Err = true;
+      return "";
+    }
+    StringRef Result(Begin, N);
+    Begin += N;
+    return Result;
+  }
+
+  // Reads a string table index and returns the string, or "" if invalid.
+  StringRef consumeString(ArrayRef<StringRef> Strings) {
+    uint32_t I = consumeVar();
+    if (I >= Strings.size()) {
+      Err = true;
+      return "";
+    }
+    return Strings[I];
+  }
+
+  SymbolID consumeID() {
+    StringRef Raw = consume(SymbolID::HashByteLength);
+    return Err ? SymbolID() : SymbolID::fromRaw(Raw);
+  }
+
+private:
+  const char *Begin, *End;
+  bool Err = false;
+};
+
+SymbolLocation readLocation(Reader &R, ArrayRef<StringRef> Strings) {
+  SymbolLocation Loc;
+  Loc.FileURI = R.consumeString(Strings);
+  Loc.Start.Line = R.consumeVar();
+  Loc.Start.Column = R.consumeVar();
+  Loc.End.Line = R.consumeVar();
+  Loc.End.Column = R.consumeVar();
+  return Loc;
+}
+
+// The returned symbol refers to Strings and Detail.
+Symbol readSymbol(Reader &R, ArrayRef<StringRef> Strings,
+                  Symbol::Details &Detail) {
+  Symbol S;
+  S.ID = R.consumeID();
+  S.SymInfo.Kind = static_cast<index::SymbolKind>(R.consume8());
+  S.SymInfo.SubKind = static_cast<index::SymbolSubKind>(R.consume8());
+  S.SymInfo.Lang = static_cast<index::SymbolLanguage>(R.consume8());
+  S.SymInfo.Properties =
+      static_cast<index::SymbolPropertySet>(R.consumeVar());
+  S.Name = R.consumeString(Strings);
+  S.Scope = R.consumeString(Strings);
+  S.Definition = readLocation(R, Strings);
+  S.CanonicalDeclaration = readLocation(R, Strings);
+  S.References = R.consumeVar();
+  uint8_t Flags = R.consume8();
+  S.IsIndexedForCodeCompletion = Flags & IndexedForCodeCompletion;
+  S.Origin = static_cast<SymbolOrigin>(R.consume8());
+  S.Signature = R.consumeString(Strings);
+  S.CompletionSnippetSuffix = R.consumeString(Strings);
+  if (Flags & HasDetail) {
+    Detail.Documentation = R.consumeString(Strings);
+    Detail.ReturnType = R.consumeString(Strings);
+    Detail.IncludeHeader = R.consumeString(Strings);
+    S.Detail = &Detail;
+  }
+  return S;
+}
+
+Error makeError(const Twine &Msg) {
+  return make_error<StringError>("malformed index file: " + Msg,
+                                 inconvertibleErrorCode());
+}
+
+void writeString(StringRef S, raw_ostream &OS) {
+  writeVar(S.size(), OS);
+  OS << S;
+}
+
+void writeIDs(const DenseSet<SymbolID> &IDs, raw_ostream &OS) {
+  writeVar(IDs.size(), OS);
+  for (const SymbolID &ID : IDs)
+    OS << ID.raw();
+}
+
+bool readIDs(Reader &R, DenseSet<SymbolID> &IDs) {
+  for (uint32_t Count = R.consumeVar(); Count > 0 && !R.err(); --Count)
+    IDs.insert(R.consumeID());
+  return !R.err();
+}
+
+// Checks the kind of the request, and returns a reader for its body.
+Expected<Reader> readRequestHeader(StringRef Data, IndexRequestKind Kind) {
+  if (requestKind(Data) != Kind)
+    return make_error<StringError>("unexpected request kind",
+                                   inconvertibleErrorCode());
+  return Reader(Data.drop_front());
+}
+
+Error makeRequestError() {
+  return make_error<StringError>("malformed request",
+                                 inconvertibleErrorCode());
+}
+
+} // namespace
+
+FileDigest digest(StringRef Content) {
+  return SHA1::hash(arrayRefFromStringRef(Content));
+}
+
+void writeIndexFile(const IndexFileOut &Data, raw_ostream &OS) {
+  StringTableOut Strings;
+  for (const auto &Source : Data.Sources)
+    Strings.intern(Source.Path);
+  if (Data.Symbols)
+    for (const Symbol &S : *Data.Symbols)
+      internSymbol(S, Strings);
+  for (const SymbolSlab *Shard : Data.SymbolShards)
+    for (const Symbol &S : *Shard)
+      internSymbol(S, Strings);
+  if (Data.Refs)
+    for (const SymbolRefLocation &Ref : *Data.Refs)
+      Strings.intern(Ref.Loc.FileURI);
+  Strings.finalize();
+
+  OS << StringRef(Magic, 4);
+  writeVar(Version, OS);
+  Strings.write(OS);
+
+  writeVar(Data.Sources.size(), OS);
+  for (const auto &Source : Data.Sources) {
+    writeVar(Strings.index(Source.Path), OS);
+    OS << toStringRef(Source.Digest);
+  }
+
+  size_t NumSymbols = Data.Symbols ? Data.Symbols->size() : 0;
+  for (const SymbolSlab *Shard : Data.SymbolShards)
+    NumSymbols += Shard->size();
+  writeVar(NumSymbols, OS);
+  if (Data.Symbols)
+    for (const Symbol &S : *Data.Symbols)
+      writeSymbol(S, Strings, OS);
+  for (const SymbolSlab *Shard : Data.SymbolShards)
+    for (const Symbol &S : *Shard)
+      writeSymbol(S, Strings, OS);
+
+  writeVar(Data.Refs ? Data.Refs->size() : 0, OS);
+  if (Data.Refs)
+    for (const SymbolRefLocation &Ref : *Data.Refs) {
+      OS << Ref.SymID.ID()->raw();
+      writeVar(static_cast<uint32_t>(Ref.Kind), OS);
+      writeLocation(Ref.Loc, Strings, OS);
+    }
+}
+
+Expected<IndexFileIn> readIndexFile(StringRef Data) {
+  Reader R(Data);
+  if (R.consume(4) != StringRef(Magic, 4))
+    return makeError("bad magic");
+  if (R.consumeVar() != Version)
+    return makeError("unsupported version");
+
+  // Each entry takes at least one byte, so larger counts are corrupt.
+  uint32_t NumStrings = R.consumeVar();
+  if (NumStrings > Data.size())
+    return makeError("bad string count");
+  std::vector<StringRef> Strings(NumStrings);
+  for (auto &S : Strings) {
+    S = R.consume(R.consumeVar());
+    if (R.err())
+      return makeError("truncated string table");
+  }
+
+  IndexFileIn Result;
+  uint32_t NumSources = R.consumeVar();
+  if (NumSources > Data.size())
+    return makeError("bad source count");
+  Result.Sources.resize(NumSources);
+  for (auto &Source : Result.Sources) {
+    Source.Path = R.consumeString(Strings);
+    StringRef Digest = R.consume(Source.Digest.size());
+    if (R.err())
+      return makeError("truncated sources");
+    std::copy(Digest.bytes_begin(), Digest.bytes_end(), Source.Digest.begin());
+  }
+
+  SymbolSlab::Builder Symbols;
+  Symbol::Details Detail;
+  for (uint32_t Count = R.consumeVar(); Count > 0; --Count) {
+    Symbol S = readSymbol(R, Strings, Detail);
+    if (R.err())
+      return makeError("truncated symbols");
+    Symbols.insert(S);
+  }
+  Result.Symbols = std::move(Symbols).build();
+
+  SymbolRefSlab::Builder Refs;
+  for (uint32_t Count = R.consumeVar(); Count > 0; --Count) {
+    SymbolID ID = R.consumeID();
+    SymbolRefLocation Ref;
+    Ref.SymID = &ID;
+    Ref.Kind = static_cast<XrefKind>(R.consumeVar());
+    Ref.Loc = readLocation(R, Strings);
+    if (R.err())
+      return makeError("truncated refs");
+    Refs.insert(Ref);
+  }
+  Result.Refs = std::move(Refs).build();
+
+  if (R.err())
+    return makeError("truncated data");
+  if (!R.eof())
+    return makeError("trailing data");
+  return std::move(Result);
+}
+
+std::unique_ptr<SymbolIndex> loadIndex(StringRef Filename) {
+  auto Buffer = MemoryBuffer::getFile(Filename);
+  if (!Buffer) {
+    log("Can't open " + Filename + ": " + Buffer.getError().message());
+    return nullptr;
+  }
+  StringRef Data = Buffer.get()->getBuffer();
+  if (!Data.startswith(StringRef(Magic, 4)))
+    return MemIndex::build(SymbolsFromYAML(Data));
+  auto In = readIndexFile(Data);
+  if (!In) {
+    log("Can't load " + Filename + ": " + llvm::toString(In.takeError()));
+    return nullptr;
+  }
+  return MemIndex::build(std::move(In->Symbols), std::move(In->Refs));
+}
+
+void writeRequest(const FuzzyFindRequest &Req, raw_ostream &OS) {
+  OS.write(static_cast<uint8_t>(IndexRequestKind::FuzzyFind));
+  writeString(Req.Query, OS);
+  writeVar(Req.Scopes.size(), OS);
+  for (const auto &Scope : Req.Scopes)
+    writeString(Scope, OS);
+  OS.write(Req.MatchScopeSuffix);
+  writeVar(std::min<size_t>(Req.MaxCandidateCount, UINT32_MAX), OS);
+  OS.write(Req.RestrictForCodeCompletion);
+  writeVar(Req.ProximityPaths.size(), OS);
+  for (const auto &Path : Req.ProximityPaths)
+    writeString(Path, OS);
+}
+
+void writeRequest(const LookupRequest &Req, raw_ostream &OS) {
+  OS.write(static_cast<uint8_t>(IndexRequestKind::Lookup));
+  writeIDs(Req.IDs, OS);
+}
+
+void writeRequest(const XrefRequest &Req, raw_ostream &OS) {
+  OS.write(static_cast<uint8_t>(IndexRequestKind::Xrefs));
+  writeIDs(Req.IDs, OS);
+  writeVar(static_cast<uint32_t>(Req.Options), OS);
+}
+
+Optional<IndexRequestKind> requestKind(StringRef Data) {
+  if (Data.empty())
+    return None;
+  uint8_t Kind = Data.front();
+  if (Kind < static_cast<uint8_t>(IndexRequestKind::FuzzyFind) ||
+      Kind > static_cast<uint8_t>(IndexRequestKind::Xrefs))
+    return None;
+  return static_cast<IndexRequestKind>(Kind);
+}
+
+Expected<FuzzyFindRequest> readFuzzyFindRequest(StringRef Data) {
+  auto R = readRequestHeader(Data, IndexRequestKind::FuzzyFind);
+  if (!R)
+    return R.takeError();
+  FuzzyFindRequest Req;
+  Req.Query = R->consume(R->consumeVar()).str();
+  for (uint32_t Count = R->consumeVar(); Count > 0 && !R->err(); --Count)
+    Req.Scopes.push_back(R->consume(R->consumeVar()).str());
+  Req.MatchScopeSuffix = R->consume8();
+  Req.MaxCandidateCount = R->consumeVar();
+  Req.RestrictForCodeCompletion = R->consume8();
+  for (uint32_t Count = R->consumeVar(); Count > 0 && !R->err(); --Count)
+    Req.ProximityPaths.push_back(R->consume(R->consumeVar()).str());
+  if (R->err() || !R->eof())
+    return makeRequestError();
+  return std::move(Req);
+}
+
+Expected<LookupRequest> readLookupRequest(StringRef Data) {
+  auto R = readRequestHeader(Data, IndexRequestKind::Lookup);
+  if (!R)
+    return R.takeError();
+  LookupRequest Req;
+  if (!readIDs(*R, Req.IDs) || !R->eof())
+    return makeRequestError();
+  return std::move(Req);
+}
+
+Expected<XrefRequest> readXrefRequest(StringRef Data) {
+  auto R = readRequestHeader(Data, IndexRequestKind::Xrefs);
+  if (!R)
+    return R.takeError();
+  XrefRequest Req;
+  readIDs(*R, Req.IDs);
+  Req.Options = static_cast<int32_t>(R->consumeVar());
+  if (R->err() || !R->eof())
+    return makeRequestError();
+  return std::move(Req);
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,85 @@
+//===--- Serialization.h - Binary format for index data ----------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A compact binary format for symbols and references. Unlike SymbolYAML, it is
+// meant to be stored and loaded in bulk: strings are deduplicated into a table
+// and numbers are variable-length encoded.
+//
+// An index file may also record the source files it was built from, along with
+// digests of their contents, so that readers can tell when it is stale.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
+
+#include "Index.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include <array>
+#include <memory>
+
+namespace clang {
+namespace clangd {
+
+/// A SHA1 digest of a file's contents.
+using FileDigest = std::array<uint8_t, 20>;
+FileDigest digest(llvm::StringRef Content);
+
+/// A file that the index data was built from.
+struct IndexFileSource {
+  std::string Path;
+  FileDigest Digest;
+};
+
+/// The data read from an index file.
+struct IndexFileIn {
+  SymbolSlab Symbols;
+  SymbolRefSlab Refs;
+  std::vector<IndexFileSource> Sources;
+};
+/// Parses an index file produced by writeIndexFile().
+llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef Data);
+
+/// The data to be written to an index file. Null slabs are written as empty.
+struct IndexFileOut {
+  const SymbolSlab *Symbols = nullptr;
+  /// More symbols, written after Symbols, e.g. the shards of an index that was
+  /// merged in parallel. A symbol must not be in more than one slab.
+  llvm::ArrayRef<const SymbolSlab *> SymbolShards;
+  const SymbolRefSlab *Refs = nullptr;
+  llvm::ArrayRef<IndexFileSource> Sources;
+};
+void writeIndexFile(const IndexFileOut &Data, llvm::raw_ostream &OS);
+
+/// Builds an in-memory index from a file in either the binary format or YAML.
+/// Returns nullptr if the file can't be read or parsed.
+std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef Filename);
+
+/// The kinds of SymbolIndex requests, e.g. for sending them to a remote index.
+enum class IndexRequestKind : uint8_t {
+  FuzzyFind = 1,
+  Lookup = 2,
+  Xrefs = 3,
+};
+/// Requests are encoded as their kind, followed by their fields.
+void writeRequest(const FuzzyFindRequest &Req, llvm::raw_ostream &OS);
+void writeRequest(const LookupRequest &Req, llvm::raw_ostream &OS);
+void writeRequest(const XrefRequest &Req, llvm::raw_ostream &OS);
+/// Returns the kind of an encoded request, or None if it is not a request.
+llvm::Optional<IndexRequestKind> requestKind(llvm::StringRef Data);
+llvm::Expected<FuzzyFindRequest> readFuzzyFindRequest(llvm::StringRef Data);
+llvm::Expected<LookupRequest> readLookupRequest(llvm::StringRef Data);
+llvm::Expected<XrefRequest> readXrefRequest(llvm::StringRef Data);
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
@@ -301,16 +301,19 @@ bool SymbolCollector::shouldCollectSymbol(const NamedDecl &ND,
       translationUnitDecl(), namespaceDecl(), linkageSpecDecl(), recordDecl(),
       enumDecl(), objcProtocolDecl(), objcInterfaceDecl(), objcCategoryDecl(),
       objcCategoryImplDecl(), objcImplementationDecl()));
-  // Don't index template specializations and expansions in main files.
+  // Don't index template specializations.
   auto IsSpecialization =
       anyOf(functionDecl(isExplicitTemplateSpecialization()),
             cxxRecordDecl(isExplicitTemplateSpecialization()),
             varDecl(isExplicitTemplateSpecialization()));
-  if (match(decl(allOf(unless(isExpansionInMainFile()), InNonLocalContext,
-                       unless(IsSpecialization))),
-            ND, ASTCtx)
+  if (match(decl(allOf(InNonLocalContext, unless(IsSpecialization))), ND,
+            ASTCtx)
           .empty())
     return false;
+  // Nor the decls and expansions of main files, unless asked to.
+  if (!Opts.CollectMainFileSymbols &&
+      !match(decl(isExpansionInMainFile()), ND, ASTCtx).empty())
+    return false;
 
   // Avoid indexing internal symbols in protobuf generated headers.
   if (isPrivateProtoDecl(ND))
@@ -405,6 +408,11 @@ const Symbol *SymbolCollector::addDeclaration(const NamedDecl &ND,
   // for consistency with CodeCompletionString and a clean name/signature split.
 
   S.IsIndexedForCodeCompletion = isIndexedForCodeCompletion(ND, Ctx);
+  // Internal symbols of the main file, e.g. static functions, can't be used
+  // from the other files that are completed with the index.
+  if (Opts.CollectMainFileSymbols && !ND.isExternallyVisible() &&
+      SM.isInMainFile(SM.getExpansionLoc(ND.getLocation())))
+    S.IsIndexedForCodeCompletion = false;
   S.SymInfo = index::getSymbolInfo(&ND);
   std::string FileURI;
   if (auto DeclLoc =
@@ -25,7 +25,7 @@ namespace clangd {
 /// - Anonymous declarations (anonymous enum/class/struct, etc)
 /// - Declarations in anonymous namespaces
 /// - Local declarations (in function bodies, blocks, etc)
-/// - Declarations in main files
+/// - Declarations in main files, unless Options::CollectMainFileSymbols is set
 /// - Template specializations
 /// - Library-specific private declarations (e.g. private declaration generated
 /// by protobuf compiler)
@@ -55,6 +55,10 @@ public:
     bool CountReferences = false;
     // Every symbol collected will be stamped with this origin.
     SymbolOrigin Origin = SymbolOrigin::Unknown;
+    /// Collect symbols declared in the main file too, e.g. to index the
+    /// decls of an open file that aren't in its preamble. The ones with
+    /// internal linkage are not indexed for code completion.
+    bool CollectMainFileSymbols = false;
   };
 
   SymbolCollector(Options Opts);
@@ -0,0 +1,423 @@
+//===--- ReplayMain.cpp ------------------------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Plays sessions recorded with clangd -input-mirror-file back against clangd
+// processes, with the original timing (recorded with -input-mirror-timestamps)
+// or faster, and reports the latency of each kind of request and the overall
+// throughput.
+//
+// Each client runs its own clangd and replays one of the recordings; with
+// more clients than recordings, the recordings are shared round-robin.
+// Messages are sent at their recorded times, without waiting for replies, so
+// that a slow server builds up a backlog just as it would with an editor.
+//
+//===---------------------------------------------------------------------===//
+
+#include "Metrics.h"
+#include "Replay.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+using namespace clang::clangd;
+
+static cl::list<std::string> Recordings(cl::Positional, cl::OneOrMore,
+                                        cl::desc("<recorded session>..."));
+
+static cl::opt<std::string> Clangd("clangd",
+                                   cl::desc("The clangd binary to replay to"),
+                                   cl::init("clangd"));
+
+static cl::list<std::string> ClangdArgs("clangd-arg",
+                                        cl::desc("Argument to pass to clangd"));
+
+static cl::opt<unsigned>
+    Clients("clients", cl::desc("Number of concurrent clients, each with its "
+                                "own clangd process"),
+            cl::init(1));
+
+static cl::opt<double>
+    Speed("speed",
+          cl::desc("Replay speed relative to the recording: 1 replays with the "
+                   "original timing, 2 twice as fast, and 0 sends messages as "
+                   "fast as possible. Recordings without X-Clangd-Time headers "
+                   "are always replayed as fast as possible"),
+          cl::init(1));
+
+static cl::opt<unsigned>
+    Timeout("timeout",
+            cl::desc("Seconds to wait for outstanding replies at the end of a "
+                     "session"),
+            cl::init(60));
+
+static cl::opt<std::string>
+    ReportFile("report", cl::desc("Write the report as JSON to this file"),
+               cl::value_desc("filename"));
+
+static cl::opt<std::string>
+    BaselineFile("baseline",
+                 cl::desc("A JSON report of an earlier run to compare to"),
+                 cl::value_desc("filename"));
+
+#ifndef _WIN32
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point Start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - Start)
+      .count();
+}
+
+// A key for request IDs, which may be numbers or strings.
+std::string idKey(const json::Expr &ID) { return formatv("{0}", ID).str(); }
+
+// Reads a message from clangd's output. Returns None at the end of the
+// output.
+Optional<json::Expr> readMessage(std::FILE *In) {
+  unsigned long long ContentLength = 0;
+  char Line[256];
+  while (true) {
+    if (!std::fgets(Line, sizeof(Line), In))
+      return None;
+    StringRef LineRef(Line);
+    if (LineRef.consume_front("Content-Length: "))
+      getAsUnsignedInteger(LineRef.trim(), 10, ContentLength);
+    else if (LineRef.trim().empty())
+      break;
+  }
+  std::string JSON(ContentLength, '\0');
+  if (std::fread(&JSON[0], 1, ContentLength, In) != ContentLength)
+    return None;
+  auto Message = json::parse(JSON);
+  if (!Message) {
+    errs() << "Bad message from clangd: " << toString(Message.takeError())
+           << "\n";
+    return json::Expr(nullptr);
+  }
+  return std::move(*Message);
+}
+
+// Replays a session to its own clangd process.
+class Client {
+public:
+  Client(const std::vector<RecordedMessage> &Session, trace::Metrics &M)
+      : Session(Session), M(M) {}
+
+  ~Client() {
+    if (Reader.joinable())
+      Reader.join();
+  }
+
+  // Starts clangd, with its input and output connected to the client.
+  bool start(StringRef Program, ArrayRef<std::string> Args) {
+    int ToServer[2], FromServer[2];
+    if (::pipe(ToServer) != 0 || ::pipe(FromServer) != 0) {
+      errs() << "Can't create pipes: " << sys::StrError() << "\n";
+      return false;
+    }
+    std::vector<const char *> Argv = {Program.data()};
+    for (const std::string &Arg : Args)
+      Argv.push_back(Arg.c_str());
+    Argv.push_back(nullptr);
+
+    Pid = ::fork();
+    if (Pid < 0) {
+      errs() << "Can't start clangd: " << sys::StrError() << "\n";
+      return false;
+    }
+    if (Pid == 0) {
+      // clangd logs to stderr, which would drown the report.
+      int Null = ::open("/dev/null", O_WRONLY);
+      ::dup2(ToServer[0], STDIN_FILENO);
+      ::dup2(FromServer[1], STDOUT_FILENO);
+      ::dup2(Null, STDERR_FILENO);
+      ::close(ToServer[1]);
+      ::close(FromServer[0]);
+      ::execv(Argv[0], const_cast<char *const *>(Argv.data()));
+      ::_exit(127);
+    }
+    ::close(ToServer[0]);
+    ::close(FromServer[1]);
+    Out = ::fdopen(ToServer[1], "w");
+    std::FILE *In = ::fdopen(FromServer[0], "r");
+    Reader = std::thread([this, In] { readReplies(In); });
+    return true;
+  }
+
+  // Sends the recorded messages, waits for the outstanding replies and shuts
+  // clangd down. Returns when the replies arrived, or when waiting for them
+  // timed out.
+  void replay(Clock::time_point Start, double Speed) {
+    Optional<uint64_t> FirstTime;
+    bool SentShutdown = false;
+    for (const RecordedMessage &Recorded : Session) {
+      const json::obj *Message = Recorded.Message.asObject();
+      if (!Message)
+        continue;
+      auto Method = Message->getString("method");
+      // Exit is sent once the replies to all requests have arrived.
+      if (Method && *Method == "exit")
+        continue;
+      if (Recorded.TimeMs && Speed > 0) {
+        if (!FirstTime)
+          FirstTime = Recorded.TimeMs;
+        std::this_thread::sleep_until(
+            Start + std::chrono::microseconds(static_cast<int64_t>(
+                        (*Recorded.TimeMs - *FirstTime) * 1000 / Speed)));
+      }
+      {
+        std::lock_guard<std::mutex> Lock(Mu);
+        const json::Expr *ID = Message->get("id");
+        if (Method && ID)
+          Pending[idKey(*ID)] = {Method->str(), Clock::now()};
+        if (Method && (*Method == "textDocument/didOpen" ||
+                       *Method == "textDocument/didChange"))
+          if (const json::obj *Params = Message->getObject("params"))
+            if (const json::obj *Doc = Params->getObject("textDocument"))
+              if (auto URI = Doc->getString("uri"))
+                PendingDiagnostics[*URI] = Clock::now();
+        if (Method && *Method == "shutdown")
+          SentShutdown = true;
+      }
+      send(Recorded.Message);
+    }
+
+    {
+      std::unique_lock<std::mutex> Lock(Mu);
+      if (!CV.wait_for(Lock, std::chrono::seconds(unsigned(Timeout)),
+                       [this] { return Pending.empty() || Done; }))
+        errs() << "Timed out waiting for " << Pending.size()
+               << " replies from clangd\n";
+    }
+    if (!SentShutdown)
+      send(json::obj{{"jsonrpc", "2.0"},
+                     {"id", "clangd-replay-shutdown"},
+                     {"method", "shutdown"}});
+    send(json::obj{{"jsonrpc", "2.0"}, {"method", "exit"}});
+    std::fclose(Out);
+  }
+
+  // Waits for clangd to exit. Returns false if it failed.
+  bool wait() {
+    if (Reader.joinable())
+      Reader.join();
+    int Status;
+    if (::waitpid(Pid, &Status, 0) != Pid)
+      return false;
+    if (WIFEXITED(Status) && WEXITSTATUS(Status) == 127) {
+      errs() << "Can't run " << Clangd << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  unsigned replies() const { return Replies; }
+  unsigned errors() const { return Errors; }
+
+private:
+  void send(const json::Expr &Message) {
+    std::string S;
+    raw_string_ostream OS(S);
+    writeLSPMessage(Message, OS);
+    OS.flush();
+    std::fwrite(S.data(), 1, S.size(), Out);
+    std::fflush(Out);
+  }
+
+  void readReplies(std::FILE *In) {
+    while (auto Message = readMessage(In)) {
+      const json::obj *O = Message->asObject();
+      if (!O)
+        continue;
+      std::lock_guard<std::mutex> Lock(Mu);
+      auto Method = O->getString("method");
+      if (Method && *Method == "textDocument/publishDiagnostics") {
+        if (const json::obj *Params = O->getObject("params"))
+          if (auto URI = Params->getString("uri")) {
+            auto It = PendingDiagnostics.find(*URI);
+            if (It != PendingDiagnostics.end()) {
+              M.record(*Method, millisecondsSince(It->second));
+              PendingDiagnostics.erase(It);
+            }
+          }
+        continue;
+      }
+      const json::Expr *ID = O->get("id");
+      if (Method || !ID)
+        continue;
+      auto It = Pending.find(idKey(*ID));
+      if (It == Pending.end())
+        continue;
+      M.record(It->second.first, millisecondsSince(It->second.second));
+      ++Replies;
+      if (O->get("error"))
+        ++Errors;
+      Pending.erase(It);
+      if (Pending.empty())
+        CV.notify_all();
+    }
+    std::fclose(In);
+    std::lock_guard<std::mutex> Lock(Mu);
+    Done = true;
+    CV.notify_all();
+  }
+
+  const std::vector<RecordedMessage> &Session;
+  trace::Metrics &M;
+  pid_t Pid = -1;
+  std::FILE *Out = nullptr;
+  std::thread Reader;
+
+  std::mutex Mu;
+  std::condition_variable CV;
+  // The method and send time of the requests without replies, by ID.
+  std::map<std::string, std::pair<std::string, Clock::time_point>> Pending;
+  // When each document was last changed, until diagnostics are published.
+  StringMap<Clock::time_point> PendingDiagnostics;
+  std::atomic<unsigned> Replies = {0};
+  std::atomic<unsigned> Errors = {0};
+  // Set when clangd closed its output.
+  bool Done = false;
+};
+
+Optional<json::Expr> readJSONFile(StringRef Filename) {
+  auto Buffer = MemoryBuffer::getFile(Filename);
+  if (!Buffer) {
+    errs() << "Can't open " << Filename << ": "
+           << Buffer.getError().message() << "\n";
+    return None;
+  }
+  auto JSON = json::parse(Buffer.get()->getBuffer());
+  if (!JSON) {
+    errs() << Filename << ": " << toString(JSON.takeError()) << "\n";
+    return None;
+  }
+  return std::move(*JSON);
+}
+
+} // namespace
+#endif
+
+int main(int argc, const char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Replays LSP sessions recorded with clangd -input-mirror-file, and "
+      "reports\nthe latency of requests and the throughput of clangd.\n");
+
+#ifdef _WIN32
+  errs() << "clangd-replay is not supported on Windows.\n";
+  return 1;
+#else
+  // A clangd that crashes must not take the replay down with it.
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::string Program = Clangd;
+  if (!StringRef(Program).contains('/')) {
+    auto Found = sys::findProgramByName(Program);
+    if (!Found) {
+      errs() << "Can't find " << Program << ": " << Found.getError().message()
+             << "\n";
+      return 1;
+    }
+    Program = *Found;
+  }
+
+  std::vector<std::vector<RecordedMessage>> Sessions;
+  for (const std::string &Recording : Recordings) {
+    auto Buffer = MemoryBuffer::getFile(Recording);
+    if (!Buffer) {
+      errs() << "Can't open " << Recording << ": "
+             << Buffer.getError().message() << "\n";
+      return 1;
+    }
+    auto Session = readRecording(Buffer.get()->getBuffer());
+    if (!Session) {
+      errs() << Recording << ": " << toString(Session.takeError()) << "\n";
+      return 1;
+    }
+    Sessions.push_back(std::move(*Session));
+  }
+  Optional<json::Expr> Baseline;
+  if (!BaselineFile.empty() && !(Baseline = readJSONFile(BaselineFile)))
+    return 1;
+
+  trace::Metrics M;
+  std::vector<std::unique_ptr<Client>> ClientList;
+  for (unsigned I = 0; I < std::max(1u, unsigned(Clients)); ++I) {
+    ClientList.push_back(
+        llvm::make_unique<Client>(Sessions[I % Sessions.size()], M));
+    if (!ClientList.back()->start(Program, ClangdArgs))
+      return 1;
+  }
+
+  auto Start = Clock::now();
+  std::vector<std::thread> Threads;
+  for (auto &C : ClientList) {
+    Client *Ptr = C.get();
+    Threads.emplace_back([Ptr, Start] { Ptr->replay(Start, Speed); });
+  }
+  for (std::thread &T : Threads)
+    T.join();
+  double Seconds = millisecondsSince(Start) / 1000;
+
+  bool Failed = false;
+  unsigned Replies = 0, Errors = 0;
+  for (auto &C : ClientList) {
+    Failed |= !C->wait();
+    Replies += C->replies();
+    Errors += C->errors();
+  }
+  if (Failed)
+    return 1;
+
+  json::Expr Report = json::obj{
+      {"clients", static_cast<int64_t>(ClientList.size())},
+      {"speed", double(Speed)},
+      {"seconds", Seconds},
+      {"requests", Replies},
+      {"errors", Errors},
+      {"latency", M.summary()},
+  };
+  printReplayReport(Report, Baseline ? Baseline.getPointer() : nullptr,
+                    outs());
+  if (Errors)
+    outs() << Errors << " requests failed.\n";
+  if (!ReportFile.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(ReportFile, EC, sys::fs::F_None);
+    if (EC) {
+      errs() << "Can't open " << ReportFile << ": " << EC.message() << "\n";
+      return 1;
+    }
+    OS << formatv("{0:2}", Report) << "\n";
+  }
+  return 0;
+#endif
+}
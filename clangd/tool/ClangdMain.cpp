@@ -9,9 +9,11 @@
 
 #include "ClangdLSPServer.h"
 #include "JSONRPCDispatcher.h"
+#include "Metrics.h"
 #include "Path.h"
 #include "Trace.h"
-#include "index/SymbolYAML.h"
+#include "index/Remote.h"
+#include "index/Serialization.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -30,23 +32,6 @@ using namespace clang::clangd;
 
 namespace {
 enum class PCHStorageFlag { Disk, Memory };
-
-// Build an in-memory static index for global symbols from a YAML-format file.
-// The size of global symbols should be relatively small, so that all symbols
-// can be managed in memory.
-std::unique_ptr<SymbolIndex> buildStaticIndex(llvm::StringRef YamlSymbolFile) {
-  auto Buffer = llvm::MemoryBuffer::getFile(YamlSymbolFile);
-  if (!Buffer) {
-    llvm::errs() << "Can't open " << YamlSymbolFile << "\n";
-    return nullptr;
-  }
-  auto Slab = SymbolsFromYAML(Buffer.get()->getBuffer());
-  SymbolSlab::Builder SymsBuilder;
-  for (auto Sym : Slab)
-    SymsBuilder.insert(Sym);
-
-  return MemIndex::build(std::move(SymsBuilder).build());
-}
 } // namespace
 
 static llvm::cl::opt<Path> CompileCommandsDir(
@@ -120,6 +105,19 @@ static llvm::cl::opt<int> LimitResults(
                    "0 means no limit."),
     llvm::cl::init(100));
 
+static llvm::cl::opt<unsigned> LimitReferences(
+    "limit-references",
+    llvm::cl::desc("Limit the number of references returned by one request "
+                   "of clients that page through them with the clangd "
+                   "'offset' extension. 0 means no limit."),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<unsigned> ReferencesBatchSize(
+    "references-batch-size",
+    llvm::cl::desc("Number of references in each partial result sent to "
+                   "clients that ask for partial results. 0 means one batch."),
+    llvm::cl::init(100), llvm::cl::Hidden);
+
 static llvm::cl::opt<bool> RunSynchronously(
     "run-synchronously",
     llvm::cl::desc("Parse on main thread. If set, -j is ignored"),
@@ -136,6 +134,13 @@ static llvm::cl::opt<Path> InputMirrorFile(
         "Mirror all LSP input to the specified file. Useful for debugging."),
     llvm::cl::init(""), llvm::cl::Hidden);
 
+static llvm::cl::opt<bool> InputMirrorTimestamps(
+    "input-mirror-timestamps",
+    llvm::cl::desc("Write the arrival time of each message to the input "
+                   "mirror file, so that clangd-replay can play the session "
+                   "back with its original timing."),
+    llvm::cl::init(false), llvm::cl::Hidden);
+
 static llvm::cl::opt<bool> EnableIndex(
     "index",
     llvm::cl::desc("Enable index-based features such as global code completion "
@@ -143,12 +148,50 @@ static llvm::cl::opt<bool> EnableIndex(
                    "Clang uses an index built from symbols in opened files"),
     llvm::cl::init(true));
 
+static llvm::cl::opt<bool> EnableBackgroundIndex(
+    "background-index",
+    llvm::cl::desc("Index all files in the compilation database of opened "
+                   "files in the background, and use this index for "
+                   "project-wide code completion and navigation"),
+    llvm::cl::init(false), llvm::cl::Hidden);
+
+static llvm::cl::opt<Path> BackgroundIndexShardDir(
+    "background-index-shard-dir",
+    llvm::cl::desc("Directory where the background index is saved, so that "
+                   "unchanged files are not indexed again after a restart. "
+                   "Defaults to clangd/index in the user's cache directory."),
+    llvm::cl::init(""), llvm::cl::Hidden);
+
 static llvm::cl::opt<bool>
     ShowOrigins("debug-origin",
                 llvm::cl::desc("Show origins of completion items"),
                 llvm::cl::init(clangd::CodeCompleteOptions().ShowOrigins),
                 llvm::cl::Hidden);
 
+static llvm::cl::opt<bool> SpeculativeIndexRequest(
+    "speculative-index-request",
+    llvm::cl::desc("Query the index for code completion in parallel with "
+                   "parsing, using scopes guessed from the text"),
+    llvm::cl::init(true), llvm::cl::Hidden);
+
+static llvm::cl::opt<bool> CacheCompletions(
+    "cache-completions",
+    llvm::cl::desc("Reuse code completion results while the user keeps typing "
+                   "the same identifier"),
+    llvm::cl::init(true), llvm::cl::Hidden);
+
+static llvm::cl::opt<bool> CacheSignatureHelp(
+    "cache-signature-help",
+    llvm::cl::desc("Reuse the signatures computed at the open paren of a call "
+                   "while the user types its arguments"),
+    llvm::cl::init(false), llvm::cl::Hidden);
+
+static llvm::cl::opt<bool> LazyCompletionDetails(
+    "lazy-completion-details",
+    llvm::cl::desc("Send the type, documentation and #include insertion of "
+                   "completion items in completionItem/resolve responses"),
+    llvm::cl::init(false), llvm::cl::Hidden);
+
 static llvm::cl::opt<Path> YamlSymbolFile(
     "yaml-symbol-file",
     llvm::cl::desc(
@@ -158,6 +201,30 @@ static llvm::cl::opt<Path> YamlSymbolFile(
         "eventually. Don't rely on it."),
     llvm::cl::init(""), llvm::cl::Hidden);
 
+static llvm::cl::opt<std::string> RemoteIndexAddress(
+    "remote-index",
+    llvm::cl::desc("Use the index served by clangd-index-server at this "
+                   "address (unix:<socket path> or <host>:<port>) as the "
+                   "static index, instead of -yaml-symbol-file."),
+    llvm::cl::init(""), llvm::cl::Hidden);
+
+static llvm::cl::opt<bool> EnableMetrics(
+    "metrics",
+    llvm::cl::desc("Record latency histograms of clangd's operations. They are "
+                   "returned by the clangd/metrics request."),
+    llvm::cl::init(false), llvm::cl::Hidden);
+
+static llvm::cl::opt<Path> MetricsFile(
+    "metrics-file",
+    llvm::cl::desc("Periodically write the latency histograms to the specified "
+                   "file. Implies -metrics."),
+    llvm::cl::init(""), llvm::cl::Hidden);
+
+static llvm::cl::opt<unsigned> MetricsDumpInterval(
+    "metrics-dump-interval",
+    llvm::cl::desc("Seconds between two writes of -metrics-file"),
+    llvm::cl::init(60), llvm::cl::Hidden);
+
 int main(int argc, char *argv[]) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
   llvm::cl::SetVersionPrinter([](llvm::raw_ostream &OS) {
@@ -204,6 +271,9 @@ int main(int argc, char *argv[]) {
   // Setup tracing facilities if CLANGD_TRACE is set. In practice enabling a
   // trace flag in your editor's config is annoying, launching with
   // `CLANGD_TRACE=trace.json vim` is easier.
+  // CLANGD_TRACE_FORMAT=binary selects the low-overhead binary tracer, and
+  // CLANGD_TRACE_SAMPLE_RATE=0.01 records only 1% of the top-level events.
+  // Binary traces are converted for viewing by clangd-trace-converter.
   llvm::Optional<llvm::raw_fd_ostream> TraceStream;
   std::unique_ptr<trace::EventTracer> Tracer;
   if (auto *TraceFile = getenv("CLANGD_TRACE")) {
@@ -215,17 +285,43 @@ int main(int argc, char *argv[]) {
       llvm::errs() << "Error while opening trace file " << TraceFile << ": "
                    << EC.message();
     } else {
-      Tracer = trace::createJSONTracer(*TraceStream, PrettyPrint);
+      const char *Format = getenv("CLANGD_TRACE_FORMAT");
+      if (Format && llvm::StringRef(Format) == "binary") {
+        double SampleRate = 1.0;
+        if (auto *Rate = getenv("CLANGD_TRACE_SAMPLE_RATE"))
+          if (llvm::StringRef(Rate).getAsDouble(SampleRate)) {
+            llvm::errs() << "Ignoring invalid CLANGD_TRACE_SAMPLE_RATE " << Rate
+                         << "\n";
+            SampleRate = 1.0;
+          }
+        Tracer = trace::createBinaryTracer(*TraceStream, SampleRate);
+      } else {
+        Tracer = trace::createJSONTracer(*TraceStream, PrettyPrint);
+      }
     }
   }
 
+  // Metrics are recorded by a tracer that forwards all events to Tracer.
+  std::unique_ptr<trace::Metrics> Metrics;
+  std::unique_ptr<trace::EventTracer> MetricsTracer;
+  llvm::Optional<trace::MetricsDumper> MetricsDumper;
+  if (EnableMetrics || !MetricsFile.empty()) {
+    Metrics = llvm::make_unique<trace::Metrics>();
+    MetricsTracer = trace::createMetricsTracer(*Metrics, Tracer.get());
+    if (!MetricsFile.empty())
+      MetricsDumper.emplace(*Metrics, MetricsFile,
+                            std::chrono::seconds(MetricsDumpInterval));
+  }
+
   llvm::Optional<trace::Session> TracingSession;
-  if (Tracer)
+  if (MetricsTracer)
+    TracingSession.emplace(*MetricsTracer);
+  else if (Tracer)
     TracingSession.emplace(*Tracer);
 
   JSONOutput Out(llvm::outs(), llvm::errs(),
                  InputMirrorStream ? InputMirrorStream.getPointer() : nullptr,
-                 PrettyPrint);
+                 PrettyPrint, InputMirrorTimestamps);
 
   clangd::LoggingSession LoggingSession(Out);
 
@@ -257,20 +353,43 @@ int main(int argc, char *argv[]) {
     Opts.ResourceDir = ResourceDir;
   Opts.BuildDynamicSymbolIndex = EnableIndex;
   std::unique_ptr<SymbolIndex> StaticIdx;
-  if (EnableIndex && !YamlSymbolFile.empty()) {
-    StaticIdx = buildStaticIndex(YamlSymbolFile);
-    Opts.StaticIndex = StaticIdx.get();
+  if (EnableIndex && !RemoteIndexAddress.empty()) {
+    auto Remote = connectRemoteIndex(RemoteIndexAddress);
+    if (Remote)
+      StaticIdx = std::move(*Remote);
+    else
+      llvm::errs() << "Can't connect to the remote index: "
+                   << llvm::toString(Remote.takeError()) << "\n";
+  } else if (EnableIndex && !YamlSymbolFile.empty()) {
+    StaticIdx = loadIndex(YamlSymbolFile);
   }
+  Opts.StaticIndex = StaticIdx.get();
   Opts.AsyncThreadsCount = WorkerThreadsCount;
+  Opts.CacheSignatureHelp = CacheSignatureHelp;
+  if (EnableIndex && EnableBackgroundIndex) {
+    Opts.BuildBackgroundIndex = true;
+    Opts.BackgroundIndexShardDir = BackgroundIndexShardDir;
+    llvm::SmallString<128> CacheDir;
+    if (Opts.BackgroundIndexShardDir.empty() &&
+        llvm::sys::path::user_cache_directory(CacheDir, "clangd", "index"))
+      Opts.BackgroundIndexShardDir = CacheDir.str();
+  }
 
   clangd::CodeCompleteOptions CCOpts;
   CCOpts.IncludeIneligibleResults = IncludeIneligibleResults;
   CCOpts.Limit = LimitResults;
   CCOpts.BundleOverloads = CompletionStyle != Detailed;
   CCOpts.ShowOrigins = ShowOrigins;
+  CCOpts.SpeculativeIndexRequest = SpeculativeIndexRequest;
+  CCOpts.CacheResults = CacheCompletions;
+  CCOpts.LazyDetails = LazyCompletionDetails;
 
   // Initialize and run ClangdLSPServer.
-  ClangdLSPServer LSPServer(Out, CCOpts, CompileCommandsDirPath, Opts);
+  ReferencesOptions RefOpts;
+  RefOpts.Limit = LimitReferences;
+  RefOpts.BatchSize = ReferencesBatchSize;
+  ClangdLSPServer LSPServer(Out, CCOpts, CompileCommandsDirPath, Opts,
+                            Metrics.get(), RefOpts);
   constexpr int NoShutdownRequestErrorCode = 1;
   llvm::set_thread_name("clangd.main");
   // Change stdin to binary to not lose \r\n on windows.
@@ -0,0 +1,58 @@
+//===--- TraceConverterMain.cpp ----------------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Converts a binary trace recorded by clangd (CLANGD_TRACE_FORMAT=binary) into
+// the Trace Event format that can be loaded into chrome://tracing.
+//
+//===---------------------------------------------------------------------===//
+
+#include "Trace.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFile(cl::Positional, cl::Required,
+                                      cl::desc("<binary trace file>"));
+
+static cl::opt<std::string> OutputFile("o", cl::desc("Output JSON file"),
+                                       cl::value_desc("filename"),
+                                       cl::init("-"));
+
+static cl::opt<bool> PrettyPrint("pretty", cl::desc("Pretty-print JSON output"),
+                                 cl::init(false));
+
+int main(int argc, const char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Converts a binary clangd trace to the Chrome trace viewer format.\n");
+
+  auto Buffer = MemoryBuffer::getFile(InputFile);
+  if (!Buffer) {
+    errs() << "Can't open " << InputFile << ": "
+           << Buffer.getError().message() << "\n";
+    return 1;
+  }
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFile, EC, sys::fs::F_None);
+  if (EC) {
+    errs() << "Can't open " << OutputFile << ": " << EC.message() << "\n";
+    return 1;
+  }
+  if (auto Err = clang::clangd::trace::convertBinaryTrace(
+          Buffer.get()->getBuffer(), OS, PrettyPrint)) {
+    errs() << InputFile << ": " << toString(std::move(Err)) << "\n";
+    return 1;
+  }
+  return 0;
+}
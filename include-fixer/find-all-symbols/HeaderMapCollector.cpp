@@ -8,19 +8,56 @@
 //===----------------------------------------------------------------------===//
 
 #include "HeaderMapCollector.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Regex.h"
+#include <algorithm>
 
 namespace clang {
 namespace find_all_symbols {
 
+// Returns the suffix that \p RE matches, if it is of the form "<suffix>$" and
+// the suffix has no special characters other than '.' and escaped ones. '.' is
+// then taken literally.
+// Keep in sync with literalSuffix() in clangd/index/CanonicalIncludes.cpp,
+// which maps the same system header patterns.
+static llvm::Optional<std::string> literalSuffix(llvm::StringRef RE) {
+  if (!RE.consume_back("$"))
+    return llvm::None;
+  std::string Suffix;
+  for (size_t I = 0; I < RE.size(); ++I) {
+    char C = RE[I];
+    if (C == '\\') {
+      if (++I == RE.size())
+        return llvm::None;
+      C = RE[I];
+      if (llvm::isAlnum(C)) // e.g. "\1", not an escaped character.
+        return llvm::None;
+    } else if (llvm::StringRef("^$|()[]{}*+?").contains(C)) {
+      return llvm::None;
+    }
+    Suffix.push_back(C);
+  }
+  return std::move(Suffix);
+}
+
 HeaderMapCollector::HeaderMapCollector(
     const RegexHeaderMap *RegexHeaderMappingTable) {
   assert(RegexHeaderMappingTable);
-  this->RegexHeaderMappingTable.reserve(RegexHeaderMappingTable->size());
-  for (const auto &Entry : *RegexHeaderMappingTable) {
+  for (unsigned I = 0; I < RegexHeaderMappingTable->size(); ++I) {
+    const auto &Entry = (*RegexHeaderMappingTable)[I];
+    if (auto Suffix = literalSuffix(Entry.first)) {
+      // The first pattern for a suffix wins.
+      if (SuffixMappingTable.try_emplace(*Suffix, I, Entry.second).second)
+        SuffixLengths.push_back(Suffix->size());
+      continue;
+    }
     this->RegexHeaderMappingTable.emplace_back(llvm::Regex(Entry.first),
-                                               Entry.second);
+                                               PatternMapping(I, Entry.second));
   }
+  std::sort(SuffixLengths.begin(), SuffixLengths.end());
+  SuffixLengths.erase(std::unique(SuffixLengths.begin(), SuffixLengths.end()),
+                      SuffixLengths.end());
 }
 
 llvm::StringRef
@@ -29,16 +66,29 @@ HeaderMapCollector::getMappedHeader(llvm::StringRef Header) const {
   if (Iter != HeaderMappingTable.end())
     return Iter->second;
   // If there is no complete header name mapping for this header, check the
-  // regex header mapping.
+  // header patterns. The first one in the table that matches wins.
+  const PatternMapping *Best = nullptr;
+  for (unsigned Length : SuffixLengths) {
+    if (Length > Header.size())
+      break;
+    auto It = SuffixMappingTable.find(Header.take_back(Length));
+    if (It != SuffixMappingTable.end() &&
+        (!Best || It->second.first < Best->first))
+      Best = &It->second;
+  }
   for (auto &Entry : RegexHeaderMappingTable) {
+    if (Best && Best->first < Entry.second.first)
+      break;
 #ifndef NDEBUG
     std::string Dummy;
     assert(Entry.first.isValid(Dummy) && "Regex should never be invalid!");
 #endif
-    if (Entry.first.match(Header))
-      return Entry.second;
+    if (Entry.first.match(Header)) {
+      Best = &Entry.second;
+      break;
+    }
   }
-  return Header;
+  return Best ? Best->second : Header;
 }
 
 } // namespace find_all_symbols
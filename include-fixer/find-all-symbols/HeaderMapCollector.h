@@ -44,10 +44,19 @@ private:
   /// A string-to-string map saving the mapping relationship.
   HeaderMap HeaderMappingTable;
 
-  // A map from header patterns to header names.
-  // The header names are not owned. This is only threadsafe because the regexes
-  // never fail.
-  mutable std::vector<std::pair<llvm::Regex, const char *>>
+  // A pattern's position in the table, which decides which one wins when
+  // several match, and its header name. The header names are not owned.
+  typedef std::pair<unsigned, const char *> PatternMapping;
+
+  // Patterns of the form "<suffix>$" map the literal suffix to a header name.
+  // A header is matched by looking up its suffix of each of the lengths in
+  // SuffixLengths, which are in increasing order.
+  llvm::StringMap<PatternMapping> SuffixMappingTable;
+  std::vector<unsigned> SuffixLengths;
+
+  // A map from the other header patterns to header names.
+  // This is only threadsafe because the regexes never fail.
+  mutable std::vector<std::pair<llvm::Regex, PatternMapping>>
       RegexHeaderMappingTable;
 };
 
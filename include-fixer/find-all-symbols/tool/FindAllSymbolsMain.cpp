@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "CachingFileSystem.h"
 #include "FindAllSymbolsAction.h"
 #include "STLPostfixHeaderMap.h"
 #include "SymbolInfo.h"
@@ -131,7 +132,9 @@ bool Merge(llvm::StringRef MergeDir, llvm::StringRef OutputFile) {
 int main(int argc, const char **argv) {
   CommonOptionsParser OptionsParser(argc, argv, FindAllSymbolsCategory);
   ClangTool Tool(OptionsParser.getCompilations(),
-                 OptionsParser.getSourcePathList());
+                 OptionsParser.getSourcePathList(),
+                 std::make_shared<clang::PCHContainerOperations>(),
+                 clang::tooling::getSharedCachingFileSystem());
 
   std::vector<std::string> sources = OptionsParser.getSourcePathList();
   if (sources.empty()) {
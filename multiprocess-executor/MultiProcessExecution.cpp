@@ -0,0 +1,311 @@
+//===--- MultiProcessExecution.cpp - Run actions in worker processes ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MultiProcessExecution.h"
+#include "CachingFileSystem.h"
+#include "clang/Tooling/ToolExecutorPluginRegistry.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
+#include <atomic>
+#include <cerrno>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace clang {
+namespace tooling {
+
+const char *MultiProcessToolExecutor::ExecutorName = "MultiProcessToolExecutor";
+
+namespace {
+llvm::Error make_string_error(const llvm::Twine &Message) {
+  return llvm::make_error<llvm::StringError>(Message,
+                                             llvm::inconvertibleErrorCode());
+}
+
+// Creates a directory with a unique name in Parent, or in the system temporary
+// directory if it is empty.
+std::string createResultsDirectory(llvm::StringRef Parent) {
+  llvm::SmallString<128> Model(Parent);
+  if (Model.empty())
+    llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, Model);
+  llvm::sys::path::append(Model, "tool-results-%%%%%%%%");
+  std::error_code EC;
+  for (unsigned Attempt = 0; Attempt < 128; ++Attempt) {
+    llvm::SmallString<128> Path;
+    EC = llvm::sys::fs::getPotentiallyUniqueFileName(Model, Path);
+    if (!EC)
+      EC = llvm::sys::fs::create_directory(Path, /*IgnoreExisting=*/false);
+    if (!EC)
+      return Path.str();
+    if (EC != std::errc::file_exists)
+      break;
+  }
+  llvm::report_fatal_error(
+      llvm::Twine("Couldn't create a directory for tool results in ") + Model +
+      ": " + EC.message());
+}
+} // namespace
+
+SpilledToolResults::SpilledToolResults(llvm::StringRef Directory,
+                                       unsigned NumShards)
+    : Directory(Directory), NumShards(NumShards), Files(NumShards) {}
+
+SpilledToolResults::~SpilledToolResults() { flush(); }
+
+std::string SpilledToolResults::filePath(unsigned Shard,
+                                         unsigned Writer) const {
+  llvm::SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, "results-" + llvm::Twine(Shard) + "-" +
+                                    llvm::Twine(Writer));
+  return Path.str();
+}
+
+unsigned SpilledToolResults::addWriters(unsigned Count) {
+  NumWriters += Count;
+  return NumWriters - Count;
+}
+
+void SpilledToolResults::setWriter(unsigned Writer) {
+  flush();
+  this->Writer = Writer;
+}
+
+void SpilledToolResults::flush() {
+  for (auto &File : Files)
+    File.reset();
+}
+
+void SpilledToolResults::addResult(StringRef Key, StringRef Value) {
+  unsigned Shard = static_cast<size_t>(llvm::hash_value(Key)) % NumShards;
+  auto &File = Files[Shard];
+  if (!File) {
+    std::error_code EC;
+    std::string Path = filePath(Shard, Writer);
+    File = llvm::make_unique<llvm::raw_fd_ostream>(Path, EC,
+                                                   llvm::sys::fs::F_Append);
+    if (EC)
+      llvm::report_fatal_error("Couldn't open " + Path + ": " + EC.message());
+  }
+  char Sizes[8];
+  llvm::support::endian::write32le(Sizes, Key.size());
+  llvm::support::endian::write32le(Sizes + 4, Value.size());
+  *File << llvm::StringRef(Sizes, sizeof(Sizes)) << Key << Value;
+}
+
+std::vector<std::pair<llvm::StringRef, llvm::StringRef>>
+SpilledToolResults::AllKVResults() {
+  std::vector<std::pair<llvm::StringRef, llvm::StringRef>> Results;
+  forEachResult([&](StringRef Key, StringRef Value) {
+    Results.emplace_back(Strings.save(Key), Strings.save(Value));
+  });
+  return Results;
+}
+
+void SpilledToolResults::forEachResult(
+    llvm::function_ref<void(StringRef Key, StringRef Value)> Callback) {
+  // Results of this process must be on disk before they are read.
+  flush();
+  for (unsigned Shard = 0; Shard < NumShards; ++Shard) {
+    for (unsigned Writer = 0; Writer < NumWriters; ++Writer) {
+      // Writers that had no results for this shard have no file.
+      std::string Path = filePath(Shard, Writer);
+      if (!llvm::sys::fs::exists(Path))
+        continue;
+      auto Buffer = llvm::MemoryBuffer::getFile(Path);
+      if (!Buffer) {
+        llvm::errs() << "Couldn't read " << Path << ": "
+                     << Buffer.getError().message() << "\n";
+        continue;
+      }
+      llvm::StringRef Data = (*Buffer)->getBuffer();
+      while (!Data.empty()) {
+        if (Data.size() < 8) {
+          llvm::errs() << "Truncated results in " << Path << "\n";
+          break;
+        }
+        uint32_t KeySize = llvm::support::endian::read32le(Data.data());
+        uint32_t ValueSize = llvm::support::endian::read32le(Data.data() + 4);
+        Data = Data.drop_front(8);
+        if (Data.size() < uint64_t(KeySize) + ValueSize) {
+          llvm::errs() << "Truncated results in " << Path << "\n";
+          break;
+        }
+        Callback(Data.take_front(KeySize),
+                 Data.substr(KeySize, ValueSize));
+        Data = Data.drop_front(KeySize + ValueSize);
+      }
+    }
+  }
+}
+
+MultiProcessToolExecutor::MultiProcessToolExecutor(
+    const CompilationDatabase &Compilations, unsigned NumProcesses,
+    llvm::StringRef SpillDir)
+    : Compilations(Compilations), NumProcesses(NumProcesses),
+      ResultsDir(createResultsDirectory(SpillDir)),
+      Results(new SpilledToolResults(ResultsDir, NumProcesses)),
+      Context(Results.get()) {}
+
+MultiProcessToolExecutor::MultiProcessToolExecutor(
+    CommonOptionsParser Options, unsigned NumProcesses,
+    llvm::StringRef SpillDir)
+    : OptionsParser(std::move(Options)),
+      Compilations(OptionsParser->getCompilations()),
+      NumProcesses(NumProcesses),
+      ResultsDir(createResultsDirectory(SpillDir)),
+      Results(new SpilledToolResults(ResultsDir, NumProcesses)),
+      Context(Results.get()) {}
+
+MultiProcessToolExecutor::~MultiProcessToolExecutor() {
+  Results.reset();
+  llvm::sys::fs::remove_directories(ResultsDir);
+}
+
+llvm::Error MultiProcessToolExecutor::execute(
+    llvm::ArrayRef<
+        std::pair<std::unique_ptr<FrontendActionFactory>, ArgumentsAdjuster>>
+        Actions) {
+  if (Actions.empty())
+    return make_string_error("No action to execute.");
+
+  if (Actions.size() != 1)
+    return make_string_error(
+        "Only support executing exactly 1 action at this point.");
+
+#ifndef LLVM_ON_UNIX
+  return make_string_error(
+      "The multi-process executor is only supported on Unix.");
+#else
+  auto &Action = Actions.front();
+  std::vector<std::string> Files = Compilations.getAllFiles();
+  const std::string TotalNumStr = std::to_string(Files.size());
+
+  // The index of the next file to process, shared by the workers.
+  void *Shared = mmap(nullptr, sizeof(std::atomic<size_t>),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                      /*fd=*/-1, /*offset=*/0);
+  if (Shared == MAP_FAILED)
+    return make_string_error("Couldn't map memory for the workers.");
+  auto *NextFile = new (Shared) std::atomic<size_t>(0);
+
+  // Buffered output would otherwise be written by every worker.
+  llvm::outs().flush();
+  llvm::errs().flush();
+  Results->flush();
+  // Each worker writes its results to files of its own.
+  unsigned FirstWriter = Results->addWriters(NumProcesses);
+
+  std::string ErrorMsg;
+  std::vector<pid_t> Workers;
+  for (unsigned I = 0; I < NumProcesses; ++I) {
+    pid_t Pid = fork();
+    if (Pid < 0) {
+      ErrorMsg += "Couldn't start a worker process.\n";
+      break;
+    }
+    if (Pid == 0) {
+      // The worker runs the action on files until there are none left, then
+      // exits without returning to the caller.
+      Results->setWriter(FirstWriter + I);
+      bool Failed = false;
+      for (size_t File; (File = (*NextFile)++) < Files.size();) {
+        const std::string &Path = Files[File];
+        llvm::errs() << "[" << File + 1 << "/" << TotalNumStr
+                     << "] Processing file " << Path << "\n";
+        ClangTool Tool(Compilations, {Path},
+                       std::make_shared<PCHContainerOperations>(),
+                       getSharedCachingFileSystem());
+        Tool.appendArgumentsAdjuster(Action.second);
+        Tool.appendArgumentsAdjuster(getDefaultArgumentsAdjusters());
+        for (const auto &FileAndContent : OverlayFiles)
+          Tool.mapVirtualFile(FileAndContent.first(), FileAndContent.second);
+        if (Tool.run(Action.first.get())) {
+          llvm::errs() << "Failed to run action on " << Path << "\n";
+          Failed = true;
+        }
+      }
+      Results->flush();
+      llvm::outs().flush();
+      llvm::errs().flush();
+      _exit(Failed ? 1 : 0);
+    }
+    Workers.push_back(Pid);
+  }
+
+  unsigned NumFailed = 0;
+  for (pid_t Pid : Workers) {
+    int Status = 0;
+    pid_t Waited;
+    while ((Waited = waitpid(Pid, &Status, 0)) < 0 && errno == EINTR)
+      ;
+    if (Waited < 0 || !WIFEXITED(Status) || WEXITSTATUS(Status) != 0)
+      ++NumFailed;
+  }
+  munmap(Shared, sizeof(std::atomic<size_t>));
+
+  if (NumFailed)
+    ErrorMsg += std::to_string(NumFailed) + " of " +
+                std::to_string(Workers.size()) +
+                " workers failed to run the action on some files.\n";
+  if (!ErrorMsg.empty())
+    return make_string_error(ErrorMsg);
+  return llvm::Error::success();
+#endif
+}
+
+static llvm::cl::opt<unsigned> ExecutorProcesses(
+    "execute-processes",
+    llvm::cl::desc("The number of worker processes used by the multi-process "
+                   "executor. 0 means the number of cores."),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<std::string> ExecutorSpillDir(
+    "execute-spill-dir",
+    llvm::cl::desc("The directory in which the multi-process executor stores "
+                   "results. Defaults to the system temporary directory."),
+    llvm::cl::init(""));
+
+class MultiProcessToolExecutorPlugin : public ToolExecutorPlugin {
+public:
+  llvm::Expected<std::unique_ptr<ToolExecutor>>
+  create(CommonOptionsParser &OptionsParser) override {
+    if (OptionsParser.getSourcePathList().empty())
+      return make_string_error(
+          "[MultiProcessToolExecutorPlugin] Please provide a directory/file "
+          "path in the compilation database.");
+    unsigned NumProcesses = ExecutorProcesses;
+    if (NumProcesses == 0)
+      NumProcesses = llvm::hardware_concurrency();
+    return llvm::make_unique<MultiProcessToolExecutor>(
+        std::move(OptionsParser), NumProcesses, ExecutorSpillDir);
+  }
+};
+
+static ToolExecutorPluginRegistry::Add<MultiProcessToolExecutorPlugin>
+    X("multi-process",
+      "Runs FrontendActions on all TUs in the compilation database, in worker "
+      "processes. Tool results are stored in files.");
+
+// This anchor is used to force the linker to link in the generated object file
+// and thus register the plugin.
+volatile int MultiProcessToolExecutorAnchorSource = 0;
+
+} // end namespace tooling
+} // end namespace clang
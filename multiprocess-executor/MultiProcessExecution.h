@@ -0,0 +1,139 @@
+//===--- MultiProcessExecution.h - Run actions in worker processes -*- C++ -*-//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A ToolExecutor that runs a FrontendAction on all files in a compilation
+// database, like the "all-TUs" executor, but in worker processes that are
+// forked from the tool. Each worker has its own heap and FileManager, so
+// workers don't contend on locks. Workers read files through the cache of
+// -immutable-dirs, see CachingFileSystem.h.
+//
+// Workers write their results to files in a spill directory rather than
+// sending them back. Results are partitioned into shards by their key: every
+// worker has one file per shard, so all the values of a key end up in the
+// files of the same shard. The results are read back one file at a time, so
+// reducing them does not require holding all of them in memory.
+//
+// Select it with --executor=multi-process. It is only available on Unix.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_MULTIPROCESS_EXECUTOR_MULTIPROCESSEXECUTION_H
+#define LLVM_CLANG_TOOLS_EXTRA_MULTIPROCESS_EXECUTOR_MULTIPROCESSEXECUTION_H
+
+#include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/Execution.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+
+/// Tool results that are stored in files, one per shard and writer. Each
+/// process that reports results is a different writer, so that processes
+/// never write to the same file. Results are initially written by writer 0.
+///
+/// A file is a sequence of records: the 32-bit little-endian sizes of the key
+/// and the value, followed by the key and the value.
+class SpilledToolResults : public ToolResults {
+public:
+  /// Files are created in \p Directory, which must exist.
+  SpilledToolResults(llvm::StringRef Directory, unsigned NumShards);
+  ~SpilledToolResults() override;
+
+  /// Reserves \p Count writers, e.g. for other processes, and returns the
+  /// first of them.
+  unsigned addWriters(unsigned Count);
+  /// Results that are added after this call are written to the files of
+  /// \p Writer. The files are appended to, not truncated.
+  void setWriter(unsigned Writer);
+  /// Closes the files of the current writer.
+  void flush();
+
+  void addResult(StringRef Key, StringRef Value) override;
+  /// Reads all results into memory.
+  std::vector<std::pair<llvm::StringRef, llvm::StringRef>>
+  AllKVResults() override;
+  /// Reads results one file at a time. The results of a shard are visited
+  /// before those of the next one.
+  void forEachResult(llvm::function_ref<void(StringRef Key, StringRef Value)>
+                         Callback) override;
+
+private:
+  std::string filePath(unsigned Shard, unsigned Writer) const;
+
+  std::string Directory;
+  unsigned NumShards;
+  unsigned Writer = 0;
+  unsigned NumWriters = 1;
+  /// The files of the current writer, opened when they are first written to.
+  std::vector<std::unique_ptr<llvm::raw_fd_ostream>> Files;
+  /// Owns the strings returned by AllKVResults().
+  llvm::BumpPtrAllocator Arena;
+  llvm::StringSaver Strings{Arena};
+};
+
+/// Runs a FrontendAction on all files in a compilation database in
+/// \p NumProcesses worker processes. Workers pick the next file to process as
+/// soon as they are done with the previous one.
+class MultiProcessToolExecutor : public ToolExecutor {
+public:
+  static const char *ExecutorName;
+
+  /// Results are spilled to a new directory in \p SpillDir, which is removed
+  /// when the executor is destroyed. If \p SpillDir is empty, the system
+  /// temporary directory is used.
+  MultiProcessToolExecutor(const CompilationDatabase &Compilations,
+                           unsigned NumProcesses, llvm::StringRef SpillDir);
+
+  /// Same as above, but the executor owns the options parser.
+  MultiProcessToolExecutor(CommonOptionsParser Options, unsigned NumProcesses,
+                           llvm::StringRef SpillDir);
+
+  ~MultiProcessToolExecutor() override;
+
+  StringRef getExecutorName() const override { return ExecutorName; }
+
+  bool isSingleProcess() const override { return false; }
+
+  using ToolExecutor::execute;
+
+  llvm::Error
+  execute(llvm::ArrayRef<
+          std::pair<std::unique_ptr<FrontendActionFactory>, ArgumentsAdjuster>>
+              Actions) override;
+
+  ExecutionContext *getExecutionContext() override { return &Context; };
+
+  ToolResults *getToolResults() override { return Results.get(); }
+
+  void mapVirtualFile(StringRef FilePath, StringRef Content) override {
+    OverlayFiles[FilePath] = Content;
+  }
+
+private:
+  // Used to store the parser when the executor is initialized with parser.
+  llvm::Optional<CommonOptionsParser> OptionsParser;
+  const CompilationDatabase &Compilations;
+  unsigned NumProcesses;
+  /// The directory that holds the results of this executor.
+  std::string ResultsDir;
+  std::unique_ptr<SpilledToolResults> Results;
+  ExecutionContext Context;
+  llvm::StringMap<std::string> OverlayFiles;
+};
+
+} // end namespace tooling
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_MULTIPROCESS_EXECUTOR_MULTIPROCESSEXECUTION_H
@@ -0,0 +1,132 @@
+//===---- CachingFileSystemTest.cpp - caching file system test ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CachingFileSystem.h"
+#include "llvm/ADT/StringMap.h"
+#include "gtest/gtest.h"
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace {
+
+// Counts the lookups of each file in an in-memory file system.
+class CountingFileSystem : public vfs::FileSystem {
+public:
+  CountingFileSystem() : FS(new vfs::InMemoryFileSystem) {
+    FS->setCurrentWorkingDirectory("/");
+  }
+
+  bool addFile(llvm::StringRef Path, llvm::StringRef Content) {
+    return FS->addFile(Path, 0, llvm::MemoryBuffer::getMemBufferCopy(Content));
+  }
+
+  llvm::ErrorOr<vfs::Status> status(const llvm::Twine &Path) override {
+    ++Stats[Path.str()];
+    return FS->status(Path);
+  }
+  llvm::ErrorOr<std::unique_ptr<vfs::File>>
+  openFileForRead(const llvm::Twine &Path) override {
+    ++Opens[Path.str()];
+    return FS->openFileForRead(Path);
+  }
+  vfs::directory_iterator dir_begin(const llvm::Twine &Dir,
+                                    std::error_code &EC) override {
+    return FS->dir_begin(Dir, EC);
+  }
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return FS->getCurrentWorkingDirectory();
+  }
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &Path) override {
+    return FS->setCurrentWorkingDirectory(Path);
+  }
+
+  llvm::StringMap<unsigned> Stats;
+  llvm::StringMap<unsigned> Opens;
+
+private:
+  llvm::IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS;
+};
+
+std::string contents(vfs::FileSystem &FS, llvm::StringRef Path) {
+  auto Buffer = FS.getBufferForFile(Path);
+  if (!Buffer)
+    return "<error>";
+  return (*Buffer)->getBuffer();
+}
+
+TEST(CachingFileSystemTest, CachesImmutableDirs) {
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> Base(new CountingFileSystem);
+  Base->addFile("/sys/a.h", "int a;");
+  Base->addFile("/src/b.h", "int b;");
+  CachingFileSystem FS(Base, {"/sys"});
+
+  for (unsigned I = 0; I < 3; ++I) {
+    EXPECT_EQ("int a;", contents(FS, "/sys/a.h"));
+    EXPECT_EQ("int b;", contents(FS, "/src/b.h"));
+    EXPECT_FALSE(FS.status("/sys/missing.h"));
+  }
+  EXPECT_EQ(1u, Base->Opens["/sys/a.h"]);
+  EXPECT_EQ(1u, Base->Stats["/sys/missing.h"]);
+  EXPECT_EQ(3u, Base->Opens["/src/b.h"]);
+}
+
+TEST(CachingFileSystemTest, KeepsRequestedNames) {
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> Base(new CountingFileSystem);
+  Base->addFile("/sys/a.h", "int a;");
+  CachingFileSystem FS(Base, {"/sys"});
+
+  auto Status = FS.status("/sys/a.h");
+  ASSERT_TRUE(bool(Status));
+  EXPECT_EQ("/sys/a.h", Status->getName());
+  ASSERT_FALSE(FS.setCurrentWorkingDirectory("/sys"));
+  Status = FS.status("a.h");
+  ASSERT_TRUE(bool(Status));
+  EXPECT_EQ("a.h", Status->getName());
+  auto File = FS.openFileForRead("./a.h");
+  ASSERT_TRUE(bool(File));
+  Status = (*File)->status();
+  ASSERT_TRUE(bool(Status));
+  EXPECT_EQ("./a.h", Status->getName());
+  EXPECT_EQ(1u, Base->Stats["/sys/a.h"]);
+}
+
+TEST(CachingFileSystemTest, KeepsDotDot) {
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> Base(new CountingFileSystem);
+  Base->addFile("/sys/a.h", "int a;");
+  Base->addFile("/sys/dir/b.h", "int b;");
+  Base->addFile("/src/c.h", "int c;");
+  CachingFileSystem FS(Base, {"/sys"});
+
+  // "dir" could be a symlink, so "dir/.." is cached apart from "/sys", and
+  // the base file system is asked for the path as written.
+  for (unsigned I = 0; I < 2; ++I) {
+    EXPECT_EQ("int a;", contents(FS, "/sys/dir/../a.h"));
+    EXPECT_EQ("int a;", contents(FS, "/sys/a.h"));
+  }
+  EXPECT_EQ(1u, Base->Opens["/sys/dir/../a.h"]);
+  EXPECT_EQ(1u, Base->Opens["/sys/a.h"]);
+
+  // Files that ".." leads out of the directory to aren't cached.
+  EXPECT_EQ("int c;", contents(FS, "/sys/../src/c.h"));
+  EXPECT_EQ("int c;", contents(FS, "/sys/../src/c.h"));
+  EXPECT_EQ(2u, Base->Opens["/sys/../src/c.h"]);
+}
+
+TEST(CachingFileSystemTest, MatchesWholeDirectoryNames) {
+  llvm::IntrusiveRefCntPtr<CountingFileSystem> Base(new CountingFileSystem);
+  Base->addFile("/sys2/a.h", "int a;");
+  CachingFileSystem FS(Base, {"/sys"});
+
+  EXPECT_EQ("int a;", contents(FS, "/sys2/a.h"));
+  EXPECT_EQ("int a;", contents(FS, "/sys2/a.h"));
+  EXPECT_EQ(2u, Base->Opens["/sys2/a.h"]);
+}
+
+} // namespace
@@ -0,0 +1,111 @@
+//===-- BackgroundIndexTests.cpp --------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TestFS.h"
+#include "index/Background.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+tooling::CompileCommand command(PathRef File) {
+  tooling::CompileCommand Cmd;
+  Cmd.Directory = testPath("root");
+  Cmd.Filename = testPath(File);
+  Cmd.CommandLine = {"clang++", "-xc++", Cmd.Filename};
+  return Cmd;
+}
+
+std::vector<std::string> allSymbols(const SymbolIndex &Index) {
+  std::vector<std::string> Names;
+  Index.fuzzyFind(FuzzyFindRequest(), [&](const Symbol &Sym) {
+    Names.push_back((Sym.Scope + Sym.Name).str());
+  });
+  return Names;
+}
+
+TEST(BackgroundIndexTest, IndexesTranslationUnits) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "void common(); namespace ns { int a; }";
+  FS.Files[testPath("root/B.h")] = "void common(); int b;";
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"\nvoid f() { common(); }";
+  FS.Files[testPath("root/B.cc")] = "#include \"B.h\"\nvoid f() { common(); }";
+  BackgroundIndex Idx(testRoot(), FS, /*ShardDir=*/"");
+  EXPECT_THAT(allSymbols(Idx), IsEmpty());
+
+  Idx.enqueue({command("root/A.cc"), command("root/B.cc")});
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  // Symbols declared only in main files are not indexed.
+  EXPECT_THAT(allSymbols(Idx),
+              UnorderedElementsAre("common", "ns", "ns::a", "b"));
+}
+
+TEST(BackgroundIndexTest, ReindexesDependentsOfChangedFiles) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "void old_name();";
+  FS.Files[testPath("root/B.h")] = "void b();";
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"";
+  FS.Files[testPath("root/B.cc")] = "#include \"B.h\"";
+  BackgroundIndex Idx(testRoot(), FS, /*ShardDir=*/"");
+  Idx.enqueue({command("root/A.cc"), command("root/B.cc")});
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  EXPECT_THAT(allSymbols(Idx), UnorderedElementsAre("old_name", "b"));
+
+  FS.Files[testPath("root/A.h")] = "void new_name();";
+  Idx.fileChanged(testPath("root/A.h"));
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  EXPECT_THAT(allSymbols(Idx), UnorderedElementsAre("new_name", "b"));
+}
+
+TEST(BackgroundIndexTest, LoadsShardsUnlessStale) {
+  llvm::SmallString<128> ShardDir;
+  ASSERT_FALSE(
+      llvm::sys::fs::createUniqueDirectory("clangd-index-shards", ShardDir));
+  auto Cleanup = llvm::make_scope_exit(
+      [&] { llvm::sys::fs::remove_directories(ShardDir); });
+
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "void old_name();";
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"";
+  {
+    BackgroundIndex Idx(testRoot(), FS, ShardDir);
+    Idx.enqueue({command("root/A.cc")});
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  }
+  std::error_code EC;
+  llvm::sys::fs::directory_iterator Shard(ShardDir, EC);
+  ASSERT_FALSE(EC);
+  EXPECT_NE(Shard, llvm::sys::fs::directory_iterator());
+
+  {
+    BackgroundIndex Idx(testRoot(), FS, ShardDir);
+    Idx.enqueue({command("root/A.cc")});
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+    EXPECT_THAT(allSymbols(Idx), UnorderedElementsAre("old_name"));
+  }
+
+  FS.Files[testPath("root/A.h")] = "void new_name();";
+  {
+    BackgroundIndex Idx(testRoot(), FS, ShardDir);
+    Idx.enqueue({command("root/A.cc")});
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+    EXPECT_THAT(allSymbols(Idx), UnorderedElementsAre("new_name"));
+  }
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
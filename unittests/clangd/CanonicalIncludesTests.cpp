@@ -0,0 +1,48 @@
+//===-- CanonicalIncludesTests.cpp - Header mapping unit tests --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/CanonicalIncludes.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+TEST(CanonicalIncludesTest, SystemHeaders) {
+  CanonicalIncludes CI;
+  addSystemHeadersMapping(&CI);
+  EXPECT_EQ(CI.mapHeader({"/usr/include/bits/types.h"}, "foo"),
+            "<sys/types.h>");
+  EXPECT_EQ(CI.mapHeader({"/usr/include/c++/bits/c++config.h"}, "foo"),
+            "<cstddef>");
+  EXPECT_EQ(CI.mapHeader({"/usr/include/foo.h"}, "foo"), "/usr/include/foo.h");
+  // Symbol mappings take precedence.
+  EXPECT_EQ(CI.mapHeader({"/usr/include/bits/types.h"}, "std::addressof"),
+            "<memory>");
+}
+
+TEST(CanonicalIncludesTest, FirstMappingWins) {
+  CanonicalIncludes CI;
+  CI.addRegexMapping("a.*\\.h$", "<first>");
+  CI.addRegexMapping("b/c.h$", "<second>");
+  CI.addMapping("/x/b/c.h", "<third>");
+  CI.addRegexMapping("c.h$", "<fourth>");
+  EXPECT_EQ(CI.mapHeader({"/x/a/b/c.h"}, "foo"), "<first>");
+  EXPECT_EQ(CI.mapHeader({"/x/b/c.h"}, "foo"), "<second>");
+  EXPECT_EQ(CI.mapHeader({"/y/c.h"}, "foo"), "<fourth>");
+  EXPECT_EQ(CI.mapHeader({"/y/d.h"}, "foo"), "/y/d.h");
+
+  // Mappings added later apply to headers that were already mapped.
+  CI.addMapping("/y/d.h", "<d>");
+  EXPECT_EQ(CI.mapHeader({"/y/d.h"}, "foo"), "<d>");
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
@@ -17,6 +17,7 @@
 #include "SourceCode.h"
 #include "SyncAPI.h"
 #include "TestFS.h"
+#include "TestTU.h"
 #include "index/MemIndex.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Testing/Support/Error.h"
@@ -443,6 +444,53 @@ TEST(CompletionTest, NoDuplicates) {
   EXPECT_THAT(Results.Completions, ElementsAre(Named("Adapter")));
 }
 
+TEST(CompletionTest, SkippedFunctionBodies) {
+  // Each test completes in a function body that follows other bodies, which
+  // are skipped by default.
+  const char *Tests[] = {
+      // The type of make() is deduced from its body, which is parsed.
+      R"cpp(
+          auto make() { struct Local { int member; }; return Local(); }
+          void f() { make().^ }
+      )cpp",
+      R"cpp(
+          namespace ns {
+          int helper() { int hidden = 0; return hidden; }
+          int other;
+          }
+          void f() { ns::^ }
+      )cpp",
+      R"cpp(
+          struct S {
+            int method() { int x = 0; return x; }
+            int field;
+          };
+          int g() { int earlier = 1; return earlier; }
+          void f(S s) { int local = g(); s.^ }
+      )cpp",
+      R"cpp(
+          int g() { int earlier = 1; return earlier; }
+          void f() { int local = g(); loc^ }
+      )cpp",
+  };
+  clangd::CodeCompleteOptions Skip, Parse;
+  Parse.SkipFunctionBodies = false;
+  auto Names = [](const CodeCompleteResult &Results)
+      -> std::vector<std::string> {
+    std::vector<std::string> Result;
+    for (const auto &C : Results.Completions)
+      Result.push_back(C.Scope + C.Name);
+    return Result;
+  };
+  for (const char *Test : Tests)
+    EXPECT_EQ(Names(completions(Test, {}, Parse)),
+              Names(completions(Test, {}, Skip)))
+        << Test;
+
+  EXPECT_THAT(completions(Tests[0]).Completions, Has("member"));
+  EXPECT_THAT(completions(Tests[3]).Completions, Has("local"));
+}
+
 TEST(CompletionTest, ScopedNoIndex) {
   auto Results = completions(
       R"cpp(
@@ -696,6 +744,78 @@ TEST(CompletionTest, Documentation) {
               Contains(AllOf(Named("baz"), Doc("Multi-line\nblock comment"))));
 }
 
+TEST(CompletionTest, LazyDetails) {
+  Symbol::Details Detail;
+  Detail.Documentation = "From the index.";
+  Detail.ReturnType = "int";
+  Detail.IncludeHeader = "<xyz>";
+  std::string DeclFile = URI::createFile(testPath("xyz.h")).toString();
+  Symbol Sym = func("ns::xyz");
+  Sym.CanonicalDeclaration.FileURI = DeclFile;
+  Sym.Detail = &Detail;
+  auto Index = memIndex({Sym});
+  clangd::CodeCompleteOptions Opts;
+  Opts.LazyDetails = true;
+  Opts.Index = Index.get();
+  Annotations Test(R"cpp(
+      namespace ns {
+      /// From the main file.
+      int xyzMain();
+      }
+      void f() { ns::xy^ }
+  )cpp");
+  auto Results = completions(Test.code(), {}, Opts);
+  EXPECT_THAT(Results.Completions,
+              UnorderedElementsAre(
+                  AllOf(Named("xyz"), Doc(""), ReturnType(""),
+                        Not(InsertInclude())),
+                  AllOf(Named("xyzMain"), Doc(""), ReturnType(""))));
+  for (const auto &C : Results.Completions) {
+    ASSERT_TRUE(C.Deferred) << C.Name;
+    // The label shows whether an #include will be inserted, so this is known.
+    EXPECT_EQ(C.Name == "xyz", C.Deferred->InsertInclude) << C.Name;
+  }
+
+  auto AST = TestTU::withCode(Test.code()).build();
+  ParseInputs Inputs = {tooling::CompileCommand(), buildTestFS({}),
+                        Test.code()};
+  for (auto &C : Results.Completions) {
+    resolveCompletionDetails(C, testPath("foo.cpp"), Inputs, AST,
+                             Index.get());
+    EXPECT_FALSE(C.Deferred);
+  }
+  // Documentation of main file declarations is found in the AST.
+  EXPECT_THAT(Results.Completions,
+              UnorderedElementsAre(
+                  AllOf(Named("xyz"), Doc("From the index."), ReturnType("int"),
+                        InsertInclude("<xyz>")),
+                  AllOf(Named("xyzMain"), Doc("From the main file."),
+                        ReturnType("int"))));
+}
+
+TEST(CompletionTest, LazyDetailsWithoutIndex) {
+  clangd::CodeCompleteOptions Opts;
+  Opts.LazyDetails = true;
+  Annotations Test(R"cpp(
+      struct S {
+        /// Member.
+        int xyzMember;
+      };
+      void f() { S().xyz^ }
+  )cpp");
+  auto Results = completions(Test.code(), {}, Opts);
+  EXPECT_THAT(Results.Completions,
+              ElementsAre(AllOf(Named("xyzMember"), Doc(""), ReturnType(""))));
+
+  auto AST = TestTU::withCode(Test.code()).build();
+  ParseInputs Inputs = {tooling::CompileCommand(), buildTestFS({}),
+                        Test.code()};
+  CodeCompletion C = Results.Completions.front();
+  resolveCompletionDetails(C, testPath("foo.cpp"), Inputs, AST,
+                           /*Index=*/nullptr);
+  EXPECT_THAT(C, AllOf(Doc("Member."), ReturnType("int")));
+}
+
 TEST(CompletionTest, GlobalCompletionFiltering) {
 
   Symbol Class = cls("XYZ");
@@ -875,11 +995,122 @@ TEST(SignatureHelpTest, ActiveArg) {
   EXPECT_EQ(1, Results.activeParameter);
 }
 
+SignatureInformation sigInfo(std::string Label,
+                             std::vector<std::string> Params) {
+  SignatureInformation Sig;
+  Sig.label = std::move(Label);
+  for (auto &P : Params) {
+    ParameterInformation Info;
+    Info.label = std::move(P);
+    Sig.parameters.push_back(std::move(Info));
+  }
+  return Sig;
+}
+
+TEST(SignatureHelpCacheTest, ReusedWhileTypingArguments) {
+  auto File = testPath("foo.cpp");
+  SignatureHelp Help;
+  Help.signatures = {
+      sigInfo("baz(int a, int b, int c) -> int", {"int a", "int b", "int c"}),
+      sigInfo("baz(int a, int b) -> int", {"int a", "int b"}),
+      sigInfo("baz(int a, ...) -> int", {"int a"})};
+  SignatureHelpCache Cache;
+  Annotations Before("int x = baz(^);");
+  Cache.update(File, nullptr, Before.code(), Before.point(), Help);
+
+  Annotations After("int x = baz(f(1, 2), p->y[0], ^);");
+  auto Cached = Cache.lookup(File, nullptr, After.code(), After.point());
+  ASSERT_TRUE(Cached);
+  EXPECT_THAT(Cached->signatures,
+              ElementsAre(Sig("baz(int a, int b, int c) -> int",
+                              {"int a", "int b", "int c"}),
+                          Sig("baz(int a, ...) -> int", {"int a"})));
+  EXPECT_EQ(0, Cached->activeSignature);
+  EXPECT_EQ(2, Cached->activeParameter);
+
+  // Edits outside the arguments, and arguments we can't match without a
+  // lexer.
+  Annotations Edited("int y = baz(1, ^);");
+  EXPECT_FALSE(Cache.lookup(File, nullptr, Edited.code(), Edited.point()));
+  Annotations Nested("int x = baz(f(^);");
+  EXPECT_FALSE(Cache.lookup(File, nullptr, Nested.code(), Nested.point()));
+  Annotations Literal("int x = baz(\"a,b\", ^);");
+  EXPECT_FALSE(Cache.lookup(File, nullptr, Literal.code(), Literal.point()));
+  EXPECT_FALSE(
+      Cache.lookup(testPath("bar.cpp"), nullptr, After.code(), After.point()));
+
+  // Signatures computed at a later argument may lack some candidates.
+  Annotations Second("int x = baz(1, ^);");
+  Cache.update(File, nullptr, Second.code(), Second.point(), Help);
+  EXPECT_FALSE(Cache.lookup(File, nullptr, Before.code(), Before.point()));
+
+  Cache.remove(File);
+  EXPECT_FALSE(Cache.lookup(File, nullptr, Second.code(), Second.point()));
+}
+
+TEST(SignatureHelpTest, CachedSignaturesMatchSema) {
+  MockFSProvider FS;
+  MockCompilationDatabase CDB;
+  IgnoreDiagnostics DiagConsumer;
+  auto Opts = ClangdServer::optsForTest();
+  Opts.CacheSignatureHelp = true;
+  ClangdServer Server(CDB, FS, DiagConsumer, Opts);
+  auto File = testPath("foo.cpp");
+  const char *Decls = R"cpp(
+    int baz(int a, int b, int c);
+    int baz(float x);
+  )cpp";
+  Annotations First(std::string(Decls) + "int main() { baz(^); }");
+  runAddDocument(Server, File, First.code());
+  auto Results = cantFail(runSignatureHelp(Server, File, First.point()));
+  EXPECT_THAT(Results.signatures,
+              UnorderedElementsAre(Sig("baz(int a, int b, int c) -> int",
+                                       {"int a", "int b", "int c"}),
+                                   Sig("baz(float x) -> int", {"float x"})));
+
+  Annotations Typed(std::string(Decls) + "int main() { baz(1, ^); }");
+  runAddDocument(Server, File, Typed.code());
+  Results = cantFail(runSignatureHelp(Server, File, Typed.point()));
+  EXPECT_THAT(Results.signatures,
+              ElementsAre(Sig("baz(int a, int b, int c) -> int",
+                              {"int a", "int b", "int c"})));
+  EXPECT_EQ(1, Results.activeParameter);
+}
+
+TEST(SignatureHelpTest, CachedSignaturesDroppedWithPreamble) {
+  MockFSProvider FS;
+  MockCompilationDatabase CDB;
+  IgnoreDiagnostics DiagConsumer;
+  auto Opts = ClangdServer::optsForTest();
+  Opts.CacheSignatureHelp = true;
+  ClangdServer Server(CDB, FS, DiagConsumer, Opts);
+  auto File = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  FS.Files[Header] = "int baz(int a, int b);";
+  Annotations First("#include \"foo.h\"\nint main() { baz(^); }");
+  runAddDocument(Server, File, First.code());
+  auto Results = cantFail(runSignatureHelp(Server, File, First.point()));
+  EXPECT_THAT(Results.signatures,
+              ElementsAre(Sig("baz(int a, int b) -> int", {"int a", "int b"})));
+
+  // The header change rebuilds the preamble, the signatures are recomputed.
+  FS.Files[Header] = "int baz(int a, int b, int c);";
+  Annotations Typed("#include \"foo.h\"\nint main() { baz(1, ^); }");
+  runAddDocument(Server, File, Typed.code());
+  Results = cantFail(runSignatureHelp(Server, File, Typed.point()));
+  EXPECT_THAT(Results.signatures,
+              ElementsAre(Sig("baz(int a, int b, int c) -> int",
+                              {"int a", "int b", "int c"})));
+  EXPECT_EQ(1, Results.activeParameter);
+}
+
 class IndexRequestCollector : public SymbolIndex {
 public:
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const override {
+    // Speculative requests are made on another thread.
+    std::lock_guard<std::mutex> Lock(Mu);
     Requests.push_back(Req);
     return true;
   }
@@ -887,14 +1118,19 @@ public:
   void lookup(const LookupRequest &,
               llvm::function_ref<void(const Symbol &)>) const override {}
 
-  const std::vector<FuzzyFindRequest> allRequests() const { return Requests; }
+  const std::vector<FuzzyFindRequest> allRequests() const {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return Requests;
+  }
 
 private:
+  mutable std::mutex Mu;
   mutable std::vector<FuzzyFindRequest> Requests;
 };
 
-std::vector<FuzzyFindRequest> captureIndexRequests(llvm::StringRef Code) {
-  clangd::CodeCompleteOptions Opts;
+std::vector<FuzzyFindRequest>
+captureIndexRequests(llvm::StringRef Code,
+                     clangd::CodeCompleteOptions Opts = {}) {
   IndexRequestCollector Requests;
   Opts.Index = &Requests;
   completions(Code, {}, Opts);
@@ -995,6 +1231,149 @@ TEST(CompletionTest, GlobalQualifiedQuery) {
                                           UnorderedElementsAre(""))));
 }
 
+Optional<SpeculativeIndexQuery> speculate(StringRef Text) {
+  Annotations Test(Text);
+  return speculateIndexQuery(Test.code(),
+                             cantFail(positionToOffset(Test.code(),
+                                                       Test.point())));
+}
+
+TEST(SpeculateIndexQueryTest, Unqualified) {
+  auto Query = speculate(R"cpp(
+      namespace std {}
+      using namespace std;
+      namespace ns { namespace a::b {
+        namespace {}
+        namespace c { void g() { using namespace x::y; } }
+        void f() {
+          using namespace other;
+          vec^
+  )cpp");
+  ASSERT_TRUE(Query);
+  EXPECT_EQ(Query->Filter, "vec");
+  EXPECT_THAT(Query->Scopes, UnorderedElementsAre("", "std::", "ns::",
+                                                  "ns::a::", "ns::a::b::",
+                                                  "other::"));
+
+  Query = speculate("namespace { namespace ns { ^");
+  ASSERT_TRUE(Query);
+  EXPECT_EQ(Query->Filter, "");
+  EXPECT_THAT(Query->Scopes,
+              UnorderedElementsAre("", "(anonymous namespace)::",
+                                   "(anonymous namespace)::ns::"));
+}
+
+TEST(SpeculateIndexQueryTest, Qualified) {
+  auto Query = speculate("namespace ns { void f() { ::a :: b::fo^");
+  ASSERT_TRUE(Query);
+  EXPECT_EQ(Query->Filter, "fo");
+  EXPECT_THAT(Query->Scopes, ElementsAre("a::b::"));
+
+  Query = speculate("void f() { ::^");
+  ASSERT_TRUE(Query);
+  EXPECT_THAT(Query->Scopes, ElementsAre(""));
+
+  EXPECT_FALSE(speculate("void f() { Foo<int>::^"));
+  EXPECT_FALSE(speculate("void f() { x.fo^"));
+  EXPECT_FALSE(speculate("void f() { p->^"));
+}
+
+TEST(CompletionTest, SpeculativeIndexRequest) {
+  clangd::CodeCompleteOptions Opts;
+  Opts.SpeculativeIndexRequest = true;
+  // The guessed scopes are right.
+  auto Results = completions(R"cpp(
+      namespace ns {
+      void f() { ns::xy^ }
+      }
+  )cpp",
+                             {func("ns::xyz"), func("xyzzy")}, Opts);
+  EXPECT_THAT(Results.Completions, ElementsAre(Named("xyz")));
+
+  // Sema adds a scope to the guess, so the index is queried again.
+  Results = completions(R"cpp(
+      namespace other {}
+      namespace ns { using namespace other; }
+      void f() { ns::xy^ }
+  )cpp",
+                        {func("ns::xyz"), func("other::xyzzy")}, Opts);
+  EXPECT_THAT(Results.Completions,
+              UnorderedElementsAre(Named("xyz"), Named("xyzzy")));
+}
+
+TEST(CompletionTest, SpeculativeIndexRequestQueriesOnce) {
+  clangd::CodeCompleteOptions Opts;
+  Opts.SpeculativeIndexRequest = true;
+  // The speculative results are used, the index is not queried again.
+  auto Requests = captureIndexRequests(R"cpp(
+      namespace ns {
+      void f() { ns::xy^ }
+      }
+  )cpp",
+                                       Opts);
+  EXPECT_THAT(Requests, ElementsAre(Field(&FuzzyFindRequest::Scopes,
+                                          ElementsAre("ns::"))));
+
+  // Sema disagrees with the guess, the index is queried again.
+  Requests = captureIndexRequests(R"cpp(
+      namespace other {}
+      namespace ns { using namespace other; }
+      void f() { ns::xy^ }
+  )cpp",
+                                  Opts);
+  EXPECT_THAT(Requests,
+              UnorderedElementsAre(
+                  Field(&FuzzyFindRequest::Scopes, ElementsAre("ns::")),
+                  Field(&FuzzyFindRequest::Scopes,
+                        UnorderedElementsAre("ns::", "other::"))));
+}
+
+CodeCompletion scored(StringRef Name, float ExcludingName) {
+  CodeCompletion C;
+  C.Name = Name;
+  C.Score.ExcludingName = C.Score.Total = ExcludingName;
+  return C;
+}
+
+TEST(CodeCompletionCacheTest, RefiltersWhileTypingIdentifier) {
+  auto File = testPath("foo.cpp");
+  clangd::CodeCompleteOptions Opts;
+  CodeCompleteResult Results;
+  Results.Completions = {scored("fob", 1), scored("fooBar", 0.5),
+                         scored("fooBaz", 0.8)};
+  CodeCompletionCache Cache;
+  Annotations Before("int x = fo^ + 1;");
+  Cache.update(File, Before.code(), Before.point(), Opts, Results);
+
+  Annotations After("int x = fooba^ + 1;");
+  auto Cached = Cache.lookup(File, After.code(), After.point(), Opts);
+  ASSERT_TRUE(Cached);
+  EXPECT_THAT(Cached->Completions,
+              ElementsAre(Named("fooBaz"), Named("fooBar")));
+  EXPECT_FALSE(Cached->HasMore);
+
+  // Other edits, deleting characters, or different options.
+  Annotations Edited("int y = fooba^ + 1;");
+  EXPECT_FALSE(Cache.lookup(File, Edited.code(), Edited.point(), Opts));
+  Annotations Deleted("int x = f^ + 1;");
+  EXPECT_FALSE(Cache.lookup(File, Deleted.code(), Deleted.point(), Opts));
+  clangd::CodeCompleteOptions Snippets;
+  Snippets.EnableSnippets = true;
+  EXPECT_FALSE(Cache.lookup(File, After.code(), After.point(), Snippets));
+  EXPECT_FALSE(
+      Cache.lookup(testPath("bar.cpp"), After.code(), After.point(), Opts));
+
+  // Results cut by the limit are not a superset of the new results.
+  Results.HasMore = true;
+  Cache.update(File, Before.code(), Before.point(), Opts, Results);
+  EXPECT_FALSE(Cache.lookup(File, After.code(), After.point(), Opts));
+
+  Results.HasMore = false;
+  Cache.update(File, Before.code(), Before.point(), Opts, Results);
+  Cache.remove(File);
+  EXPECT_FALSE(Cache.lookup(File, After.code(), After.point(), Opts));
+}
+
 TEST(CompletionTest, NoIndexCompletionsInsideClasses) {
   auto Completions = completions(
       R"cpp(
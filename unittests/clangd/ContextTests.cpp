@@ -53,5 +53,39 @@ TEST(ContextTests, Builders) {
   EXPECT_EQ(*ChildCtx.get(ChildParam), 40);
 }
 
+TEST(ContextTests, LongChains) {
+  Key<int> Keys[10];
+  Key<int> Shadowed;
+  Key<int> Missing;
+
+  Context Ctx = Context::empty().derive(Shadowed, 0);
+  for (int I = 0; I < 10; ++I)
+    Ctx = std::move(Ctx).derive(Keys[I], I).derive(Shadowed, I + 1);
+  Context Child = Ctx.derive(Keys[0], 100);
+
+  for (int I = 0; I < 10; ++I)
+    EXPECT_EQ(*Ctx.get(Keys[I]), I);
+  EXPECT_EQ(*Ctx.get(Shadowed), 10);
+  EXPECT_EQ(Ctx.get(Missing), nullptr);
+  EXPECT_EQ(*Child.get(Keys[0]), 100);
+  EXPECT_EQ(*Child.get(Keys[9]), 9);
+}
+
+TEST(ContextTests, ParentOutlivesValue) {
+  Key<std::string> Name;
+  struct Greeter {
+    const std::string *Name;
+    std::string *Out;
+    ~Greeter() { *Out = "bye " + *Name; }
+  };
+  std::string Out;
+  {
+    Context Parent = Context::empty().derive(Name, "parent");
+    Context Child = Parent.derive(Greeter{Parent.get(Name), &Out});
+    Parent = Context::empty();
+  }
+  EXPECT_EQ(Out, "bye parent");
+}
+
 } // namespace clangd
 } // namespace clang
@@ -94,6 +94,25 @@ TEST(FileDistance, LimitUpTraversals) {
   EXPECT_EQ(D.distance("/a/b/z"), 2u);
 }
 
+TEST(FileDistance, Cache) {
+  URIDistanceCache Cache;
+  llvm::StringMap<SourceParams> Sources = {{"/a/b", SourceParams()}};
+  auto D = Cache.get("/a/b/c.cc", Sources);
+  EXPECT_EQ(D->distance("file:///a/b/c.h"), 1u);
+  // Same sources: the URIDistance is reused.
+  EXPECT_EQ(Cache.get("/a/b/c.cc", Sources), D);
+  EXPECT_NE(Cache.get("/a/b/d.cc", Sources), D);
+
+  EXPECT_EQ(D->distance("file:///x/y"), 6u);
+  Sources["/x"] = SourceParams();
+  auto Changed = Cache.get("/a/b/c.cc", Sources);
+  EXPECT_NE(Changed, D);
+  EXPECT_EQ(Changed->distance("file:///x/y"), 1u);
+
+  Cache.remove("/a/b/c.cc");
+  EXPECT_NE(Cache.get("/a/b/c.cc", Sources), Changed);
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -64,6 +64,30 @@ TEST(FileSymbolsTest, Overlap) {
               UnorderedElementsAre("1", "2", "3", "3", "4", "5"));
 }
 
+TEST(FileSymbolsTest, MergedSymbols) {
+  FileSymbols FS;
+  SymbolSlab::Builder Decl, Def;
+  Symbol Sym = symbol("x");
+  Sym.References = 1;
+  Decl.insert(Sym);
+  Sym.Definition.FileURI = "file:///x.h";
+  Sym.References = 2;
+  Def.insert(Sym);
+  FS.update("f1", llvm::make_unique<SymbolSlab>(std::move(Decl).build()),
+            nullptr);
+  FS.update("f2", llvm::make_unique<SymbolSlab>(std::move(Def).build()),
+            nullptr);
+  FS.update("f3", numSlab(1, 2), nullptr);
+
+  auto Merged = FS.mergedSymbols();
+  EXPECT_THAT(getSymbolNames(*Merged), UnorderedElementsAre("x", "1", "2"));
+  for (const Symbol *S : *Merged)
+    if (S->Name == "x") {
+      EXPECT_EQ(S->Definition.FileURI, "file:///x.h");
+      EXPECT_EQ(S->References, 3u);
+    }
+}
+
 TEST(FileSymbolsTest, SnapshotAliveAfterRemove) {
   FileSymbols FS;
 
@@ -93,7 +117,8 @@ void update(FileIndex &M, llvm::StringRef Basename, llvm::StringRef Code) {
   File.HeaderFilename = (Basename + ".h").str();
   File.HeaderCode = Code;
   auto AST = File.build();
-  M.update(File.Filename, &AST.getASTContext(), AST.getPreprocessorPtr());
+  M.updatePreamble(File.Filename, &AST.getASTContext(),
+                   AST.getPreprocessorPtr());
 }
 
 TEST(FileIndexTest, CustomizedURIScheme) {
@@ -149,13 +174,13 @@ TEST(FileIndexTest, RemoveAST) {
   Req.Scopes = {"ns::"};
   EXPECT_THAT(match(M, Req), UnorderedElementsAre("ns::f", "ns::X"));
 
-  M.update("f1.cpp", nullptr, nullptr);
+  M.updatePreamble("f1.cpp", nullptr, nullptr);
   EXPECT_THAT(match(M, Req), UnorderedElementsAre());
 }
 
 TEST(FileIndexTest, RemoveNonExisting) {
   FileIndex M;
-  M.update("no.cpp", nullptr, nullptr);
+  M.updatePreamble("no.cpp", nullptr, nullptr);
   EXPECT_THAT(match(M, FuzzyFindRequest()), UnorderedElementsAre());
 }
 
@@ -240,6 +265,7 @@ TEST(FileIndexTest, RebuildWithPreamble) {
     #include "foo.h"
     namespace ns_in_source {
       int func_in_source();
+      static int static_in_source();
     }
   )cpp";
 
@@ -248,14 +274,14 @@ TEST(FileIndexTest, RebuildWithPreamble) {
 
   FileIndex Index;
   bool IndexUpdated = false;
-  buildPreamble(
+  auto Preamble = buildPreamble(
       FooCpp, *CI, /*OldPreamble=*/nullptr, tooling::CompileCommand(), PI,
       std::make_shared<PCHContainerOperations>(), /*StoreInMemory=*/true,
       [&Index, &IndexUpdated](PathRef FilePath, ASTContext &Ctx,
                               std::shared_ptr<Preprocessor> PP) {
         EXPECT_FALSE(IndexUpdated) << "Expected only a single index update";
         IndexUpdated = true;
-        Index.update(FilePath, &Ctx, std::move(PP));
+        Index.updatePreamble(FilePath, &Ctx, std::move(PP));
       });
   ASSERT_TRUE(IndexUpdated);
 
@@ -268,6 +294,32 @@ TEST(FileIndexTest, RebuildWithPreamble) {
   EXPECT_THAT(
       match(Index, Req),
       UnorderedElementsAre("ns_in_header", "ns_in_header::func_in_header"));
+
+  // The AST built on top of the preamble adds the symbols of the main file.
+  auto AST = buildAST(FooCpp, buildCompilerInvocation(PI), PI, Preamble,
+                      std::make_shared<PCHContainerOperations>());
+  ASSERT_TRUE(AST);
+  Index.updateMain(FooCpp, *AST);
+  Req.Scopes.push_back("ns_in_source::");
+  EXPECT_THAT(match(Index, Req),
+              UnorderedElementsAre(
+                  "ns_in_header", "ns_in_header::func_in_header",
+                  "ns_in_source", "ns_in_source::func_in_source",
+                  "ns_in_source::static_in_source"));
+
+  // Internal symbols of the main file are not completed in other files.
+  Req.RestrictForCodeCompletion = true;
+  EXPECT_THAT(match(Index, Req),
+              UnorderedElementsAre(
+                  "ns_in_header", "ns_in_header::func_in_header",
+                  "ns_in_source", "ns_in_source::func_in_source"));
+  Req.RestrictForCodeCompletion = false;
+
+  // Closing the file drops the symbols of the main file only.
+  Index.removeMain(FooCpp);
+  EXPECT_THAT(
+      match(Index, Req),
+      UnorderedElementsAre("ns_in_header", "ns_in_header::func_in_header"));
 }
 
 } // namespace
@@ -165,6 +165,10 @@ TEST_F(WorkspaceSymbolsTest, Namespaces) {
   EXPECT_THAT(getSymbols("::ans1::ans2"), ElementsAre(QName("ans1::ans2")));
   EXPECT_THAT(getSymbols("::ans1::ans2::"),
               ElementsAre(QName("ans1::ans2::ai2")));
+  // Partially qualified names match nested scopes.
+  EXPECT_THAT(getSymbols("ans2::"), ElementsAre(QName("ans1::ans2::ai2")));
+  EXPECT_THAT(getSymbols("ans2::ai"), ElementsAre(QName("ans1::ans2::ai2")));
+  EXPECT_THAT(getSymbols("::ans2::"), IsEmpty());
 }
 
 TEST_F(WorkspaceSymbolsTest, AnonymousNamespace) {
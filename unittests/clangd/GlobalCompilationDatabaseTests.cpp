@@ -10,14 +10,30 @@
 #include "GlobalCompilationDatabase.h"
 
 #include "TestFS.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace clang {
 namespace clangd {
 namespace {
+using ::testing::Contains;
 using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::Not;
+using ::testing::UnorderedElementsAre;
+
+void writeFile(llvm::StringRef Path, llvm::StringRef Contents) {
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+  ASSERT_FALSE(EC) << EC.message();
+  OS << Contents;
+}
 
 TEST(GlobalCompilationDatabaseTest, FallbackCommand) {
   DirectoryBasedGlobalCompilationDatabase DB(llvm::None);
@@ -32,6 +48,49 @@ TEST(GlobalCompilationDatabaseTest, FallbackCommand) {
                                            testPath("foo/bar.h")));
 }
 
+TEST(GlobalCompilationDatabaseTest, ReloadsChangedDatabases) {
+  llvm::SmallString<128> Root;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clangd-cdb", Root));
+  auto Cleanup =
+      llvm::make_scope_exit([&] { llvm::sys::fs::remove_directories(Root); });
+  llvm::SmallString<128> Sub = Root;
+  llvm::sys::path::append(Sub, "sub");
+  ASSERT_FALSE(llvm::sys::fs::create_directory(Sub));
+  auto InRoot = [&](llvm::StringRef Name) {
+    llvm::SmallString<128> Path = Root;
+    llvm::sys::path::append(Path, Name);
+    return Path.str().str();
+  };
+  std::string RootFlags = InRoot("compile_flags.txt");
+  std::string SubFlags = InRoot("sub/compile_flags.txt");
+  std::string Foo = InRoot("foo.cc"), Bar = InRoot("sub/bar.cc");
+
+  writeFile(RootFlags, "-DOLD");
+  DirectoryBasedGlobalCompilationDatabase DB(llvm::None);
+  CachingCompilationDb Cached(DB);
+  ASSERT_TRUE(Cached.getCompileCommand(Foo));
+  ASSERT_TRUE(Cached.getCompileCommand(Bar));
+  EXPECT_THAT(Cached.getCompileCommand(Bar)->CommandLine, Contains("-DOLD"));
+
+  // Changes are not picked up until they are reported.
+  writeFile(RootFlags, "-DNEW");
+  EXPECT_THAT(DB.getCompileCommand(Foo)->CommandLine, Contains("-DOLD"));
+  EXPECT_EQ(DB.compilationDatabaseChanged(InRoot("foo.cc")), llvm::None);
+  EXPECT_EQ(DB.compilationDatabaseChanged(RootFlags), Root.str().str());
+  EXPECT_THAT(DB.getCompileCommand(Foo)->CommandLine, Contains("-DNEW"));
+  EXPECT_THAT(Cached.reloadDirectory(Root), UnorderedElementsAre(Foo, Bar));
+  EXPECT_THAT(Cached.getCompileCommand(Bar)->CommandLine, Contains("-DNEW"));
+  EXPECT_THAT(Cached.reloadDirectory(Root), IsEmpty());
+
+  // A database created in a directory that was searched takes precedence.
+  writeFile(SubFlags, "-DSUB");
+  EXPECT_EQ(DB.compilationDatabaseChanged(SubFlags), Sub.str().str());
+  EXPECT_THAT(Cached.reloadDirectory(Sub), ElementsAre(Bar));
+  EXPECT_THAT(Cached.getCompileCommand(Bar)->CommandLine, Contains("-DSUB"));
+  EXPECT_THAT(Cached.getCompileCommand(Foo)->CommandLine,
+              Not(Contains("-DSUB")));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
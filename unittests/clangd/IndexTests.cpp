@@ -12,6 +12,7 @@
 #include "index/Merge.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <thread>
 
 using testing::UnorderedElementsAre;
 using testing::Pointee;
@@ -203,6 +204,52 @@ TEST(MemIndexTest, NoMatchNestedScopes) {
   EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1"));
 }
 
+TEST(MemIndexTest, MatchScopeSuffix) {
+  SymbolSlab::Builder Slab;
+  for (const char *QName : {"a::b::y1", "b::y2", "ab::y3", "y4", "b::c::y5"})
+    Slab.insert(symbol(QName));
+  auto I = MemIndex::build(std::move(Slab).build());
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  Req.Scopes = {"b::"};
+  Req.MatchScopeSuffix = true;
+  EXPECT_THAT(match(*I, Req), UnorderedElementsAre("a::b::y1", "b::y2"));
+}
+
+TEST(MemIndexTest, ManySymbols) {
+  // Enough symbols to be scored in parallel.
+  SymbolSlab::Builder Slab;
+  size_t NumMatches = 0;
+  for (int I = 0; I < 100000; ++I) {
+    std::string Name = std::to_string(I);
+    NumMatches += StringRef(Name).startswith("7");
+    Slab.insert(symbol(Name));
+  }
+  auto I = MemIndex::build(std::move(Slab).build());
+  FuzzyFindRequest Req;
+  Req.Query = "7";
+  bool Incomplete;
+  EXPECT_EQ(match(*I, Req, &Incomplete).size(), NumMatches);
+  EXPECT_FALSE(Incomplete);
+  Req.MaxCandidateCount = 10;
+  EXPECT_EQ(match(*I, Req, &Incomplete).size(), 10u);
+  EXPECT_TRUE(Incomplete);
+}
+
+TEST(MemIndexTest, QueriesDuringRebuild) {
+  MemIndex I;
+  I.build(generateNumSymbols(0, 10));
+  std::thread Queries([&] {
+    FuzzyFindRequest Req;
+    Req.Query = "7";
+    for (int Round = 0; Round < 100; ++Round)
+      EXPECT_THAT(match(I, Req), UnorderedElementsAre("7"));
+  });
+  for (int Round = 0; Round < 100; ++Round)
+    I.build(generateNumSymbols(0, 10));
+  Queries.join();
+}
+
 TEST(MemIndexTest, IgnoreCases) {
   MemIndex I;
   I.build(generateSymbols({"ns::ABC", "ns::abc"}));
@@ -0,0 +1,123 @@
+//===-- MappedCompilationDatabaseTests.cpp ----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MappedCompilationDatabase.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+// Writes a compile_commands.json and loads it.
+class MappedCompilationDatabaseTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("compile_commands",
+                                                    "json", FilePath));
+  }
+  void TearDown() override { llvm::sys::fs::remove(FilePath); }
+
+  std::unique_ptr<MappedCompilationDatabase> load(llvm::StringRef JSON) {
+    std::error_code EC;
+    {
+      llvm::raw_fd_ostream OS(FilePath, EC, llvm::sys::fs::F_None);
+      EXPECT_FALSE(EC) << EC.message();
+      OS << JSON;
+    }
+    std::string Error;
+    auto CDB = MappedCompilationDatabase::loadFromFile(FilePath, Error);
+    if (!CDB)
+      Error.swap(LastError);
+    return CDB;
+  }
+
+  llvm::SmallString<128> FilePath;
+  std::string LastError;
+};
+
+std::string native(llvm::StringRef Path) {
+  llvm::SmallString<128> Result = Path;
+  llvm::sys::path::native(Result);
+  return Result.str().str();
+}
+
+TEST_F(MappedCompilationDatabaseTest, ParsesEntries) {
+  auto CDB = load(R"json([
+    {
+      "directory": "/src",
+      "file": "a.cc",
+      "command": "clang++ -DNAME=\"a b\" -c a.cc",
+      "output": "a.o"
+    },
+    {
+      "arguments": ["clang++", "-DNAME=b", "-c", "b.cc"],
+      "unknown": {"nested": [1, "]}", true]},
+      "file": "sub/../b.cc",
+      "directory": "/src"
+    },
+    {"directory": "/src", "file": "\/src\/c.cc", "arguments": ["clang"]}
+  ])json");
+  ASSERT_TRUE(CDB) << LastError;
+
+  EXPECT_THAT(CDB->getAllFiles(),
+              UnorderedElementsAre(native("/src/a.cc"), native("/src/b.cc"),
+                                   native("/src/c.cc")));
+
+  auto A = CDB->getCompileCommands(native("/src/a.cc"));
+  ASSERT_EQ(A.size(), 1u);
+  EXPECT_EQ(A[0].Directory, "/src");
+  EXPECT_EQ(A[0].Filename, "a.cc");
+  EXPECT_EQ(A[0].Output, "a.o");
+  EXPECT_THAT(A[0].CommandLine,
+              ElementsAre("clang++", "-DNAME=a b", "-c", "a.cc"));
+  // The parsed entry is kept.
+  EXPECT_THAT(CDB->getCompileCommands(native("/src/a.cc"))[0].CommandLine,
+              ElementsAre("clang++", "-DNAME=a b", "-c", "a.cc"));
+
+  auto B = CDB->getCompileCommands(native("/src/b.cc"));
+  ASSERT_EQ(B.size(), 1u);
+  EXPECT_THAT(B[0].CommandLine,
+              ElementsAre("clang++", "-DNAME=b", "-c", "b.cc"));
+
+  EXPECT_THAT(CDB->getCompileCommands(native("/src/missing.cc")), IsEmpty());
+  EXPECT_EQ(CDB->getAllCompileCommands().size(), 3u);
+}
+
+TEST_F(MappedCompilationDatabaseTest, SkipsMalformedEntries) {
+  auto CDB = load(R"json([
+    {"directory": "/src", "file": "a.cc", "arguments": [1]},
+    {"directory": "/src", "file": "b.cc"},
+    {"directory": "/src", "file": "c.cc", "arguments": ["clang", "c.cc"]}
+  ])json");
+  ASSERT_TRUE(CDB) << LastError;
+  EXPECT_THAT(CDB->getCompileCommands(native("/src/a.cc")), IsEmpty());
+  EXPECT_THAT(CDB->getCompileCommands(native("/src/b.cc")), IsEmpty());
+  EXPECT_EQ(CDB->getAllCompileCommands().size(), 1u);
+}
+
+TEST_F(MappedCompilationDatabaseTest, RejectsMalformedFiles) {
+  EXPECT_TRUE(load("[]"));
+  EXPECT_FALSE(load(""));
+  EXPECT_FALSE(load("{}"));
+  EXPECT_FALSE(load(R"json([{"file": "a.cc"})json"));
+  EXPECT_FALSE(load(R"json([{"file": "a.cc"}] trailing)json"));
+  EXPECT_FALSE(load(R"json([{"file": "a.cc}])json"));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
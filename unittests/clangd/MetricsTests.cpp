@@ -0,0 +1,98 @@
+//===-- MetricsTests.cpp - Metrics unit tests -------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Metrics.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace trace {
+namespace {
+
+using ::testing::DoubleNear;
+
+TEST(HistogramTest, Empty) {
+  Histogram H;
+  EXPECT_EQ(H.count(), 0u);
+  EXPECT_EQ(H.quantile(0.5), 0);
+  EXPECT_EQ(H.mean(), 0);
+  EXPECT_EQ(H.max(), 0);
+}
+
+TEST(HistogramTest, Quantiles) {
+  Histogram H;
+  for (int I = 1; I <= 1000; ++I)
+    H.record(I);
+  EXPECT_EQ(H.count(), 1000u);
+  EXPECT_THAT(H.mean(), DoubleNear(500.5, 0.01));
+  EXPECT_EQ(H.max(), 1000);
+  // Values are accurate up to ~3%.
+  EXPECT_THAT(H.quantile(0.5), DoubleNear(500, 500 * 0.03));
+  EXPECT_THAT(H.quantile(0.99), DoubleNear(990, 990 * 0.03));
+  EXPECT_EQ(H.quantile(1), 1000);
+}
+
+TEST(HistogramTest, SmallAndLargeValues) {
+  Histogram H;
+  H.record(0.001);
+  H.record(-1);
+  H.record(1e12);
+  EXPECT_EQ(H.count(), 3u);
+  EXPECT_EQ(H.quantile(0.1), 0);
+  EXPECT_GT(H.quantile(1), 1e9);
+}
+
+TEST(MetricsTest, RecordsSpansAndMetrics) {
+  Metrics M;
+  {
+    auto Tracer = createMetricsTracer(M);
+    Session S(*Tracer);
+    {
+      Span Outer("Outer");
+      Span Inner("Inner");
+    }
+    { Span Outer("Outer"); }
+    metric("Value", 42);
+  }
+  ASSERT_NE(M.get("Outer"), nullptr);
+  EXPECT_EQ(M.get("Outer")->count(), 2u);
+  ASSERT_NE(M.get("Inner"), nullptr);
+  EXPECT_EQ(M.get("Inner")->count(), 1u);
+  ASSERT_NE(M.get("Value"), nullptr);
+  EXPECT_THAT(M.get("Value")->quantile(0.5), DoubleNear(42, 42 * 0.03));
+  EXPECT_EQ(M.get("Missing"), nullptr);
+
+  json::Expr Summary = M.summary();
+  auto *Value = Summary.asObject()->getObject("Value");
+  ASSERT_NE(Value, nullptr);
+  EXPECT_EQ(Value->getNumber("count"), 1.0);
+  EXPECT_EQ(Value->getNumber("max"), 42.0);
+}
+
+TEST(MetricsTest, ForwardsToNextTracer) {
+  Metrics M;
+  std::string JSON;
+  {
+    llvm::raw_string_ostream OS(JSON);
+    auto JSONTracer = createJSONTracer(OS);
+    auto Tracer = createMetricsTracer(M, JSONTracer.get());
+    Session S(*Tracer);
+    Span Forwarded("Forwarded");
+    log("Message");
+  }
+  EXPECT_EQ(M.get("Forwarded")->count(), 1u);
+  EXPECT_THAT(JSON, ::testing::HasSubstr(R"("name":"Forwarded")"));
+  EXPECT_THAT(JSON, ::testing::HasSubstr(R"("Message":"Message")"));
+}
+
+} // namespace
+} // namespace trace
+} // namespace clangd
+} // namespace clang
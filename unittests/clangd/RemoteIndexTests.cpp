@@ -0,0 +1,287 @@
+//===-- RemoteIndexTests.cpp - Remote index client/server tests -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/MemIndex.h"
+#include "index/Remote.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+
+using testing::IsEmpty;
+using testing::UnorderedElementsAre;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+Symbol symbol(llvm::StringRef QName) {
+  Symbol Sym;
+  Sym.ID = SymbolID(QName);
+  size_t Pos = QName.rfind("::");
+  if (Pos == llvm::StringRef::npos) {
+    Sym.Name = QName;
+    Sym.Scope = "";
+  } else {
+    Sym.Name = QName.substr(Pos + 2);
+    Sym.Scope = QName.substr(0, Pos + 2);
+  }
+  return Sym;
+}
+
+// Counts the requests that reach the underlying index.
+class CountingIndex : public SymbolIndex {
+public:
+  CountingIndex(const SymbolIndex &Base) : Base(Base) {}
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 llvm::function_ref<void(const Symbol &)> Callback)
+      const override {
+    ++Requests;
+    return Base.fuzzyFind(Req, Callback);
+  }
+
+  void lookup(const LookupRequest &Req,
+              llvm::function_ref<void(const Symbol &)> Callback)
+      const override {
+    ++Requests;
+    Base.lookup(Req, Callback);
+  }
+
+  void xrefs(const XrefRequest &Req,
+             llvm::function_ref<void(const SymbolRefLocation &)> Callback)
+      const override {
+    ++Requests;
+    Base.xrefs(Req, Callback);
+  }
+
+  mutable std::atomic<int> Requests = {0};
+
+private:
+  const SymbolIndex &Base;
+};
+
+// Blocks fuzzyFind requests for "slow" until release() is called.
+class BlockingIndex : public SymbolIndex {
+public:
+  BlockingIndex(const SymbolIndex &Base) : Base(Base) {}
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 llvm::function_ref<void(const Symbol &)> Callback)
+      const override {
+    if (Req.Query == "slow") {
+      std::unique_lock<std::mutex> Lock(Mu);
+      Blocked = true;
+      CV.notify_all();
+      CV.wait(Lock, [this] { return Released; });
+    }
+    return Base.fuzzyFind(Req, Callback);
+  }
+
+  void lookup(const LookupRequest &Req,
+              llvm::function_ref<void(const Symbol &)> Callback)
+      const override {
+    Base.lookup(Req, Callback);
+  }
+
+  void xrefs(const XrefRequest &Req,
+             llvm::function_ref<void(const SymbolRefLocation &)> Callback)
+      const override {
+    Base.xrefs(Req, Callback);
+  }
+
+  void waitUntilBlocked() {
+    std::unique_lock<std::mutex> Lock(Mu);
+    CV.wait(Lock, [this] { return Blocked; });
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Released = true;
+    CV.notify_all();
+  }
+
+private:
+  const SymbolIndex &Base;
+  mutable std::mutex Mu;
+  mutable std::condition_variable CV;
+  mutable bool Blocked = false;
+  bool Released = false;
+};
+
+std::vector<std::string> match(const SymbolIndex &I, llvm::StringRef Query,
+                               bool *More = nullptr) {
+  FuzzyFindRequest Req;
+  Req.Query = Query;
+  std::vector<std::string> Matches;
+  bool HasMore = I.fuzzyFind(Req, [&](const Symbol &Sym) {
+    Matches.push_back((Sym.Scope + Sym.Name).str());
+  });
+  if (More)
+    *More = HasMore;
+  return Matches;
+}
+
+std::vector<std::string> lookup(const SymbolIndex &I,
+                                std::vector<llvm::StringRef> QNames) {
+  LookupRequest Req;
+  for (llvm::StringRef QName : QNames)
+    Req.IDs.insert(SymbolID(QName));
+  std::vector<std::string> Results;
+  I.lookup(Req, [&](const Symbol &Sym) {
+    Results.push_back((Sym.Scope + Sym.Name).str());
+  });
+  return Results;
+}
+
+class RemoteIndexTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clangd-remote-index",
+                                                      SocketDir));
+    SymbolSlab::Builder Symbols;
+    Symbols.insert(symbol("ns::foo"));
+    Symbols.insert(symbol("ns::foobar"));
+    Symbols.insert(symbol("bar"));
+    Base = MemIndex::build(std::move(Symbols).build());
+    Counting = llvm::make_unique<CountingIndex>(*Base);
+
+    llvm::SmallString<128> Socket = SocketDir;
+    llvm::sys::path::append(Socket, "index.sock");
+    Address = ("unix:" + Socket).str();
+    auto S = IndexServer::listen(*Counting, Address);
+    ASSERT_TRUE(bool(S)) << llvm::toString(S.takeError());
+    Server = std::move(*S);
+  }
+
+  void TearDown() override {
+    Server.reset();
+    llvm::sys::fs::remove_directories(SocketDir);
+  }
+
+  std::unique_ptr<SymbolIndex> connect() {
+    auto Client = connectRemoteIndex(Address);
+    if (!Client) {
+      ADD_FAILURE() << llvm::toString(Client.takeError());
+      return nullptr;
+    }
+    return std::move(*Client);
+  }
+
+  llvm::SmallString<128> SocketDir;
+  std::string Address;
+  std::unique_ptr<SymbolIndex> Base;
+  std::unique_ptr<CountingIndex> Counting;
+  std::unique_ptr<IndexServer> Server;
+};
+
+TEST_F(RemoteIndexTest, FuzzyFind) {
+  auto Client = connect();
+  ASSERT_TRUE(Client);
+  bool More = true;
+  EXPECT_THAT(match(*Client, "foo", &More),
+              UnorderedElementsAre("ns::foo", "ns::foobar"));
+  EXPECT_FALSE(More);
+
+  FuzzyFindRequest Req;
+  Req.Query = "foo";
+  Req.MaxCandidateCount = 1;
+  std::vector<std::string> Matches;
+  EXPECT_TRUE(Client->fuzzyFind(
+      Req, [&](const Symbol &Sym) { Matches.push_back(Sym.Name.str()); }));
+  EXPECT_EQ(Matches.size(), 1u);
+}
+
+TEST_F(RemoteIndexTest, Lookup) {
+  auto Client = connect();
+  ASSERT_TRUE(Client);
+  EXPECT_THAT(lookup(*Client, {"ns::foo", "bar", "missing"}),
+              UnorderedElementsAre("ns::foo", "bar"));
+  EXPECT_THAT(lookup(*Client, {"missing"}), IsEmpty());
+}
+
+TEST_F(RemoteIndexTest, CachesResults) {
+  auto Client = connect();
+  ASSERT_TRUE(Client);
+  match(*Client, "foo");
+  match(*Client, "foo");
+  EXPECT_EQ(Counting->Requests, 1);
+  match(*Client, "bar");
+  EXPECT_EQ(Counting->Requests, 2);
+
+  // Only the IDs that are not cached are requested, in a single batch.
+  lookup(*Client, {"ns::foo", "missing"});
+  EXPECT_EQ(Counting->Requests, 3);
+  EXPECT_THAT(lookup(*Client, {"ns::foo", "missing"}),
+              UnorderedElementsAre("ns::foo"));
+  EXPECT_EQ(Counting->Requests, 3);
+  EXPECT_THAT(lookup(*Client, {"ns::foo", "ns::foobar", "bar"}),
+              UnorderedElementsAre("ns::foo", "ns::foobar", "bar"));
+  EXPECT_EQ(Counting->Requests, 4);
+}
+
+TEST_F(RemoteIndexTest, EvictsLeastRecentlyUsed) {
+  auto Client = connect();
+  ASSERT_TRUE(Client);
+  match(*Client, "foo");
+  // Many more requests than the cache holds, while "foo" stays in use.
+  for (int I = 0; I < 300; ++I) {
+    match(*Client, "q" + std::to_string(I));
+    match(*Client, "foo");
+  }
+  EXPECT_EQ(Counting->Requests, 301);
+  match(*Client, "q299");
+  EXPECT_EQ(Counting->Requests, 301);
+  match(*Client, "q0");
+  EXPECT_EQ(Counting->Requests, 302);
+}
+
+TEST_F(RemoteIndexTest, ConcurrentRequests) {
+  BlockingIndex Blocking(*Base);
+  llvm::SmallString<128> Socket = SocketDir;
+  llvm::sys::path::append(Socket, "blocking.sock");
+  auto S = IndexServer::listen(Blocking, ("unix:" + Socket).str());
+  ASSERT_TRUE(bool(S)) << llvm::toString(S.takeError());
+  auto Client = connectRemoteIndex(("unix:" + Socket).str());
+  ASSERT_TRUE(bool(Client)) << llvm::toString(Client.takeError());
+
+  std::thread Slow([&] { match(**Client, "slow"); });
+  Blocking.waitUntilBlocked();
+  // Doesn't wait for the slow request to finish.
+  EXPECT_THAT(match(**Client, "bar"), UnorderedElementsAre("bar"));
+  Blocking.release();
+  Slow.join();
+}
+
+TEST_F(RemoteIndexTest, Reconnects) {
+  auto Client = connect();
+  ASSERT_TRUE(Client);
+  EXPECT_THAT(match(*Client, "bar"), UnorderedElementsAre("bar"));
+
+  Server.reset();
+  auto S = IndexServer::listen(*Counting, Address);
+  ASSERT_TRUE(bool(S)) << llvm::toString(S.takeError());
+  Server = std::move(*S);
+  EXPECT_THAT(match(*Client, "foo"),
+              UnorderedElementsAre("ns::foo", "ns::foobar"));
+}
+
+TEST(RemoteIndexAddressTest, RejectsBadAddresses) {
+  auto Client = connectRemoteIndex("no-port");
+  ASSERT_FALSE(bool(Client));
+  llvm::consumeError(Client.takeError());
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
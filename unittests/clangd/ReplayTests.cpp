@@ -0,0 +1,75 @@
+//===-- ReplayTests.cpp - LSP session replay unit tests ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Replay.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::HasSubstr;
+
+TEST(ReplayTest, ReadRecording) {
+  std::string Recording;
+  llvm::raw_string_ostream OS(Recording);
+  OS << "X-Clangd-Time: 5\r\n";
+  writeLSPMessage(json::obj{{"id", 1}, {"method", "initialize"}}, OS);
+  // Recordings made by older versions have no times.
+  OS << "# A comment.\r\n";
+  writeLSPMessage(json::obj{{"method", "initialized"}}, OS);
+  // clangd was killed while reading this message.
+  OS << "X-Clangd-Time: 20\r\nContent-Length: 100\r\n\r\n{\"id\":";
+  OS.flush();
+
+  auto Messages = readRecording(Recording);
+  ASSERT_TRUE(bool(Messages)) << llvm::toString(Messages.takeError());
+  ASSERT_EQ(Messages->size(), 2u);
+  EXPECT_EQ((*Messages)[0].TimeMs, llvm::Optional<uint64_t>(5));
+  EXPECT_EQ((*Messages)[0].Message,
+            json::Expr(json::obj{{"id", 1}, {"method", "initialize"}}));
+  EXPECT_EQ((*Messages)[1].TimeMs, llvm::None);
+  EXPECT_EQ((*Messages)[1].Message,
+            json::Expr(json::obj{{"method", "initialized"}}));
+
+  EXPECT_FALSE(bool(readRecording("Content-Length: 2\r\n\r\n{]")));
+  EXPECT_FALSE(bool(readRecording("X-Clangd-Time: 1\r\n\r\n{}")));
+}
+
+TEST(ReplayTest, PrintReport) {
+  auto Report = [](double Seconds, double P50) -> json::Expr {
+    return json::obj{
+        {"seconds", Seconds},
+        {"requests", 100},
+        {"latency",
+         json::obj{{"textDocument/hover",
+                    json::obj{{"count", 100},
+                              {"mean", P50},
+                              {"p50", P50},
+                              {"p90", P50},
+                              {"p99", P50},
+                              {"max", P50}}}}},
+    };
+  };
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  json::Expr Baseline = Report(4, 10);
+  printReplayReport(Report(2, 15), &Baseline, OS);
+  OS.flush();
+  EXPECT_THAT(Out, HasSubstr("Replayed 100 requests in 2.00s: 50.0 requests/s "
+                             "(+100.0% from 25.0)"));
+  EXPECT_THAT(Out, HasSubstr("textDocument/hover"));
+  EXPECT_THAT(Out, HasSubstr("15.00"));
+  EXPECT_THAT(Out, HasSubstr("+50.0%"));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,217 @@
+//===-- SerializationTests.cpp - Binary index format tests -----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "index/Serialization.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::ElementsAre;
+using testing::UnorderedElementsAre;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+MATCHER_P(QName, N, "") { return (arg.Scope + arg.Name).str() == N; }
+MATCHER_P2(RefAt, ID, Line, "") {
+  return *arg.SymID.ID() == SymbolID(ID) && arg.Loc.Start.Line == Line;
+}
+
+bool parses(llvm::StringRef Data) {
+  auto In = readIndexFile(Data);
+  if (!In) {
+    llvm::consumeError(In.takeError());
+    return false;
+  }
+  return true;
+}
+
+TEST(SerializationTest, RoundTrip) {
+  Symbol::Details Detail;
+  Detail.Documentation = "Foo doc";
+  Detail.ReturnType = "int";
+  Detail.IncludeHeader = "\"foo.h\"";
+
+  Symbol Foo;
+  Foo.ID = SymbolID("ns::Foo");
+  Foo.Name = "Foo";
+  Foo.Scope = "ns::";
+  Foo.SymInfo.Kind = index::SymbolKind::Function;
+  Foo.SymInfo.Lang = index::SymbolLanguage::CXX;
+  Foo.CanonicalDeclaration.FileURI = "file:///path/foo.h";
+  Foo.CanonicalDeclaration.Start.Line = 3;
+  Foo.CanonicalDeclaration.End.Column = 300;
+  Foo.References = 12;
+  Foo.IsIndexedForCodeCompletion = true;
+  Foo.Origin = SymbolOrigin::Static;
+  Foo.Signature = "(int x)";
+  Foo.CompletionSnippetSuffix = "(${1:int x})";
+  Foo.Detail = &Detail;
+
+  Symbol Bar;
+  Bar.ID = SymbolID("Bar");
+  Bar.Name = "Bar";
+  Bar.Definition.FileURI = "file:///path/bar.cc";
+
+  SymbolSlab::Builder SymbolsBuilder;
+  SymbolsBuilder.insert(Foo);
+  SymbolsBuilder.insert(Bar);
+  SymbolSlab Symbols = std::move(SymbolsBuilder).build();
+
+  SymbolID FooID = Foo.ID;
+  SymbolRefLocation Ref;
+  Ref.SymID = &FooID;
+  Ref.Kind = XrefKind::Reference;
+  Ref.Loc.FileURI = "file:///path/bar.cc";
+  Ref.Loc.Start.Line = 42;
+  SymbolRefSlab::Builder RefsBuilder;
+  RefsBuilder.insert(Ref);
+  SymbolRefSlab Refs = std::move(RefsBuilder).build();
+
+  std::vector<IndexFileSource> Sources = {{"/path/bar.cc", digest("code")}};
+
+  IndexFileOut Out;
+  Out.Symbols = &Symbols;
+  Out.Refs = &Refs;
+  Out.Sources = Sources;
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  writeIndexFile(Out, OS);
+  OS.flush();
+
+  auto In = readIndexFile(Data);
+  ASSERT_TRUE(bool(In)) << llvm::toString(In.takeError());
+  EXPECT_THAT(In->Symbols,
+              UnorderedElementsAre(QName("ns::Foo"), QName("Bar")));
+  EXPECT_THAT(In->Refs, ElementsAre(RefAt("ns::Foo", 42u)));
+  ASSERT_EQ(In->Sources.size(), 1u);
+  EXPECT_EQ(In->Sources[0].Path, "/path/bar.cc");
+  EXPECT_EQ(In->Sources[0].Digest, digest("code"));
+
+  const Symbol &ReadFoo = *In->Symbols.find(Foo.ID);
+  EXPECT_EQ(ReadFoo.SymInfo.Kind, index::SymbolKind::Function);
+  EXPECT_EQ(ReadFoo.SymInfo.Lang, index::SymbolLanguage::CXX);
+  EXPECT_EQ(ReadFoo.CanonicalDeclaration.FileURI, "file:///path/foo.h");
+  EXPECT_EQ(ReadFoo.CanonicalDeclaration.Start.Line, 3u);
+  EXPECT_EQ(ReadFoo.CanonicalDeclaration.End.Column, 300u);
+  EXPECT_FALSE(ReadFoo.Definition);
+  EXPECT_EQ(ReadFoo.References, 12u);
+  EXPECT_TRUE(ReadFoo.IsIndexedForCodeCompletion);
+  EXPECT_EQ(ReadFoo.Origin, SymbolOrigin::Static);
+  EXPECT_EQ(ReadFoo.Signature, "(int x)");
+  EXPECT_EQ(ReadFoo.CompletionSnippetSuffix, "(${1:int x})");
+  ASSERT_TRUE(ReadFoo.Detail);
+  EXPECT_EQ(ReadFoo.Detail->Documentation, "Foo doc");
+  EXPECT_EQ(ReadFoo.Detail->ReturnType, "int");
+  EXPECT_EQ(ReadFoo.Detail->IncludeHeader, "\"foo.h\"");
+
+  const Symbol &ReadBar = *In->Symbols.find(Bar.ID);
+  EXPECT_EQ(ReadBar.Definition.FileURI, "file:///path/bar.cc");
+  EXPECT_FALSE(ReadBar.Detail);
+}
+
+TEST(SerializationTest, SymbolShards) {
+  auto Slab = [](llvm::StringRef Name) {
+    Symbol S;
+    S.ID = SymbolID(Name);
+    S.Name = Name;
+    SymbolSlab::Builder B;
+    B.insert(S);
+    return std::move(B).build();
+  };
+  SymbolSlab A = Slab("A"), B = Slab("B"), C = Slab("C");
+  const SymbolSlab *Shards[] = {&B, &C};
+  IndexFileOut Out;
+  Out.Symbols = &A;
+  Out.SymbolShards = Shards;
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  writeIndexFile(Out, OS);
+  OS.flush();
+
+  auto In = readIndexFile(Data);
+  ASSERT_TRUE(bool(In)) << llvm::toString(In.takeError());
+  EXPECT_THAT(In->Symbols,
+              UnorderedElementsAre(QName("A"), QName("B"), QName("C")));
+}
+
+TEST(SerializationTest, RejectsMalformedData) {
+  EXPECT_FALSE(parses(""));
+  EXPECT_FALSE(parses("not an index file"));
+
+  SymbolSlab::Builder B;
+  Symbol S;
+  S.ID = SymbolID("S");
+  S.Name = "S";
+  B.insert(S);
+  SymbolSlab Symbols = std::move(B).build();
+  IndexFileOut Out;
+  Out.Symbols = &Symbols;
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  writeIndexFile(Out, OS);
+  OS.flush();
+
+  EXPECT_TRUE(parses(Data));
+  EXPECT_FALSE(parses(llvm::StringRef(Data).drop_back()));
+  EXPECT_FALSE(parses(Data + "x"));
+}
+
+TEST(SerializationTest, RequestRoundTrip) {
+  FuzzyFindRequest Fuzzy;
+  Fuzzy.Query = "foo";
+  Fuzzy.Scopes = {"", "ns::"};
+  Fuzzy.MatchScopeSuffix = true;
+  Fuzzy.MaxCandidateCount = 10;
+  Fuzzy.RestrictForCodeCompletion = true;
+  Fuzzy.ProximityPaths = {"/path/foo.cc"};
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  writeRequest(Fuzzy, OS);
+  EXPECT_EQ(requestKind(OS.str()), IndexRequestKind::FuzzyFind);
+  auto ReadFuzzy = readFuzzyFindRequest(OS.str());
+  ASSERT_TRUE(bool(ReadFuzzy)) << llvm::toString(ReadFuzzy.takeError());
+  EXPECT_EQ(ReadFuzzy->Query, "foo");
+  EXPECT_THAT(ReadFuzzy->Scopes, ElementsAre("", "ns::"));
+  EXPECT_TRUE(ReadFuzzy->MatchScopeSuffix);
+  EXPECT_EQ(ReadFuzzy->MaxCandidateCount, 10u);
+  EXPECT_TRUE(ReadFuzzy->RestrictForCodeCompletion);
+  EXPECT_THAT(ReadFuzzy->ProximityPaths, ElementsAre("/path/foo.cc"));
+
+  // The default candidate count is unlimited, and must stay so.
+  Data.clear();
+  writeRequest(FuzzyFindRequest(), OS);
+  auto ReadDefault = readFuzzyFindRequest(OS.str());
+  ASSERT_TRUE(bool(ReadDefault)) << llvm::toString(ReadDefault.takeError());
+  EXPECT_EQ(ReadDefault->MaxCandidateCount,
+            FuzzyFindRequest().MaxCandidateCount);
+
+  XrefRequest Xrefs;
+  Xrefs.IDs = {SymbolID("a"), SymbolID("b")};
+  Xrefs.Options = 3;
+  Data.clear();
+  writeRequest(Xrefs, OS);
+  EXPECT_EQ(requestKind(OS.str()), IndexRequestKind::Xrefs);
+  auto ReadXrefs = readXrefRequest(OS.str());
+  ASSERT_TRUE(bool(ReadXrefs)) << llvm::toString(ReadXrefs.takeError());
+  EXPECT_EQ(ReadXrefs->IDs, Xrefs.IDs);
+  EXPECT_EQ(ReadXrefs->Options, 3);
+
+  // Requests are only read as their own kind, and must be complete.
+  auto WrongKind = readLookupRequest(OS.str());
+  EXPECT_FALSE(bool(WrongKind));
+  llvm::consumeError(WrongKind.takeError());
+  auto Truncated = readXrefRequest(llvm::StringRef(OS.str()).drop_back());
+  EXPECT_FALSE(bool(Truncated));
+  llvm::consumeError(Truncated.takeError());
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
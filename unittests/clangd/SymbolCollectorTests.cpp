@@ -579,6 +579,26 @@ TEST_F(SymbolCollectorTest, IgnoreSymbolsInMainFile) {
               UnorderedElementsAre(QName("Foo"), QName("f1"), QName("f2")));
 }
 
+TEST_F(SymbolCollectorTest, CollectMainFileSymbols) {
+  const std::string Header = R"(
+    class Foo {};
+  )";
+  const std::string Main = R"(
+    namespace {
+    void ff() {} // ignore
+    }
+    void main_f() {}
+    static void static_f() {}
+  )";
+  CollectorOpts.CollectMainFileSymbols = true;
+  runSymbolCollector(Header, Main);
+  // Other files can't use static_f, so it is not completed there.
+  EXPECT_THAT(Symbols, UnorderedElementsAre(
+                           AllOf(QName("Foo"), ForCodeCompletion(true)),
+                           AllOf(QName("main_f"), ForCodeCompletion(true)),
+                           AllOf(QName("static_f"), ForCodeCompletion(false))));
+}
+
 TEST_F(SymbolCollectorTest, ClassMembers) {
   const std::string Header = R"(
     class Foo {
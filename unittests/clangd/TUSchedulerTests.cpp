@@ -127,6 +127,32 @@ TEST_F(TUSchedulerTests, WantDiagnostics) {
   EXPECT_EQ(2, CallbackCount);
 }
 
+TEST_F(TUSchedulerTests, NoASTCallbackAfterRemove) {
+  std::atomic<int> ASTCallbackCount(0);
+  {
+    Notification Updating, Removed;
+    TUScheduler S(
+        getDefaultAsyncThreadsCount(),
+        /*StorePreamblesInMemory=*/true,
+        /*PreambleParsedCallback=*/nullptr,
+        /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+        ASTRetentionPolicy(),
+        [&](PathRef, ParsedAST &) { ++ASTCallbackCount; });
+    auto Path = testPath("foo.cpp");
+    // The AST callback runs after the diagnostics are reported. Remove the file
+    // in between.
+    S.update(Path, getInputs(Path, ""), WantDiagnostics::Yes,
+             [&](std::vector<Diag>) {
+               Updating.notify();
+               Removed.wait();
+             });
+    Updating.wait();
+    S.remove(Path);
+    Removed.notify();
+  }
+  EXPECT_EQ(0, ASTCallbackCount);
+}
+
 TEST_F(TUSchedulerTests, Debounce) {
   std::atomic<int> CallbackCount(0);
   {
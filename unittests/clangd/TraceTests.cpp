@@ -16,6 +16,7 @@
 #include "llvm/Support/YAMLParser.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <thread>
 
 namespace clang {
 namespace clangd {
@@ -122,6 +123,76 @@ TEST(TraceTest, SmokeTest) {
   ASSERT_EQ(++Prop, Root->end());
 }
 
+// Returns the names of the events with the given phase in a converted trace.
+std::vector<std::string> eventNames(StringRef BinaryTrace, StringRef Phase) {
+  std::string JSON;
+  raw_string_ostream OS(JSON);
+  if (auto Err = trace::convertBinaryTrace(BinaryTrace, OS)) {
+    ADD_FAILURE() << toString(std::move(Err));
+    return {};
+  }
+  OS.flush();
+  auto Parsed = json::parse(JSON);
+  if (!Parsed) {
+    ADD_FAILURE() << toString(Parsed.takeError());
+    return {};
+  }
+  std::vector<std::string> Names;
+  for (const auto &Event : *Parsed->asObject()->getArray("traceEvents")) {
+    auto *Obj = Event.asObject();
+    if (Obj->getString("ph") == Phase)
+      Names.push_back(Obj->getString("name")->str());
+  }
+  return Names;
+}
+
+TEST(TraceTest, BinaryTracer) {
+  std::string Trace;
+  {
+    raw_string_ostream OS(Trace);
+    auto Tracer = trace::createBinaryTracer(OS);
+    trace::Session Session(*Tracer);
+    {
+      trace::Span Outer("A");
+      {
+        trace::Span Inner("B");
+        SPAN_ATTACH(Inner, "Key", "Value");
+      }
+      trace::log("C");
+    }
+    std::thread([] { trace::Span OtherThread("D"); }).join();
+  }
+  EXPECT_THAT(eventNames(Trace, "X"),
+              ::testing::UnorderedElementsAre("A", "B", "D"));
+  EXPECT_THAT(eventNames(Trace, "i"), ::testing::ElementsAre("Log"));
+}
+
+TEST(TraceTest, BinaryTracerSampling) {
+  std::string Trace;
+  {
+    raw_string_ostream OS(Trace);
+    auto Tracer = trace::createBinaryTracer(OS, /*SampleRate=*/0.5);
+    trace::Session Session(*Tracer);
+    for (int I = 0; I < 4; ++I) {
+      trace::Span Outer("Outer");
+      trace::Span Inner("Inner");
+      trace::log("Message");
+    }
+  }
+  // Nested events are recorded iff their outermost span is.
+  EXPECT_THAT(eventNames(Trace, "X"),
+              ::testing::ElementsAre("Inner", "Outer", "Inner", "Outer"));
+  EXPECT_THAT(eventNames(Trace, "i"), ::testing::ElementsAre("Log", "Log"));
+}
+
+TEST(TraceTest, ConvertMalformedBinaryTrace) {
+  std::string JSON;
+  raw_string_ostream OS(JSON);
+  EXPECT_TRUE(errorToBool(trace::convertBinaryTrace("not a trace", OS)));
+  EXPECT_TRUE(errorToBool(
+      trace::convertBinaryTrace(StringRef("CLDTRACE\x01\0\0\0X", 13), OS)));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
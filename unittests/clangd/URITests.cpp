@@ -9,6 +9,7 @@
 
 #include "TestFS.h"
 #include "URI.h"
+#include "URITable.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -171,6 +172,43 @@ TEST(URITest, ResolveFailed) {
   EXPECT_TRUE(FailedResolve("file:a/b/c"));
 }
 
+TEST(URITableTest, ParseAndResolve) {
+  URITable Table(testPath("x"));
+  unsigned X = Table.intern("x:a%21b");
+  EXPECT_EQ(X, Table.intern("x:a%21b"));
+  EXPECT_EQ(Table.uri(X), "x:a%21b");
+  auto U = Table.parse(X);
+  ASSERT_TRUE(bool(U));
+  EXPECT_THAT(*U, AllOf(Scheme("x"), Body("a!b")));
+  auto NoScheme = Table.parse(Table.intern("no-scheme"));
+  EXPECT_FALSE(bool(NoScheme));
+  llvm::consumeError(NoScheme.takeError());
+
+  std::string Path = testPath("x");
+  unsigned File = Table.intern(createOrDie(Path));
+  auto Resolved = Table.resolve(File);
+  ASSERT_TRUE(bool(Resolved));
+  EXPECT_EQ(*Resolved, Path);
+  auto LSPURI = Table.uriForFile(File);
+  ASSERT_TRUE(bool(LSPURI));
+  EXPECT_EQ(LSPURI->file(), Path);
+  // Both refer to the memoized path.
+  EXPECT_EQ(Resolved->data(), LSPURI->file().data());
+  // The hint path is used.
+  Resolved = Table.resolve(Table.intern("unittest:///a"));
+  ASSERT_TRUE(bool(Resolved));
+  EXPECT_EQ(*Resolved, testPath("a"));
+
+  unsigned Relative = Table.intern("file:a/b/c");
+  auto Failed = Table.resolve(Relative);
+  EXPECT_FALSE(bool(Failed));
+  llvm::consumeError(Failed.takeError());
+  // Failures are memoized, too.
+  Failed = Table.resolve(Relative);
+  EXPECT_FALSE(bool(Failed));
+  llvm::consumeError(Failed.takeError());
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
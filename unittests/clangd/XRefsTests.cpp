@@ -983,6 +983,32 @@ TEST(GoToInclude, All) {
   EXPECT_THAT(*Locations, IsEmpty());
 }
 
+TEST(ReferencesTest, BatchesAndLimit) {
+  Annotations Main(R"cpp(
+    int x;
+    void f() { x++; x = ^x + x; }
+  )cpp");
+  auto AST = TestTU::withCode(Main.code()).build();
+  auto All = references(AST, Main.point(), /*includeDeclaration=*/true);
+  ASSERT_GE(All.size(), 3u);
+
+  ReferencesOptions Opts;
+  Opts.IncludeDeclaration = true;
+  Opts.BatchSize = 2;
+  std::vector<Location> Paged;
+  auto Collect = [&](std::vector<Location> Batch) {
+    EXPECT_LE(Batch.size(), 2u);
+    Paged.insert(Paged.end(), Batch.begin(), Batch.end());
+  };
+  Opts.Limit = All.size() - 1;
+  EXPECT_TRUE(references(AST, Main.point(), Opts, nullptr, Collect));
+  EXPECT_EQ(Paged.size(), Opts.Limit);
+  // Continue after the first page.
+  Opts.Offset = Opts.Limit;
+  EXPECT_FALSE(references(AST, Main.point(), Opts, nullptr, Collect));
+  EXPECT_EQ(Paged, All);
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
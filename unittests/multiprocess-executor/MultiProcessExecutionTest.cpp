@@ -0,0 +1,164 @@
+//===---- MultiProcessExecutionTest.cpp - multi-process executor test -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MultiProcessExecution.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <unistd.h>
+
+using namespace clang;
+using namespace clang::tooling;
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+using ::testing::UnorderedElementsAreArray;
+
+namespace {
+
+std::vector<std::pair<std::string, std::string>> allResults(ToolResults &R) {
+  std::vector<std::pair<std::string, std::string>> Results;
+  R.forEachResult([&](StringRef Key, StringRef Value) {
+    Results.emplace_back(Key.str(), Value.str());
+  });
+  return Results;
+}
+
+class SpilledToolResultsTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("results", Dir));
+  }
+  void TearDown() override { llvm::sys::fs::remove_directories(Dir); }
+
+  llvm::SmallString<128> Dir;
+};
+
+TEST_F(SpilledToolResultsTest, RoundTrip) {
+  SpilledToolResults Results(Dir, /*NumShards=*/3);
+  Results.addResult("a", "1");
+  Results.addResult("b", "");
+  Results.addResult("", "3");
+  EXPECT_THAT(allResults(Results),
+              UnorderedElementsAre(Pair("a", "1"), Pair("b", ""),
+                                   Pair("", "3")));
+  // Results can still be added after they were read.
+  Results.addResult("a", "4");
+  EXPECT_THAT(Results.AllKVResults(),
+              UnorderedElementsAre(Pair("a", "1"), Pair("b", ""),
+                                   Pair("", "3"), Pair("a", "4")));
+}
+
+TEST_F(SpilledToolResultsTest, ValuesOfAKeyAreInOneShard) {
+  SpilledToolResults Results(Dir, /*NumShards=*/4);
+  unsigned Writer = Results.addWriters(2);
+  Results.addResult("key", "0");
+  Results.setWriter(Writer);
+  Results.addResult("key", "1");
+  Results.addResult("other", "x");
+  Results.setWriter(Writer + 1);
+  Results.addResult("key", "2");
+  // The values of a key are read in the order of their writers.
+  std::vector<std::string> Values;
+  bool SeenOther = false;
+  Results.forEachResult([&](StringRef Key, StringRef Value) {
+    if (Key == "key")
+      Values.push_back(Value.str());
+    else
+      SeenOther = true;
+  });
+  EXPECT_THAT(Values, ElementsAre("0", "1", "2"));
+  EXPECT_TRUE(SeenOther);
+}
+
+// A compilation database with a fixed command for each file.
+class FileListCompilationDatabase : public CompilationDatabase {
+public:
+  FileListCompilationDatabase(std::vector<std::string> Files)
+      : Files(std::move(Files)) {}
+
+  std::vector<CompileCommand>
+  getCompileCommands(StringRef FilePath) const override {
+    return {CompileCommand(llvm::sys::path::parent_path(FilePath), FilePath,
+                           {"clang", "-fsyntax-only", FilePath.str()}, "")};
+  }
+  std::vector<std::string> getAllFiles() const override { return Files; }
+
+private:
+  std::vector<std::string> Files;
+};
+
+// Reports the main file of each translation unit and the worker it was
+// processed in.
+class ReportFileAction : public SyntaxOnlyAction {
+public:
+  ReportFileAction(ExecutionContext &Context) : Context(Context) {}
+
+  void EndSourceFileAction() override {
+    Context.reportResult(getCurrentFile(), std::to_string(getpid()));
+  }
+
+private:
+  ExecutionContext &Context;
+};
+
+class ReportFileActionFactory : public FrontendActionFactory {
+public:
+  ReportFileActionFactory(ExecutionContext &Context) : Context(Context) {}
+  FrontendAction *create() override { return new ReportFileAction(Context); }
+
+private:
+  ExecutionContext &Context;
+};
+
+TEST(MultiProcessToolExecutorTest, RunsActionOnAllFiles) {
+  llvm::SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("sources", Dir));
+  std::vector<std::string> Files;
+  for (unsigned I = 0; I < 8; ++I) {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, "file" + llvm::Twine(I) + ".cpp");
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "int f" << I << "();\n";
+    Files.push_back(Path.str());
+  }
+
+  FileListCompilationDatabase Compilations(Files);
+  MultiProcessToolExecutor Executor(Compilations, /*NumProcesses=*/3,
+                                    /*SpillDir=*/"");
+  auto Err = Executor.execute(llvm::make_unique<ReportFileActionFactory>(
+      *Executor.getExecutionContext()));
+  ASSERT_FALSE(bool(Err)) << llvm::toString(std::move(Err));
+
+  std::vector<std::string> Reported;
+  for (const auto &Result : allResults(*Executor.getToolResults())) {
+    Reported.push_back(Result.first);
+    // Actions don't run in the process of the tool.
+    EXPECT_NE(std::to_string(getpid()), Result.second);
+  }
+  EXPECT_THAT(Reported, UnorderedElementsAreArray(Files));
+  llvm::sys::fs::remove_directories(Dir);
+}
+
+TEST(MultiProcessToolExecutorTest, ReportsFailures) {
+  FileListCompilationDatabase Compilations({"/no/such/file.cpp"});
+  MultiProcessToolExecutor Executor(Compilations, /*NumProcesses=*/2,
+                                    /*SpillDir=*/"");
+  auto Err = Executor.execute(llvm::make_unique<ReportFileActionFactory>(
+      *Executor.getExecutionContext()));
+  EXPECT_TRUE(bool(Err));
+  llvm::consumeError(std::move(Err));
+}
+
+} // namespace